@@ -33,6 +33,10 @@ typedef struct IWDLSNR {
 
   /**
    * @brief Copy @a len bytes from @a off offset to @a noff offset
+   *
+   * Copy within memory mapped file area is reported by `onwrite()` event
+   * with copied data, so listener is able to replay it regardless of
+   * the current contents of source area.
    */
   iwrc(*oncopy)(struct IWDLSNR *self, off_t off, off_t len, off_t noff, int flags);
 
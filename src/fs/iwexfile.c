@@ -28,6 +28,7 @@
 #include "iwutils.h"
 #include "iwlog.h"
 #include "iwexfile.h"
+#include "iwdrwl.h"
 
 #include <pthread.h>
 #include <sys/mman.h>
@@ -37,7 +38,7 @@ typedef struct IWFS_EXT_IMPL {
   IWFS_FILE file;            /**< Underlying file */
   off_t fsize;               /**< Current file size */
   off_t psize;               /**< System page size */
-  pthread_rwlock_t *rwlock;  /**< Thread RW lock */
+  IWDRWL *rwlock;            /**< Thread RW lock */
   IW_EXT_RSPOLICY rspolicy;  /**< File resize policy function ptr */
   void *rspolicy_ctx;        /**< Custom opaque data for policy functions */
   struct MMAPSLOT *mmslots;  /**< Memory mapping slots */
@@ -75,7 +76,7 @@ IW_INLINE iwrc _exfile_wlock(IWFS_EXT *f) {
   if (!f->impl) return IW_ERROR_INVALID_STATE;
   if (!f->impl->use_locks) return 0;
   if (f->impl->rwlock) {
-    int rv = pthread_rwlock_wrlock(f->impl->rwlock);
+    int rv = iwdrwl_wrlock(f->impl->rwlock);
     return rv ? iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rv) : 0;
   }
   return IW_ERROR_INVALID_STATE;
@@ -86,7 +87,7 @@ IW_INLINE iwrc _exfile_rlock(IWFS_EXT *f) {
   if (!f->impl) return IW_ERROR_INVALID_STATE;
   if (!f->impl->use_locks) return 0;
   if (f->impl->rwlock) {
-    int rv = pthread_rwlock_rdlock(f->impl->rwlock);
+    int rv = iwdrwl_rdlock(f->impl->rwlock);
     return rv ? iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rv) : 0;
   }
   return IW_ERROR_INVALID_STATE;
@@ -97,7 +98,7 @@ IW_INLINE iwrc _exfile_unlock(IWFS_EXT *f) {
   if (!f->impl) return IW_ERROR_INVALID_STATE;
   if (!f->impl->use_locks) return 0;
   if (f->impl->rwlock) {
-    int rv = pthread_rwlock_unlock(f->impl->rwlock);
+    int rv = iwdrwl_unlock(f->impl->rwlock);
     return rv ? iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rv) : 0;
   }
   return IW_ERROR_INVALID_STATE;
@@ -107,7 +108,7 @@ IW_INLINE iwrc _exfile_unlock2(EXF *impl) {
   if (!impl) return IW_ERROR_INVALID_STATE;
   if (!impl->use_locks) return 0;
   if (impl->rwlock) {
-    int rv = pthread_rwlock_unlock(impl->rwlock);
+    int rv = iwdrwl_unlock(impl->rwlock);
     return rv ? iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rv) : 0;
   }
   return IW_ERROR_INVALID_STATE;
@@ -116,7 +117,7 @@ IW_INLINE iwrc _exfile_unlock2(EXF *impl) {
 static iwrc _exfile_destroylocks(EXF *impl) {
   if (!impl) return IW_ERROR_INVALID_STATE;
   if (!impl->rwlock) return 0;
-  int rv = pthread_rwlock_destroy(impl->rwlock);
+  int rv = iwdrwl_destroy(impl->rwlock);
   free(impl->rwlock);
   impl->rwlock = 0;
   return rv ? iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rv) : 0;
@@ -398,7 +399,7 @@ static iwrc _exfile_copy(struct IWFS_EXT *f, off_t off, size_t siz, off_t noff)
     RCRET(rc);
     memmove(s->mmap + noff, s->mmap + off, siz);
     if (impl->dlsnr) {
-      rc = impl->dlsnr->oncopy(impl->dlsnr, off, siz, noff, 0);
+      rc = impl->dlsnr->onwrite(impl->dlsnr, noff, s->mmap + noff, siz, 0);
       RCRET(rc);
     }
   } else {
@@ -766,7 +767,7 @@ static iwrc _exfile_initlocks(IWFS_EXT *f) {
   if (!impl->rwlock) {
     return iwrc_set_errno(IW_ERROR_ALLOC, errno);
   }
-  int rv = pthread_rwlock_init(impl->rwlock, (void *) 0);
+  int rv = iwdrwl_init(impl->rwlock);
   if (rv) {
     free(impl->rwlock);
     impl->rwlock = 0;
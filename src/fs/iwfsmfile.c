@@ -828,7 +828,7 @@ static iwrc _fsm_init_lw(FSM *impl, uint64_t bmoff, uint64_t bmlen) {
     assert(!((impl->bmlen - bmlen) & ((1 << impl->bpow) - 1)));
     memcpy(mm, mm2, impl->bmlen);
     if (impl->dlsnr) {
-      rc = impl->dlsnr->oncopy(impl->dlsnr, impl->bmoff, impl->bmlen, bmoff, 0);
+      rc = impl->dlsnr->onwrite(impl->dlsnr, bmoff, mm, impl->bmlen, 0);
       RCRET(rc);
     }
     if (bmlen > impl->bmlen) {
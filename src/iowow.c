@@ -37,6 +37,7 @@ static_assert(sizeof(off_t) == 8, "sizeof(off_t) == 8 bytes");
 
 iwrc iwfs_init(void);
 iwrc iwp_init(void);
+iwrc iwu_init(void);
 iwrc iwkv_init(void);
 
 iwrc iw_init(void) {
@@ -51,6 +52,9 @@ iwrc iw_init(void) {
   rc = iwp_init();
   RCGO(rc, finish);
 
+  rc = iwu_init();
+  RCGO(rc, finish);
+
   uint64_t ts;
   rc = iwp_current_time_ms(&ts);
   RCRET(rc);
@@ -8,8 +8,8 @@ void iwkvd_trigger_xor(uint64_t val) {
 void iwkvd_kvblk(FILE *f, KVBLK *kb, int maxvlen) {
   assert(f && kb && kb->addr);
   uint8_t *mm, *vbuf;
-  const uint8_t *kbuf;
-  uint32_t klen, vlen;
+  KVKEY k;
+  uint32_t vlen;
   IWFS_FSM *fsm = &kb->db->iwkv->fsm;
   blkn_t blkn = ADDR2BLK(kb->addr);
   fprintf(f, "\n === KVBLK[%u] maxoff=%" PRIx64 ", zidx=%d, idxsz=%d, szpow=%u, flg=%x, db=%d\n",
@@ -20,17 +20,17 @@ void iwkvd_kvblk(FILE *f, KVBLK *kb, int maxvlen) {
     iwlog_ecode_error3(rc);
     return;
   }
-  for (int i = 0; i < KVBLK_IDXNUM; ++i) {
+  for (int i = 0; i < kb->db->idxnum; ++i) {
     KVP *kvp = &kb->pidx[i];
-    rc = _kvblk_peek_key(kb, i, mm, &kbuf, &klen);
+    rc = _kvblk_peek_key(kb, i, mm, &k);
     if (rc) {
       iwlog_ecode_error3(rc);
       return;
     }
     _kvblk_peek_val(kb, i, mm, &vbuf, &vlen);
-    fprintf(f, "\n    %02d: [%04" PRIx64 ", %02u, %02d]: %.*s:%.*s",
+    fprintf(f, "\n    %02d: [%04" PRIx64 ", %02u, %02d]: %.*s%.*s:%.*s",
             i, kvp->off, kvp->len, kvp->ridx,
-            klen, kbuf, MIN(vlen, maxvlen), vbuf);
+            k.pfxlen, k.pfx, k.sfxlen, k.sfx, MIN(vlen, maxvlen), vbuf);
   }
   fprintf(f, "\n");
 }
@@ -42,8 +42,9 @@ iwrc iwkvd_sblk(FILE *f, IWLCTX *lx, SBLK *sb, int flags) {
   int lkl = 0;
   char lkbuf[SBLK_LKLEN + 1] = {0};
   uint8_t *mm, *vbuf;
+  KVKEY key;
   const uint8_t *kbuf;
-  uint32_t klen, vlen;
+  uint32_t vlen;
   IWFS_FSM *fsm = &sb->db->iwkv->fsm;
   blkn_t blkn = ADDR2BLK(sb->addr);
   iwrc rc = fsm->probe_mmap(fsm, 0, &mm, 0);
@@ -93,11 +94,12 @@ iwrc iwkvd_sblk(FILE *f, IWLCTX *lx, SBLK *sb, int flags) {
     if (j == 0) {
       fprintf(f, " === SBLK[%u]", blkn);
     }
-    rc = _kvblk_peek_key(sb->kvblk, sb->pi[i], mm, &kbuf, &klen);
+    rc = _kvblk_peek_key(sb->kvblk, sb->pi[i], mm, &key);
     if (rc) {
       iwlog_ecode_error3(rc);
       return rc;
     }
+    kbuf = key.sfx;
     if (flags & IWKVD_PRINT_VALS) {
       _kvblk_peek_val(sb->kvblk, sb->pi[i], mm, &vbuf, &vlen);
       if (sb->db->dbflg & IWDB_UINT64_KEYS) {
@@ -111,7 +113,8 @@ iwrc iwkvd_sblk(FILE *f, IWLCTX *lx, SBLK *sb, int flags) {
         k = IW_ITOHL(k);
         fprintf(f, "    [%03d,%03d] %u:%.*s", i, sb->pi[i], k, MIN(vlen, IWKVD_MAX_VALSZ), vbuf);
       } else {
-        fprintf(f, "    [%03d,%03d] %.*s:%.*s", i, sb->pi[i], klen, kbuf, MIN(vlen, IWKVD_MAX_VALSZ), vbuf);
+        fprintf(f, "    [%03d,%03d] %.*s%.*s:%.*s", i, sb->pi[i], key.pfxlen, key.pfx, key.sfxlen, kbuf,
+                MIN(vlen, IWKVD_MAX_VALSZ), vbuf);
       }
     } else {
       if (sb->db->dbflg & IWDB_UINT64_KEYS) {
@@ -125,7 +128,7 @@ iwrc iwkvd_sblk(FILE *f, IWLCTX *lx, SBLK *sb, int flags) {
         k = IW_ITOHL(k);
         fprintf(f, "    [%03d,%03d] %u", i, sb->pi[i], k);
       } else {
-        fprintf(f, "    [%03d,%03d] %.*s", i, sb->pi[i], klen, kbuf);
+        fprintf(f, "    [%03d,%03d] %.*s%.*s", i, sb->pi[i], key.pfxlen, key.pfx, key.sfxlen, kbuf);
       }
     }
   }
@@ -13,6 +13,7 @@ typedef enum {
   WOP_WRITE,
   WOP_RESIZE,
   WOP_FIXPOINT,
+  WOP_APPLIED,
   WOP_SEP = 127, /**< WAL file separator */
 } wop_t;
 
@@ -54,6 +55,19 @@ typedef struct WBFIXPOINT {
   uint64_t ts;
 } WBFIXPOINT;
 
+/** Database file contains all changes of WAL records before `pos` */
+typedef struct WBAPPLIED {
+  uint8_t id;
+  off_t pos;
+} WBAPPLIED;
+
+/** Snapshot opened over database file by `iwkv_snapshot_open()` */
+typedef struct WALSNAP {
+  IWKV snap;                        /**< Snapshot handle */
+  uint8_t *mm;                      /**< Snapshot private mapping of database file */
+  off_t len;                        /**< Length of mapping */
+} WALSNAP;
+
 typedef struct IWAL {
   IWDLSNR lsnr;
   atomic_bool applying;             /**< WAL log applying */
@@ -61,6 +75,7 @@ typedef struct IWAL {
   iwkv_openflags oflags;            /**< File open flags */
   size_t wal_buffer_sz;             /**< WAL file intermediate buffer size */
   size_t checkpoint_buffer_sz;      /**< Checkpoint buffer size in bytes. */
+  size_t checkpoint_slice_sz;       /**< Max size of WAL data applied in one step of incremental checkpoint */
   uint64_t checkpoint_timeout_ms;   /**< Checkpoint timeout millesconds */
   char *path;                       /**< WAL file path */
   uint8_t *buf;                     /**< File buffer */
@@ -69,14 +84,31 @@ typedef struct IWAL {
   uint32_t bufpos;                  /**< Current position in buffer */
   atomic_uint_fast64_t mbytes;      /**< Estimated size of modifed private mmaped memory bytes */
   uint64_t checkpoint_ts;           /**< Last checkpoint timestamp */
+  uint64_t wlsn;                    /**< Log sequence number: total number of bytes written into WAL file */
+  uint64_t slsn;                    /**< Log sequence number known to be durable */
+  bool syncing;                     /**< WAL file fsync is in progress by group commit leader */
+  off_t cppos;                      /**< WAL file offset up to which data is already applied to database file */
+  off_t fpend;                      /**< WAL file offset just after the last fixpoint record */
+  uint64_t cpgen;                   /**< Checkpoint generation, incremented on every WAL truncation */
   HANDLE fh;                        /**< File handle */
   pthread_mutex_t *mtx;             /**< Global thread mutex */
+  pthread_cond_t *cpt_cond;         /**< Checkpoint worker wakeup condition */
+  pthread_cond_t *sync_cond;        /**< Group commit followers wait condition */
+  pthread_t cpt;                    /**< Checkpoint worker thread */
+  bool cpt_started;                 /**< Checkpoint worker thread is running */
+  volatile bool cpt_shutdown;       /**< Checkpoint worker shutdown requested */
+  bool txn;                         /**< Transaction changes are being written, see `iwal_txn_begin()` */
+  bool txn_cpt;                     /**< Checkpoint deferred till the end of transaction by file resize */
+  WBRESIZE txn_shrink;              /**< File shrink deferred till the end of transaction, `nsize` is zero if none */
+  WALSNAP *snaps;                   /**< Open snapshots */
+  uint32_t snaps_num;               /**< Number of open snapshots */
   IWKV iwkv;
 } IWAL;
 
 bool extfile_use_locks(IWFS_EXT *f, bool use_locks);
 static iwrc _checkpoint(IWAL *wal);
 static iwrc _checkpoint_wl(IWAL *wal);
+static iwrc _savepoint_wl(IWAL *wal, bool sync, uint64_t *lsnp);
 
 IW_INLINE iwrc _lock(IWAL *wal) {
   int rci = wal->mtx ? pthread_mutex_lock(wal->mtx) : 0;
@@ -103,6 +135,26 @@ static iwrc _init_locks(IWAL *wal) {
     wal->mtx = 0;
     return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
   }
+  wal->cpt_cond = malloc(sizeof(*wal->cpt_cond));
+  if (!wal->cpt_cond) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  rci = pthread_cond_init(wal->cpt_cond, 0);
+  if (rci) {
+    free(wal->cpt_cond);
+    wal->cpt_cond = 0;
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  wal->sync_cond = malloc(sizeof(*wal->sync_cond));
+  if (!wal->sync_cond) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  rci = pthread_cond_init(wal->sync_cond, 0);
+  if (rci) {
+    free(wal->sync_cond);
+    wal->sync_cond = 0;
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
   return 0;
 }
 
@@ -111,7 +163,24 @@ static iwrc _destroy_locks(IWAL *wal) {
     return 0;
   }
   iwrc rc = 0;
-  int rci = pthread_mutex_destroy(wal->mtx);
+  int rci;
+  if (wal->cpt_cond) {
+    rci = pthread_cond_destroy(wal->cpt_cond);
+    if (rci) {
+      IWRC(iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci), rc);
+    }
+    free(wal->cpt_cond);
+    wal->cpt_cond = 0;
+  }
+  if (wal->sync_cond) {
+    rci = pthread_cond_destroy(wal->sync_cond);
+    if (rci) {
+      IWRC(iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci), rc);
+    }
+    free(wal->sync_cond);
+    wal->sync_cond = 0;
+  }
+  rci = pthread_mutex_destroy(wal->mtx);
   if (rci) {
     IWRC(iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci), rc);
   }
@@ -120,8 +189,11 @@ static iwrc _destroy_locks(IWAL *wal) {
   return rc;
 }
 
+static iwrc _cpt_shutdown(IWAL *wal);
+
 static void _iwal_destroy(IWAL *wal) {
   if (wal) {
+    _cpt_shutdown(wal);
     if (!INVALIDHANDLE(wal->fh)) {
       iwp_unlock(wal->fh);
       iwp_closefh(wal->fh);
@@ -134,6 +206,7 @@ static void _iwal_destroy(IWAL *wal) {
       wal->buf -= sizeof(WBSEP);
       free(wal->buf);
     }
+    free(wal->snaps);
     free(wal);
   }
 }
@@ -153,9 +226,13 @@ static iwrc _flush_wl(IWAL *wal, bool sync) {
     if (wz != sz) {
       return iwrc_set_errno(IW_ERROR_IO_ERRNO, errno);
     }
+    wal->wlsn += wz;
   }
-  if (sync && fsync(wal->fh)) {
-    return iwrc_set_errno(IW_ERROR_IO_ERRNO, errno);
+  if (sync) {
+    if (fsync(wal->fh)) {
+      return iwrc_set_errno(IW_ERROR_IO_ERRNO, errno);
+    }
+    wal->slsn = wal->wlsn;
   }
   return 0;
 }
@@ -191,6 +268,7 @@ static iwrc _write_wl(IWAL *wal, const void *op, off_t oplen, const uint8_t *dat
     if (sz != len) {
       return iwrc_set_errno(IW_ERROR_IO_ERRNO, errno);
     }
+    wal->wlsn += len;
   } else {
     assert(bufsz - wal->bufpos >= len);
     memcpy(wal->buf + wal->bufpos, data, len);
@@ -226,7 +304,7 @@ static iwrc _onopen(struct IWDLSNR *self, const char *path, int mode) {
 
 static iwrc _onclosing(struct IWDLSNR *self) {
   IWAL *wal = (IWAL *) self;
-  if (wal->applying) {
+  if (wal->applying || wal->iwkv->fatalrc) {
     return 0;
   }
 #ifdef IW_TESTS
@@ -282,6 +360,132 @@ static iwrc _onwrite(struct IWDLSNR *self, off_t off, const void *buf, off_t len
   return _write(wal, &wb, sizeof(wb), buf, len, false);
 }
 
+/**
+ * @brief Applies WAL records not yet written to database file
+ *        to the private mapping of database file.
+ */
+static iwrc _replay_wl(IWAL *wal, IWFS_EXT *extf) {
+  iwrc rc = 0;
+  size_t sp;
+  uint8_t *mm;
+  const off_t fsz = lseek(wal->fh, 0, SEEK_END);
+  if (fsz < 0) {
+    return iwrc_set_errno(IW_ERROR_IO_ERRNO, errno);
+  } else if (fsz <= wal->cppos) {
+    return 0;
+  }
+  rc = extf->probe_mmap(extf, 0, &mm, &sp);
+  RCRET(rc);
+  const off_t pfsz = IW_ROUNDUP(fsz, wal->page_size);
+  uint8_t *wmm = mmap(0, pfsz, PROT_READ, MAP_PRIVATE, wal->fh, 0);
+  if (wmm == MAP_FAILED) {
+    return iwrc_set_errno(IW_ERROR_ERRNO, errno);
+  }
+
+#define _WAL_CORRUPTED(msg_) do { \
+    rc = IWKV_ERROR_CORRUPTED_WAL_FILE; \
+    iwlog_ecode_error2(rc, msg_); \
+    goto finish; \
+  } while(0);
+
+  uint8_t *rp = wmm + wal->cppos;
+  while (rp - wmm < fsz) {
+    uint8_t opid;
+    off_t avail = fsz - (rp - wmm);
+    memcpy(&opid, rp, 1);
+    switch (opid) {
+      case WOP_SEP:
+        if (avail < sizeof(WBSEP)) _WAL_CORRUPTED("Premature end of WAL (WBSEP)");
+        rp += sizeof(WBSEP);
+        break;
+      case WOP_SET: {
+        WBSET wb;
+        if (avail < sizeof(wb)) _WAL_CORRUPTED("Premature end of WAL (WBSET)");
+        memcpy(&wb, rp, sizeof(wb));
+        rp += sizeof(wb);
+        memset(mm + wb.off, wb.val, wb.len);
+        break;
+      }
+      case WOP_COPY: {
+        WBCOPY wb;
+        if (avail < sizeof(wb)) _WAL_CORRUPTED("Premature end of WAL (WBCOPY)");
+        memcpy(&wb, rp, sizeof(wb));
+        rp += sizeof(wb);
+        memmove(mm + wb.noff, mm + wb.off, wb.len);
+        break;
+      }
+      case WOP_WRITE: {
+        WBWRITE wb;
+        if (avail < sizeof(wb)) _WAL_CORRUPTED("Premature end of WAL (WBWRITE)");
+        memcpy(&wb, rp, sizeof(wb));
+        rp += sizeof(wb);
+        if (avail < sizeof(wb) + wb.len) _WAL_CORRUPTED("Premature end of WAL (WBWRITE)");
+        memcpy(mm + wb.off, rp, wb.len);
+        rp += wb.len;
+        break;
+      }
+      case WOP_RESIZE:
+        // File is already resized
+        if (avail < sizeof(WBRESIZE)) _WAL_CORRUPTED("Premature end of WAL (WBRESIZE)");
+        rp += sizeof(WBRESIZE);
+        break;
+      case WOP_FIXPOINT:
+        if (avail < sizeof(WBFIXPOINT)) _WAL_CORRUPTED("Premature end of WAL (WBFIXPOINT)");
+        rp += sizeof(WBFIXPOINT);
+        break;
+      case WOP_APPLIED:
+        if (avail < sizeof(WBAPPLIED)) _WAL_CORRUPTED("Premature end of WAL (WBAPPLIED)");
+        rp += sizeof(WBAPPLIED);
+        break;
+      default:
+        _WAL_CORRUPTED("Invalid WAL command");
+        break;
+    }
+  }
+#undef _WAL_CORRUPTED
+
+finish:
+  munmap(wmm, pfsz);
+  return rc;
+}
+
+/**
+ * @brief Resizes database file in the middle of transaction.
+ *
+ * Checkpoint puts a fixpoint over partially written transaction,
+ * so it is deferred till `iwal_txn_end()`. File is resized directly instead,
+ * changes lost by remapping of private mapping are restored from WAL.
+ */
+static iwrc _txn_resize(IWAL *wal, const WBRESIZE *wb) {
+  IWFS_EXT *extf;
+  IWKV iwkv = wal->iwkv;
+  iwrc rc = iwkv->fsm.extfile(&iwkv->fsm, &extf);
+  RCRET(rc);
+  rc = _lock(wal);
+  RCRET(rc);
+  rc = _write_wl(wal, wb, sizeof(*wb), 0, 0, false);
+  RCGO(rc, finish);
+  rc = _flush_wl(wal, false);
+  RCGO(rc, finish);
+  wal->applying = true;
+  bool eul = extfile_use_locks(extf, false);
+  rc = extf->truncate(extf, wb->nsize);
+  if (!rc) {
+    rc = _replay_wl(wal, extf);
+  }
+  extfile_use_locks(extf, eul);
+  wal->applying = false;
+  if (!rc) {
+    wal->txn_cpt = true;
+  } else {
+    iwkv->fatalrc = rc;
+  }
+
+finish:
+  IWRC(_unlock(wal), rc);
+  return rc;
+}
+
 static iwrc _onresize(struct IWDLSNR *self, off_t osize, off_t nsize, int flags, bool *handled) {
   IWAL *wal = (IWAL *) self;
   if (wal->applying) {
@@ -293,7 +497,20 @@ static iwrc _onresize(struct IWDLSNR *self, off_t osize, off_t nsize, int flags,
   wb.id = WOP_RESIZE;
   wb.osize = osize;
   wb.nsize = nsize;
-  return _write(wal, &wb, sizeof(wb), 0, 0, true);
+  if (wal->txn) {
+    iwrc rc = _lock(wal);
+    RCRET(rc);
+    if (nsize < osize) {
+      // Transaction still may need file tail, it is trimmed by `iwal_txn_end()`
+      wal->txn_shrink = wb;
+      return _unlock(wal);
+    }
+    memset(&wal->txn_shrink, 0, sizeof(wal->txn_shrink));
+    rc = _unlock(wal);
+    RCRET(rc);
+    return _txn_resize(wal, &wb);
+  }
+  return _write(wal, &wb, sizeof(wb), 0, 0, !wal->iwkv->fatalrc);
 }
 
 static iwrc _onsynced(struct IWDLSNR *self, int flags) {
@@ -308,9 +525,32 @@ static iwrc _onsynced(struct IWDLSNR *self, int flags) {
   return rc;
 }
 
-static iwrc _find_last_fixpoint(IWAL *wal, uint8_t *wmm, off_t fsz, off_t *pfpos) {
+/**
+ * @brief Detaches pages of database file region from every open snapshot
+ *        before region is modified by checkpoint.
+ *
+ * Write access to a page of snapshot private mapping forces kernel
+ * to make a private copy of it, so snapshot keeps page contents
+ * as they were before checkpoint.
+ */
+static void _snaps_touch_wl(IWAL *wal, off_t off, off_t len) {
+  for (uint32_t i = 0; i < wal->snaps_num; ++i) {
+    WALSNAP *s = &wal->snaps[i];
+    if (off >= s->len) {
+      continue;
+    }
+    off_t end = MIN(off + len, s->len);
+    for (off_t p = IW_ROUNDOWN(off, wal->page_size); p < end; p += wal->page_size) {
+      volatile uint8_t *vp = s->mm + p;
+      *vp = *vp;
+    }
+  }
+}
+
+static iwrc _find_last_fixpoint(IWAL *wal, uint8_t *wmm, off_t fsz, off_t *pfpos, off_t *papos) {
   uint8_t *rp = wmm;
   *pfpos = 0;
+  *papos = 0;
   
 #define _WAL_CORRUPTED(msg_) do { \
     iwrc rc = IWKV_ERROR_CORRUPTED_WAL_FILE; \
@@ -367,9 +607,18 @@ static iwrc _find_last_fixpoint(IWAL *wal, uint8_t *wmm, off_t fsz, off_t *pfpos
         break;
       }
       case WOP_FIXPOINT:
+        if (avail < sizeof(WBFIXPOINT)) _WAL_CORRUPTED("Premature end of WAL (WBFIXPOINT)");
         *pfpos = (rp - wmm);
         rp += sizeof(WBFIXPOINT);
         break;
+      case WOP_APPLIED: {
+        WBAPPLIED wb;
+        if (avail < sizeof(wb)) _WAL_CORRUPTED("Premature end of WAL (WBAPPLIED)");
+        memcpy(&wb, rp, sizeof(wb));
+        *papos = wb.pos;
+        rp += sizeof(wb);
+        break;
+      }
       default: {
         _WAL_CORRUPTED("Invalid WAL command");
         break;
@@ -380,6 +629,19 @@ static iwrc _find_last_fixpoint(IWAL *wal, uint8_t *wmm, off_t fsz, off_t *pfpos
   return 0;
 }
 
+/**
+ * @brief Appends `WOP_APPLIED` marker so recovery will not replay WAL records before `pos` again.
+ * @note Changes of database file made by records before `pos` must be already synced.
+ */
+static iwrc _applied_wl(IWAL *wal, off_t pos) {
+  WBAPPLIED wb = {0}; // Avoid uninitialized padding bytes
+  wb.id = WOP_APPLIED;
+  wb.pos = pos;
+  iwrc rc = _write_wl(wal, &wb, sizeof(wb), 0, 0, false);
+  RCRET(rc);
+  return _flush_wl(wal, false);
+}
+
 static iwrc _rollforward_wl(IWAL *wal, IWFS_EXT *extf, bool recover) {
   assert(wal->bufpos == 0);
   iwrc rc = 0;
@@ -393,6 +655,7 @@ static iwrc _rollforward_wl(IWAL *wal, IWFS_EXT *extf, bool recover) {
   uint8_t *mm;
   const bool ccrc = wal->check_cp_crc;
   off_t fpos = 0; // checkpoint
+  off_t apos = 0; // already applied
   off_t pfsz = IW_ROUNDUP(fsz, wal->page_size);
   uint8_t *wmm = mmap(0, pfsz, PROT_READ, MAP_PRIVATE, wal->fh, 0);
   if (wmm == MAP_FAILED) {
@@ -414,8 +677,8 @@ static iwrc _rollforward_wl(IWAL *wal, IWFS_EXT *extf, bool recover) {
     return rc;
   }
   if (recover) {
-    rc = _find_last_fixpoint(wal, wmm, fsz, &fpos);
-    if (rc || !fpos) {
+    rc = _find_last_fixpoint(wal, wmm, fsz, &fpos, &apos);
+    if (rc || !fpos || apos > fpos) {
       goto finish;
     }
   }
@@ -425,12 +688,13 @@ static iwrc _rollforward_wl(IWAL *wal, IWFS_EXT *extf, bool recover) {
     goto finish; \
   } while(0);
   
-  uint8_t *rp = wmm;
+  // Data before `cppos` (`WOP_APPLIED` position on recovery) is already applied
+  uint8_t *rp = wmm + (recover ? apos : wal->cppos);
   for (uint32_t i = 0; rp - wmm < fsz; ++i) {
     uint8_t opid;
     off_t avail = fsz - (rp - wmm);
     memcpy(&opid, rp, 1);
-    if (i == 0 && opid != WOP_SEP) {
+    if (i == 0 && rp == wmm && opid != WOP_SEP) {
       rc = IWKV_ERROR_CORRUPTED_WAL_FILE;
       goto finish;
     }
@@ -456,6 +720,7 @@ static iwrc _rollforward_wl(IWAL *wal, IWFS_EXT *extf, bool recover) {
         rp += sizeof(wb);
         rc = extf->probe_mmap(extf, 0, &mm, &sp);
         RCGO(rc, finish);
+        _snaps_touch_wl(wal, wb.off, wb.len);
         memset(mm + wb.off, wb.val, wb.len);
         break;
       }
@@ -466,6 +731,7 @@ static iwrc _rollforward_wl(IWAL *wal, IWFS_EXT *extf, bool recover) {
         rp += sizeof(wb);
         rc = extf->probe_mmap(extf, 0, &mm, &sp);
         RCGO(rc, finish);
+        _snaps_touch_wl(wal, wb.noff, wb.len);
         memmove(mm + wb.noff, mm + wb.off, wb.len);
         break;
       }
@@ -483,6 +749,7 @@ static iwrc _rollforward_wl(IWAL *wal, IWFS_EXT *extf, bool recover) {
         }
         rc = extf->probe_mmap(extf, 0, &mm, &sp);
         RCGO(rc, finish);
+        _snaps_touch_wl(wal, wb.off, wb.len);
         memmove(mm + wb.off, rp, wb.len);
         rp += wb.len;
         break;
@@ -492,6 +759,8 @@ static iwrc _rollforward_wl(IWAL *wal, IWFS_EXT *extf, bool recover) {
         if (avail < sizeof(wb)) _WAL_CORRUPTED("Premature end of WAL (WBRESIZE)");
         memcpy(&wb, rp, sizeof(wb));
         rp += sizeof(wb);
+        // Cut off pages will be inaccessible by snapshots
+        _snaps_touch_wl(wal, wb.nsize, OFF_T_MAX - wb.nsize);
         rc = extf->truncate(extf, wb.nsize);
         RCGO(rc, finish);
         break;
@@ -505,6 +774,10 @@ static iwrc _rollforward_wl(IWAL *wal, IWFS_EXT *extf, bool recover) {
         }
         rp += sizeof(WBFIXPOINT);
         break;
+      case WOP_APPLIED:
+        if (avail < sizeof(WBAPPLIED)) _WAL_CORRUPTED("Premature end of WAL (WBAPPLIED)");
+        rp += sizeof(WBAPPLIED);
+        break;
       default: {
         _WAL_CORRUPTED("Invalid WAL command");
         break;
@@ -522,6 +795,9 @@ finish:
   IWRC(extf->add_mmap(extf, 0, SIZE_T_MAX, IWFS_MMAP_PRIVATE), rc);
   if (!rc) {
     rc = _truncate(wal);
+    wal->cppos = 0;
+    wal->fpend = 0;
+    ++wal->cpgen;
   }
   wal->applying = false;
   extfile_use_locks(extf, eul);
@@ -561,6 +837,11 @@ static iwrc _checkpoint_wl(IWAL *wal) {
   //fprintf(stderr, "_checkpoint_wl\n");
   IWFS_EXT *extf;
   IWKV iwkv = wal->iwkv;
+  if (iwkv->fatalrc) {
+    // WAL tail may contain changes of failed operation,
+    // they will be discarded by recovery and must not reach database file
+    return iwkv->fatalrc;
+  }
   WBFIXPOINT wbfp = {0};
   wbfp.id = WOP_FIXPOINT;
   iwrc rc = iwp_current_time_ms(&wbfp.ts);
@@ -572,6 +853,9 @@ static iwrc _checkpoint_wl(IWAL *wal) {
   rc = iwkv->fsm.extfile(&iwkv->fsm, &extf);
   RCGO(rc, finish);
   rc = _rollforward_wl(wal, extf, false);
+  if (!rc) {
+    wal->slsn = wal->wlsn;
+  }
   wal->mbytes = 0;
   iwp_current_time_ms(&wal->checkpoint_ts);
 finish:
@@ -589,6 +873,345 @@ IW_INLINE iwrc _checkpoint(IWAL *wal) {
   return rc;
 }
 
+/**
+ * @brief Group commit: makes WAL data durable up to the given `lsn`.
+ *
+ * Concurrent callers are coalesced: the first one becomes a leader and
+ * performs `fsync()` for everything written so far, others wait on `sync_cond`
+ * until their `lsn` is covered by the leader's sync.
+ */
+static iwrc _sync_lsn(IWAL *wal, uint64_t lsn) {
+  iwrc rc = _lock(wal);
+  RCRET(rc);
+  while (wal->slsn < lsn) {
+    if (wal->syncing) {
+      pthread_cond_wait(wal->sync_cond, wal->mtx);
+      continue;
+    }
+    uint64_t tlsn = wal->wlsn;
+    wal->syncing = true;
+    _unlock(wal);
+    if (fsync(wal->fh)) {
+      rc = iwrc_set_errno(IW_ERROR_IO_ERRNO, errno);
+    }
+    _lock(wal);
+    wal->syncing = false;
+    if (!rc && wal->slsn < tlsn) {
+      wal->slsn = tlsn;
+    }
+    pthread_cond_broadcast(wal->sync_cond);
+    if (rc) {
+      break;
+    }
+  }
+  IWRC(_unlock(wal), rc);
+  return rc;
+}
+
+IW_INLINE bool _need_checkpoint_ts(IWAL *wal, uint64_t ts) {
+  return (wal->mbytes > 0 && ts >= wal->checkpoint_ts + wal->checkpoint_timeout_ms);
+}
+
+static iwrc _checkpoint_exl(IWAL *wal, bool force) {
+  IWKV iwkv = wal->iwkv;
+  iwrc rc = iwkv_exclusive_lock(iwkv);
+  RCRET(rc);
+  if (force || _need_checkpoint(wal)) {
+    rc = _checkpoint(wal);
+  }
+  IWRC(iwkv_exclusive_unlock(iwkv), rc);
+  return rc;
+}
+
+/**
+ * @brief Applies WAL records starting at `*ppos` directly to the shared mapping `dmm` of database file
+ *        until at least `checkpoint_slice_sz` bytes processed.
+ *
+ * Processing is stopped (`*stop` is set) on any record which cannot be applied
+ * outside of exclusive checkpoint, such records will be handled by the final `_checkpoint_wl()` call.
+ */
+static iwrc _apply_slice_wl(IWAL *wal, const uint8_t *wmm, off_t end, uint8_t *dmm, off_t dsz,
+                            off_t *ppos, bool *stop) {
+  const bool ccrc = wal->check_cp_crc;
+  const uint8_t *sp = wmm + *ppos;
+  const uint8_t *rp = sp;
+  
+#define _WAL_CORRUPTED(msg_) do { \
+    iwrc rc = IWKV_ERROR_CORRUPTED_WAL_FILE; \
+    iwlog_ecode_error2(rc, msg_); \
+    return rc; \
+  } while(0);
+  
+  *stop = false;
+  while (rp - wmm < end) {
+    uint8_t opid;
+    off_t avail = end - (rp - wmm);
+    memcpy(&opid, rp, 1);
+    switch (opid) {
+      case WOP_SEP: {
+        WBSEP wb;
+        if (rp - sp >= wal->checkpoint_slice_sz) {
+          goto finish;
+        }
+        if (avail < sizeof(wb)) _WAL_CORRUPTED("Premature end of WAL (WBSEP)");
+        memcpy(&wb, rp, sizeof(wb));
+        rp += sizeof(wb);
+        if (wb.len > avail) _WAL_CORRUPTED("Premature end of WAL (WBSEP)");
+        if (ccrc) {
+          uint32_t crc = iwu_crc32(rp, wb.len, 0);
+          if (crc != wb.crc) {
+            _WAL_CORRUPTED("Invalid CRC32 checksum of WAL segment (WBSEP)");
+          }
+        }
+        break;
+      }
+      case WOP_SET: {
+        WBSET wb;
+        if (avail < sizeof(wb)) _WAL_CORRUPTED("Premature end of WAL (WBSET)");
+        memcpy(&wb, rp, sizeof(wb));
+        if (wb.off + wb.len > dsz) {
+          *stop = true;
+          goto finish;
+        }
+        rp += sizeof(wb);
+        _snaps_touch_wl(wal, wb.off, wb.len);
+        memset(dmm + wb.off, wb.val, wb.len);
+        break;
+      }
+      case WOP_WRITE: {
+        WBWRITE wb;
+        if (avail < sizeof(wb)) _WAL_CORRUPTED("Premature end of WAL (WBWRITE)");
+        memcpy(&wb, rp, sizeof(wb));
+        if (avail < sizeof(wb) + wb.len) _WAL_CORRUPTED("Premature end of WAL (WBWRITE)");
+        if (wb.off + wb.len > dsz) {
+          *stop = true;
+          goto finish;
+        }
+        rp += sizeof(wb);
+        if (ccrc) {
+          uint32_t crc = iwu_crc32(rp, wb.len, 0);
+          if (crc != wb.crc) {
+            _WAL_CORRUPTED("Invalid CRC32 checksum of WAL segment (WBWRITE)");
+          }
+        }
+        _snaps_touch_wl(wal, wb.off, wb.len);
+        memcpy(dmm + wb.off, rp, wb.len);
+        rp += wb.len;
+        break;
+      }
+      case WOP_FIXPOINT:
+        rp += sizeof(WBFIXPOINT);
+        break;
+      case WOP_APPLIED:
+        rp += sizeof(WBAPPLIED);
+        break;
+      default:
+        // WOP_RESIZE, WOP_COPY and others should be applied by exclusive checkpoint.
+        // Replay of WOP_COPY after crash is not idempotent if its source was changed later.
+        *stop = true;
+        goto finish;
+    }
+  }
+#undef _WAL_CORRUPTED
+
+finish:
+  *ppos = rp - wmm;
+  return 0;
+}
+
+/**
+ * @brief Applies WAL data accumulated so far to the database file in slices
+ *        without blocking database readers and writers.
+ *
+ * Every slice is applied while holding WAL mutex only.
+ * Readers keep working with private mapping of database file since
+ * all pages touched by WAL records are already copied-on-write there.
+ * Slices never go past the last durable fixpoint, so database file
+ * contains only changes of completed operations.
+ * Progress is persisted by `WOP_APPLIED` markers which allow recovery
+ * to skip WAL records already applied to database file.
+ * Checkpoint should be finished by `_checkpoint_wl()` which applies
+ * the remaining WAL tail starting from `IWAL::cppos` under exclusive lock.
+ */
+static iwrc _checkpoint_slices(IWAL *wal) {
+  iwrc rc = 0;
+  bool stop = false;
+  uint64_t lsn = 0, cpgen = 0;
+  uint8_t *wmm = MAP_FAILED, *dmm = MAP_FAILED;
+  IWKV iwkv = wal->iwkv;
+  IWFS_FSM_STATE fst;
+  off_t end, pos, spos;
+  
+  rc = iwkv->fsm.state(&iwkv->fsm, &fst);
+  RCRET(rc);
+  const off_t dsz = fst.exfile.fsize;
+  rc = _lock(wal);
+  RCRET(rc);
+  rc = _flush_wl(wal, false);
+  end = lseek(wal->fh, 0, SEEK_END);
+  pos = wal->cppos;
+  _unlock(wal);
+  RCRET(rc);
+  if (end < 0) {
+    return iwrc_set_errno(IW_ERROR_IO_ERRNO, errno);
+  }
+  if (end - pos <= wal->checkpoint_slice_sz || !dsz) {
+    return 0; // Small enough to be applied at once
+  }
+  // Records after the last fixpoint may belong to unfinished operations,
+  // so put a fresh fixpoint between operations and make it durable
+  rc = iwkv_exclusive_lock(iwkv);
+  RCRET(rc);
+  rc = _lock(wal);
+  if (!rc) {
+    if (!wal->txn) {
+      rc = _savepoint_wl(wal, false, &lsn);
+    }
+    end = wal->fpend;
+    pos = wal->cppos;
+    cpgen = wal->cpgen;
+    IWRC(_unlock(wal), rc);
+  }
+  IWRC(iwkv_exclusive_unlock(iwkv), rc);
+  RCRET(rc);
+  if (!lsn) {
+    return 0;
+  }
+  rc = _sync_lsn(wal, lsn);
+  RCRET(rc);
+  spos = pos;
+  
+  const off_t pend = IW_ROUNDUP(end, wal->page_size);
+  wmm = mmap(0, pend, PROT_READ, MAP_PRIVATE, wal->fh, 0);
+  if (wmm == MAP_FAILED) {
+    return iwrc_set_errno(IW_ERROR_ERRNO, errno);
+  }
+  dmm = mmap(0, dsz, PROT_READ | PROT_WRITE, MAP_SHARED, fst.exfile.file.fh, 0);
+  if (dmm == MAP_FAILED) {
+    rc = iwrc_set_errno(IW_ERROR_ERRNO, errno);
+    goto finish;
+  }
+  while (!stop && pos < end) {
+    rc = _lock(wal);
+    RCGO(rc, finish);
+    if (cpgen != wal->cpgen || !iwkv->open) {
+      // WAL was checkpointed by someone else
+      _unlock(wal);
+      goto finish;
+    }
+    if (wal->txn) {
+      // Transaction changes must not reach database file before commit fixpoint
+      _unlock(wal);
+      break;
+    }
+    rc = _apply_slice_wl(wal, wmm, end, dmm, dsz, &pos, &stop);
+    if (!rc) {
+      wal->cppos = pos;
+    }
+    _unlock(wal);
+    RCGO(rc, finish);
+  }
+  if (pos > spos) {
+    if (msync(dmm, dsz, MS_SYNC) == -1) {
+      rc = iwrc_set_errno(IW_ERROR_IO_ERRNO, errno);
+      goto finish;
+    }
+    rc = _lock(wal);
+    RCGO(rc, finish);
+    if (cpgen == wal->cpgen) {
+      rc = _applied_wl(wal, pos);
+    }
+    IWRC(_unlock(wal), rc);
+  }
+  
+finish:
+  if (dmm != MAP_FAILED) {
+    munmap(dmm, dsz);
+  }
+  munmap(wmm, pend);
+  return rc;
+}
+
+static void *_cpt_worker_fn(void *op) {
+  IWAL *wal = op;
+  IWKV iwkv = wal->iwkv;
+  uint64_t rts = 0; // Time to retry failed checkpoint
+  while (true) {
+    iwrc rc = 0;
+    uint64_t ts;
+    pthread_mutex_lock(wal->mtx);
+    while (!wal->cpt_shutdown) {
+      iwp_current_time_ms(&ts);
+      if (iwkv->open && !iwkv->fatalrc && ts >= rts) {
+        if (_need_checkpoint(wal) || _need_checkpoint_ts(wal, ts)) {
+          break;
+        }
+      }
+      uint64_t dl = wal->checkpoint_ts + wal->checkpoint_timeout_ms;
+      if (dl <= ts) { // Nothing was changed since last checkpoint
+        wal->checkpoint_ts = ts;
+        dl = ts + wal->checkpoint_timeout_ms;
+      }
+      if (dl < rts) {
+        dl = rts;
+      }
+      struct timespec tp = {
+        .tv_sec = dl / 1000,
+        .tv_nsec = (dl % 1000) * 1000000
+      };
+      pthread_cond_timedwait(wal->cpt_cond, wal->mtx, &tp);
+    }
+    pthread_mutex_unlock(wal->mtx);
+    if (wal->cpt_shutdown) {
+      break;
+    }
+    rc = _checkpoint_slices(wal);
+    if (!rc) {
+      rc = _checkpoint_exl(wal, true);
+    }
+    if (rc) {
+      iwlog_ecode_error2(rc, "WAL checkpoint failed");
+      if (iwkv->fatalrc) {
+        break;
+      }
+      // Checkpoint is still needed, so back off instead of retrying at once
+      iwp_current_time_ms(&ts);
+      rts = ts + wal->checkpoint_timeout_ms;
+    }
+  }
+  return 0;
+}
+
+static iwrc _cpt_startup(IWAL *wal) {
+  if (!wal->mtx || wal->cpt_started) {
+    return 0;
+  }
+  wal->cpt_shutdown = false;
+  int rci = pthread_create(&wal->cpt, 0, _cpt_worker_fn, wal);
+  if (rci) {
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  wal->cpt_started = true;
+  return 0;
+}
+
+static iwrc _cpt_shutdown(IWAL *wal) {
+  if (!wal->cpt_started) {
+    return 0;
+  }
+  iwrc rc = _lock(wal);
+  RCRET(rc);
+  wal->cpt_shutdown = true;
+  pthread_cond_broadcast(wal->cpt_cond);
+  rc = _unlock(wal);
+  int rci = pthread_join(wal->cpt, 0);
+  if (rci) {
+    IWRC(iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci), rc);
+  }
+  wal->cpt_started = false;
+  return rc;
+}
+
 //--------------------------------------- Public API
 
 iwrc iwal_checkpoint(IWKV iwkv, bool force) {
@@ -600,10 +1223,42 @@ iwrc iwal_checkpoint(IWKV iwkv, bool force) {
   if (!ncp && !force) {
     return 0;
   }
-  iwrc rc = iwkv_exclusive_lock(iwkv);
-  rc = _checkpoint(wal);
-  iwkv_exclusive_unlock(iwkv);
-  return rc;
+  if (!force && wal->cpt_started && wal->mbytes < 2 * wal->checkpoint_buffer_sz) {
+    // Let checkpoint worker do its job,
+    // writers will fall back to inline checkpoint only when the worker lags behind
+    iwrc rc = _lock(wal);
+    RCRET(rc);
+    pthread_cond_broadcast(wal->cpt_cond);
+    return _unlock(wal);
+  }
+  return _checkpoint_exl(wal, force);
+}
+
+iwrc iwal_shutdown(IWKV iwkv) {
+  IWAL *wal = (IWAL *) iwkv->dlsnr;
+  if (!wal) {
+    return 0;
+  }
+  return _cpt_shutdown(wal);
+}
+
+static iwrc _savepoint_wl(IWAL *wal, bool sync, uint64_t *lsnp) {
+  WBFIXPOINT wbfp = {0};
+  wbfp.id = WOP_FIXPOINT;
+  iwrc rc = iwp_current_time_ms(&wbfp.ts);
+  RCRET(rc);
+  rc = _write_wl(wal, &wbfp, sizeof(wbfp), 0, 0, false);
+  RCRET(rc);
+  // In NOLOCKS mode there is no concurrent savepoints so fsync the file right here
+  rc = _flush_wl(wal, sync && !wal->mtx);
+  RCRET(rc);
+  off_t fpend = lseek(wal->fh, 0, SEEK_END);
+  if (fpend < 0) {
+    return iwrc_set_errno(IW_ERROR_IO_ERRNO, errno);
+  }
+  wal->fpend = fpend;
+  *lsnp = wal->wlsn;
+  return 0;
 }
 
 iwrc iwal_savepoint(IWKV iwkv, bool sync) {
@@ -611,6 +1266,7 @@ iwrc iwal_savepoint(IWKV iwkv, bool sync) {
   if (!wal) {
     return 0;
   }
+  uint64_t lsn = 0;
   iwrc rc = iwkv_exclusive_lock(iwkv);
   RCRET(rc);
   rc = _lock(wal);
@@ -618,21 +1274,122 @@ iwrc iwal_savepoint(IWKV iwkv, bool sync) {
     iwkv_exclusive_unlock(iwkv);
     return rc;
   }
-  WBFIXPOINT wbfp = {0};
-  wbfp.id = WOP_FIXPOINT;
-  rc = iwp_current_time_ms(&wbfp.ts);
-  RCGO(rc, finish);
-  rc = _write_wl(wal, &wbfp, sizeof(wbfp), 0, 0, false);
-  RCRET(rc);
-  rc = _flush_wl(wal, sync);
-  RCGO(rc, finish);
-  
-finish:
+  rc = _savepoint_wl(wal, sync, &lsn);
   _unlock(wal);
   iwkv_exclusive_unlock(iwkv);
+  if (!rc && sync && wal->mtx) {
+    rc = _sync_lsn(wal, lsn);
+  }
+  return rc;
+}
+
+iwrc iwal_txn_begin(IWKV iwkv) {
+  IWAL *wal = (IWAL *) iwkv->dlsnr;
+  if (!wal) {
+    return IWKV_ERROR_INCOMPATIBLE_DB_MODE;
+  }
+  uint64_t lsn;
+  iwrc rc = _lock(wal);
+  RCRET(rc);
+  // Storage is recovered to this fixpoint if transaction is not completed
+  rc = _savepoint_wl(wal, false, &lsn);
+  if (!rc) {
+    wal->txn = true;
+  }
+  IWRC(_unlock(wal), rc);
+  return rc;
+}
+
+iwrc iwal_txn_end(IWKV iwkv, bool commit, bool sync, uint64_t *lsnp) {
+  IWAL *wal = (IWAL *) iwkv->dlsnr;
+  *lsnp = 0;
+  if (!wal) {
+    return IWKV_ERROR_INCOMPATIBLE_DB_MODE;
+  }
+  iwrc rc = _lock(wal);
+  RCRET(rc);
+  wal->txn = false;
+  if (commit) {
+    rc = _savepoint_wl(wal, sync, lsnp);
+    if (!rc && wal->txn_shrink.nsize) {
+      // Resize record follows commit fixpoint, so it is applied only for committed transaction
+      rc = _write_wl(wal, &wal->txn_shrink, sizeof(wal->txn_shrink), 0, 0, false);
+      wal->txn_cpt = true;
+    }
+    if (!rc && wal->txn_cpt) {
+      rc = _checkpoint_wl(wal); // Deferred by `_txn_resize()` or `_onresize()`
+    }
+  }
+  wal->txn_cpt = false;
+  memset(&wal->txn_shrink, 0, sizeof(wal->txn_shrink));
+  IWRC(_unlock(wal), rc);
   return rc;
 }
 
+iwrc iwal_txn_sync(IWKV iwkv, uint64_t lsn) {
+  IWAL *wal = (IWAL *) iwkv->dlsnr;
+  if (!wal || !wal->mtx) {
+    return 0;
+  }
+  return _sync_lsn(wal, lsn);
+}
+
+iwrc iwal_snapshot_checkpoint(IWKV iwkv) {
+  IWAL *wal = (IWAL *) iwkv->dlsnr;
+  if (!wal) {
+    return IWKV_ERROR_INCOMPATIBLE_DB_MODE;
+  }
+  return _checkpoint(wal);
+}
+
+iwrc iwal_snapshot_add(IWKV iwkv, IWKV snap) {
+  IWAL *wal = (IWAL *) iwkv->dlsnr;
+  if (!wal) {
+    return IWKV_ERROR_INCOMPATIBLE_DB_MODE;
+  }
+  size_t sp;
+  uint8_t *mm;
+  IWFS_EXT *extf;
+  iwrc rc = snap->fsm.extfile(&snap->fsm, &extf);
+  RCRET(rc);
+  rc = extf->probe_mmap(extf, 0, &mm, &sp);
+  RCRET(rc);
+  // Snapshot is opened in read-only mode, allow private copies of its pages
+  if (mprotect(mm, sp, PROT_READ | PROT_WRITE) == -1) {
+    return iwrc_set_errno(IW_ERROR_ERRNO, errno);
+  }
+  rc = _lock(wal);
+  RCRET(rc);
+  WALSNAP *snaps = realloc(wal->snaps, (wal->snaps_num + 1) * sizeof(*snaps));
+  if (snaps) {
+    snaps[wal->snaps_num].snap = snap;
+    snaps[wal->snaps_num].mm = mm;
+    snaps[wal->snaps_num].len = sp;
+    wal->snaps = snaps;
+    ++wal->snaps_num;
+  } else {
+    rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  IWRC(_unlock(wal), rc);
+  return rc;
+}
+
+iwrc iwal_snapshot_remove(IWKV iwkv, IWKV snap) {
+  IWAL *wal = (IWAL *) iwkv->dlsnr;
+  if (!wal) {
+    return 0;
+  }
+  iwrc rc = _lock(wal);
+  RCRET(rc);
+  for (uint32_t i = 0; i < wal->snaps_num; ++i) {
+    if (wal->snaps[i].snap == snap) {
+      wal->snaps[i] = wal->snaps[--wal->snaps_num];
+      break;
+    }
+  }
+  return _unlock(wal);
+}
+
 iwrc iwal_close(IWKV iwkv) {
   IWAL *wal = (IWAL *) iwkv->dlsnr;
   if (wal) {
@@ -699,6 +1456,10 @@ iwrc iwal_create(IWKV iwkv, const IWKV_OPTS *opts, IWFS_FSM_OPTS *fsmopts) {
     = opts->wal.checkpoint_timeout_ms > 0 ?
       opts->wal.checkpoint_timeout_ms : 60 * 1000; // 1 min
       
+  wal->checkpoint_slice_sz
+    = opts->wal.checkpoint_slice_sz > 0 ?
+      opts->wal.checkpoint_slice_sz : 4 * 1024 * 1024; // 4M
+      
   wal->check_cp_crc = opts->wal.check_crc_on_checkpoint;
   
   wal->buf = malloc(wal->wal_buffer_sz);
@@ -733,6 +1494,8 @@ iwrc iwal_create(IWKV iwkv, const IWKV_OPTS *opts, IWFS_FSM_OPTS *fsmopts) {
     RCGO(rc, finish);
   }
   
+  rc = _cpt_startup(wal);
+  
 finish:
   if (rc) {
     iwkv->dlsnr = 0;
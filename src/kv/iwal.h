@@ -44,6 +44,50 @@ iwrc iwal_checkpoint(IWKV iwkv, bool force);
 
 iwrc iwal_savepoint(IWKV iwkv, bool sync);
 
+/**
+ * @brief Starts writing of transaction changes.
+ *        WAL records are not applied to database file until `iwal_txn_end()`,
+ *        checkpoint forced by database file resize is deferred till `iwal_txn_end()` as well.
+ *        Database file shrink is applied by `iwal_txn_end()` only if transaction is committed.
+ *        Transaction changes are preceded by fixpoint which storage is recovered to
+ *        if transaction is not completed.
+ * @note Exclusive lock must be held by caller.
+ */
+iwrc iwal_txn_begin(IWKV iwkv);
+
+/**
+ * @brief Finishes writing of transaction changes.
+ *        If `commit` is true transaction changes are closed by fixpoint record.
+ * @note Exclusive lock must be held by caller.
+ *
+ * @param [out] lsnp Log sequence number to be passed to `iwal_txn_sync()`
+ */
+iwrc iwal_txn_end(IWKV iwkv, bool commit, bool sync, uint64_t *lsnp);
+
+/**
+ * @brief Makes committed transaction durable. Called without exclusive lock.
+ */
+iwrc iwal_txn_sync(IWKV iwkv, uint64_t lsn);
+
+iwrc iwal_shutdown(IWKV iwkv);
+
+/**
+ * @brief Applies all WAL data to the database file before snapshot is opened.
+ * @note Exclusive lock must be held by caller.
+ */
+iwrc iwal_snapshot_checkpoint(IWKV iwkv);
+
+/**
+ * @brief Registers `snap` opened over database file of `iwkv`.
+ *        Pages of snapshot mapping are preserved by subsequent checkpoints.
+ */
+iwrc iwal_snapshot_add(IWKV iwkv, IWKV snap);
+
+/**
+ * @brief Unregisters snapshot, must be called before snapshot file is closed.
+ */
+iwrc iwal_snapshot_remove(IWKV iwkv, IWKV snap);
+
 iwrc iwal_close(IWKV iwkv);
 
 IW_EXTERN_C_END
@@ -1,4 +1,6 @@
 #include "iwkv_internal.h"
+#include "iwbits.h"
+#include "iwlz.h"
 
 static iwrc _dbcache_fill_lw(IWLCTX *lx);
 static iwrc _dbcache_get(IWLCTX *lx);
@@ -6,6 +8,18 @@ static iwrc _dbcache_put_lw(IWLCTX *lx, SBLK *sblk);
 static void _dbcache_remove_lw(IWLCTX *lx, SBLK *sblk);
 static void _dbcache_update_lw(IWLCTX *lx, SBLK *sblk);
 static void _dbcache_destroy_lw(IWDB db);
+static iwrc _bloom_check(IWDB db, const IWKV_val *key, bool *maybe);
+IW_INLINE bool _bloom_check_mm(IWDB db, const IWKV_val *key, const uint8_t *mm);
+static iwrc _bloom_create(IWDB db, uint64_t num);
+static iwrc _bloom_add_lw(IWDB db, const void *key, uint32_t ksz);
+static iwrc _bloom_put_lw(IWDB db, const void *key, uint32_t ksz);
+static iwrc _bloom_rebuild_lw(IWDB db);
+IW_INLINE uint64_t _bloom_capacity(IWDB db);
+static iwrc _bloom_del_lw(IWDB db, uint64_t num);
+static iwrc _ttl_reaper_start(IWKV iwkv);
+static iwrc _ttl_reaper_shutdown(IWKV iwkv);
+static iwrc _kvblk_at_mm(IWLCTX *lx, off_t addr, uint8_t *mm, KVBLK *kbp, KVBLK **blkp);
+IW_INLINE void _kvblk_peek_val(const KVBLK *kb, uint8_t idx, const uint8_t *mm, uint8_t **obuf, uint32_t *olen);
 
 //-------------------------- GLOBALS
 
@@ -16,7 +30,14 @@ atomic_uint_fast64_t g_trigger;
 
 //-------------------------- UTILS
 
-IW_INLINE int _cmp_key2(iwdb_flags_t dbflg, const void *v1, int v1len, const void *v2, int v2len) {
+/**
+ * @brief Compare keys or their prefixes stored in `SBLK::lk`.
+ *
+ * Zero result for prefixes is not decisive: full keys must be compared by `_cmp_key()`.
+ * Prefixes are never decisive for databases with custom comparator.
+ */
+IW_INLINE int _cmp_key2(IWDB db, const void *v1, int v1len, const void *v2, int v2len) {
+  iwdb_flags_t dbflg = db->dbflg;
   if (dbflg & IWDB_UINT64_KEYS) {
     uint64_t n1, n2;
     memcpy(&n1, v1, v1len);
@@ -31,20 +52,83 @@ IW_INLINE int _cmp_key2(iwdb_flags_t dbflg, const void *v1, int v1len, const voi
     memcpy(&n2, v2, v2len);
     n2 = IW_ITOHL(n2);
     return n1 > n2 ? -1 : n1 < n2 ? 1 : 0;
+  } else if (db->cmp) {
+    return 0;
   } else {
-    return strncmp(v2, v1, MIN(v1len, v2len));
+    return iwu_memcmp(v2, v1, MIN(v1len, v2len));
   }
 }
 
-IW_INLINE int _cmp_key(iwdb_flags_t dbflg, const void *v1, int v1len, const void *v2, int v2len) {
-  int rv = _cmp_key2(dbflg, v1, v1len, v2, v2len);
-  if (!rv && !(dbflg & (IWDB_UINT64_KEYS | IWDB_UINT32_KEYS))) {
+IW_INLINE int _cmp_key(IWDB db, const void *v1, int v1len, const void *v2, int v2len) {
+  if (db->cmp) {
+    // Skiplist is ordered by keys in descending order
+    return db->cmp(v2, v2len, v1, v1len, db->cmp_op);
+  }
+  int rv = _cmp_key2(db, v1, v1len, v2, v2len);
+  if (!rv && !(db->dbflg & (IWDB_UINT64_KEYS | IWDB_UINT32_KEYS))) {
     return v2len - v1len;
   } else {
     return rv;
   }
 }
 
+IW_INLINE uint32_t _kvkey_len(const KVKEY *k) {
+  return k->pfxlen + k->sfxlen;
+}
+
+/**
+ * @brief Copy at most `len` first bytes of `k` into `buf`.
+ */
+IW_INLINE void _kvkey_copy(const KVKEY *k, uint8_t *buf, uint32_t len) {
+  uint32_t n = MIN(len, k->pfxlen);
+  if (n) {
+    memcpy(buf, k->pfx, n);
+  }
+  if (len > n && k->sfxlen) {
+    memcpy(buf + n, k->sfx, MIN(len - n, k->sfxlen));
+  }
+}
+
+/**
+ * @brief Compare keys split into prefix and suffix parts. Result is the same as of `_cmp_key()`.
+ *
+ * Split keys exist only in `IWDB_PREFIX_KEYS` databases with bytewise keys order.
+ */
+static int _cmp_kvkey(IWDB db, const KVKEY *k1, const KVKEY *k2) {
+  if (!k1->pfxlen && !k2->pfxlen) {
+    return _cmp_key(db, k1->sfx, k1->sfxlen, k2->sfx, k2->sfxlen);
+  }
+  const uint8_t *p1 = k1->pfx, *p2 = k2->pfx;
+  uint32_t l1 = k1->pfxlen, l2 = k2->pfxlen; // bytes left in current parts
+  uint32_t r1 = _kvkey_len(k1), r2 = _kvkey_len(k2); // bytes left in keys
+  if (!l1) {
+    p1 = k1->sfx;
+    l1 = k1->sfxlen;
+  }
+  if (!l2) {
+    p2 = k2->sfx;
+    l2 = k2->sfxlen;
+  }
+  while (r1 && r2) {
+    uint32_t n = MIN(l1, l2);
+    int rv = iwu_memcmp(p2, p1, n);
+    if (rv) {
+      return rv;
+    }
+    p1 += n, l1 -= n, r1 -= n;
+    p2 += n, l2 -= n, r2 -= n;
+    if (!l1) {
+      p1 = k1->sfx;
+      l1 = r1;
+    }
+    if (!l2) {
+      p2 = k2->sfx;
+      l2 = r2;
+    }
+  }
+  return (int) r2 - (int) r1;
+}
+
 IW_INLINE void _kv_val_dispose(IWKV_val *v) {
   if (v) {
     if (v->data) {
@@ -60,6 +144,242 @@ IW_INLINE void _kv_dispose(IWKV_val *key, IWKV_val *val) {
   _kv_val_dispose(val);
 }
 
+/**
+ * @brief Write `len` bytes of `data` into newly allocated blob.
+ */
+static WUR iwrc _kv_blob_put(IWDB db, const void *data, uint32_t len, blkn_t *oblkn) {
+  uint8_t *mm;
+  off_t addr = 0, alen;
+  IWFS_FSM *fsm = &db->iwkv->fsm;
+  IWDLSNR *dlsnr = db->iwkv->dlsnr;
+  iwrc rc = fsm->allocate(fsm, len, &addr, &alen,
+                          IWFSM_ALLOC_NO_OVERALLOCATE | IWFSM_SOLID_ALLOCATED_SPACE | IWFSM_ALLOC_NO_STATS);
+  RCRET(rc);
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  if (rc) {
+    IWRC(fsm->deallocate(fsm, addr, alen), rc);
+    return rc;
+  }
+  memcpy(mm + addr, data, len);
+  if (dlsnr) {
+    rc = dlsnr->onwrite(dlsnr, addr, mm + addr, len, 0);
+  }
+  fsm->release_mmap(fsm);
+  if (rc) {
+    IWRC(fsm->deallocate(fsm, addr, alen), rc);
+    return rc;
+  }
+  *oblkn = ADDR2BLK(addr);
+  return 0;
+}
+
+/**
+ * @brief Read header of encoded value.
+ *
+ * @param [out] ovtype Value type without `KVVAL_TTL` flag
+ * @param [out] oexpire Expiration time, zero if value never expires
+ * @return Size of header or zero if encoded value is malformed
+ */
+static uint32_t _kv_val_hdr(const uint8_t *vbuf, uint32_t vlen, uint8_t *ovtype, uint64_t *oexpire) {
+  *oexpire = 0;
+  if (vlen < 1) {
+    return 0;
+  }
+  *ovtype = vbuf[0] & ~KVVAL_TTL;
+  if (!(vbuf[0] & KVVAL_TTL)) {
+    return 1;
+  }
+  if (vlen < 1 + sizeof(uint64_t)) {
+    return 0;
+  }
+  memcpy(oexpire, vbuf + 1, sizeof(*oexpire));
+  *oexpire = IW_ITOHLL(*oexpire);
+  return 1 + sizeof(uint64_t);
+}
+
+/**
+ * @brief Get expiration time of encoded value.
+ * @return Zero if value never expires.
+ */
+IW_INLINE uint64_t _kv_val_expire(const uint8_t *vbuf, uint32_t vlen) {
+  uint8_t vtype;
+  uint64_t expire;
+  _kv_val_hdr(vbuf, vlen, &vtype, &expire);
+  return expire;
+}
+
+/**
+ * @brief Get blob referenced by encoded value.
+ * @return False if value is stored inline.
+ */
+static bool _kv_val_blob(const uint8_t *vbuf, uint32_t vlen, blkn_t *oblkn, uint32_t *olen) {
+  int step;
+  uint8_t vtype;
+  uint64_t expire;
+  uint32_t hsz = _kv_val_hdr(vbuf, vlen, &vtype, &expire);
+  if (!hsz || vtype != KVVAL_BLOB || vlen < hsz + 2) {
+    return false;
+  }
+  vbuf += hsz;
+  vlen -= hsz;
+  IW_READVNUMBUF(vbuf, *olen, step);
+  if (step >= vlen) {
+    return false;
+  }
+  IW_READVNUMBUF(vbuf + step, *oblkn, step);
+  return true;
+}
+
+/**
+ * @brief Release blob of `blen` bytes at `blkn` block.
+ * @note Memory mapped file must not be acquired by caller.
+ */
+static iwrc _kv_blob_free(IWDB db, blkn_t blkn, uint32_t blen) {
+  IWFS_FSM *fsm = &db->iwkv->fsm;
+  iwrc rc = fsm->deallocate(fsm, BLK2ADDR(blkn), IW_ROUNDUP(blen, 1 << IWKV_FSM_BPOW));
+  if (rc) {
+    iwlog_ecode_error3(rc);
+  }
+  return rc;
+}
+
+/**
+ * @brief Release blob referenced by encoded value.
+ */
+static iwrc _kv_val_blob_free(IWDB db, const uint8_t *vbuf, uint32_t vlen) {
+  blkn_t blkn;
+  uint32_t blen;
+  if (!(db->dbflg & IWDB_BLOB_VALS) || !_kv_val_blob(vbuf, vlen, &blkn, &blen)) {
+    return 0;
+  }
+  return _kv_blob_free(db, blkn, blen);
+}
+
+/**
+ * @brief Encode value of `IWDB_COMPRESS_VALS`|`IWDB_BLOB_VALS`|`IWDB_TTL` database.
+ *
+ * Value is encoded as [vtype:u1,value] or [vtype:u1,vlen:vn,lz block] for `IWDB_COMPRESS_VALS` databases.
+ * Values smaller than `IWKV_COMPRESS_MIN_VALSZ` and not compressible values are stored as is.
+ * Encoded values larger than `IWKV::blob_threshold` of `IWDB_BLOB_VALS` databases
+ * are written into separate blobs and replaced by [vtype:u1,blen:vn,blkn:vn] reference.
+ * Expiration time is kept inline right after value type: [vtype|KVVAL_TTL:u1,expire:u8,...].
+ *
+ * @param expire Expiration time ms, zero if value never expires
+ * @param [out] oval Allocated encoded value
+ */
+static WUR iwrc _kv_val_pack(IWDB db, const IWKV_val *val, uint64_t expire, IWKV_val *oval) {
+  if (val->size > IWKV_MAX_KVSZ) {
+    return IWKV_ERROR_MAXKVSZ;
+  }
+  int step;
+  // Value is encoded after space reserved for expiration time
+  uint8_t *obuf = malloc(1 + sizeof(expire) + val->size);
+  if (!obuf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  uint8_t *buf = obuf + sizeof(expire);
+  oval->data = obuf;
+  oval->size = 0;
+  if ((db->dbflg & IWDB_COMPRESS_VALS) && val->size >= IWKV_COMPRESS_MIN_VALSZ) {
+    buf[0] = KVVAL_LZ;
+    IW_SETVNUMBUF(step, buf + 1, val->size);
+    // Compressed value is used only if it is smaller than raw one
+    size_t csz = iwlz_compress(val->data, val->size, buf + 1 + step, val->size - step);
+    if (csz) {
+      oval->size = 1 + step + csz;
+    }
+  }
+  if (!oval->size) {
+    buf[0] = KVVAL_RAW;
+    memcpy(buf + 1, val->data, val->size);
+    oval->size = 1 + val->size;
+  }
+  if ((db->dbflg & IWDB_BLOB_VALS) && oval->size > db->iwkv->blob_threshold) {
+    blkn_t blkn;
+    iwrc rc = _kv_blob_put(db, buf, oval->size, &blkn);
+    if (rc) {
+      _kv_val_dispose(oval);
+      return rc;
+    }
+    uint8_t *wp = buf;
+    *wp++ = KVVAL_BLOB;
+    IW_SETVNUMBUF(step, wp, oval->size);
+    wp += step;
+    IW_SETVNUMBUF(step, wp, blkn);
+    wp += step;
+    oval->size = wp - buf;
+  }
+  if (expire) {
+    uint8_t vtype = buf[0] | KVVAL_TTL;
+    expire = IW_HTOILL(expire);
+    memcpy(obuf + 1, &expire, sizeof(expire)); // Overwrites `buf[0]`
+    obuf[0] = vtype;
+    oval->size += sizeof(expire);
+  } else {
+    memmove(obuf, buf, oval->size);
+  }
+  return 0;
+}
+
+/**
+ * @brief Decode value stored in `IWDB_COMPRESS_VALS`|`IWDB_BLOB_VALS` database.
+ *
+ * @param mm Memory mapped database file, used to access blobs
+ * @param [in,out] vbuf Stored value, replaced by decoded value
+ * @param [in,out] vlen Stored value length, replaced by decoded value length
+ * @param [out] obuf Allocated buffer of decompressed value to be freed by caller,
+ *                   zero if value is not compressed
+ */
+static WUR iwrc _kv_val_decode(const uint8_t *mm, const uint8_t **vbuf, uint32_t *vlen, uint8_t **obuf) {
+  const uint8_t *rp = *vbuf;
+  uint32_t len = *vlen, rlen, blen, hsz;
+  uint64_t expire;
+  uint8_t vtype;
+  blkn_t blkn;
+  int step;
+  *obuf = 0;
+  if (_kv_val_blob(rp, len, &blkn, &blen)) {
+    // Blob keeps value encoded without expiration time
+    rp = mm + BLK2ADDR(blkn);
+    len = blen;
+    if (len > 0 && (rp[0] & ~KVVAL_LZ)) {
+      iwlog_ecode_error3(IWKV_ERROR_CORRUPTED);
+      return IWKV_ERROR_CORRUPTED;
+    }
+  }
+  hsz = _kv_val_hdr(rp, len, &vtype, &expire);
+  if (hsz && vtype == KVVAL_RAW) {
+    *vbuf = rp + hsz;
+    *vlen = len - hsz;
+    return 0;
+  }
+  if (!hsz || len < hsz + 1 || vtype != KVVAL_LZ) {
+    iwlog_ecode_error3(IWKV_ERROR_CORRUPTED);
+    return IWKV_ERROR_CORRUPTED;
+  }
+  // Header is skipped up to value type byte
+  rp += hsz - 1;
+  len -= hsz - 1;
+  IW_READVNUMBUF(rp + 1, rlen, step);
+  if (1 + step >= len || rlen > IWKV_MAX_KVSZ) {
+    iwlog_ecode_error3(IWKV_ERROR_CORRUPTED);
+    return IWKV_ERROR_CORRUPTED;
+  }
+  uint8_t *buf = malloc(rlen ? rlen : 1);
+  if (!buf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  if (iwlz_decompress(rp + 1 + step, len - 1 - step, buf, rlen) != rlen) {
+    free(buf);
+    iwlog_ecode_error3(IWKV_ERROR_CORRUPTED);
+    return IWKV_ERROR_CORRUPTED;
+  }
+  *obuf = buf;
+  *vbuf = buf;
+  *vlen = rlen;
+  return 0;
+}
+
 void iwkv_val_dispose(IWKV_val *v) {
   _kv_val_dispose(v);
 }
@@ -189,7 +509,7 @@ static iwrc _db_worker_dec_nolk(IWDB db) {
 }
 
 static WUR iwrc _wnw_iwkw_wl(IWKV iwkv) {
-  int rci = pthread_rwlock_wrlock(&iwkv->rwl);
+  int rci = iwdrwl_wrlock(&iwkv->rwl);
   if (rci) {
     return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
   }
@@ -245,6 +565,34 @@ static WUR iwrc _wnw_db(IWDB db, iwrc(*after)(IWDB db)) {
 
 //--------------------------  DB
 
+IW_INLINE bool _db_idxnum_valid(uint8_t idxnum) {
+  return idxnum >= KVBLK_IDXNUM && idxnum <= KVBLK_IDXNUM_MAX && !(idxnum & (idxnum - 1));
+}
+
+/**
+ * @brief ID of keys comparator stored in database block.
+ */
+static uint8_t _db_cmp_id(IWDB_CMP cmp) {
+  if (!cmp) {
+    return DB_CMP_DEFAULT;
+  } else if (cmp == iwkv_cmp_int64) {
+    return DB_CMP_INT64;
+  } else if (cmp == iwkv_cmp_double) {
+    return DB_CMP_DOUBLE;
+  } else if (cmp == iwkv_cmp_vtuple) {
+    return DB_CMP_VTUPLE;
+  }
+  return DB_CMP_CUSTOM;
+}
+
+/**
+ * @brief Keys comparator of database is not given yet after storage is opened.
+ *        Database records must not be accessed until that.
+ */
+IW_INLINE bool _db_cmp_missing(IWDB db) {
+  return db->cmpid == DB_CMP_CUSTOM && !db->cmp;
+}
+
 static WUR iwrc _db_at(IWKV iwkv, IWDB *dbp, off_t addr, uint8_t *mm) {
   iwrc rc = 0;
   uint8_t *rp;
@@ -280,6 +628,54 @@ static WUR iwrc _db_at(IWKV iwkv, IWDB *dbp, off_t addr, uint8_t *mm) {
   for (int i = 0; i < SLEVELS; ++i) {
     IW_READLV(rp, lv, db->lcnt[i]);
   }
+  if (iwkv->fmt_version > 0) {
+    memcpy(&db->idxnum, mm + addr + DOFF_IDXNUM_U1, 1);
+    if (!_db_idxnum_valid(db->idxnum)) {
+      rc = IWKV_ERROR_CORRUPTED;
+      iwlog_ecode_error3(rc);
+      goto finish;
+    }
+  } else {
+    db->idxnum = KVBLK_IDXNUM;
+  }
+  if (iwkv->fmt_version > 1) {
+    rp = mm + addr + DOFF_BLOOM_U4;
+    IW_READLV(rp, lv, db->bloomn);
+    memcpy(&db->bloom_pow, rp, 1);
+    if (db->bloomn && (db->bloom_pow < BLOOM_POW_MIN || db->bloom_pow > BLOOM_POW_MAX)) {
+      rc = IWKV_ERROR_CORRUPTED;
+      iwlog_ecode_error3(rc);
+      goto finish;
+    }
+  }
+  if (iwkv->fmt_version > 2) {
+    memcpy(&db->cmpid, mm + addr + DOFF_CMP_U1, 1);
+    switch (db->cmpid) {
+      case DB_CMP_DEFAULT:
+      case DB_CMP_CUSTOM:
+        break;
+      case DB_CMP_INT64:
+        db->cmp = iwkv_cmp_int64;
+        break;
+      case DB_CMP_DOUBLE:
+        db->cmp = iwkv_cmp_double;
+        break;
+      case DB_CMP_VTUPLE:
+        db->cmp = iwkv_cmp_vtuple;
+        break;
+      default:
+        rc = IWKV_ERROR_CORRUPTED;
+        iwlog_ecode_error3(rc);
+        goto finish;
+    }
+    if (db->bloomn) {
+      uint64_t llv;
+      rp = mm + addr + DOFF_BLOOMPUTS_U8;
+      IW_READLLV(rp, llv, db->bloom_puts);
+      IW_READLLV(rp, llv, db->bloom_dels);
+    }
+  }
+  db->lklen = SBLK_LKLEN - (db->idxnum - KVBLK_IDXNUM);
   db->open = true;
   *dbp = db;
   
@@ -340,6 +736,7 @@ static WUR iwrc _db_load_chain(IWKV iwkv, off_t addr, uint8_t *mm) {
 static void _db_release_lw(IWDB *dbp) {
   assert(dbp && *dbp);
   _dbcache_destroy_lw(*dbp);
+  _kv_val_dispose(&(*dbp)->reap_key);
   pthread_rwlock_destroy(&(*dbp)->rwl);
   free(*dbp);
   *dbp = 0;
@@ -360,8 +757,22 @@ static void *_db_dispose_chain_thr(void *op) {
   uint8_t *mm, kvszpow;
   IWFS_FSM *fsm = &dctx->iwkv->fsm;
   blkn_t sbn = dctx->sbn, kvblkn;
+  blkn_t bblkn[KVBLK_IDXNUM_MAX]; // value blobs of `KVBLK`
+  uint32_t bblen[KVBLK_IDXNUM_MAX];
+  int bnum;
+  IWLCTX *lx = 0;
+  if ((*dctx->dbp)->dbflg & IWDB_BLOB_VALS) {
+    lx = calloc(1, sizeof(*lx));
+    if (!lx) {
+      rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+      iwlog_ecode_error2(rc, "Value blobs of destroyed database will not be released");
+    } else {
+      lx->db = *dctx->dbp;
+    }
+  }
   while (sbn) {
     off_t sba = BLK2ADDR(sbn);
+    bnum = 0;
     rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
     RCBREAK(rc);
     memcpy(&kvblkn, mm + sba + SOFF_KBLK_U4, 4);
@@ -370,9 +781,30 @@ static void *_db_dispose_chain_thr(void *op) {
     sbn = IW_ITOHL(sbn);
     if (kvblkn) {
       memcpy(&kvszpow, mm +  BLK2ADDR(kvblkn) + KBLK_SZPOW_OFF, 1);
+      if (lx) {
+        KVBLK kbs, *kb;
+        rc = _kvblk_at_mm(lx, BLK2ADDR(kvblkn), mm, &kbs, &kb);
+        if (!rc) {
+          for (int i = 0; i < lx->db->idxnum; ++i) {
+            uint8_t *vbuf;
+            uint32_t vlen;
+            _kvblk_peek_val(kb, i, mm, &vbuf, &vlen);
+            if (_kv_val_blob(vbuf, vlen, &bblkn[bnum], &bblen[bnum])) {
+              ++bnum;
+            }
+          }
+        } else {
+          iwlog_ecode_error3(rc);
+          rc = 0;
+        }
+      }
     }
     rc = fsm->release_mmap(fsm);
     RCBREAK(rc);
+    // Deallocate value blobs
+    for (int i = 0; i < bnum; ++i) {
+      _kv_blob_free(lx->db, bblkn[i], bblen[i]);
+    }
     // Deallocate `SBLK`
     rc = fsm->deallocate(fsm, sba, SBLK_SZ);
     if (rc) {
@@ -388,6 +820,7 @@ static void *_db_dispose_chain_thr(void *op) {
       }
     }
   }
+  free(lx);
   _db_release_lw(dctx->dbp);
   rc = _iwkv_worker_dec_nolk(dctx->iwkv);
   if (rc) {
@@ -456,6 +889,9 @@ static WUR iwrc _db_destroy_lw(IWDB *dbp) {
       rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
     }
   }
+  if (db->bloomn) {
+    IWRC(_kv_blob_free(db, db->bloomn, 1U << db->bloom_pow), rc);
+  }
   IWRC(fsm->deallocate(fsm, db_addr, DB_SZ), rc);
   if (dec_worker) {
     _db_release_lw(dbp);
@@ -464,7 +900,8 @@ static WUR iwrc _db_destroy_lw(IWDB *dbp) {
   return rc;
 }
 
-static WUR iwrc _db_create_lw(IWKV iwkv, dbid_t dbid, iwdb_flags_t dbflg, IWDB *odb) {
+static WUR iwrc _db_create_lw(IWKV iwkv, dbid_t dbid, iwdb_flags_t dbflg, uint8_t idxnum, uint32_t bloom_keys,
+                              IWDB_CMP cmp, void *cmp_op, IWDB *odb) {
   iwrc rc;
   int rci;
   uint8_t *mm = 0;
@@ -488,8 +925,13 @@ static WUR iwrc _db_create_lw(IWKV iwkv, dbid_t dbid, iwdb_flags_t dbflg, IWDB *
   }
   db->iwkv = iwkv;
   db->dbflg = dbflg;
+  db->idxnum = idxnum;
+  db->lklen = SBLK_LKLEN - (idxnum - KVBLK_IDXNUM);
   db->addr = baddr;
   db->id = dbid;
+  db->cmp = cmp;
+  db->cmp_op = cmp_op;
+  db->cmpid = _db_cmp_id(cmp);
   db->prev = iwkv->last_db;
   if (!iwkv->first_db) {
     uint64_t llv;
@@ -509,15 +951,39 @@ static WUR iwrc _db_create_lw(IWKV iwkv, dbid_t dbid, iwdb_flags_t dbflg, IWDB *
   }
   rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
   RCGO(rc, finish);
+  // Block may be reused space of removed data
+  memset(mm + db->addr, 0, DB_SZ);
+  if (iwkv->dlsnr) {
+    rc = iwkv->dlsnr->onset(iwkv->dlsnr, db->addr, 0, DB_SZ, 0);
+    RCGO(rc, finish);
+  }
   rc = _db_save(db, mm);
   RCGO(rc, finish);
+  memcpy(mm + db->addr + DOFF_IDXNUM_U1, &db->idxnum, 1);
+  if (iwkv->dlsnr) {
+    rc = iwkv->dlsnr->onwrite(iwkv->dlsnr, db->addr + DOFF_IDXNUM_U1, &db->idxnum, 1, 0);
+    RCGO(rc, finish);
+  }
+  if (db->cmpid != DB_CMP_DEFAULT) {
+    memcpy(mm + db->addr + DOFF_CMP_U1, &db->cmpid, 1);
+    if (iwkv->dlsnr) {
+      rc = iwkv->dlsnr->onwrite(iwkv->dlsnr, db->addr + DOFF_CMP_U1, &db->cmpid, 1, 0);
+      RCGO(rc, finish);
+    }
+  }
   if (db->prev) {
     rc = _db_save(db->prev, mm);
     RCGO(rc, finish);
   }
+  if (bloom_keys) {
+    fsm->release_mmap(fsm);
+    mm = 0;
+    rc = _bloom_create(db, bloom_keys);
+    RCGO(rc, finish);
+  }
   db->open = true;
   *odb = db;
-  
+
 finish:
   if (mm) {
     fsm->release_mmap(fsm);
@@ -537,10 +1003,14 @@ IW_INLINE void _kvblk_create(IWLCTX *lx, off_t baddr, off_t blen, uint8_t kvbpow
   kblk->db = lx->db;
   kblk->addr = baddr;
   kblk->maxoff = 0;
-  kblk->idxsz = 2 * IW_VNUMSIZE(0) * KVBLK_IDXNUM;
+  kblk->idxsz = 2 * IW_VNUMSIZE(0) * lx->db->idxnum;
+  if (lx->db->dbflg & IWDB_PREFIX_KEYS) {
+    kblk->idxsz += IW_VNUMSIZE(0);
+  }
   kblk->zidx = 0;
   kblk->szpow = kvbpow;
   kblk->flags = KVBLK_DURTY;
+  kblk->pfxlen = 0;
   memset(kblk->pidx, 0, sizeof(kblk->pidx));
   *oblk = kblk;
   AAPOS_INC(lx->kaan);
@@ -553,48 +1023,125 @@ IW_INLINE WUR iwrc _kvblk_destroy(KVBLK **kbp) {
   return fsm->deallocate(fsm, blk->addr, 1ULL << blk->szpow);
 }
 
-IW_INLINE WUR iwrc _kvblk_peek_key(const KVBLK *kb, uint8_t idx, const uint8_t *mm, const uint8_t **obuf,
-                                   uint32_t *olen) {
-  if (kb->pidx[idx].len) {
-    uint32_t klen, step;
-    const uint8_t *rp = mm + kb->addr + (1ULL << kb->szpow) - kb->pidx[idx].off;
-    IW_READVNUMBUF(rp, klen, step);
-    if (!klen) {
-      *obuf = 0;
-      *olen = 0;
+/**
+ * @brief Decode key of KV pair located at `rp`.
+ *
+ * KV pair: [klen:vn,key,value] or [klen:vn,plen:vn,key suffix,value] for `IWDB_PREFIX_KEYS` databases
+ * where `plen` is the number of first key bytes stored in `KVBLK::pfx`.
+ *
+ * @return Size of encoded key or zero if pair data is corrupted.
+ */
+IW_INLINE uint32_t _kvblk_kdecode(const KVBLK *kb, const KVP *kvp, const uint8_t *rp, KVKEY *okey) {
+  uint32_t klen, plen = 0;
+  int step;
+  const uint8_t *sp = rp;
+  IW_READVNUMBUF(rp, klen, step);
+  rp += step;
+  if (kb->db->dbflg & IWDB_PREFIX_KEYS) {
+    IW_READVNUMBUF(rp, plen, step);
+    rp += step;
+  }
+  if (klen < 1 || plen > klen || plen > kb->pfxlen) {
+    return 0;
+  }
+  uint32_t ksz = (rp - sp) + klen - plen;
+  if (ksz > kvp->len) {
+    return 0;
+  }
+  okey->pfx = kb->pfx;
+  okey->pfxlen = plen;
+  okey->sfx = rp;
+  okey->sfxlen = klen - plen;
+  return ksz;
+}
+
+IW_INLINE WUR iwrc _kvblk_peek_key(const KVBLK *kb, uint8_t idx, const uint8_t *mm, KVKEY *okey) {
+  const KVP *kvp = &kb->pidx[idx];
+  if (kvp->len) {
+    const uint8_t *rp = mm + kb->addr + (1ULL << kb->szpow) - kvp->off;
+    if (!_kvblk_kdecode(kb, kvp, rp, okey)) {
+      memset(okey, 0, sizeof(*okey));
       iwlog_ecode_error3(IWKV_ERROR_CORRUPTED);
       return IWKV_ERROR_CORRUPTED;
     }
-    rp += step;
-    *obuf = (uint8_t *) rp;
-    *olen = klen;
   } else {
-    *obuf = 0;
-    *olen = 0;
+    memset(okey, 0, sizeof(*okey));
   }
   return 0;
 }
 
 IW_INLINE void _kvblk_peek_val(const KVBLK *kb, uint8_t idx, const uint8_t *mm, uint8_t **obuf, uint32_t *olen) {
-  assert(idx < KVBLK_IDXNUM);
-  if (kb->pidx[idx].len) {
-    uint32_t klen, step;
-    const uint8_t *rp = mm + kb->addr + (1ULL << kb->szpow) - kb->pidx[idx].off;
-    IW_READVNUMBUF(rp, klen, step);
-    rp += step;
-    rp += klen;
-    *obuf = (uint8_t *) rp;
-    *olen = kb->pidx[idx].len - klen - step;
+  assert(idx < kb->db->idxnum);
+  const KVP *kvp = &kb->pidx[idx];
+  uint32_t ksz;
+  KVKEY key;
+  if (kvp->len) {
+    const uint8_t *rp = mm + kb->addr + (1ULL << kb->szpow) - kvp->off;
+    ksz = _kvblk_kdecode(kb, kvp, rp, &key);
+    assert(ksz);
+    *obuf = (uint8_t *) rp + ksz;
+    *olen = kvp->len - ksz;
   } else {
     *obuf = 0;
     *olen = 0;
   }
 }
 
+/**
+ * @brief Check if record at `idx` slot of `IWDB_TTL` database is expired at `ts` time.
+ */
+IW_INLINE bool _kvblk_expired(const KVBLK *kb, uint8_t idx, const uint8_t *mm, uint64_t ts) {
+  if (!(kb->db->dbflg & IWDB_TTL)) {
+    return false;
+  }
+  uint8_t *vbuf;
+  uint32_t vlen;
+  _kvblk_peek_val(kb, idx, mm, &vbuf, &vlen);
+  uint64_t expire = _kv_val_expire(vbuf, vlen);
+  return expire && expire <= ts;
+}
+
+static WUR iwrc _kvblk_visit(const KVBLK *kb, uint8_t idx, const uint8_t *mm, IWKV_VISITOR visitor, void *opaq) {
+  KVKEY k;
+  uint8_t *vbuf;
+  uint32_t vlen;
+  uint8_t kbuf[256];
+  iwrc rc = _kvblk_peek_key(kb, idx, mm, &k);
+  RCRET(rc);
+  _kvblk_peek_val(kb, idx, mm, &vbuf, &vlen);
+  IWKV_val key = {
+    .data = (void *) k.sfx,
+    .size = k.sfxlen
+  };
+  uint8_t *dbuf = 0;
+  if (kb->db->dbflg & IWDB_VENC_FLAGS) {
+    rc = _kv_val_decode(mm, (const uint8_t **) &vbuf, &vlen, &dbuf);
+    RCRET(rc);
+  }
+  IWKV_val val = {
+    .data = vlen ? vbuf : 0,
+    .size = vlen
+  };
+  if (k.pfxlen) { // Key is split in KVBLK, visitor needs a contiguous one
+    key.size = _kvkey_len(&k);
+    key.data = key.size > sizeof(kbuf) ? malloc(key.size) : kbuf;
+    if (!key.data) {
+      free(dbuf);
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    _kvkey_copy(&k, key.data, key.size);
+  }
+  rc = visitor(&key, &val, opaq);
+  if (key.data != k.sfx && key.data != kbuf) {
+    free(key.data);
+  }
+  free(dbuf);
+  return rc;
+}
+
 static WUR iwrc _kvblk_getkey(KVBLK *kb, uint8_t *mm, uint8_t idx, IWKV_val *key) {
-  assert(mm && idx < KVBLK_IDXNUM);
-  int32_t klen;
-  int step;
+  assert(mm && idx < kb->db->idxnum);
+  KVKEY k;
   KVP *kvp = &kb->pidx[idx];
   if (!kvp->len) {
     key->data = 0;
@@ -603,26 +1150,23 @@ static WUR iwrc _kvblk_getkey(KVBLK *kb, uint8_t *mm, uint8_t idx, IWKV_val *key
   }
   // [klen:vn,key,value]
   uint8_t *rp = mm + kb->addr + (1ULL << kb->szpow) - kvp->off;
-  IW_READVNUMBUF(rp, klen, step);
-  rp += step;
-  if (klen < 1 || klen > kvp->len || klen > kvp->off) {
+  if (!_kvblk_kdecode(kb, kvp, rp, &k) || kvp->len > kvp->off) {
     iwlog_ecode_error3(IWKV_ERROR_CORRUPTED);
     return IWKV_ERROR_CORRUPTED;
   }
-  key->size = klen;
+  key->size = _kvkey_len(&k);
   key->data = malloc(key->size);
   if (!key->data) {
     return iwrc_set_errno(IW_ERROR_ALLOC, errno);
   }
-  memcpy(key->data, rp, key->size);
-  rp += key->size;
+  _kvkey_copy(&k, key->data, key->size);
   return 0;
 }
 
 static WUR iwrc _kvblk_getvalue(KVBLK *kb, uint8_t *mm, uint8_t idx, IWKV_val *val) {
-  assert(mm && idx < KVBLK_IDXNUM);
-  int32_t klen;
-  int step;
+  assert(mm && idx < kb->db->idxnum);
+  KVKEY k;
+  uint32_t ksz;
   KVP *kvp = &kb->pidx[idx];
   if (!kvp->len) {
     val->data = 0;
@@ -631,15 +1175,29 @@ static WUR iwrc _kvblk_getvalue(KVBLK *kb, uint8_t *mm, uint8_t idx, IWKV_val *v
   }
   // [klen:vn,key,value]
   uint8_t *rp = mm + kb->addr + (1ULL << kb->szpow) - kvp->off;
-  IW_READVNUMBUF(rp, klen, step);
-  rp += step;
-  if (klen < 1 || klen > kvp->len || klen > kvp->off) {
+  ksz = _kvblk_kdecode(kb, kvp, rp, &k);
+  if (!ksz || kvp->len > kvp->off) {
     iwlog_ecode_error3(IWKV_ERROR_CORRUPTED);
     return IWKV_ERROR_CORRUPTED;
   }
-  rp += klen;
-  if (kvp->len > klen + step) {
-    val->size = kvp->len - klen - step;
+  rp += ksz;
+  uint32_t vlen = kvp->len - ksz;
+  if (kb->db->dbflg & IWDB_VENC_FLAGS) {
+    uint8_t *dbuf;
+    iwrc rc = _kv_val_decode(mm, (const uint8_t **) &rp, &vlen, &dbuf);
+    if (rc) {
+      val->data = 0;
+      val->size = 0;
+      return rc;
+    }
+    if (dbuf) { // Decompressed value
+      val->data = dbuf;
+      val->size = vlen;
+      return 0;
+    }
+  }
+  if (vlen) {
+    val->size = vlen;
     val->data = malloc(val->size);
     if (!val->data) {
       iwrc rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
@@ -655,10 +1213,14 @@ static WUR iwrc _kvblk_getvalue(KVBLK *kb, uint8_t *mm, uint8_t idx, IWKV_val *v
   return 0;
 }
 
+/**
+ * @brief Get key and value of KV pair as they are stored in `KVBLK`.
+ * @note Values of `IWDB_COMPRESS_VALS`|`IWDB_BLOB_VALS` databases are not decoded.
+ */
 static WUR iwrc _kvblk_getkv(KVBLK *kb, uint8_t *mm, uint8_t idx, IWKV_val *key, IWKV_val *val) {
-  assert(mm && idx < KVBLK_IDXNUM);
-  int32_t klen;
-  int step;
+  assert(mm && idx < kb->db->idxnum);
+  KVKEY k;
+  uint32_t ksz;
   KVP *kvp = &kb->pidx[idx];
   if (!kvp->len) {
     key->data = 0;
@@ -669,21 +1231,20 @@ static WUR iwrc _kvblk_getkv(KVBLK *kb, uint8_t *mm, uint8_t idx, IWKV_val *key,
   }
   // [klen:vn,key,value]
   uint8_t *rp = mm + kb->addr + (1ULL << kb->szpow) - kvp->off;
-  IW_READVNUMBUF(rp, klen, step);
-  rp += step;
-  if (klen < 1 || klen > kvp->len || klen > kvp->off) {
+  ksz = _kvblk_kdecode(kb, kvp, rp, &k);
+  if (!ksz || kvp->len > kvp->off) {
     iwlog_ecode_error3(IWKV_ERROR_CORRUPTED);
     return IWKV_ERROR_CORRUPTED;
   }
-  key->size = klen;
+  key->size = _kvkey_len(&k);
   key->data = malloc(key->size);
   if (!key->data) {
     return iwrc_set_errno(IW_ERROR_ALLOC, errno);
   }
-  memcpy(key->data, rp, key->size);
-  rp += klen;
-  if (kvp->len > klen + step) {
-    val->size = kvp->len - klen - step;
+  _kvkey_copy(&k, key->data, key->size);
+  rp += ksz;
+  if (kvp->len > ksz) {
+    val->size = kvp->len - ksz;
     val->data = malloc(val->size);
     if (!val->data) {
       iwrc rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
@@ -714,6 +1275,7 @@ static WUR iwrc _kvblk_at_mm(IWLCTX *lx, off_t addr, uint8_t *mm, KVBLK *kbp, KV
   kb->zidx = -1;
   kb->szpow = 0;
   kb->flags = 0;
+  kb->pfxlen = 0;
   memset(kb->pidx, 0, sizeof(kb->pidx));
   
   *blkp = 0;
@@ -721,12 +1283,12 @@ static WUR iwrc _kvblk_at_mm(IWLCTX *lx, off_t addr, uint8_t *mm, KVBLK *kbp, KV
   memcpy(&kb->szpow, rp, 1);
   rp += 1;
   IW_READSV(rp, sv, kb->idxsz);
-  if (IW_UNLIKELY(kb->idxsz > KVBLK_MAX_IDX_SZ)) {
+  if (IW_UNLIKELY(kb->idxsz > KVBLK_MAX_IDX_SZ(lx->db->idxnum) + ((lx->db->dbflg & IWDB_PREFIX_KEYS) ? KVBLK_MAX_PFXA_SZ : 0))) {
     rc = IWKV_ERROR_CORRUPTED;
     iwlog_ecode_error3(rc);
     goto finish;
   }
-  for (int i = 0; i < KVBLK_IDXNUM; ++i) {
+  for (int i = 0; i < lx->db->idxnum; ++i) {
     IW_READVNUMBUF64(rp, kb->pidx[i].off, step);
     rp += step;
     IW_READVNUMBUF(rp, kb->pidx[i].len, step);
@@ -745,6 +1307,19 @@ static WUR iwrc _kvblk_at_mm(IWLCTX *lx, off_t addr, uint8_t *mm, KVBLK *kbp, KV
     }
     kb->pidx[i].ridx = i;
   }
+  if (lx->db->dbflg & IWDB_PREFIX_KEYS) {
+    uint32_t pfxlen;
+    IW_READVNUMBUF(rp, pfxlen, step);
+    rp += step;
+    if (IW_UNLIKELY(pfxlen > KVBLK_MAX_PFX_SZ)) {
+      rc = IWKV_ERROR_CORRUPTED;
+      iwlog_ecode_error3(rc);
+      goto finish;
+    }
+    kb->pfxlen = pfxlen;
+    memcpy(kb->pfx, rp, pfxlen);
+    rp += pfxlen;
+  }
   *blkp = kb;
   assert(rp - (mm + addr) <= (1ULL << kb->szpow));
   if (!kbp) {
@@ -773,15 +1348,22 @@ IW_INLINE WUR iwrc _kvblk_at(IWLCTX *lx, SBLK *sblk, KVBLK **blkp) {
 
 IW_INLINE off_t _kvblk_compacted_offset(KVBLK *kb) {
   off_t coff = 0;
-  for (int i = 0; i < KVBLK_IDXNUM; ++i) {
+  for (int i = 0; i < kb->db->idxnum; ++i) {
     coff += kb->pidx[i].len;
   }
   return coff;
 }
 
+/**
+ * @brief Size of `[pfxlen:vn,pfx]` area of `IWDB_PREFIX_KEYS` KVBLK.
+ */
+IW_INLINE uint16_t _kvblk_pfxa_size(KVBLK *kb) {
+  return (kb->db->dbflg & IWDB_PREFIX_KEYS) ? IW_VNUMSIZE32(kb->pfxlen) + kb->pfxlen : 0;
+}
+
 IW_INLINE off_t _kvblk_compacted_dsize(KVBLK *kb) {
-  off_t coff = KVBLK_HDRSZ;
-  for (int i = 0; i < KVBLK_IDXNUM; ++i) {
+  off_t coff = KVBLK_HDRSZ + _kvblk_pfxa_size(kb);
+  for (int i = 0; i < kb->db->idxnum; ++i) {
     coff += kb->pidx[i].len;
     coff += IW_VNUMSIZE32(kb->pidx[i].len);
     coff += IW_VNUMSIZE(kb->pidx[i].off);
@@ -803,16 +1385,22 @@ static WUR iwrc _kvblk_sync_mm(KVBLK *kb, uint8_t *mm) {
   wp += 1;
   szp = wp;
   wp += sizeof(uint16_t);
-  for (int i = 0; i < KVBLK_IDXNUM; ++i) {
+  for (int i = 0; i < kb->db->idxnum; ++i) {
     KVP *kvp = &kb->pidx[i];
     IW_SETVNUMBUF64(sp, wp, kvp->off);
     wp += sp;
     IW_SETVNUMBUF(sp, wp, kvp->len);
     wp += sp;
   }
+  if (kb->db->dbflg & IWDB_PREFIX_KEYS) {
+    IW_SETVNUMBUF(sp, wp, kb->pfxlen);
+    wp += sp;
+    memcpy(wp, kb->pfx, kb->pfxlen);
+    wp += kb->pfxlen;
+  }
   sp = wp - szp - sizeof(uint16_t);
   kb->idxsz = sp;
-  assert(kb->idxsz <= KVBLK_MAX_IDX_SZ);
+  assert(kb->idxsz <= KVBLK_MAX_IDX_SZ(kb->db->idxnum) + KVBLK_MAX_PFXA_SZ);
   sp = IW_HTOIS(sp);
   memcpy(szp, &sp, sizeof(uint16_t));
   assert(wp - (mm + kb->addr) <= (1ULL << kb->szpow));
@@ -834,18 +1422,18 @@ static WUR iwrc _kvblk_compact_mm(KVBLK *kb, uint8_t *mm) {
   if (coff == kb->maxoff) { // already compacted
     return 0;
   }
-  KVP tidx[KVBLK_IDXNUM];
-  KVP tidx_tmp[KVBLK_IDXNUM];
+  KVP tidx[KVBLK_IDXNUM_MAX];
+  KVP tidx_tmp[KVBLK_IDXNUM_MAX];
   iwrc rc = 0;
   uint16_t idxsiz = 0;
   IWDLSNR *dlsnr = kb->db->iwkv->dlsnr;
   off_t blkend = kb->addr + (1ULL << kb->szpow);
   uint8_t *wp = mm + blkend;
   memcpy(tidx, kb->pidx, sizeof(tidx));
-  ks_mergesort_kvblk(KVBLK_IDXNUM, tidx, tidx_tmp);
+  ks_mergesort_kvblk(kb->db->idxnum, tidx, tidx_tmp);
   
   coff = 0;
-  for (i = 0; i < KVBLK_IDXNUM && tidx[i].off; ++i) {
+  for (i = 0; i < kb->db->idxnum && tidx[i].off; ++i) {
 #ifndef NDEBUG
     if (i > 0) {
       assert(tidx[i - 1].off < tidx[i].off);
@@ -857,7 +1445,7 @@ static WUR iwrc _kvblk_compact_mm(KVBLK *kb, uint8_t *mm) {
       assert(noff <= (1ULL << kb->szpow) && kvp->len <= noff);
       memmove(wp - noff, wp - kvp->off, kvp->len);
       if (dlsnr) {
-        rc = dlsnr->oncopy(dlsnr, blkend - kvp->off, kvp->len, blkend - noff, 0);
+        rc = dlsnr->onwrite(dlsnr, blkend - noff, wp - noff, kvp->len, 0);
       }
       kvp->off = noff;
     }
@@ -865,8 +1453,9 @@ static WUR iwrc _kvblk_compact_mm(KVBLK *kb, uint8_t *mm) {
     idxsiz += IW_VNUMSIZE(kvp->off);
     idxsiz += IW_VNUMSIZE32(kvp->len);
   }
-  idxsiz += (KVBLK_IDXNUM - i) * 2;
-  for (i = 0; i < KVBLK_IDXNUM; ++i) {
+  idxsiz += (kb->db->idxnum - i) * 2;
+  idxsiz += _kvblk_pfxa_size(kb);
+  for (i = 0; i < kb->db->idxnum; ++i) {
     if (!kb->pidx[i].len)  {
       kb->zidx = i;
       break;
@@ -875,7 +1464,7 @@ static WUR iwrc _kvblk_compact_mm(KVBLK *kb, uint8_t *mm) {
   assert(idxsiz <= kb->idxsz);
   kb->idxsz = idxsiz;
   kb->maxoff = coff;
-  if (i == KVBLK_IDXNUM) {
+  if (i == kb->db->idxnum) {
     kb->zidx = -1;
   }
   kb->flags |= KVBLK_DURTY;
@@ -885,7 +1474,7 @@ static WUR iwrc _kvblk_compact_mm(KVBLK *kb, uint8_t *mm) {
 
 IW_INLINE off_t _kvblk_maxkvoff(KVBLK *kb) {
   off_t off = 0;
-  for (int i = 0; i < KVBLK_IDXNUM; ++i) {
+  for (int i = 0; i < kb->db->idxnum; ++i) {
     if (kb->pidx[i].off > off) {
       off = kb->pidx[i].off;
     }
@@ -900,7 +1489,7 @@ static WUR iwrc _kvblk_rmkv(KVBLK *kb, uint8_t idx, kvblk_rmkv_opts_t opts) {
   IWFS_FSM *fsm = &kb->db->iwkv->fsm;
   if (kb->pidx[idx].off >= kb->maxoff) {
     kb->maxoff = 0;
-    for (int i = 0; i < KVBLK_IDXNUM; ++i) {
+    for (int i = 0; i < kb->db->idxnum; ++i) {
       if (i != idx && kb->pidx[i].off > kb->maxoff) {
         kb->maxoff = kb->pidx[i].off;
       }
@@ -931,7 +1520,8 @@ static WUR iwrc _kvblk_rmkv(KVBLK *kb, uint8_t idx, kvblk_rmkv_opts_t opts) {
               mm + kb->addr + nlen - maxoff,
               maxoff);
       if (dlsnr) {
-        rc = dlsnr->oncopy(dlsnr, kb->addr + nlen - maxoff, maxoff, kb->addr + (1ULL << npow) - maxoff, 0);
+        rc = dlsnr->onwrite(dlsnr, kb->addr + (1ULL << npow) - maxoff,
+                            mm + kb->addr + (1ULL << npow) - maxoff, maxoff, 0);
         RCGO(rc, finish);
       }
       fsm->release_mmap(fsm);
@@ -964,6 +1554,7 @@ static WUR iwrc _kvblk_addkv(KVBLK *kb,
                              const IWKV_val *val,
                              int8_t *oidx,
                              iwkv_opflags opflags,
+                             uint64_t expire,
                              bool internal) {
   iwrc rc = 0;
   off_t msz;    // max available free space
@@ -979,10 +1570,27 @@ static WUR iwrc _kvblk_addkv(KVBLK *kb,
   IWDLSNR *dlsnr = kb->db->iwkv->dlsnr;
   IWKV_val *uval = (IWKV_val *) val, sval;
   off_t psz = IW_VNUMSIZE(key->size) + key->size + uval->size; // required KVP size
+  uint32_t plen = 0; // number of first key bytes stored in block prefix
   
   if (kb->zidx < 0) {
     return _IWKV_ERROR_KVBLOCK_FULL;
   }
+  if (db->dbflg & IWDB_PREFIX_KEYS) {
+    for (i = 0; i < db->idxnum && !kb->pidx[i].len; ++i);
+    if (i == db->idxnum) { // Block prefix is taken from the first key of empty block
+      kb->idxsz -= _kvblk_pfxa_size(kb);
+      kb->pfxlen = MIN(key->size, KVBLK_MAX_PFX_SZ);
+      memcpy(kb->pfx, key->data, kb->pfxlen);
+      kb->idxsz += _kvblk_pfxa_size(kb);
+      kb->flags |= KVBLK_DURTY;
+    }
+    const uint8_t *kp = key->data;
+    while (plen < kb->pfxlen && plen < key->size && kp[plen] == kb->pfx[plen]) {
+      ++plen;
+    }
+    psz += IW_VNUMSIZE32(plen);
+    psz -= plen;
+  }
   // DUP
   if (!internal && (db->dbflg & IWDB_DUP_FLAGS)) {
     if (opflags & IWKV_DUP_REMOVE) {
@@ -1004,12 +1612,16 @@ static WUR iwrc _kvblk_addkv(KVBLK *kb,
     memcpy(wp, &lv, 4);
     memcpy(wp + 4, vbuf, val->size);
   }
+  if (!internal && (db->dbflg & IWDB_VENC_FLAGS)) {
+    rc = _kv_val_pack(db, val, expire, &sval);
+    RCRET(rc);
+    uval = &sval;
+    psz += (off_t) uval->size - (off_t) val->size;
+  }
   // !DUP
   if (psz > IWKV_MAX_KVSZ) {
-    if (uval != val) {
-      _kv_val_dispose(uval);
-    }
-    return IWKV_ERROR_MAXKVSZ;
+    rc = IWKV_ERROR_MAXKVSZ;
+    goto finish;
   }
   
 start:
@@ -1051,7 +1663,7 @@ start:
     memmove(mm + naddr + nlen - kb->maxoff,
             mm + naddr + (1ULL << kb->szpow) - kb->maxoff, kb->maxoff);
     if (dlsnr) {
-      rc = dlsnr->oncopy(dlsnr, naddr + (1ULL << kb->szpow) - kb->maxoff, kb->maxoff, naddr + nlen - kb->maxoff, 0);
+      rc = dlsnr->onwrite(dlsnr, naddr + nlen - kb->maxoff, mm + naddr + nlen - kb->maxoff, kb->maxoff, 0);
       RCGO(rc, finish);
     }
     fsm->release_mmap(fsm);
@@ -1064,13 +1676,13 @@ start:
   kvp->ridx = kb->zidx;
   kb->maxoff = noff;
   kb->flags |= KVBLK_DURTY;
-  for (i = 0; i < KVBLK_IDXNUM; ++i) {
+  for (i = 0; i < db->idxnum; ++i) {
     if (!kb->pidx[i].len && i != kb->zidx) {
       kb->zidx = i;
       break;
     }
   }
-  if (i >= KVBLK_IDXNUM) {
+  if (i >= db->idxnum) {
     kb->zidx = -1;
   }
   rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
@@ -1079,11 +1691,15 @@ start:
   assert(kvp->off < (1ULL << kb->szpow) && kvp->len <= kvp->off);
   wp = mm + kb->addr + (1ULL << kb->szpow) - kvp->off;
   sptr = wp;
-  // [klen:vn,key,value]
+  // [klen:vn,key,value] or [klen:vn,plen:vn,key suffix,value]
   IW_SETVNUMBUF(sp, wp, key->size);
   wp += sp;
-  memcpy(wp, key->data, key->size);
-  wp += key->size;
+  if (db->dbflg & IWDB_PREFIX_KEYS) {
+    IW_SETVNUMBUF(sp, wp, plen);
+    wp += sp;
+  }
+  memcpy(wp, (uint8_t *) key->data + plen, key->size - plen);
+  wp += key->size - plen;
   memcpy(wp, uval->data, uval->size);
   wp += uval->size;
 #ifndef NDEBUG
@@ -1096,6 +1712,9 @@ start:
   
 finish:
   if (uval != val) {
+    if (rc && (db->dbflg & IWDB_BLOB_VALS)) {
+      _kv_val_blob_free(db, uval->data, uval->size);
+    }
     _kv_val_dispose(uval);
   }
   return rc;
@@ -1106,8 +1725,9 @@ static WUR iwrc _kvblk_updatev(KVBLK *kb,
                                const IWKV_val *key, /* Nullable */
                                const IWKV_val *val,
                                iwkv_opflags opflags,
+                               uint64_t expire,
                                bool internal) {
-  assert(*idxp < KVBLK_IDXNUM);
+  assert(*idxp < kb->db->idxnum);
   int32_t i;
   uint32_t len, nlen, sz;
   IWDB db = kb->db;
@@ -1121,9 +1741,18 @@ static WUR iwrc _kvblk_updatev(KVBLK *kb,
   size_t kbsz = 1ULL << kb->szpow; // kvblk size
   off_t freesz = kbsz - KVBLK_HDRSZ - kb->idxsz - kb->maxoff; // free space available
   IWFS_FSM *fsm = &db->iwkv->fsm;
+  blkn_t oblkn = 0; // blob of the old value
+  uint32_t oblen = 0;
+  iwrc rc = 0;
   
-  iwrc rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
-  RCRET(rc);
+  if (!internal && (db->dbflg & IWDB_VENC_FLAGS)) {
+    // Value blob must be allocated before mmap is acquired
+    rc = _kv_val_pack(db, val, expire, &sval);
+    RCRET(rc);
+    uval = &sval;
+  }
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCGO(rc, finish);
   assert(freesz >= 0);
   
   // DUP
@@ -1210,15 +1839,18 @@ static WUR iwrc _kvblk_updatev(KVBLK *kb,
   // !DUP
   wp = mm + kb->addr + kbsz - kvp->off;
   sp = wp;
-  IW_READVNUMBUF(wp, len, sz);
-  wp += sz;
-  if (ukey && len != ukey->size) {
+  KVKEY k;
+  sz = _kvblk_kdecode(kb, kvp, wp, &k);
+  if (!sz || (ukey && _kvkey_len(&k) != ukey->size)) {
     rc = IWKV_ERROR_CORRUPTED;
     iwlog_ecode_error3(rc);
     goto finish;
   }
-  wp += len;
-  off_t rsize = sz + len + uval->size; // required size
+  if (!internal && (db->dbflg & IWDB_BLOB_VALS)) {
+    _kv_val_blob(wp + sz, kvp->len - sz, &oblkn, &oblen);
+  }
+  wp += sz;
+  off_t rsize = sz + uval->size; // required size
   if (rsize <= kvp->len) {
     memcpy(wp, uval->data, uval->size);
     if (dlsnr) {
@@ -1231,18 +1863,18 @@ static WUR iwrc _kvblk_updatev(KVBLK *kb,
       kb->flags |= KVBLK_DURTY;
     }
   } else {
-    KVP tidx[KVBLK_IDXNUM];
-    KVP tidx_tmp[KVBLK_IDXNUM];
+    KVP tidx[KVBLK_IDXNUM_MAX];
+    KVP tidx_tmp[KVBLK_IDXNUM_MAX];
     off_t koff = kb->pidx[idx].off;
-    memcpy(tidx, kb->pidx, KVBLK_IDXNUM * sizeof(kb->pidx[0]));
-    ks_mergesort_kvblk(KVBLK_IDXNUM, tidx, tidx_tmp);
+    memcpy(tidx, kb->pidx, db->idxnum * sizeof(kb->pidx[0]));
+    ks_mergesort_kvblk(db->idxnum, tidx, tidx_tmp);
     kb->flags |= KVBLK_DURTY;
     if (!ukey) { // we need a key
       ukey = &skey;
       rc = _kvblk_getkey(kb, mm, idx, ukey);
       RCGO(rc, finish);
     }
-    for (i = 0; i < KVBLK_IDXNUM; ++i) {
+    for (i = 0; i < db->idxnum; ++i) {
       if (tidx[i].off == koff) {
         if (koff - (i > 0 ? tidx[i - 1].off : 0) >= rsize) {
           uint32_t nlen = wp + uval->size - sp;
@@ -1261,22 +1893,28 @@ static WUR iwrc _kvblk_updatev(KVBLK *kb,
         fsm->release_mmap(fsm);
         rc = _kvblk_rmkv(kb, idx, RMKV_NO_RESIZE);
         RCGO(rc, finish);
-        rc = _kvblk_addkv(kb, ukey, uval, idxp, opflags, true);
+        rc = _kvblk_addkv(kb, ukey, uval, idxp, opflags, 0, true);
         break;
       }
     }
   }
   
 finish:
+  if (mm) {
+    IWRC(fsm->release_mmap(fsm), rc);
+  }
+  if (!rc && oblkn) {
+    _kv_blob_free(db, oblkn, oblen);
+  }
   if (uval != val) {
+    if (rc && (db->dbflg & IWDB_BLOB_VALS)) {
+      _kv_val_blob_free(db, uval->data, uval->size);
+    }
     _kv_val_dispose(uval);
   }
   if (ukey != key) {
     _kv_val_dispose(ukey);
   }
-  if (mm) {
-    IWRC(fsm->release_mmap(fsm), rc);
-  }
   return rc;
 }
 
@@ -1336,6 +1974,7 @@ IW_INLINE WUR iwrc _sblk_destroy(IWLCTX *lx, SBLK **sblkp) {
       lx->db->lcnt[sblk->lvl]--;
       lx->db->flags |= SBLK_DURTY;
     }
+    ++lx->db->rmcnt;
     if (sblk->flags & SBLK_CACHE_REMOVE) {
       _dbcache_remove_lw(lx, sblk);
     }
@@ -1429,7 +2068,7 @@ static WUR iwrc _sblk_at2(IWLCTX *lx, off_t addr, sblk_flags_t flgs, SBLK *sblk)
     sblk->p0 = 0;
     sblk->kvblkn = 0;
     sblk->lkl = 0;
-    sblk->pnum = KVBLK_IDXNUM;
+    sblk->pnum = lx->db->idxnum;
     memset(sblk->pi, 0, sizeof(sblk->pi));
     for (int i = 0; i < SLEVELS; ++i) {
       IW_READLV(rp, lv, sblk->n[i]);
@@ -1458,7 +2097,7 @@ static WUR iwrc _sblk_at2(IWLCTX *lx, off_t addr, sblk_flags_t flgs, SBLK *sblk)
       goto finish;
     }
     memcpy(&sblk->lkl, rp++, 1);
-    if (sblk->lkl > SBLK_LKLEN) {
+    if (sblk->lkl > lx->db->lklen) {
       rc = IWKV_ERROR_CORRUPTED;
       iwlog_ecode_error3(rc);
       goto finish;
@@ -1483,6 +2122,10 @@ static WUR iwrc _sblk_at2(IWLCTX *lx, off_t addr, sblk_flags_t flgs, SBLK *sblk)
       rp += 4;
     }
     rp = mm + addr + SOFF_LK;
+    if (lx->db->idxnum > KVBLK_IDXNUM) {
+      memcpy(sblk->pi + KVBLK_IDXNUM, rp, lx->db->idxnum - KVBLK_IDXNUM);
+      rp += lx->db->idxnum - KVBLK_IDXNUM;
+    }
     memcpy(sblk->lk, rp, sblk->lkl);
   } else { // Database tail
     uint8_t *rp = mm + lx->db->addr + DOFF_P0_U4;
@@ -1491,7 +2134,7 @@ static WUR iwrc _sblk_at2(IWLCTX *lx, off_t addr, sblk_flags_t flgs, SBLK *sblk)
     sblk->lvl = 0;
     sblk->kvblkn = 0;
     sblk->lkl = 0;
-    sblk->pnum = KVBLK_IDXNUM;
+    sblk->pnum = lx->db->idxnum;
     memset(sblk->pi, 0, sizeof(sblk->pi));
     IW_READLV(rp, lv, sblk->p0);
     if (!sblk->p0) {
@@ -1547,7 +2190,7 @@ static WUR iwrc _sblk_sync_mm(IWLCTX *lx, SBLK *sblk, uint8_t *mm) {
     } else {
       uint8_t *wp = mm + sblk->addr;
       sblk_flags_t flags = (sblk->flags & SBLK_PERSISTENT_FLAGS);
-      assert(sblk->lkl <= SBLK_LKLEN);
+      assert(sblk->lkl <= lx->db->lklen);
       // [u1:flags,lvl:u1,lkl:u1,pnum:u1,p0:u4,kblk:u4,[pi0:u1,... pi32],n0-n23:u4,lk:u116]:u256
       wp += SOFF_FLAGS_U1;
       memcpy(wp++, &flags, 1);
@@ -1563,6 +2206,10 @@ static WUR iwrc _sblk_sync_mm(IWLCTX *lx, SBLK *sblk, uint8_t *mm) {
         IW_WRITELV(wp, lv, sblk->n[i]);
       }
       wp = mm + sblk->addr + SOFF_LK;
+      if (lx->db->idxnum > KVBLK_IDXNUM) {
+        memcpy(wp, sblk->pi + KVBLK_IDXNUM, lx->db->idxnum - KVBLK_IDXNUM);
+        wp += lx->db->idxnum - KVBLK_IDXNUM;
+      }
       memcpy(wp, sblk->lk, sblk->lkl);
       wp += sblk->lkl;
       if (dlsnr) {
@@ -1610,12 +2257,13 @@ IW_INLINE WUR iwrc _sblk_sync_and_release(IWLCTX *lx, SBLK **sblkp) {
 static WUR iwrc _sblk_find_pi_mm(SBLK *sblk, const IWKV_val *key, const uint8_t *mm, bool *found, uint8_t *idxp) {
   *found = false;
   if (sblk->flags & SBLK_DB) {
-    *idxp = KVBLK_IDXNUM;
+    *idxp = sblk->db->idxnum;
     return 0;
   }
-  const uint8_t *k;
-  uint32_t kl;
-  iwdb_flags_t dbflg = sblk->db->dbflg;
+  KVKEY k, skey = {
+    .sfx = key->data,
+    .sfxlen = key->size
+  };
   int idx = 0,
       lb = 0,
       ub = sblk->pnum - 1;
@@ -1625,9 +2273,9 @@ static WUR iwrc _sblk_find_pi_mm(SBLK *sblk, const IWKV_val *key, const uint8_t
   }
   while (1) {
     idx = (ub + lb) / 2;
-    iwrc rc = _kvblk_peek_key(sblk->kvblk, sblk->pi[idx], mm, &k, &kl);
+    iwrc rc = _kvblk_peek_key(sblk->kvblk, sblk->pi[idx], mm, &k);
     RCRET(rc);
-    int cr = _cmp_key(dbflg, k, kl, key->data, key->size);
+    int cr = _cmp_kvkey(sblk->db, &k, &skey);
     if (!cr) {
       *found = true;
       break;
@@ -1651,9 +2299,10 @@ static WUR iwrc _sblk_find_pi_mm(SBLK *sblk, const IWKV_val *key, const uint8_t
 static WUR iwrc _sblk_insert_pi_mm(SBLK *sblk, uint8_t nidx, const IWKV_val *key,
                                    const uint8_t *mm, uint8_t *idxp) {
   assert(sblk->kvblk);
-  const uint8_t *k;
-  uint32_t kl;
-  iwdb_flags_t dbflg = sblk->db->dbflg;
+  KVKEY k, skey = {
+    .sfx = key->data,
+    .sfxlen = key->size
+  };
   int idx = 0,
       lb = 0,
       ub = sblk->pnum - 1,
@@ -1666,9 +2315,9 @@ static WUR iwrc _sblk_insert_pi_mm(SBLK *sblk, uint8_t nidx, const IWKV_val *key
   }
   while (1) {
     idx = (ub + lb) / 2;
-    iwrc rc = _kvblk_peek_key(sblk->kvblk, sblk->pi[idx], mm, &k, &kl);
+    iwrc rc = _kvblk_peek_key(sblk->kvblk, sblk->pi[idx], mm, &k);
     RCRET(rc);
-    int cr = _cmp_key(dbflg, k, kl, key->data, key->size);
+    int cr = _cmp_kvkey(sblk->db, &k, &skey);
     if (!cr) {
       break;
     } else if (cr < 0) {
@@ -1695,18 +2344,18 @@ static WUR iwrc _sblk_insert_pi_mm(SBLK *sblk, uint8_t nidx, const IWKV_val *key
 }
 
 IW_INLINE WUR iwrc _sblk_addkv2(SBLK *sblk, int8_t idx, const IWKV_val *key, const IWKV_val *val,
-                                iwkv_opflags opflags, bool internal) {
+                                iwkv_opflags opflags, uint64_t expire, bool internal) {
   assert(sblk && key && key->size && key->data &&
          val && idx >= 0 && sblk->kvblk);
   int8_t kvidx;
   KVBLK *kvblk = sblk->kvblk;
-  if (sblk->pnum >= KVBLK_IDXNUM) {
+  if (sblk->pnum >= sblk->db->idxnum) {
     return _IWKV_ERROR_KVBLOCK_FULL;
   }
   if (!internal && (opflags & IWKV_DUP_REMOVE)) {
     return IWKV_ERROR_NOTFOUND;
   }
-  iwrc rc = _kvblk_addkv(kvblk, key, val, &kvidx, opflags, internal);
+  iwrc rc = _kvblk_addkv(kvblk, key, val, &kvidx, opflags, expire, internal);
   RCRET(rc);
   if (sblk->pnum - idx > 0) {
     memmove(sblk->pi + idx + 1, sblk->pi + idx, sblk->pnum - idx);
@@ -1721,9 +2370,9 @@ IW_INLINE WUR iwrc _sblk_addkv2(SBLK *sblk, int8_t idx, const IWKV_val *key, con
   ++sblk->pnum;
   sblk->flags |= SBLK_DURTY;
   if (idx == 0) { // the lowest key inserted
-    sblk->lkl = MIN(SBLK_LKLEN, key->size);
+    sblk->lkl = MIN(sblk->db->lklen, key->size);
     memcpy(sblk->lk, key->data, sblk->lkl);
-    if (key->size <= SBLK_LKLEN) {
+    if (key->size <= sblk->db->lklen) {
       sblk->flags |= SBLK_FULL_LKEY;
     } else {
       sblk->flags &= ~SBLK_FULL_LKEY;
@@ -1736,28 +2385,28 @@ IW_INLINE WUR iwrc _sblk_addkv2(SBLK *sblk, int8_t idx, const IWKV_val *key, con
 }
 
 static WUR iwrc _sblk_addkv(SBLK *sblk, const IWKV_val *key, const IWKV_val *val,
-                            iwkv_opflags opflags, bool internal) {
+                            iwkv_opflags opflags, uint64_t expire, bool internal) {
   assert(sblk && key && key->size && key->data && val && sblk->kvblk);
   int8_t kvidx;
   uint8_t *mm, idx;
   KVBLK *kvblk = sblk->kvblk;
   IWFS_FSM *fsm = &sblk->db->iwkv->fsm;
-  if (sblk->pnum >= KVBLK_IDXNUM) {
+  if (sblk->pnum >= sblk->db->idxnum) {
     return _IWKV_ERROR_KVBLOCK_FULL;
   }
   if (!internal && (opflags & IWKV_DUP_REMOVE)) {
     return IWKV_ERROR_NOTFOUND;
   }
-  iwrc rc = _kvblk_addkv(kvblk, key, val, &kvidx, opflags, internal);
+  iwrc rc = _kvblk_addkv(kvblk, key, val, &kvidx, opflags, expire, internal);
   RCRET(rc);
   rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
   RCRET(rc);
   rc = _sblk_insert_pi_mm(sblk, kvidx, key, mm, &idx);
   RCRET(rc);
   if (idx == 0) { // the lowest key inserted
-    sblk->lkl = MIN(SBLK_LKLEN, key->size);
+    sblk->lkl = MIN(sblk->db->lklen, key->size);
     memcpy(sblk->lk, key->data, sblk->lkl);
-    if (key->size <= SBLK_LKLEN) {
+    if (key->size <= sblk->db->lklen) {
       sblk->flags |= SBLK_FULL_LKEY;
     } else {
       sblk->flags &= ~SBLK_FULL_LKEY;
@@ -1779,11 +2428,11 @@ static WUR iwrc _sblk_addkv(SBLK *sblk, const IWKV_val *key, const IWKV_val *val
 
 IW_INLINE WUR iwrc _sblk_updatekv(SBLK *sblk, int8_t idx,
                                   const IWKV_val *key, const IWKV_val *val,
-                                  iwkv_opflags opflags) {
+                                  iwkv_opflags opflags, uint64_t expire) {
   assert(sblk && sblk->kvblk && idx >= 0 && idx < sblk->pnum);
   KVBLK *kvblk = sblk->kvblk;
   int8_t kvidx = sblk->pi[idx];
-  iwrc rc = _kvblk_updatev(kvblk, &kvidx, key, val, opflags, false);
+  iwrc rc = _kvblk_updatev(kvblk, &kvidx, key, val, opflags, expire, false);
   RCRET(rc);
   if (sblk->kvblkn != ADDR2BLK(kvblk->addr)) {
     sblk->kvblkn = ADDR2BLK(kvblk->addr);
@@ -1800,9 +2449,24 @@ IW_INLINE WUR iwrc _sblk_rmkv(SBLK *sblk, uint8_t idx) {
   assert(sblk && sblk->kvblk);
   KVBLK *kvblk = sblk->kvblk;
   IWFS_FSM *fsm = &sblk->db->iwkv->fsm;
-  assert(kvblk && idx < sblk->pnum && sblk->pi[idx] < KVBLK_IDXNUM);
-  iwrc rc = _kvblk_rmkv(kvblk, sblk->pi[idx], 0);
+  assert(kvblk && idx < sblk->pnum && sblk->pi[idx] < sblk->db->idxnum);
+  iwrc rc;
+  blkn_t bblkn = 0; // value blob
+  uint32_t bblen = 0;
+  if (sblk->db->dbflg & IWDB_BLOB_VALS) {
+    uint8_t *mm, *vbuf;
+    uint32_t vlen;
+    rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+    RCRET(rc);
+    _kvblk_peek_val(kvblk, sblk->pi[idx], mm, &vbuf, &vlen);
+    _kv_val_blob(vbuf, vlen, &bblkn, &bblen);
+    fsm->release_mmap(fsm);
+  }
+  rc = _kvblk_rmkv(kvblk, sblk->pi[idx], 0);
   RCRET(rc);
+  if (bblkn) {
+    _kv_blob_free(sblk->db, bblkn, bblen);
+  }
   if (sblk->kvblkn != ADDR2BLK(kvblk->addr)) {
     sblk->kvblkn = ADDR2BLK(kvblk->addr);
     if (!(sblk->flags & SBLK_CACHE_FLAGS)) {
@@ -1820,13 +2484,13 @@ IW_INLINE WUR iwrc _sblk_rmkv(SBLK *sblk, uint8_t idx) {
     RCRET(rc);
     // Replace key with the next one or reset
     if (sblk->pnum > 0) {
-      const uint8_t *kbuf;
-      uint32_t klen;
-      rc = _kvblk_peek_key(sblk->kvblk, sblk->pi[idx], mm, &kbuf, &klen);
+      KVKEY k;
+      rc = _kvblk_peek_key(sblk->kvblk, sblk->pi[idx], mm, &k);
       RCRET(rc);
-      sblk->lkl = MIN(SBLK_LKLEN, klen);
-      memcpy(sblk->lk, kbuf, sblk->lkl);
-      if (klen <= SBLK_LKLEN) {
+      uint32_t klen = _kvkey_len(&k);
+      sblk->lkl = MIN(sblk->db->lklen, klen);
+      _kvkey_copy(&k, sblk->lk, sblk->lkl);
+      if (klen <= sblk->db->lklen) {
         sblk->flags |= SBLK_FULL_LKEY;
       } else {
         sblk->flags &= ~SBLK_FULL_LKEY;
@@ -1846,19 +2510,21 @@ IW_INLINE WUR iwrc _sblk_rmkv(SBLK *sblk, uint8_t idx) {
 //--------------------------  IWLCTX
 
 IW_INLINE WUR iwrc _lx_sblk_cmp_key(IWLCTX *lx, SBLK *sblk, int *res) {
-  iwdb_flags_t dbflg = sblk->db->dbflg;
+  IWDB db = sblk->db;
   const IWKV_val *key = lx->key;
   if (IW_UNLIKELY(sblk->pnum < 1 || (sblk->flags & SBLK_DB))) { // empty block
     *res = 0;
     iwlog_ecode_error3(IWKV_ERROR_CORRUPTED);
     return IWKV_ERROR_CORRUPTED;
-  } else if ((sblk->flags & SBLK_FULL_LKEY) || key->size < sblk->lkl) {
-    *res = _cmp_key(dbflg, sblk->lk, sblk->lkl, key->data, key->size);
+  } else if ((sblk->flags & SBLK_FULL_LKEY) || (key->size < sblk->lkl && !db->cmp)) {
+    *res = _cmp_key(db, sblk->lk, sblk->lkl, key->data, key->size);
   } else {
-    *res = _cmp_key2(dbflg, sblk->lk, sblk->lkl, key->data, key->size);
+    *res = _cmp_key2(db, sblk->lk, sblk->lkl, key->data, key->size);
     if (*res == 0) {
-      uint32_t kl;
-      const uint8_t *k;
+      KVKEY k, skey = {
+        .sfx = key->data,
+        .sfxlen = key->size
+      };
       uint8_t *mm;
       IWFS_FSM *fsm = &lx->db->iwkv->fsm;
       iwrc rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
@@ -1874,10 +2540,12 @@ IW_INLINE WUR iwrc _lx_sblk_cmp_key(IWLCTX *lx, SBLK *sblk, int *res) {
           return rc;
         }
       }
-      rc = _kvblk_peek_key(sblk->kvblk, sblk->pi[0], mm, &k, &kl);
-      RCRET(rc);
-      *res = _cmp_key(dbflg, k, kl, key->data, key->size);
+      rc = _kvblk_peek_key(sblk->kvblk, sblk->pi[0], mm, &k);
+      if (!rc) {
+        *res = _cmp_kvkey(db, &k, &skey);
+      }
       fsm->release_mmap(fsm);
+      RCRET(rc);
     }
   }
   return 0;
@@ -1940,6 +2608,7 @@ static WUR iwrc _lx_find_bounds(IWLCTX *lx) {
     lx->dblk.flags |= SBLK_DURTY;
   }
   lvl = lx->lower->lvl;
+  lx->flvl = lvl;
   while (lvl > -1) {
     rc = _lx_roll_forward(lx, lvl);
     RCRET(rc);
@@ -1949,6 +2618,8 @@ static WUR iwrc _lx_find_bounds(IWLCTX *lx) {
       blkn = 0;
     }
     do {
+      lx->flower[lvl] = lx->lower->addr;
+      lx->fupper[lvl] = lx->upper ? lx->upper->addr : 0;
       if (lx->nlvl >= lvl) {
         lx->plower[lvl] = lx->lower;
         lx->pupper[lvl] = lx->upper;
@@ -1958,10 +2629,73 @@ static WUR iwrc _lx_find_bounds(IWLCTX *lx) {
   return 0;
 }
 
-static iwrc _lx_release_mm(IWLCTX *lx, uint8_t *mm) {
-  iwrc rc = 0;
-  if (lx->nlvl > -1) {
-    SBLK *lsb = 0, *usb = 0;
+/**
+ * @brief Revalidate the `lower` node found by optimistic lookup
+ *        performed under database read lock.
+ *
+ * `lower` is replaced by its fresh copy if it was not removed in between
+ * and its lowest key is not greater than the search key,
+ * otherwise it is reset and `_lx_find_bounds()` will start from scratch.
+ */
+static WUR iwrc _lx_revalidate_lower_lw(IWLCTX *lx) {
+  if (lx->lower) {
+    int cret;
+    SBLK *lower;
+    off_t addr = lx->lower->addr;
+    bool dblk = (lx->lower->flags & SBLK_DB);
+    lx->lower = 0;
+    lx->upper = 0;
+    lx->dblk.addr = 0;
+    if (!dblk && lx->rmcnt == lx->db->rmcnt) {
+      iwrc rc = _sblk_at(lx, addr, 0, &lower);
+      RCRET(rc);
+      rc = _lx_sblk_cmp_key(lx, lower, &cret);
+      RCRET(rc);
+      if (cret <= 0) { // lower <= key
+        lx->lower = lower;
+      } else {
+        _sblk_release(lx, &lower);
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Find the lower node to start lookup of `lx->key` using finger
+ *        recorded by the previous lookup of a smaller or equal key.
+ *
+ * Lookup is started from the finger lower node on the lowest level
+ * whose upper node is greater than the key.
+ * Finger nodes must not be removed since they were recorded.
+ */
+static WUR iwrc _lx_finger_lower(IWLCTX *lx) {
+  int cret;
+  SBLK *sblk;
+  lx->lower = 0;
+  for (int lvl = 0; lvl <= lx->flvl; ++lvl) {
+    if (lx->fupper[lvl]) {
+      iwrc rc = _sblk_at(lx, lx->fupper[lvl], 0, &sblk);
+      RCRET(rc);
+      rc = _lx_sblk_cmp_key(lx, sblk, &cret);
+      _sblk_release(lx, &sblk);
+      RCRET(rc);
+      if (cret <= 0) { // upper <= key
+        continue;
+      }
+    }
+    if (lx->flower[lvl] != lx->db->addr) {
+      return _sblk_at(lx, lx->flower[lvl], 0, &lx->lower);
+    }
+    break;
+  }
+  return 0;
+}
+
+static iwrc _lx_release_mm(IWLCTX *lx, uint8_t *mm) {
+  iwrc rc = 0;
+  if (lx->nlvl > -1) {
+    SBLK *lsb = 0, *usb = 0;
     if (lx->nb) {
       rc = _sblk_sync_mm(lx, lx->nb, mm);
       RCRET(rc);
@@ -2031,7 +2765,7 @@ static iwrc _lx_split_addkv(IWLCTX *lx, int idx, SBLK *sblk) {
   SBLK *nb;
   blkn_t nblk;
   uint8_t kvbpow = 0;
-  register int pivot = (KVBLK_IDXNUM / 2) + 1; // 32
+  register int pivot = (lx->db->idxnum / 2) + 1;
   if (idx < sblk->pnum) {
     assert(sblk->kvblk);
     // Partial split required
@@ -2043,7 +2777,10 @@ static iwrc _lx_split_addkv(IWLCTX *lx, int idx, SBLK *sblk) {
     if (idx > pivot) {
       sz += IW_VNUMSIZE(lx->key->size) + lx->key->size + lx->val->size;
     }
-    sz += KVBLK_MAX_NKV_SZ;
+    sz += KVBLK_MAX_NKV_SZ(lx->db->idxnum);
+    if (lx->db->dbflg & IWDB_PREFIX_KEYS) {
+      sz += KVBLK_MAX_PFXA_SZ;
+    }
     kvbpow = iwlog2_64(sz);
     while ((1ULL << kvbpow) < sz) {
       kvbpow++;
@@ -2053,7 +2790,7 @@ static iwrc _lx_split_addkv(IWLCTX *lx, int idx, SBLK *sblk) {
   RCRET(rc);
   nblk = ADDR2BLK(nb->addr);
   if (idx == sblk->pnum) { // Upper side
-    rc = _sblk_addkv(nb, lx->key, lx->val, lx->opflags, false);
+    rc = _sblk_addkv(nb, lx->key, lx->val, lx->opflags, lx->expire, false);
     RCGO(rc, finish);
   } else { // New key is somewere in a middle of sblk->kvblk
     assert(sblk->kvblk);
@@ -2070,7 +2807,7 @@ static iwrc _lx_split_addkv(IWLCTX *lx, int idx, SBLK *sblk) {
       assert(key.size);
       fsm->release_mmap(fsm);
       RCBREAK(rc);
-      rc = _sblk_addkv2(nb, i - pivot, &key, &val, lx->opflags, true);
+      rc = _sblk_addkv2(nb, i - pivot, &key, &val, lx->opflags, 0, true);
       _kv_dispose(&key, &val);
       RCBREAK(rc);
       sblk->kvblk->pidx[sblk->pi[i]].len = 0;
@@ -2080,15 +2817,15 @@ static iwrc _lx_split_addkv(IWLCTX *lx, int idx, SBLK *sblk) {
     sblk->kvblk->flags |= KVBLK_DURTY;
     sblk->kvblk->zidx = sblk->pi[pivot];
     sblk->kvblk->maxoff = 0;
-    for (int i = 0; i < KVBLK_IDXNUM; ++i) {
+    for (int i = 0; i < lx->db->idxnum; ++i) {
       if (sblk->kvblk->pidx[i].off > sblk->kvblk->maxoff) {
         sblk->kvblk->maxoff = sblk->kvblk->pidx[i].off;
       }
     }
     if (idx > pivot) {
-      rc = _sblk_addkv(nb, lx->key, lx->val, lx->opflags, false);
+      rc = _sblk_addkv(nb, lx->key, lx->val, lx->opflags, lx->expire, false);
     } else {
-      rc = _sblk_addkv(sblk, lx->key, lx->val, lx->opflags, false);
+      rc = _sblk_addkv(sblk, lx->key, lx->val, lx->opflags, lx->expire, false);
     }
     RCGO(rc, finish);
   }
@@ -2128,6 +2865,21 @@ IW_INLINE iwrc _lx_init_chute(IWLCTX *lx) {
   return 0;
 }
 
+static WUR iwrc _lx_ph_mm(IWLCTX *lx, SBLK *sblk, bool found, uint8_t idx, uint8_t *mm) {
+  iwrc rc;
+  IWKV_val oval = {0};
+  lx->phdone = true;
+  if (found && !_kvblk_expired(sblk->kvblk, sblk->pi[idx], mm, lx->ts)) {
+    rc = _kvblk_getvalue(sblk->kvblk, mm, sblk->pi[idx], &oval);
+    RCRET(rc);
+    rc = lx->ph(lx, &oval);
+    _kv_val_dispose(&oval);
+  } else {
+    rc = lx->ph(lx, 0);
+  }
+  return rc;
+}
+
 WUR iwrc _lx_addkv(IWLCTX *lx) {
   iwrc rc;
   bool found, uadd;
@@ -2147,13 +2899,22 @@ WUR iwrc _lx_addkv(IWLCTX *lx) {
   }
   rc = _sblk_find_pi_mm(sblk, lx->key, mm, &found, &idx);
   RCRET(rc);
-  if (found && (lx->opflags & IWKV_NO_OVERWRITE)) {
+  if (found && (lx->opflags & IWKV_NO_OVERWRITE)
+      && !_kvblk_expired(sblk->kvblk, sblk->pi[idx], mm, lx->ts)) {
     fsm->release_mmap(fsm);
     return IWKV_ERROR_KEY_EXISTS;
   }
+  if (lx->ph && !lx->phdone) {
+    // Called once: on `_IWKV_ERROR_REQUIRE_NLEVEL` retry record is the same since db is write locked
+    rc = _lx_ph_mm(lx, sblk, found, idx, mm);
+    if (rc) {
+      fsm->release_mmap(fsm);
+      return rc;
+    }
+  }
   uadd = (!found &&
-          sblk->pnum > KVBLK_IDXNUM - 1 && idx > KVBLK_IDXNUM - 1 &&
-          lx->upper && lx->upper->pnum < KVBLK_IDXNUM);
+          sblk->pnum > lx->db->idxnum - 1 && idx > lx->db->idxnum - 1 &&
+          lx->upper && lx->upper->pnum < lx->db->idxnum);
   if (uadd) {
     rc = _sblk_loadkvblk_mm(lx, lx->upper, mm);
     if (rc) {
@@ -2162,21 +2923,21 @@ WUR iwrc _lx_addkv(IWLCTX *lx) {
     }
   }
   fsm->release_mmap(fsm);
-  if (!found && sblk->pnum > KVBLK_IDXNUM - 1) {
+  if (!found && sblk->pnum > lx->db->idxnum - 1) {
     if (uadd) {
-      return _sblk_addkv(lx->upper, lx->key, lx->val, lx->opflags, false);
+      return _sblk_addkv(lx->upper, lx->key, lx->val, lx->opflags, lx->expire, false);
     }
     if (lx->nlvl < 0) {
       return _IWKV_ERROR_REQUIRE_NLEVEL;
     }
   }
-  if (!found && sblk->pnum >= KVBLK_IDXNUM) {
+  if (!found && sblk->pnum >= lx->db->idxnum) {
     return _lx_split_addkv(lx, idx, sblk);
   } else {
     if (!found) {
-      return _sblk_addkv2(sblk, idx, lx->key, lx->val, lx->opflags, false);
+      return _sblk_addkv2(sblk, idx, lx->key, lx->val, lx->opflags, lx->expire, false);
     } else {
-      return _sblk_updatekv(sblk, idx, lx->key, lx->val, lx->opflags);
+      return _sblk_updatekv(sblk, idx, lx->key, lx->val, lx->opflags, lx->expire);
     }
   }
 }
@@ -2207,24 +2968,32 @@ start:
     _lx_release_mm(lx, 0);
   } else {
     rc = _lx_release(lx);
+    if (!rc && lx->db->bloomn) {
+      rc = _bloom_put_lw(lx->db, lx->key->data, lx->key->size);
+    }
   }
   return rc;
 }
 
 IW_INLINE WUR iwrc _lx_get_lr(IWLCTX *lx) {
-  iwrc rc = _lx_find_bounds(lx);
-  RCRET(rc);
   bool found;
   uint8_t *mm, idx;
   IWFS_FSM *fsm = &lx->db->iwkv->fsm;
   lx->val->size = 0;
+  iwrc rc = _bloom_check(lx->db, lx->key, &found);
+  RCRET(rc);
+  if (!found) {
+    return IWKV_ERROR_NOTFOUND;
+  }
+  rc = _lx_find_bounds(lx);
+  RCRET(rc);
   rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
   RCRET(rc);
   rc = _sblk_loadkvblk_mm(lx, lx->lower, mm);
   RCGO(rc, finish);
   rc = _sblk_find_pi_mm(lx->lower, lx->key, mm, &found, &idx);
   RCGO(rc, finish);
-  if (found) {
+  if (found && !_kvblk_expired(lx->lower->kvblk, lx->lower->pi[idx], mm, lx->ts)) {
     idx = lx->lower->pi[idx];
     rc = _kvblk_getvalue(lx->lower->kvblk, mm, idx, lx->val);
   } else {
@@ -2237,6 +3006,35 @@ finish:
   return rc;
 }
 
+IW_INLINE WUR iwrc _lx_peek_lr(IWLCTX *lx, IWKV_VISITOR visitor, void *opaq) {
+  bool found;
+  iwrc rc = _bloom_check(lx->db, lx->key, &found);
+  RCRET(rc);
+  if (!found) {
+    return IWKV_ERROR_NOTFOUND;
+  }
+  rc = _lx_find_bounds(lx);
+  RCRET(rc);
+  uint8_t *mm, idx;
+  IWFS_FSM *fsm = &lx->db->iwkv->fsm;
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCRET(rc);
+  rc = _sblk_loadkvblk_mm(lx, lx->lower, mm);
+  RCGO(rc, finish);
+  rc = _sblk_find_pi_mm(lx->lower, lx->key, mm, &found, &idx);
+  RCGO(rc, finish);
+  if (found && !_kvblk_expired(lx->lower->kvblk, lx->lower->pi[idx], mm, lx->ts)) {
+    rc = _kvblk_visit(lx->lower->kvblk, lx->lower->pi[idx], mm, visitor, opaq);
+  } else {
+    rc = IWKV_ERROR_NOTFOUND;
+  }
+
+finish:
+  IWRC(fsm->release_mmap(fsm), rc);
+  _lx_release_mm(lx, 0);
+  return rc;
+}
+
 IW_INLINE WUR iwrc _lx_del_lw(IWLCTX *lx) {
   iwrc rc;
   bool found;
@@ -2302,20 +3100,446 @@ finish:
     _lx_release_mm(lx, 0);
   } else {
     rc = _lx_release(lx);
+    if (!rc && lx->db->bloomn) {
+      rc = _bloom_del_lw(lx->db, 1);
+    }
+  }
+  return rc;
+}
+
+//-------------------------- BLOOM
+
+/**
+ * @brief MurmurHash64A of key bytes.
+ *
+ * Hash is stable across platforms since Bloom filter is persisted.
+ */
+static uint64_t _bloom_hash(const uint8_t *data, size_t len) {
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  uint64_t h = 0x6977646262ULL ^ (len * m);
+  const uint8_t *end = data + (len & ~(size_t) 7);
+  for (; data != end; data += 8) {
+    uint64_t k;
+    memcpy(&k, data, sizeof(k));
+    k = IW_ITOHLL(k);
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  switch (len & 7) {
+    case 7:
+      h ^= (uint64_t) data[6] << 48; // fallthrough
+    case 6:
+      h ^= (uint64_t) data[5] << 40; // fallthrough
+    case 5:
+      h ^= (uint64_t) data[4] << 32; // fallthrough
+    case 4:
+      h ^= (uint64_t) data[3] << 24; // fallthrough
+    case 3:
+      h ^= (uint64_t) data[2] << 16; // fallthrough
+    case 2:
+      h ^= (uint64_t) data[1] << 8; // fallthrough
+    case 1:
+      h ^= (uint64_t) data[0];
+      h *= m;
+  }
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+/**
+ * @brief Offset of filter block for key hash `h` within filter of `1 << pow` bytes.
+ */
+IW_INLINE size_t _bloom_blk(uint64_t h, uint8_t pow) {
+  return ((h >> 32) & ((1ULL << (pow - 6)) - 1)) * BLOOM_BLKSZ;
+}
+
+/**
+ * @brief Set key bits in filter block.
+ * @return True if block was changed.
+ */
+IW_INLINE bool _bloom_set(uint8_t *blk, uint64_t h) {
+  bool changed = false;
+  uint64_t g = (h ^ (h >> 29)) * 0xbf58476d1ce4e5b9ULL;
+  for (int i = 0; i < BLOOM_HASHES; ++i, g >>= 9) {
+    uint32_t bit = g & (BLOOM_BLKSZ * 8 - 1);
+    uint8_t mask = 1 << (bit & 7);
+    if (!(blk[bit >> 3] & mask)) {
+      blk[bit >> 3] |= mask;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+IW_INLINE bool _bloom_test(const uint8_t *blk, uint64_t h) {
+  uint64_t g = (h ^ (h >> 29)) * 0xbf58476d1ce4e5b9ULL;
+  for (int i = 0; i < BLOOM_HASHES; ++i, g >>= 9) {
+    uint32_t bit = g & (BLOOM_BLKSZ * 8 - 1);
+    if (!(blk[bit >> 3] & (1 << (bit & 7)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Filter size as power of 2 suitable for `num` keys.
+ */
+static uint8_t _bloom_pow(uint64_t num) {
+  uint8_t pow = BLOOM_POW_MIN;
+  while (pow < BLOOM_POW_MAX && (1ULL << pow) * 8 < num * BLOOM_BITS_PER_KEY) {
+    ++pow;
+  }
+  return pow;
+}
+
+/**
+ * @brief Number of keys filter of `db` is sized for.
+ */
+IW_INLINE uint64_t _bloom_capacity(IWDB db) {
+  return (1ULL << db->bloom_pow) * 8 / BLOOM_BITS_PER_KEY;
+}
+
+/**
+ * @brief Check if key may be in database.
+ */
+IW_INLINE bool _bloom_check_mm(IWDB db, const IWKV_val *key, const uint8_t *mm) {
+  if (!db->bloomn || db->cmp) {
+    return true;
+  }
+  uint64_t h = _bloom_hash(key->data, key->size);
+  return _bloom_test(mm + BLK2ADDR(db->bloomn) + _bloom_blk(h, db->bloom_pow), h);
+}
+
+/**
+ * @brief Check if key may be in database.
+ * @note Memory mapped file must not be acquired by caller.
+ */
+static WUR iwrc _bloom_check(IWDB db, const IWKV_val *key, bool *maybe) {
+  uint8_t *mm;
+  *maybe = true;
+  if (!db->bloomn || db->cmp) {
+    return 0;
+  }
+  IWFS_FSM *fsm = &db->iwkv->fsm;
+  iwrc rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCRET(rc);
+  *maybe = _bloom_check_mm(db, key, mm);
+  fsm->release_mmap(fsm);
+  return 0;
+}
+
+/**
+ * @brief Store filter block number and size in database block.
+ */
+static WUR iwrc _bloom_save(IWDB db, uint8_t *mm) {
+  iwrc rc = 0;
+  uint32_t lv;
+  uint8_t *wp = mm + db->addr + DOFF_BLOOM_U4;
+  IWDLSNR *dlsnr = db->iwkv->dlsnr;
+  IW_WRITELV(wp, lv, db->bloomn);
+  memcpy(wp, &db->bloom_pow, 1);
+  if (dlsnr) {
+    rc = dlsnr->onwrite(dlsnr, db->addr + DOFF_BLOOM_U4, mm + db->addr + DOFF_BLOOM_U4, 5, 0);
+  }
+  return rc;
+}
+
+/**
+ * @brief Store filter counters of databases in their blocks,
+ *        so filter rebuild thresholds are kept across storage reopen.
+ */
+static WUR iwrc _bloom_save_counters_lw(IWKV iwkv) {
+  iwrc rc;
+  uint8_t *mm;
+  IWFS_FSM *fsm = &iwkv->fsm;
+  if (iwkv->fmt_version < 3 || (iwkv->oflags & IWKV_RDONLY) || iwkv->fatalrc) {
+    return 0;
+  }
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCRET(rc);
+  for (IWDB db = iwkv->first_db; db; db = db->next) {
+    if (!db->bloomn) {
+      continue;
+    }
+    uint64_t llv;
+    uint8_t *wp = mm + db->addr + DOFF_BLOOMPUTS_U8;
+    IW_WRITELLV(wp, llv, db->bloom_puts);
+    IW_WRITELLV(wp, llv, db->bloom_dels);
+    if (iwkv->dlsnr) {
+      rc = iwkv->dlsnr->onwrite(iwkv->dlsnr, db->addr + DOFF_BLOOMPUTS_U8, mm + db->addr + DOFF_BLOOMPUTS_U8, 16, 0);
+      RCBREAK(rc);
+    }
+  }
+  fsm->release_mmap(fsm);
+  return rc;
+}
+
+/**
+ * @brief Replace filter of database by new one of `1 << pow` bytes.
+ * @note Memory mapped file must not be acquired by caller.
+ */
+static WUR iwrc _bloom_replace(IWDB db, const uint8_t *buf, uint8_t pow) {
+  uint8_t *mm;
+  blkn_t blkn;
+  blkn_t oblkn = db->bloomn;
+  uint8_t opow = db->bloom_pow;
+  IWFS_FSM *fsm = &db->iwkv->fsm;
+  iwrc rc = _kv_blob_put(db, buf, 1U << pow, &blkn);
+  RCRET(rc);
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  if (rc) {
+    _kv_blob_free(db, blkn, 1U << pow);
+    return rc;
+  }
+  db->bloomn = blkn;
+  db->bloom_pow = pow;
+  rc = _bloom_save(db, mm);
+  fsm->release_mmap(fsm);
+  if (oblkn) {
+    IWRC(_kv_blob_free(db, oblkn, 1U << opow), rc);
+  }
+  return rc;
+}
+
+/**
+ * @brief Create empty filter for `num` keys.
+ */
+static WUR iwrc _bloom_create(IWDB db, uint64_t num) {
+  uint8_t pow = _bloom_pow(num);
+  uint8_t *buf = calloc(1, 1U << pow);
+  if (!buf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  iwrc rc = _bloom_replace(db, buf, pow);
+  free(buf);
+  db->bloom_puts = 0;
+  db->bloom_dels = 0;
+  return rc;
+}
+
+/**
+ * @brief Build new filter from all database keys.
+ *
+ * Filter is sized by actual number of keys, so it grows and shrinks along with database.
+ * @note Memory mapped file must not be acquired by caller.
+ */
+static WUR iwrc _bloom_rebuild_lw(IWDB db) {
+  iwrc rc;
+  SBLK *sblk;
+  blkn_t n;
+  uint8_t *mm = 0, *buf = 0, *kbuf = 0;
+  uint32_t kbufsz = 0;
+  uint64_t num = 0;
+  uint8_t pow;
+  IWFS_FSM *fsm = &db->iwkv->fsm;
+  IWLCTX lx = {
+    .db = db,
+    .nlvl = -1
+  };
+  // Count keys
+  rc = _sblk_at(&lx, db->addr, 0, &sblk);
+  RCRET(rc);
+  while ((n = sblk->n[0])) {
+    rc = _sblk_at(&lx, BLK2ADDR(n), 0, &sblk);
+    RCRET(rc);
+    num += sblk->pnum;
+  }
+  pow = _bloom_pow(num);
+  buf = calloc(1, 1U << pow);
+  if (!buf) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  rc = _sblk_at(&lx, db->addr, 0, &sblk);
+  RCGO(rc, finish);
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCGO(rc, finish);
+  while ((n = sblk->n[0])) {
+    rc = _sblk_at(&lx, BLK2ADDR(n), 0, &sblk);
+    RCGO(rc, finish);
+    rc = _sblk_loadkvblk_mm(&lx, sblk, mm);
+    RCGO(rc, finish);
+    for (int i = 0; i < sblk->pnum; ++i) {
+      KVKEY k;
+      rc = _kvblk_peek_key(sblk->kvblk, sblk->pi[i], mm, &k);
+      RCGO(rc, finish);
+      const uint8_t *kp = k.sfx;
+      uint32_t ksz = k.pfxlen + k.sfxlen;
+      if (k.pfxlen) {
+        if (ksz > kbufsz) {
+          uint8_t *nbuf = realloc(kbuf, ksz);
+          if (!nbuf) {
+            rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+            goto finish;
+          }
+          kbuf = nbuf;
+          kbufsz = ksz;
+        }
+        memcpy(kbuf, k.pfx, k.pfxlen);
+        memcpy(kbuf + k.pfxlen, k.sfx, k.sfxlen);
+        kp = kbuf;
+      }
+      uint64_t h = _bloom_hash(kp, ksz);
+      _bloom_set(buf + _bloom_blk(h, pow), h);
+    }
+  }
+  fsm->release_mmap(fsm);
+  mm = 0;
+  rc = _bloom_replace(db, buf, pow);
+  RCGO(rc, finish);
+  db->bloom_puts = num;
+  db->bloom_dels = 0;
+
+finish:
+  if (mm) {
+    fsm->release_mmap(fsm);
+  }
+  free(buf);
+  free(kbuf);
+  return rc;
+}
+
+/**
+ * @brief Add key to filter.
+ * @note Memory mapped file must not be acquired by caller.
+ */
+static WUR iwrc _bloom_add_lw(IWDB db, const void *key, uint32_t ksz) {
+  uint8_t *mm;
+  IWFS_FSM *fsm = &db->iwkv->fsm;
+  uint64_t h = _bloom_hash(key, ksz);
+  iwrc rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCRET(rc);
+  off_t addr = BLK2ADDR(db->bloomn) + _bloom_blk(h, db->bloom_pow);
+  if (_bloom_set(mm + addr, h) && db->iwkv->dlsnr) {
+    rc = db->iwkv->dlsnr->onwrite(db->iwkv->dlsnr, addr, mm + addr, BLOOM_BLKSZ, 0);
+  }
+  fsm->release_mmap(fsm);
+  ++db->bloom_puts;
+  return rc;
+}
+
+/**
+ * @brief Add key to filter, filter is rebuilt if it is overloaded.
+ * @note Memory mapped file must not be acquired by caller.
+ */
+static WUR iwrc _bloom_put_lw(IWDB db, const void *key, uint32_t ksz) {
+  iwrc rc = _bloom_add_lw(db, key, ksz);
+  if (!rc && db->bloom_puts > 2 * _bloom_capacity(db)) {
+    rc = _bloom_rebuild_lw(db);
   }
   return rc;
 }
 
+/**
+ * @brief Account `num` removed keys, filter is rebuilt once many keys are removed.
+ * @note Memory mapped file must not be acquired by caller.
+ */
+static WUR iwrc _bloom_del_lw(IWDB db, uint64_t num) {
+  db->bloom_dels += num;
+  if (db->bloom_dels > MAX(_bloom_capacity(db), db->bloom_puts) / 2) {
+    return _bloom_rebuild_lw(db);
+  }
+  return 0;
+}
+
 //-------------------------- CACHE
 
 static void _dbcache_destroy_lw(IWDB db) {
   if (db->cache.nodes) {
     free(db->cache.nodes);
   }
+  free(db->cache.pfx);
   memset(&db->cache, 0, sizeof(db->cache));
 }
 
-IW_INLINE uint8_t _dbcache_lvl(uint8_t lvl) {
+/**
+ * @brief Lower key prefix as number ordered in the same way as keys.
+ *
+ * Numeric keys are used as is, first 8 bytes of other keys are read as big-endian number
+ * padded by zeros. If prefixes are not equal keys order is defined by prefixes.
+ */
+IW_INLINE uint64_t _dbcache_pfx(IWDB db, const uint8_t *lk, uint32_t lkl) {
+  if (db->dbflg & IWDB_UINT64_KEYS) {
+    uint64_t llv = 0;
+    memcpy(&llv, lk, MIN(lkl, sizeof(llv)));
+    return IW_ITOHLL(llv);
+  } else if (db->dbflg & IWDB_UINT32_KEYS) {
+    uint32_t lv = 0;
+    memcpy(&lv, lk, MIN(lkl, sizeof(lv)));
+    return IW_ITOHL(lv);
+  } else {
+    uint64_t llv = 0;
+    memcpy(&llv, lk, MIN(lkl, sizeof(llv)));
+    // Big-endian -> host: swap bytes on little-endian hosts only
+    llv = IW_ITOHLL(llv);
+    return IW_SWAB64(llv);
+  }
+}
+
+/**
+ * @brief Number of leading nodes having prefix greater than `kp` (`eq == false`)
+ *        or greater or equal to `kp` (`eq == true`).
+ *
+ * Nodes are ordered by descending prefixes, branchless binary search is used.
+ */
+IW_INLINE size_t _dbcache_pfx_bound(const uint64_t *pfx, size_t num, uint64_t kp, bool eq) {
+  const uint64_t *base = pfx;
+  if (!num) {
+    return 0;
+  }
+  if (eq) {
+    while (num > 1) {
+      size_t half = num / 2;
+      base = (base[half] >= kp) ? base + half : base;
+      num -= half;
+    }
+    return (base - pfx) + (*base >= kp);
+  } else {
+    while (num > 1) {
+      size_t half = num / 2;
+      base = (base[half] > kp) ? base + half : base;
+      num -= half;
+    }
+    return (base - pfx) + (*base > kp);
+  }
+}
+
+/**
+ * @brief Number of `SBLK` nodes of database at `lvl` and above levels.
+ */
+IW_INLINE size_t _dbcache_lvl_num(IWDB db, uint8_t lvl) {
+  size_t num = 0;
+  for (int i = lvl; i < SLEVELS; ++i) {
+    num += db->lcnt[i];
+  }
+  return num;
+}
+
+/**
+ * @brief Lowest cached level for database of `lvl` height.
+ *
+ * If `IWKV::dbcache_max_sz` memory budget is set it is the lowest level
+ * which nodes fit into budget, `SLEVELS` if even the top level doesn't fit.
+ * Otherwise top `DBCACHE_LEVELS` levels above `DBCACHE_MIN_LEVEL` are cached.
+ */
+IW_INLINE uint8_t _dbcache_lvl(IWDB db, uint8_t lvl, size_t nsize) {
+  size_t maxsz = db->iwkv->dbcache_max_sz;
+  if (maxsz) {
+    size_t num = 0;
+    for (int i = lvl; i >= 0; --i) {
+      num += db->lcnt[i];
+      if (num * nsize > maxsz) {
+        return (i < lvl) ? i + 1 : SLEVELS;
+      }
+    }
+    return 0;
+  }
   uint8_t clvl = (lvl >= DBCACHE_LEVELS) ? (lvl - DBCACHE_LEVELS + 1) : DBCACHE_MIN_LEVEL;
   if (clvl < DBCACHE_MIN_LEVEL) {
     clvl = DBCACHE_MIN_LEVEL;
@@ -2328,28 +3552,37 @@ static WUR iwrc _dbcache_cmp_nodes(const void *v1, const void *v2, void *op, int
   IWLCTX *lx = op;
   IWFS_FSM *fsm = &lx->db->iwkv->fsm;
   const DBCNODE *c1 = v1, *c2 = v2;
-  const uint8_t *k1 = c1->lk, *k2 = c2->lk;
-  uint32_t kl1 = c1->lkl, kl2 = c2->lkl;
+  KVKEY k1 = {
+    .sfx = c1->lk,
+    .sfxlen = c1->lkl
+  };
+  KVKEY k2 = {
+    .sfx = c2->lk,
+    .sfxlen = c2->lkl
+  };
   uint8_t *mm = 0;
   iwrc rc = 0;
   
-  *res = _cmp_key2(lx->db->dbflg, k1, kl1, k2, kl2);
-  if (*res == 0 && (!c1->fullkey || !c2->fullkey)) {
-    rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
-    RCRET(rc);
-    if (!c1->fullkey) {
-      rc = _kvblk_at_mm(lx, BLK2ADDR(c1->kblkn), mm, 0, &kb);
-      RCGO(rc, finish);
-      rc = _kvblk_peek_key(kb, c1->k0idx, mm, &k1, &kl1);
-      RCGO(rc, finish);
-    }
-    if (!c2->fullkey) {
-      rc = _kvblk_at_mm(lx, BLK2ADDR(c2->kblkn), mm, 0, &kb);
-      RCGO(rc, finish);
-      rc = _kvblk_peek_key(kb, c2->k0idx, mm, &k2, &kl2);
-      RCGO(rc, finish);
+  *res = _cmp_key2(lx->db, c1->lk, c1->lkl, c2->lk, c2->lkl);
+  if (*res == 0) {
+    if (!c1->fullkey || !c2->fullkey) {
+      rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+      RCRET(rc);
+      if (!c1->fullkey) {
+        rc = _kvblk_at_mm(lx, BLK2ADDR(c1->kblkn), mm, 0, &kb);
+        RCGO(rc, finish);
+        rc = _kvblk_peek_key(kb, c1->k0idx, mm, &k1);
+        RCGO(rc, finish);
+      }
+      if (!c2->fullkey) {
+        rc = _kvblk_at_mm(lx, BLK2ADDR(c2->kblkn), mm, 0, &kb);
+        RCGO(rc, finish);
+        rc = _kvblk_peek_key(kb, c2->k0idx, mm, &k2);
+        RCGO(rc, finish);
+      }
     }
-    *res = _cmp_key(lx->db->dbflg, k1, kl1, k2, kl2);
+    // Keys with common prefix are ordered by length
+    *res = _cmp_kvkey(lx->db, &k1, &k2);
   }
   
 finish:
@@ -2359,80 +3592,343 @@ finish:
   return rc;
 }
 
-static WUR iwrc _dbcache_fill_lw(IWLCTX *lx) {
-  iwrc rc = 0;
-  IWDB db = lx->db;
-  lx->cache_reload = 0;
-  if (!lx->dblk.addr) {
-    SBLK *s;
-    rc = _sblk_at(lx, lx->db->addr, 0, &s);
-    RCRET(rc);
-    memcpy(&lx->dblk, s, sizeof(lx->dblk));
+/**
+ * @brief Find insertion index of node `n` in the cache.
+ *
+ * Range of nodes having the same key prefix as `n` is located by search
+ * over compact prefixes array, full keys comparison is performed only within this range.
+ */
+static off_t _dbcache_find_idx(IWLCTX *lx, DBCNODE *n, bool *found) {
+  DBCACHE *cache = &lx->db->cache;
+  if (!cache->pfx) {
+    return iwarr_sorted_find2(cache->nodes, cache->num, cache->nsize, n, lx, found, _dbcache_cmp_nodes);
+  }
+  uint64_t kp = _dbcache_pfx(lx->db, n->lk, n->lkl);
+  size_t lb = _dbcache_pfx_bound(cache->pfx, cache->num, kp, false);
+  size_t ub = _dbcache_pfx_bound(cache->pfx, cache->num, kp, true);
+  if (lb == ub) {
+    return lb;
+  }
+  return lb + iwarr_sorted_find2((uint8_t *) cache->nodes + lb * cache->nsize, ub - lb, cache->nsize,
+                                 n, lx, found, _dbcache_cmp_nodes);
+}
+
+/**
+ * @brief Ensure capacity of cache arrays for `num` nodes.
+ */
+static WUR iwrc _dbcache_reserve_lw(DBCACHE *c, size_t num) {
+  size_t nsize = c->nsize;
+  if (c->asize >= nsize * num) {
+    return 0;
   }
-  SBLK *sdb = &lx->dblk;
-  SBLK *sblk = sdb;
-  DBCACHE *c = &db->cache;
-  assert(lx->db->addr == sdb->addr);
-  c->atime = lx->ts;
-  c->num = 0;
-  if (c->nodes) {
-    free(c->nodes);
-    c->nodes = 0;
+  size_t asize = c->asize + nsize * MAX(DBCACHE_ALLOC_STEP, c->num / 2);
+  if (asize < nsize * num) {
+    asize = nsize * (num + DBCACHE_ALLOC_STEP);
   }
-  if (sdb->lvl < DBCACHE_MIN_LEVEL) {
-    c->open = true;
-    return 0;
+  DBCNODE *nodes = realloc(c->nodes, asize);
+  if (!nodes) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
   }
-  c->lvl = _dbcache_lvl(sdb->lvl);
-  c->nsize = (lx->db->dbflg & IWDB_UINT_KEYS_FLAGS) ? DBCNODE_NUM_SZ : DBCNODE_STR_SZ;
-  c->asize = c->nsize * ((1 << DBCACHE_LEVELS) + DBCACHE_ALLOC_STEP);
+  c->nodes = nodes;
+  if (c->pfx) {
+    uint64_t *pfx = realloc(c->pfx, asize / nsize * sizeof(*c->pfx));
+    if (!pfx) {
+      // Keep `asize` consistent with size of `pfx` array
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    c->pfx = pfx;
+  }
+  c->asize = asize;
+  return 0;
+}
+
+/**
+ * @brief Drop all cached nodes keeping cache open.
+ */
+static void _dbcache_clear_lw(DBCACHE *c) {
+  free(c->nodes);
+  free(c->pfx);
+  c->nodes = 0;
+  c->pfx = 0;
+  c->asize = 0;
+  c->num = 0;
+  c->fnum = 0;
+  c->partial = false;
+}
+
+/**
+ * @brief Insert node of `sblk` at `idx` position of cache.
+ */
+static WUR iwrc _dbcache_insert_lw(IWDB db, SBLK *sblk, size_t idx) {
+  DBCACHE *c = &db->cache;
   size_t nsize = c->nsize;
-  c->nodes = malloc(c->asize);
-  if (!c->nodes) {
-    c->open = false;
-    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  iwrc rc = _dbcache_reserve_lw(c, c->num + 1);
+  RCRET(rc);
+  DBCNODE cn = {
+    .lkl = sblk->lkl,
+    .fullkey = (sblk->flags & SBLK_FULL_LKEY),
+    .k0idx = sblk->pi[0],
+    .lvl = sblk->lvl,
+    .sblkn = ADDR2BLK(sblk->addr),
+    .kblkn = sblk->kvblkn
+  };
+  uint8_t *wp = (uint8_t *) c->nodes + idx * nsize;
+  memmove(wp + nsize, wp, (c->num - idx) * nsize);
+  memcpy(wp, &cn, offsetof(DBCNODE, lk));
+  memcpy(wp + offsetof(DBCNODE, lk), sblk->lk, sblk->lkl);
+  if (c->pfx) {
+    memmove(c->pfx + idx + 1, c->pfx + idx, (c->num - idx) * sizeof(*c->pfx));
+    c->pfx[idx] = _dbcache_pfx(db, sblk->lk, sblk->lkl);
+  }
+  ++c->num;
+  return 0;
+}
+
+/**
+ * @brief Remove cached nodes below `lvl` level.
+ */
+static void _dbcache_shrink_lw(DBCACHE *c, uint8_t lvl) {
+  size_t nsize = c->nsize;
+  size_t num = 0, fnum = 0;
+  uint8_t *rp = (uint8_t *) c->nodes;
+  for (size_t i = 0; i < c->num; ++i) {
+    DBCNODE *n = (DBCNODE *)(rp + i * nsize);
+    if (n->lvl < lvl) {
+      continue;
+    }
+    if (i < c->fnum) {
+      ++fnum;
+    }
+    if (num != i) {
+      memcpy(rp + num * nsize, n, nsize);
+      if (c->pfx) {
+        c->pfx[num] = c->pfx[i];
+      }
+    }
+    ++num;
   }
+  c->num = num;
+  c->fnum = fnum;
+  c->lvl = lvl;
+}
+
+/**
+ * @brief Continue fill of partial cache visiting at most `steps` nodes of cached level.
+ *
+ * Database level list is walked from the last filled node. Nodes already cached
+ * (inserted by writers or left from the higher cached level) are skipped.
+ */
+static WUR iwrc _dbcache_fill_step_lw(IWLCTX *lx, size_t steps) {
+  iwrc rc;
   blkn_t n;
-  uint8_t *wp;
-  size_t num = 0;
-  while ((n = sblk->n[c->lvl])) {
+  SBLK *sblk;
+  IWDB db = lx->db;
+  DBCACHE *c = &db->cache;
+  size_t nsize = c->nsize;
+  size_t maxsz = db->iwkv->dbcache_max_sz;
+  if (!c->partial) {
+    return 0;
+  }
+  if (c->fnum) {
+    DBCNODE *fn = (DBCNODE *)((uint8_t *) c->nodes + (c->fnum - 1) * nsize);
+    rc = _sblk_at(lx, BLK2ADDR(fn->sblkn), 0, &sblk);
+  } else {
+    rc = _sblk_at(lx, db->addr, 0, &sblk);
+  }
+  RCRET(rc);
+  while (steps-- > 0) {
+    if (!(n = sblk->n[c->lvl])) {
+      c->partial = false;
+      break;
+    }
     rc = _sblk_at(lx, BLK2ADDR(n), 0, &sblk);
     RCRET(rc);
+    if (c->fnum < c->num) {
+      DBCNODE *fn = (DBCNODE *)((uint8_t *) c->nodes + c->fnum * nsize);
+      if (fn->sblkn == n) {
+        ++c->fnum;
+        continue;
+      }
+    }
     if (offsetof(DBCNODE, lk) + sblk->lkl > nsize) {
-      free(c->nodes);
-      c->nodes = 0;
       rc = IWKV_ERROR_CORRUPTED;
       iwlog_ecode_error3(rc);
       return rc;
     }
-    DBCNODE cn = {
-      .lkl = sblk->lkl,
-      .fullkey = (sblk->flags & SBLK_FULL_LKEY),
-      .k0idx = sblk->pi[0],
-      .sblkn = ADDR2BLK(sblk->addr),
-      .kblkn = sblk->kvblkn
-    };
-    if (c->asize < nsize * (num + 1)) {
-      c->asize += (nsize * DBCACHE_ALLOC_STEP);
-      wp = (uint8_t *) c->nodes;
-      c->nodes = realloc(c->nodes, c->asize);
-      if (!c->nodes) {
-        rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
-        free(wp);
+    if (maxsz && (c->num + 1) * nsize > maxsz) {
+      // Memory budget exceeded, try to shift cache up
+      uint8_t lvl = c->lvl;
+      lx->dblk.addr = 0;
+      rc = _dbcache_fill_lw(lx);
+      if (rc || c->lvl != lvl || !c->partial) {
         return rc;
       }
     }
-    wp = (uint8_t *) c->nodes + nsize * num;
-    memcpy(wp, &cn, offsetof(DBCNODE, lk));
-    wp += offsetof(DBCNODE, lk);
-    memcpy(wp, sblk->lk, sblk->lkl);
-    ++num;
+    rc = _dbcache_insert_lw(db, sblk, c->fnum);
+    RCRET(rc);
+    ++c->fnum;
+  }
+  return 0;
+}
+
+static void *_dbcache_fill_worker_fn(void *op) {
+  IWKV iwkv = op;
+  while (true) {
+    bool more = false;
+    pthread_mutex_lock(&iwkv->dbc_mtx);
+    while (!iwkv->dbc_pending && !iwkv->dbc_shutdown) {
+      pthread_cond_wait(&iwkv->dbc_cond, &iwkv->dbc_mtx);
+    }
+    iwkv->dbc_pending = false;
+    pthread_mutex_unlock(&iwkv->dbc_mtx);
+    if (iwkv->dbc_shutdown) {
+      break;
+    }
+    do {
+      // Database locks are released after every step
+      // so fill doesn't block readers, writers and WAL checkpoints for long
+      if (_api_rlock(iwkv)) {
+        break;
+      }
+      more = false;
+      for (IWDB db = iwkv->first_db; db && !iwkv->dbc_shutdown; db = db->next) {
+        if (pthread_rwlock_wrlock(&db->rwl)) {
+          continue;
+        }
+        if (db->cache.partial && !_db_cmp_missing(db)) {
+          IWLCTX lx = {
+            .db = db,
+            .nlvl = -1
+          };
+          iwp_current_time_ms(&lx.ts);
+          iwrc rc = _dbcache_fill_step_lw(&lx, DBCACHE_FILL_STEP);
+          if (rc) {
+            iwlog_ecode_error2(rc, "Background dbcache fill failed");
+            _dbcache_clear_lw(&db->cache);
+          }
+          more |= db->cache.partial;
+        }
+        pthread_rwlock_unlock(&db->rwl);
+      }
+      iwdrwl_unlock(&iwkv->rwl);
+    } while (more && !iwkv->dbc_shutdown);
+  }
+  return 0;
+}
+
+/**
+ * @brief Wake up background fill of partial caches, starts fill thread if needed.
+ */
+static WUR iwrc _dbcache_fill_schedule(IWKV iwkv) {
+  iwrc rc = 0;
+  int rci = pthread_mutex_lock(&iwkv->dbc_mtx);
+  if (rci) {
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  if (!iwkv->dbc_started && !iwkv->dbc_shutdown) {
+    rci = pthread_create(&iwkv->dbc_thr, 0, _dbcache_fill_worker_fn, iwkv);
+    if (rci) {
+      rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+    } else {
+      iwkv->dbc_started = true;
+    }
+  }
+  iwkv->dbc_pending = true;
+  pthread_cond_broadcast(&iwkv->dbc_cond);
+  pthread_mutex_unlock(&iwkv->dbc_mtx);
+  return rc;
+}
+
+static iwrc _dbcache_fill_shutdown(IWKV iwkv) {
+  int rci = pthread_mutex_lock(&iwkv->dbc_mtx);
+  if (rci) {
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  bool started = iwkv->dbc_started;
+  iwkv->dbc_shutdown = true;
+  iwkv->dbc_started = false;
+  pthread_cond_broadcast(&iwkv->dbc_cond);
+  pthread_mutex_unlock(&iwkv->dbc_mtx);
+  if (started) {
+    rci = pthread_join(iwkv->dbc_thr, 0);
+    if (rci) {
+      return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+    }
   }
-  c->num = num;
-  c->open = true;
   return 0;
 }
 
+/**
+ * @brief Open cache or adjust its level to the current database height.
+ *
+ * Cache is not rebuilt from scratch: nodes below new cached level are removed in place,
+ * missing nodes are added by background fill walking database level list.
+ * Cached nodes are valid search start points at any fill stage.
+ */
+static WUR iwrc _dbcache_fill_lw(IWLCTX *lx) {
+  iwrc rc = 0;
+  IWDB db = lx->db;
+  lx->cache_reload = 0;
+  if (!lx->dblk.addr) {
+    SBLK *s;
+    rc = _sblk_at(lx, lx->db->addr, 0, &s);
+    RCRET(rc);
+    memcpy(&lx->dblk, s, sizeof(lx->dblk));
+  }
+  SBLK *sdb = &lx->dblk;
+  DBCACHE *c = &db->cache;
+  assert(lx->db->addr == sdb->addr);
+  c->atime = lx->ts;
+  c->open = true;
+  c->nsize = (lx->db->dbflg & IWDB_UINT_KEYS_FLAGS) ? DBCNODE_NUM_SZ : DBCNODE_STR_SZ;
+  uint8_t lvl = _dbcache_lvl(db, sdb->lvl, c->nsize);
+  if (lvl > sdb->lvl || (!db->iwkv->dbcache_max_sz && sdb->lvl < DBCACHE_MIN_LEVEL)) {
+    _dbcache_clear_lw(c);
+    c->lvl = lvl;
+    return 0;
+  }
+  size_t nsize = c->nsize;
+  if (!c->nodes) {
+    if (db->iwkv->dbcache_max_sz) {
+      c->asize = nsize * (_dbcache_lvl_num(db, lvl) + DBCACHE_ALLOC_STEP);
+    } else {
+      c->asize = nsize * ((1 << DBCACHE_LEVELS) + DBCACHE_ALLOC_STEP);
+    }
+    c->num = 0;
+    c->nodes = malloc(c->asize);
+    if (!c->nodes) {
+      rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+      _dbcache_clear_lw(c);
+      return rc;
+    }
+    if (!db->cmp || (db->dbflg & IWDB_UINT_KEYS_FLAGS)) {
+      c->pfx = malloc(c->asize / nsize * sizeof(*c->pfx));
+      if (!c->pfx) {
+        rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+        _dbcache_clear_lw(c);
+        return rc;
+      }
+    }
+  } else if (lvl > c->lvl) {
+    _dbcache_shrink_lw(c, lvl);
+  } else if (lvl == c->lvl && c->partial) {
+    return 0; // Fill is in progress
+  }
+  c->lvl = lvl;
+  c->fnum = 0;
+  c->partial = true;
+  rc = _dbcache_fill_schedule(db->iwkv);
+  if (rc) {
+    // Fill synchronously if worker thread is not available
+    iwlog_ecode_error3(rc);
+    rc = _dbcache_fill_step_lw(lx, SIZE_MAX);
+    if (rc) {
+      _dbcache_clear_lw(c);
+    }
+  }
+  return rc;
+}
+
 static WUR iwrc _dbcache_get(IWLCTX *lx) {
   iwrc rc = 0;
   off_t idx;
@@ -2461,7 +3957,7 @@ static WUR iwrc _dbcache_get(IWLCTX *lx) {
   n->sblkn = 0;
   n->kblkn = 0;
   memcpy((uint8_t *)n + offsetof(DBCNODE, lk), lx->key->data, lx->key->size);
-  idx = iwarr_sorted_find2(cache->nodes, cache->num, cache->nsize, n, lx, &found, _dbcache_cmp_nodes);
+  idx = _dbcache_find_idx(lx, n, &found);
   if (idx > 0) {
     DBCNODE *fn = (DBCNODE *)((uint8_t *)cache->nodes + (idx - 1) * cache->nsize);
     assert(fn && idx - 1 < cache->num);
@@ -2477,7 +3973,7 @@ static WUR iwrc _dbcache_get(IWLCTX *lx) {
 
 static WUR iwrc _dbcache_put_lw(IWLCTX *lx, SBLK *sblk) {
   off_t idx;
-  bool found;
+  bool found = false;
   IWDB db = lx->db;
   uint8_t dbcbuf[1024];
   DBCNODE *n = (DBCNODE *) dbcbuf;
@@ -2490,7 +3986,10 @@ static WUR iwrc _dbcache_put_lw(IWLCTX *lx, SBLK *sblk) {
   if (sblk->pnum < 1 || sblk->lvl < cache->lvl) {
     return 0;
   }
-  if (sblk->lvl >= cache->lvl + DBCACHE_LEVELS || !cache->nodes) { // need to reload full cache
+  if (!cache->nodes
+      || (db->iwkv->dbcache_max_sz
+          ? (cache->num + 1) * nsize > db->iwkv->dbcache_max_sz // memory budget exceeded, cache higher levels
+          : sblk->lvl >= cache->lvl + DBCACHE_LEVELS)) {     // need to reload full cache
     lx->cache_reload = 1;
     return 0;
   }
@@ -2501,31 +4000,64 @@ static WUR iwrc _dbcache_put_lw(IWLCTX *lx, SBLK *sblk) {
   n->lkl = sblk->lkl;
   n->fullkey = (sblk->flags & SBLK_FULL_LKEY);
   n->k0idx = sblk->pi[0];
+  n->lvl = sblk->lvl;
   n->sblkn = ADDR2BLK(sblk->addr);
   n->kblkn = sblk->kvblkn;
   memcpy((uint8_t *)n + offsetof(DBCNODE, lk), sblk->lk, sblk->lkl);
   
-  idx = iwarr_sorted_find2(cache->nodes, cache->num, nsize, n, lx, &found, _dbcache_cmp_nodes);
+  idx = _dbcache_find_idx(lx, n, &found);
   assert(!found);
-  if (cache->asize <= cache->num * nsize) {
-    size_t nsz = cache->asize + (nsize * DBCACHE_ALLOC_STEP);
-    DBCNODE *nodes = realloc(cache->nodes, nsz);
-    if (!nodes) {
-      iwrc rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
-      free(cache->nodes);
-      cache->nodes = 0;
-      return rc;
-    }
-    cache->asize = nsz;
-    cache->nodes = nodes;
+  iwrc rc = _dbcache_insert_lw(db, sblk, idx);
+  if (rc) {
+    _dbcache_destroy_lw(db);
+    return rc;
+  }
+  if (idx < cache->fnum) {
+    // Node is behind of background fill position
+    ++cache->fnum;
   }
-  uint8_t *cptr = (uint8_t *) cache->nodes;
-  memmove(cptr + (idx + 1) * nsize, cptr + idx * nsize, (cache->num - idx) * nsize);
-  memcpy(cptr + idx * nsize, n, nsize);
-  ++cache->num;
   return 0;
 }
 
+/**
+ * @brief Find cached node of `sblk`.
+ *
+ * Node is located by binary search of `sblk` lower key prefix. Lower key of `sblk`
+ * may be changed since node was cached, so nodes with the same key prefix
+ * and its neighbours are checked.
+ *
+ * @return Node index or `-1` if not found.
+ */
+static off_t _dbcache_find_lw(IWLCTX *lx, SBLK *sblk) {
+  IWDB db = lx->db;
+  DBCACHE *cache = &db->cache;
+  blkn_t sblkn = ADDR2BLK(sblk->addr);
+  size_t nsize = cache->nsize;
+  uint8_t *rp = (uint8_t *) cache->nodes;
+  off_t num = cache->num, lb = 0, ub = num;
+  if (sblk->lkl) {
+    while (lb < ub) { // First node not less than `sblk` lower key prefix
+      off_t idx = (lb + ub) / 2;
+      DBCNODE *n = (DBCNODE *)(rp + idx * nsize);
+      if (_cmp_key2(db, n->lk, n->lkl, sblk->lk, sblk->lkl) < 0) {
+        lb = idx + 1;
+      } else {
+        ub = idx;
+      }
+    }
+  }
+  for (off_t i = lb > 0 ? lb - 1 : 0; i < num; ++i) {
+    DBCNODE *n = (DBCNODE *)(rp + i * nsize);
+    if (sblkn == n->sblkn) {
+      return i;
+    }
+    if (sblk->lkl && i >= lb && _cmp_key2(db, n->lk, n->lkl, sblk->lk, sblk->lkl) > 0) {
+      break;
+    }
+  }
+  return -1;
+}
+
 static void _dbcache_remove_lw(IWLCTX *lx, SBLK *sblk) {
   IWDB db = lx->db;
   DBCACHE *cache = &db->cache;
@@ -2534,24 +4066,33 @@ static void _dbcache_remove_lw(IWLCTX *lx, SBLK *sblk) {
   if (sblk->lvl < cache->lvl || cache->num < 1) {
     return;
   }
-  if (cache->lvl > DBCACHE_MIN_LEVEL && lx->dblk.lvl < sblk->lvl) {
+  if (db->iwkv->dbcache_max_sz) {
+    if (cache->lvl > 0
+        && (cache->num + db->lcnt[cache->lvl - 1]) * cache->nsize <= db->iwkv->dbcache_max_sz / 2) {
+      // Lower level fits into memory budget
+      lx->cache_reload = 1;
+      return;
+    }
+  } else if (cache->lvl > DBCACHE_MIN_LEVEL && lx->dblk.lvl < sblk->lvl) {
     // Database level reduced so we need to shift cache down
     lx->cache_reload = 1;
     return;
   }
-  blkn_t sblkn = ADDR2BLK(sblk->addr);
-  size_t num = cache->num;
-  size_t nsize = cache->nsize;
-  uint8_t *rp = (uint8_t *) cache->nodes;
-  for (size_t i = 0; i < num; ++i) {
-    DBCNODE *n = (DBCNODE *)(rp + i * nsize);
-    if (sblkn == n->sblkn) {
-      if (i < num - 1) {
-        memmove(rp + i * nsize, rp + (i + 1) * nsize, (num - i - 1) * nsize);
+  off_t i = _dbcache_find_lw(lx, sblk);
+  if (i > -1) {
+    size_t num = cache->num;
+    size_t nsize = cache->nsize;
+    uint8_t *rp = (uint8_t *) cache->nodes;
+    if (i < num - 1) {
+      memmove(rp + i * nsize, rp + (i + 1) * nsize, (num - i - 1) * nsize);
+      if (cache->pfx) {
+        memmove(cache->pfx + i, cache->pfx + i + 1, (num - i - 1) * sizeof(*cache->pfx));
       }
-      --cache->num;
-      break;
     }
+    if (i < cache->fnum) {
+      --cache->fnum;
+    }
+    --cache->num;
   }
 }
 
@@ -2564,19 +4105,16 @@ static void _dbcache_update_lw(IWLCTX *lx, SBLK *sblk) {
   if (sblk->lvl < cache->lvl || cache->num < 1) {
     return;
   }
-  blkn_t sblkn = ADDR2BLK(sblk->addr);
-  size_t num = cache->num;
-  size_t nsize = cache->nsize;
-  uint8_t *rp = (uint8_t *) cache->nodes;
-  for (size_t i = 0; i < num; ++i) {
-    DBCNODE *n = (DBCNODE *)(rp + i * nsize);
-    if (sblkn == n->sblkn) {
-      n->kblkn = sblk->kvblkn;
-      n->lkl = sblk->lkl;
-      n->fullkey = (sblk->flags & SBLK_FULL_LKEY);
-      n->k0idx = sblk->pi[0];
-      memcpy((uint8_t *)n + offsetof(DBCNODE, lk), sblk->lk, sblk->lkl);
-      break;
+  off_t i = _dbcache_find_lw(lx, sblk);
+  if (i > -1) {
+    DBCNODE *n = (DBCNODE *)((uint8_t *) cache->nodes + i * cache->nsize);
+    n->kblkn = sblk->kvblkn;
+    n->lkl = sblk->lkl;
+    n->fullkey = (sblk->flags & SBLK_FULL_LKEY);
+    n->k0idx = sblk->pi[0];
+    memcpy((uint8_t *)n + offsetof(DBCNODE, lk), sblk->lk, sblk->lkl);
+    if (cache->pfx) {
+      cache->pfx[i] = _dbcache_pfx(db, sblk->lk, sblk->lkl);
     }
   }
 }
@@ -2610,7 +4148,7 @@ finish:
   return rc;
 }
 
-IW_INLINE WUR iwrc _cursor_to_lr(IWKV_cursor cur, IWKV_cursor_op op) {
+IW_INLINE WUR iwrc _cursor_move_lr(IWKV_cursor cur, IWKV_cursor_op op) {
   iwrc rc = 0;
   IWDB db = cur->lx.db;
   IWLCTX *lx = &cur->lx;
@@ -2622,7 +4160,7 @@ IW_INLINE WUR iwrc _cursor_to_lr(IWKV_cursor cur, IWKV_cursor_op op) {
     }
     if (op == IWKV_CURSOR_BEFORE_FIRST) {
       cur->dbaddr = db->addr;
-      cur->cnpos = KVBLK_IDXNUM - 1;
+      cur->cnpos = db->idxnum - 1;
     } else {
       cur->dbaddr = -1; // Negative as sign of dbtail
       cur->cnpos = 0;
@@ -2710,6 +4248,76 @@ finish:
   return rc;
 }
 
+/**
+ * @brief Move cursor skipping expired records of `IWDB_TTL` database.
+ *
+ * Expired records are passed in the direction of `IWKV_CURSOR_NEXT`|`IWKV_CURSOR_PREV`
+ * movement, `IWKV_CURSOR_GE` lookup continues to the next live record like `IWKV_CURSOR_NEXT`.
+ */
+static WUR iwrc _cursor_to_lr(IWKV_cursor cur, IWKV_cursor_op op) {
+  iwrc rc = _cursor_move_lr(cur, op);
+  if (rc || op < IWKV_CURSOR_NEXT || !(cur->lx.db->dbflg & IWDB_TTL)) {
+    return rc;
+  }
+  bool expired;
+  uint8_t *mm;
+  IWFS_FSM *fsm = &cur->lx.db->iwkv->fsm;
+  IWKV_cursor_op nop = (op == IWKV_CURSOR_PREV) ? IWKV_CURSOR_PREV : IWKV_CURSOR_NEXT;
+  while (1) {
+    rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+    RCBREAK(rc);
+    if (!cur->cn->kvblk) {
+      rc = _sblk_loadkvblk_mm(&cur->lx, cur->cn, mm);
+    }
+    expired = !rc && _kvblk_expired(cur->cn->kvblk, cur->cn->pi[cur->cnpos], mm, cur->lx.ts);
+    fsm->release_mmap(fsm);
+    if (rc || !expired) {
+      break;
+    }
+    if (op == IWKV_CURSOR_EQ) {
+      rc = IWKV_ERROR_NOTFOUND;
+      break;
+    }
+    rc = _cursor_move_lr(cur, nop);
+    RCBREAK(rc);
+  }
+  return rc;
+}
+
+#ifdef __GNUC__
+#define _PREFETCH(p_) __builtin_prefetch(p_)
+#else
+#define _PREFETCH(p_)
+#endif
+
+/**
+ * @brief Prefetch the next `SBLK` of cursor scan and its `KVBLK` index.
+ *
+ * Node header is prefetched as scan enters the current node, `KVBLK`
+ * is prefetched halfway through the current node when the next node header
+ * is already in CPU cache.
+ */
+IW_INLINE void _cursor_prefetch_mm(IWKV_cursor cur, uint8_t *mm) {
+  blkn_t n = cur->cn->n[0];
+  if (!n) {
+    return;
+  }
+  uint8_t *sp = mm + BLK2ADDR(n);
+  if (cur->cnpos == 0) {
+    _PREFETCH(sp);
+  } else if (cur->cnpos == cur->cn->pnum / 2) {
+    uint32_t kvblkn;
+    memcpy(&kvblkn, sp + SOFF_KBLK_U4, sizeof(kvblkn));
+    kvblkn = IW_ITOHL(kvblkn);
+    if (kvblkn) {
+      uint8_t *kp = mm + BLK2ADDR(kvblkn);
+      _PREFETCH(kp);
+      _PREFETCH(kp + 64);
+      _PREFETCH(kp + 128);
+    }
+  }
+}
+
 //--------------------------  PUBLIC API
 
 static const char *_kv_ecodefn(locale_t locale, uint32_t ecode) {
@@ -2735,6 +4343,8 @@ static const char *_kv_ecodefn(locale_t locale, uint32_t ecode) {
       return "Incompatible database format version, please migrate database data (IWKV_ERROR_INCOMPATIBLE_DB_FORMAT)";
     case IWKV_ERROR_CORRUPTED_WAL_FILE:
       return "Corrupted WAL file (IWKV_ERROR_CORRUPTED_WAL_FILE)";
+    case IWKV_ERROR_CAS_MISMATCH:
+      return "Current value of record does not match expected one (IWKV_ERROR_CAS_MISMATCH)";
   }
   return 0;
 }
@@ -2784,7 +4394,7 @@ static off_t _szpolicy(off_t nsize, off_t csize, struct IWFS_EXT *f, void **_ctx
   return res;
 }
 
-iwrc iwkv_open(const IWKV_OPTS *opts, IWKV *iwkvp) {
+static iwrc _iwkv_open(const IWKV_OPTS *opts, bool snapshot, IWKV *iwkvp) {
   assert(iwkvp && opts);
   int rci;
   iwrc rc = 0;
@@ -2802,21 +4412,59 @@ iwrc iwkv_open(const IWKV_OPTS *opts, IWKV *iwkvp) {
   }
   IWKV iwkv = *iwkvp;
   iwkv->fmt_version = IWKV_FORMAT;
-  rci = pthread_rwlock_init(&iwkv->rwl, 0);
+  rci = iwdrwl_init(&iwkv->rwl);
   if (rci) {
     free(*iwkvp);
     return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
   }
   rci = pthread_mutex_init(&iwkv->wk_mtx, 0);
   if (rci) {
-    pthread_rwlock_destroy(&iwkv->rwl);
+    iwdrwl_destroy(&iwkv->rwl);
     free(*iwkvp);
     return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
   }
   rci = pthread_cond_init(&iwkv->wk_cond, 0);
   if (rci) {
-    pthread_rwlock_destroy(&iwkv->rwl);
+    iwdrwl_destroy(&iwkv->rwl);
+    pthread_mutex_destroy(&iwkv->wk_mtx);
+    free(*iwkvp);
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  rci = pthread_mutex_init(&iwkv->dbc_mtx, 0);
+  if (rci) {
+    iwdrwl_destroy(&iwkv->rwl);
     pthread_mutex_destroy(&iwkv->wk_mtx);
+    pthread_cond_destroy(&iwkv->wk_cond);
+    free(*iwkvp);
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  rci = pthread_cond_init(&iwkv->dbc_cond, 0);
+  if (rci) {
+    iwdrwl_destroy(&iwkv->rwl);
+    pthread_mutex_destroy(&iwkv->wk_mtx);
+    pthread_cond_destroy(&iwkv->wk_cond);
+    pthread_mutex_destroy(&iwkv->dbc_mtx);
+    free(*iwkvp);
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  rci = pthread_mutex_init(&iwkv->ttl_mtx, 0);
+  if (rci) {
+    iwdrwl_destroy(&iwkv->rwl);
+    pthread_mutex_destroy(&iwkv->wk_mtx);
+    pthread_cond_destroy(&iwkv->wk_cond);
+    pthread_mutex_destroy(&iwkv->dbc_mtx);
+    pthread_cond_destroy(&iwkv->dbc_cond);
+    free(*iwkvp);
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  rci = pthread_cond_init(&iwkv->ttl_cond, 0);
+  if (rci) {
+    iwdrwl_destroy(&iwkv->rwl);
+    pthread_mutex_destroy(&iwkv->wk_mtx);
+    pthread_cond_destroy(&iwkv->wk_cond);
+    pthread_mutex_destroy(&iwkv->dbc_mtx);
+    pthread_cond_destroy(&iwkv->dbc_cond);
+    pthread_mutex_destroy(&iwkv->ttl_mtx);
     free(*iwkvp);
     return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
   }
@@ -2830,6 +4478,10 @@ iwrc iwkv_open(const IWKV_OPTS *opts, IWKV *iwkvp) {
     omode |= IWFS_OWRITE;
   }
   iwkv->oflags = oflags;
+  iwkv->blob_threshold = opts->blob_threshold
+                         ? MAX(opts->blob_threshold, IWKV_BLOB_THRESHOLD_MIN) : IWKV_BLOB_THRESHOLD_DEFAULT;
+  iwkv->dbcache_max_sz = opts->dbcache_max_sz;
+  iwkv->ttl_reap_interval_ms = opts->ttl_reap_interval_ms ? opts->ttl_reap_interval_ms : TTL_REAP_INTERVAL_MS;
   IWFS_FSM_STATE fsmstate;
   IWFS_FSM_OPTS fsmopts = {
     .exfile = {
@@ -2849,6 +4501,11 @@ iwrc iwkv_open(const IWKV_OPTS *opts, IWKV *iwkvp) {
 #if defined(IW_TESTS) && !defined(IW_RELEASE)
   fsmopts.oflags |= IWFSM_STRICT;
 #endif
+  if (snapshot) {
+    // Private copy-on-write mapping of database file, file lock is held by parent IWKV
+    fsmopts.exfile.file.lock_mode = IWP_NOLOCK;
+    fsmopts.mmap_opts = IWFS_MMAP_PRIVATE;
+  }
   
   // Init WAL
   rc = iwal_create(iwkv, opts, &fsmopts);
@@ -2888,7 +4545,7 @@ iwrc iwkv_open(const IWKV_OPTS *opts, IWKV *iwkvp) {
       goto finish;
     }
     IW_READLV(rp, lv, iwkv->fmt_version);
-    if ((iwkv->fmt_version != IWKV_FORMAT)) {
+    if (iwkv->fmt_version > IWKV_FORMAT) {
       rc = IWKV_ERROR_INCOMPATIBLE_DB_FORMAT;
       iwlog_ecode_error3(rc);
       goto finish;
@@ -2908,6 +4565,68 @@ finish:
   return rc;
 }
 
+iwrc iwkv_open(const IWKV_OPTS *opts, IWKV *iwkvp) {
+  return _iwkv_open(opts, false, iwkvp);
+}
+
+/**
+ * @brief Restores lock of database file held by `iwkv`.
+ *
+ * POSIX record locks of process are released
+ * when any file descriptor of database file is closed, snapshot's one in particular.
+ */
+static iwrc _snapshot_relock(IWKV iwkv) {
+  IWFS_FSM_STATE fst;
+  iwrc rc = iwkv->fsm.state(&iwkv->fsm, &fst);
+  RCRET(rc);
+  return iwp_flock(fst.exfile.file.fh, fst.exfile.file.opts.lock_mode);
+}
+
+iwrc iwkv_snapshot_open(IWKV iwkv, IWKV *snapp) {
+  if (!snapp) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  *snapp = 0;
+  ENSURE_OPEN(iwkv);
+  if (!iwkv->dlsnr) {
+    return IWKV_ERROR_INCOMPATIBLE_DB_MODE;
+  }
+  IWKV snap = 0;
+  IWFS_FSM_STATE fst;
+  iwrc rc = iwkv->fsm.state(&iwkv->fsm, &fst);
+  RCRET(rc);
+  IWKV_OPTS opts = {
+    .path = (char *) fst.exfile.file.opts.path,
+    .oflags = IWKV_RDONLY,
+    .blob_threshold = iwkv->blob_threshold,
+    .dbcache_max_sz = iwkv->dbcache_max_sz
+  };
+  rc = iwkv_exclusive_lock(iwkv);
+  RCRET(rc);
+  // Database file should contain all data written so far,
+  // then it will be changed by checkpoints only
+  rc = iwal_snapshot_checkpoint(iwkv);
+  RCGO(rc, finish);
+  rc = _iwkv_open(&opts, true, &snap);
+  if (!rc) {
+    rc = iwal_snapshot_add(iwkv, snap);
+    if (rc) {
+      iwkv_close(&snap);
+    }
+  }
+  if (rc) {
+    IWRC(_snapshot_relock(iwkv), rc);
+  } else {
+    snap->snapof = iwkv;
+    ++iwkv->snaps_num;
+    *snapp = snap;
+  }
+
+finish:
+  IWRC(iwkv_exclusive_unlock(iwkv), rc);
+  return rc;
+}
+
 iwrc iwkv_exclusive_lock(IWKV iwkv) {
   return _wnw(iwkv, _wnw_iwkw_wl);
 }
@@ -2920,28 +4639,52 @@ iwrc iwkv_exclusive_unlock(IWKV iwkv) {
 }
 
 iwrc iwkv_close(IWKV *iwkvp) {
-  ENSURE_OPEN((*iwkvp));
+  // Storage can be closed after fatal error
+  if (!iwkvp || !*iwkvp || !(*iwkvp)->open) {
+    return IW_ERROR_INVALID_STATE;
+  }
   IWKV iwkv = *iwkvp;
+  if (iwkv->snaps_num) {
+    return IW_ERROR_INVALID_STATE;
+  }
   iwkv->open = false;
-  iwrc rc = iwkv_exclusive_lock(iwkv);
+  iwrc rc = _ttl_reaper_shutdown(iwkv);
   RCRET(rc);
+  rc = _dbcache_fill_shutdown(iwkv);
+  RCRET(rc);
+  rc = iwal_shutdown(iwkv);
+  RCRET(rc);
+  rc = iwkv_exclusive_lock(iwkv);
+  RCRET(rc);
+  IWRC(_bloom_save_counters_lw(iwkv), rc);
   IWDB db = iwkv->first_db;
   while (db) {
     IWDB ndb = db->next;
     _db_release_lw(&db);
     db = ndb;
   }
+  if (iwkv->snapof) {
+    IWRC(iwal_snapshot_remove(iwkv->snapof, iwkv), rc);
+  }
   IWRC(iwkv->fsm.close(&iwkv->fsm), rc);
   IWRC(iwal_close(iwkv), rc);
+  if (iwkv->snapof) {
+    IWRC(_snapshot_relock(iwkv->snapof), rc);
+    --iwkv->snapof->snaps_num;
+  }
   // Below the memory cleanup only
   if (iwkv->dbs) {
     kh_destroy(DBS, iwkv->dbs);
     iwkv->dbs = 0;
   }
   iwkv_exclusive_unlock(iwkv);
-  pthread_rwlock_destroy(&iwkv->rwl);
+  iwdrwl_destroy(&iwkv->rwl);
   pthread_mutex_destroy(&iwkv->wk_mtx);
   pthread_cond_destroy(&iwkv->wk_cond);
+  pthread_mutex_destroy(&iwkv->dbc_mtx);
+  pthread_cond_destroy(&iwkv->dbc_cond);
+  pthread_mutex_destroy(&iwkv->ttl_mtx);
+  pthread_cond_destroy(&iwkv->ttl_cond);
   free(iwkv);
   *iwkvp = 0;
   return rc;
@@ -2970,10 +4713,10 @@ iwrc iwkv_sync(IWKV iwkv, iwfs_sync_flags _flags) {
     rc = iwal_savepoint(iwkv, true);
   } else {
     IWFS_FSM *fsm  = &iwkv->fsm;
-    pthread_rwlock_wrlock(&iwkv->rwl);
+    iwdrwl_wrlock(&iwkv->rwl);
     iwfs_sync_flags flags = IWFS_FDATASYNC | _flags;
     rc = fsm->sync(fsm, flags);
-    pthread_rwlock_unlock(&iwkv->rwl);
+    iwdrwl_unlock(&iwkv->rwl);
   }
   return rc;
 }
@@ -2987,10 +4730,40 @@ iwrc iwkv_checkpoint(IWKV iwkv) {
 }
 
 iwrc iwkv_db(IWKV iwkv, uint32_t dbid, iwdb_flags_t dbflg, IWDB *dbp) {
+  return iwkv_db_ext(iwkv, dbid, dbflg, 0, dbp);
+}
+
+/**
+ * @brief Check options of `iwkv_db_ext()` match existing database.
+ */
+static bool _db_opts_match(IWDB db, iwdb_flags_t dbflg, uint8_t idxnum, uint32_t bloom_keys, IWDB_CMP cmp) {
+  if (db->dbflg != dbflg || (idxnum && db->idxnum != idxnum) || (bloom_keys && !db->bloomn)) {
+    return false;
+  }
+  if (db->cmpid == DB_CMP_CUSTOM) {
+    // Custom comparator is not stored in file so it must be given by the first call after storage open
+    return db->cmp ? (!cmp || cmp == db->cmp) : (_db_cmp_id(cmp) == DB_CMP_CUSTOM);
+  }
+  return !cmp || _db_cmp_id(cmp) == db->cmpid;
+}
+
+iwrc iwkv_db_ext(IWKV iwkv, uint32_t dbid, iwdb_flags_t dbflg, const IWDB_OPTS *opts, IWDB *dbp) {
   int rci;
   iwrc rc = 0;
   IWDB db = 0;
+  uint8_t idxnum = (opts && opts->fanout) ? opts->fanout : 0;
+  uint32_t bloom_keys = opts ? opts->bloom_keys : 0;
+  IWDB_CMP cmp = opts ? opts->cmp : 0;
+  void *cmp_op = opts ? opts->cmp_op : 0;
   *dbp = 0;
+  if (((dbflg & IWDB_PREFIX_KEYS) && (dbflg & (IWDB_UINT32_KEYS | IWDB_UINT64_KEYS)))
+      || ((dbflg & IWDB_VENC_FLAGS) && (dbflg & IWDB_DUP_FLAGS))
+      || (cmp && (dbflg & (IWDB_UINT32_KEYS | IWDB_UINT64_KEYS | IWDB_PREFIX_KEYS)))) {
+    return IWKV_ERROR_INCOMPATIBLE_DB_MODE;
+  }
+  if (idxnum && !_db_idxnum_valid(idxnum)) {
+    return IW_ERROR_INVALID_ARGS;
+  }
   API_RLOCK(iwkv, rci);
   khiter_t ki = kh_get(DBS, iwkv->dbs, dbid);
   if (ki != kh_end(iwkv->dbs)) {
@@ -2999,189 +4772,1814 @@ iwrc iwkv_db(IWKV iwkv, uint32_t dbid, iwdb_flags_t dbflg, IWDB *dbp) {
   API_UNLOCK(iwkv, rci, rc);
   RCRET(rc);
   if (db) {
-    if (db->dbflg != dbflg) {
+    if (!_db_opts_match(db, dbflg, idxnum, bloom_keys, cmp)) {
       return IWKV_ERROR_INCOMPATIBLE_DB_MODE;
     }
-    *dbp = db;
+    if (_db_cmp_missing(db)) {
+      API_DB_WLOCK(db, rci);
+      if (!db->cmp) {
+        db->cmp = cmp;
+        db->cmp_op = cmp_op;
+      } else if (db->cmp != cmp) {
+        rc = IWKV_ERROR_INCOMPATIBLE_DB_MODE;
+      }
+      API_DB_UNLOCK(db, rci, rc);
+      RCRET(rc);
+    }
+    *dbp = db;
+    if ((dbflg & IWDB_TTL) && !(iwkv->oflags & IWKV_RDONLY)) {
+      rc = _ttl_reaper_start(iwkv);
+    }
+    return rc;
+  }
+  if (iwkv->oflags & IWKV_RDONLY) {
+    return IW_ERROR_READONLY;
+  }
+  if (idxnum && idxnum != KVBLK_IDXNUM && iwkv->fmt_version < 1) {
+    // Fanout is not stored in database blocks of older format
+    return IWKV_ERROR_INCOMPATIBLE_DB_FORMAT;
+  }
+  if (bloom_keys && iwkv->fmt_version < 2) {
+    return IWKV_ERROR_INCOMPATIBLE_DB_FORMAT;
+  }
+  if (cmp && iwkv->fmt_version < 3) {
+    // Comparator is not stored in database blocks of older format
+    return IWKV_ERROR_INCOMPATIBLE_DB_FORMAT;
+  }
+  rc = iwkv_exclusive_lock(iwkv);
+  RCRET(rc);
+  ki = kh_get(DBS, iwkv->dbs, dbid);
+  if (ki != kh_end(iwkv->dbs)) {
+    db = kh_value(iwkv->dbs, ki);
+  }
+  if (db) {
+    if (!_db_opts_match(db, dbflg, idxnum, bloom_keys, cmp)) {
+      rc = IWKV_ERROR_INCOMPATIBLE_DB_MODE;
+    } else {
+      if (_db_cmp_missing(db)) {
+        db->cmp = cmp;
+        db->cmp_op = cmp_op;
+      }
+      *dbp = db;
+    }
+  } else {
+    rc = _db_create_lw(iwkv, dbid, dbflg, idxnum ? idxnum : KVBLK_IDXNUM, bloom_keys, cmp, cmp_op, dbp);
+  }
+  iwkv_exclusive_unlock(iwkv);
+  if (!rc) {
+    rc = iwal_checkpoint(iwkv, true);
+  }
+  if (!rc && (dbflg & IWDB_TTL)) {
+    rc = _ttl_reaper_start(iwkv);
+  }
+  return rc;
+}
+
+iwrc iwkv_db_set_comparator(IWDB db, IWDB_CMP cmp, void *op) {
+  if (!db || !db->iwkv) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  if (cmp && (db->dbflg & (IWDB_UINT32_KEYS | IWDB_UINT64_KEYS | IWDB_PREFIX_KEYS))) {
+    return IWKV_ERROR_INCOMPATIBLE_DB_MODE;
+  }
+  int rci;
+  iwrc rc = 0;
+  uint8_t *mm;
+  uint32_t n0;
+  IWKV iwkv = db->iwkv;
+  IWFS_FSM *fsm = &iwkv->fsm;
+  uint8_t cmpid = _db_cmp_id(cmp);
+  if (cmpid != db->cmpid) {
+    if (iwkv->oflags & IWKV_RDONLY) {
+      return IW_ERROR_READONLY;
+    }
+    if (iwkv->fmt_version < 3) {
+      return IWKV_ERROR_INCOMPATIBLE_DB_FORMAT;
+    }
+  }
+  API_DB_WLOCK(db, rci);
+  if (db->cmp == cmp && db->cmp_op == op) {
+    goto finish;
+  }
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCGO(rc, finish);
+  memcpy(&n0, mm + db->addr + DOFF_N0_U4, 4);
+  if (n0 && !(_db_cmp_missing(db) && cmpid == DB_CMP_CUSTOM)) {
+    // Records are ordered by current comparator
+    rc = IW_ERROR_INVALID_STATE;
+  } else if (cmpid != db->cmpid) {
+    memcpy(mm + db->addr + DOFF_CMP_U1, &cmpid, 1);
+    if (iwkv->dlsnr) {
+      rc = iwkv->dlsnr->onwrite(iwkv->dlsnr, db->addr + DOFF_CMP_U1, &cmpid, 1, 0);
+    }
+  }
+  fsm->release_mmap(fsm);
+  if (!rc) {
+    _dbcache_destroy_lw(db);
+    db->cmp = cmp;
+    db->cmp_op = op;
+    db->cmpid = cmpid;
+  }
+
+finish:
+  API_DB_UNLOCK(db, rci, rc);
+  return rc;
+}
+
+int iwkv_cmp_int64(const void *v1, size_t v1len, const void *v2, size_t v2len, void *op) {
+  int64_t n1, n2;
+  if (v1len != sizeof(n1) || v2len != sizeof(n2)) {
+    return v1len < v2len ? -1 : v1len > v2len ? 1 : memcmp(v1, v2, v1len);
+  }
+  memcpy(&n1, v1, sizeof(n1));
+  memcpy(&n2, v2, sizeof(n2));
+  return n1 < n2 ? -1 : n1 > n2 ? 1 : 0;
+}
+
+int iwkv_cmp_double(const void *v1, size_t v1len, const void *v2, size_t v2len, void *op) {
+  double d1, d2;
+  if (v1len != sizeof(d1) || v2len != sizeof(d2)) {
+    return v1len < v2len ? -1 : v1len > v2len ? 1 : memcmp(v1, v2, v1len);
+  }
+  memcpy(&d1, v1, sizeof(d1));
+  memcpy(&d2, v2, sizeof(d2));
+  if (d1 < d2) {
+    return -1;
+  } else if (d1 > d2) {
+    return 1;
+  } else if (d1 == d2) {
+    return 0;
+  }
+  // NaN is greater than any other number
+  return isnan(d1) ? (isnan(d2) ? 0 : 1) : -1;
+}
+
+IW_INLINE bool _vtuple_next(const uint8_t **rp, const uint8_t *ep, uint64_t *v) {
+  uint64_t base = 1;
+  *v = 0;
+  for (const uint8_t *p = *rp; p < ep && base; ++p) {
+    int8_t b = (int8_t) *p;
+    if (b >= 0) {
+      *v += base * b;
+      *rp = p + 1;
+      return true;
+    }
+    *v += base * (uint8_t) ~b;
+    base <<= 7;
+  }
+  return false;
+}
+
+int iwkv_cmp_vtuple(const void *v1, size_t v1len, const void *v2, size_t v2len, void *op) {
+  uint64_t n1, n2;
+  const uint8_t *p1 = v1, *e1 = p1 + v1len;
+  const uint8_t *p2 = v2, *e2 = p2 + v2len;
+  while (p1 < e1 && p2 < e2) {
+    bool r1 = _vtuple_next(&p1, e1, &n1);
+    bool r2 = _vtuple_next(&p2, e2, &n2);
+    if (!r1 || !r2) {
+      // Malformed tuples
+      int rv = iwu_memcmp(p1, p2, MIN(e1 - p1, e2 - p2));
+      return rv ? rv : (int)((e1 - p1) - (e2 - p2));
+    }
+    if (n1 != n2) {
+      return n1 < n2 ? -1 : 1;
+    }
+  }
+  // Tuple prefix is less than tuple itself
+  return (p1 < e1) ? 1 : (p2 < e2) ? -1 : 0;
+}
+
+iwrc iwkv_db_cache_release(IWDB db) {
+  if (!db || !db->iwkv) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  int rci;
+  iwrc rc = 0;
+  API_DB_WLOCK(db, rci);
+  _dbcache_destroy_lw(db);
+  API_DB_UNLOCK(db, rci, rc);
+  return rc;
+}
+
+iwrc iwkv_db_last_access_time(const IWDB db, uint64_t *ts) {
+  if (!db || !db->iwkv || !ts) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  int rci;
+  iwrc rc = 0;
+  API_DB_RLOCK(db, rci);
+  if (db->cache.open)   {
+    *ts = db->cache.atime;
+  } else {
+    *ts = 0;
+  }
+  API_DB_UNLOCK(db, rci, rc);
+  return rc;
+}
+
+iwrc iwkv_db_destroy(IWDB *dbp) {
+  if (!dbp || !*dbp) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  IWDB db = *dbp;
+  IWKV iwkv = db->iwkv;
+  if (iwkv->oflags & IWKV_RDONLY) {
+    return IW_ERROR_READONLY;
+  }
+  iwrc rc = iwkv_exclusive_lock(iwkv);
+  RCGO(rc, finish);
+  rc = _iwkv_worker_inc_nolk(iwkv);
+  if (!rc) {
+    rc = _db_destroy_lw(dbp);
+  }
+  iwkv_exclusive_unlock(iwkv);
+  
+finish:
+  return rc;
+}
+
+/**
+ * @brief Acquire database write lock for update operation.
+ *
+ * Before that key bounds are looked up under database read lock,
+ * so skiplist traversals of concurrent writers are not serialized.
+ * Lookup results are revalidated by `_lx_revalidate_lower_lw()` once write lock is acquired.
+ */
+static WUR iwrc _api_db_wlock_lx(IWLCTX *lx) {
+  int rci;
+  IWDB db = lx->db;
+  if (IW_UNLIKELY(!db->cache.open)) {
+    API_DB_WLOCK(db, rci);
+    return 0;
+  }
+  API_DB_RLOCK(db, rci);
+  lx->rmcnt = db->rmcnt;
+  iwrc rc = _lx_find_bounds(lx);
+  if (rc) { // Lookup will be repeated under write lock
+    lx->lower = 0;
+    lx->upper = 0;
+    lx->dblk.addr = 0;
+  }
+  pthread_rwlock_unlock(&db->rwl);
+  rci = pthread_rwlock_wrlock(&db->rwl);
+  if (rci) {
+    iwdrwl_unlock(&db->iwkv->rwl);
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  return 0;
+}
+
+iwrc iwkv_put(IWDB db, const IWKV_val *key, const IWKV_val *val, iwkv_opflags opflags) {
+  return iwkv_put_ttl(db, key, val, 0, opflags);
+}
+
+static iwrc _kv_put(IWDB db, const IWKV_val *key, const IWKV_val *val, uint64_t ttl_ms,
+                   iwrc(*ph)(IWLCTX *lx, const IWKV_val *oval), void *phop, iwkv_opflags opflags) {
+  if (!db || !db->iwkv || !key || !key->size || !val) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  IWKV iwkv = db->iwkv;
+  if (iwkv->oflags & IWKV_RDONLY) {
+    return IW_ERROR_READONLY;
+  }
+  if (((db->dbflg & IWDB_UINT32_KEYS) && key->size != 4) ||
+      ((db->dbflg & IWDB_UINT64_KEYS) && key->size != 8)) {
+    return IWKV_ERROR_KEY_NUM_VALUE_SIZE;
+  }
+  if ((ttl_ms && !(db->dbflg & IWDB_TTL)) || (ph && (db->dbflg & IWDB_DUP_FLAGS))) {
+    return IWKV_ERROR_INCOMPATIBLE_DB_MODE;
+  }
+  int rci;
+  iwrc rc = 0;
+  IWLCTX lx = {
+    .db = db,
+    .key = key,
+    .val = (IWKV_val *) val,
+    .nlvl = -1,
+    .op = IWLCTX_PUT,
+    .opflags = opflags,
+    .ph = ph,
+    .phop = phop
+  };
+  iwp_current_time_ms(&lx.ts);
+  if (ttl_ms) {
+    lx.expire = lx.ts + ttl_ms;
+  }
+  rc = _api_db_wlock_lx(&lx);
+  RCRET(rc);
+  if (!db->cache.open) {
+    rc = _dbcache_fill_lw(&lx);
+    RCGO(rc, finish);
+  }
+  rc = _lx_revalidate_lower_lw(&lx);
+  RCGO(rc, finish);
+  rc = _lx_put_lw(&lx);
+
+finish:
+  API_DB_UNLOCK(db, rci, rc);
+  _kv_val_dispose(&lx.phval);
+  if (!rc) {
+    if (lx.opflags & IWKV_SYNC) {
+      rc = iwkv_sync(iwkv, 0);
+    } else {
+      rc = iwal_checkpoint(iwkv, false);
+    }
+  }
+  return rc;
+}
+
+iwrc iwkv_put_ttl(IWDB db, const IWKV_val *key, const IWKV_val *val, uint64_t ttl_ms, iwkv_opflags opflags) {
+  return _kv_put(db, key, val, ttl_ms, 0, 0, opflags);
+}
+
+static iwrc _cas_ph(IWLCTX *lx, const IWKV_val *oval) {
+  const IWKV_val *expected = lx->phop;
+  if (expected) {
+    if (!oval || oval->size != expected->size || memcmp(oval->data, expected->data, oval->size)) {
+      return IWKV_ERROR_CAS_MISMATCH;
+    }
+  } else if (oval) {
+    return IWKV_ERROR_CAS_MISMATCH;
+  }
+  return 0;
+}
+
+iwrc iwkv_put_cas(IWDB db, const IWKV_val *key, const IWKV_val *expected, const IWKV_val *val,
+                  iwkv_opflags opflags) {
+  return _kv_put(db, key, val, 0, _cas_ph, (void *) expected, opflags);
+}
+
+typedef struct MERGEOP {
+  IWKV_MERGE mfn;
+  void *op;
+} MERGEOP;
+
+static iwrc _merge_ph(IWLCTX *lx, const IWKV_val *oval) {
+  MERGEOP *mop = lx->phop;
+  iwrc rc = mop->mfn(lx->key, oval, &lx->phval, mop->op);
+  RCRET(rc);
+  lx->val = &lx->phval;
+  return 0;
+}
+
+iwrc iwkv_merge(IWDB db, const IWKV_val *key, IWKV_MERGE mfn, void *op, iwkv_opflags opflags) {
+  if (!mfn) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  IWKV_val val = {0};
+  MERGEOP mop = {.mfn = mfn, .op = op};
+  return _kv_put(db, key, &val, 0, _merge_ph, &mop, opflags);
+}
+
+typedef struct KVREF {
+  const IWKV_val *key;
+  const IWKV_val *val;
+  IWDB db;
+} KVREF;
+
+// Records are ordered as keys in skiplist
+#define _kvref_lt(r1, r2) \
+  (_cmp_key((r1).db, (r1).key->data, (r1).key->size, (r2).key->data, (r2).key->size) < 0)
+
+KSORT_INIT(kvref, KVREF, _kvref_lt)
+
+iwrc iwkv_put_batch(IWDB db, const IWKV_val *keys, const IWKV_val *vals, size_t num, iwkv_opflags opflags) {
+  if (!db || !db->iwkv || (num && (!keys || !vals))) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  IWKV iwkv = db->iwkv;
+  if (iwkv->oflags & IWKV_RDONLY) {
+    return IW_ERROR_READONLY;
+  }
+  if (!num) {
+    return 0;
+  }
+  for (size_t i = 0; i < num; ++i) {
+    if (!keys[i].size) {
+      return IW_ERROR_INVALID_ARGS;
+    }
+    if (((db->dbflg & IWDB_UINT32_KEYS) && keys[i].size != 4) ||
+        ((db->dbflg & IWDB_UINT64_KEYS) && keys[i].size != 8)) {
+      return IWKV_ERROR_KEY_NUM_VALUE_SIZE;
+    }
+  }
+  int rci;
+  iwrc rc = 0;
+  KVREF *refs = malloc(2 * num * sizeof(*refs));
+  if (!refs) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  for (size_t i = 0; i < num; ++i) {
+    refs[i].key = &keys[i];
+    refs[i].val = &vals[i];
+    refs[i].db = db;
+  }
+  ks_mergesort_kvref(num, refs, refs + num);
+
+  IWLCTX lx = {
+    .db = db,
+    .nlvl = -1,
+    .op = IWLCTX_PUT,
+    .opflags = opflags
+  };
+  iwp_current_time_ms(&lx.ts);
+  API_DB_WLOCK(db, rci);
+  if (!db->cache.open) {
+    rc = _dbcache_fill_lw(&lx);
+    RCGO(rc, finish);
+  }
+  for (size_t i = 0; i < num; ++i) {
+    lx.key = refs[i].key;
+    lx.val = (IWKV_val *) refs[i].val;
+    lx.nlvl = -1;
+    lx.upper = 0;
+    lx.dblk.addr = 0;
+    if (i > 0) {
+      rc = _lx_finger_lower(&lx);
+      RCBREAK(rc);
+    }
+    rc = _lx_put_lw(&lx);
+    RCBREAK(rc);
+  }
+
+finish:
+  API_DB_UNLOCK(db, rci, rc);
+  free(refs);
+  if (!rc) {
+    if (opflags & IWKV_SYNC) {
+      rc = iwkv_sync(iwkv, 0);
+    } else {
+      rc = iwal_checkpoint(iwkv, false);
+    }
+  }
+  return rc;
+}
+
+//-------------------------- BULK LOAD
+
+/** Record buffered by `iwkv_load()` */
+typedef struct LOADREC {
+  size_t off;                   /**< Record offset in `LOADCTX::buf`: [key,value] */
+  uint32_t ksz;                 /**< Key size */
+  uint32_t vsz;                 /**< Value size */
+} LOADREC;
+
+/** Bulk load context */
+typedef struct LOADCTX {
+  uint8_t *buf;                 /**< Records data buffer: [previous key,records...] */
+  size_t bufsz;                 /**< Allocated size of `buf` */
+  size_t bufpos;                /**< Used size of `buf` */
+  uint32_t pksz;                /**< Size of previous key stored at the start of `buf` */
+  int num;                      /**< Number of buffered records */
+  uint64_t bnum;                /**< Number of loaded `SBLK` nodes */
+  uint64_t rmcnt;               /**< `IWDB::rmcnt` snapshot */
+  int8_t tlvl;                  /**< Top level of loaded nodes */
+  off_t tails[SLEVELS];         /**< Addresses of the last loaded nodes per level */
+  LOADREC recs[KVBLK_IDXNUM_MAX];   /**< Buffered records of the next node */
+} LOADCTX;
+
+static WUR iwrc _lx_load_add(IWLCTX *lx, LOADCTX *ld, const IWKV_val *key, const IWKV_val *val) {
+  IWDB db = lx->db;
+  const uint8_t *pk = ld->buf;
+  uint32_t pksz = ld->pksz;
+  if (!key->size || !key->data || (val->size && !val->data)) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  if (((db->dbflg & IWDB_UINT32_KEYS) && key->size != 4) ||
+      ((db->dbflg & IWDB_UINT64_KEYS) && key->size != 8)) {
+    return IWKV_ERROR_KEY_NUM_VALUE_SIZE;
+  }
+  if (ld->num) {
+    pk = ld->buf + ld->recs[ld->num - 1].off;
+    pksz = ld->recs[ld->num - 1].ksz;
+  }
+  if (pksz && _cmp_key(db, pk, pksz, key->data, key->size) >= 0) {
+    iwlog_ecode_error2(IW_ERROR_INVALID_ARGS, "Loaded records are not sorted or keys are not unique");
+    return IW_ERROR_INVALID_ARGS;
+  }
+  if (db->bloomn) {
+    // Filter is rebuilt if needed once all records are loaded
+    iwrc rc = _bloom_add_lw(db, key->data, key->size);
+    RCRET(rc);
+  }
+  size_t rsz = key->size + val->size;
+  if (ld->bufpos + rsz > ld->bufsz) {
+    size_t nsz = MAX(2 * ld->bufsz, ld->bufpos + rsz);
+    uint8_t *nbuf = realloc(ld->buf, nsz);
+    if (!nbuf) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    ld->buf = nbuf;
+    ld->bufsz = nsz;
+  }
+  LOADREC *r = &ld->recs[ld->num++];
+  r->off = ld->bufpos;
+  r->ksz = key->size;
+  r->vsz = val->size;
+  memcpy(ld->buf + r->off, key->data, key->size);
+  memcpy(ld->buf + r->off + key->size, val->data, val->size);
+  ld->bufpos += rsz;
+  return 0;
+}
+
+/**
+ * @brief Upper bound of loaded value size as it is stored in KVBLK by `_kvblk_addkv()`.
+ */
+IW_INLINE size_t _lx_load_vsz(IWDB db, uint32_t vsz) {
+  size_t sz = vsz;
+  if (db->dbflg & IWDB_DUP_FLAGS) {
+    sz += 4;
+  }
+  if (db->dbflg & IWDB_VENC_FLAGS) {
+    // [vtype:u1,value], compressed value with its `vlen:vn` is kept only if not larger,
+    // loaded records have no expiration time
+    sz += 1;
+    if ((db->dbflg & IWDB_BLOB_VALS) && sz > db->iwkv->blob_threshold) {
+      sz = db->iwkv->blob_threshold; // Compressed value or blob reference
+    }
+  }
+  return sz;
+}
+
+/**
+ * @brief Write buffered records as a new `SBLK` node appended to the end of skiplist.
+ *
+ * Node level is the number of trailing zero bits in node ordinal number,
+ * so every 2^n-th node reaches level n. Forward links of previous
+ * nodes are patched in place, database block is updated in `lx->dblk`.
+ */
+static WUR iwrc _lx_load_flush(IWLCTX *lx, LOADCTX *ld) {
+  iwrc rc;
+  SBLK *sblk;
+  uint8_t *mm;
+  uint32_t lv;
+  IWKV_val key, val;
+  IWDB db = lx->db;
+  IWFS_FSM *fsm = &db->iwkv->fsm;
+  IWDLSNR *dlsnr = db->iwkv->dlsnr;
+  size_t sz = KVBLK_MAX_NKV_SZ(db->idxnum);
+  if (db->dbflg & IWDB_PREFIX_KEYS) {
+    sz += KVBLK_MAX_PFXA_SZ;
+  }
+  for (int i = 0; i < ld->num; ++i) {
+    sz += IW_VNUMSIZE(ld->recs[i].ksz) + ld->recs[i].ksz + _lx_load_vsz(db, ld->recs[i].vsz);
+    if (db->dbflg & IWDB_PREFIX_KEYS) {
+      sz += 1; // plen:vn
+    }
+  }
+  uint8_t kvbpow = iwlog2_64(sz);
+  while ((1ULL << kvbpow) < sz) {
+    kvbpow++;
+  }
+  int8_t lvl = iwbits_find_first_sbit64(ld->bnum + 1);
+  if (lvl >= SLEVELS) {
+    lvl = SLEVELS - 1;
+  }
+  rc = _sblk_create(lx, lvl, kvbpow, ld->tails[0], &sblk);
+  RCRET(rc);
+  for (int i = 0; i < ld->num; ++i) {
+    key.data = ld->buf + ld->recs[i].off;
+    key.size = ld->recs[i].ksz;
+    val.data = ld->buf + ld->recs[i].off + key.size;
+    val.size = ld->recs[i].vsz;
+    rc = _sblk_addkv2(sblk, i, &key, &val, lx->opflags, 0, false);
+    if (rc) {
+      IWRC(_sblk_destroy(lx, &sblk), rc);
+      return rc;
+    }
+  }
+  sblk->flags &= ~SBLK_CACHE_FLAGS;
+  sblk->p0 = ADDR2BLK(ld->tails[0]);
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  if (rc) {
+    IWRC(_sblk_destroy(lx, &sblk), rc);
+    return rc;
+  }
+  rc = _sblk_sync_mm(lx, sblk, mm);
+  RCGO(rc, finish);
+  for (int i = 0; i <= lvl; ++i) {
+    if (ld->tails[i] == db->addr) {
+      lx->dblk.n[i] = ADDR2BLK(sblk->addr);
+      lx->dblk.flags |= SBLK_DURTY;
+    } else {
+      uint8_t *wp = mm + ld->tails[i] + SOFF_N0_U4 + 4 * i;
+      IW_WRITELV(wp, lv, ADDR2BLK(sblk->addr));
+      if (dlsnr) {
+        rc = dlsnr->onwrite(dlsnr, wp - 4 - mm, wp - 4, 4, 0);
+        RCGO(rc, finish);
+      }
+    }
+    ld->tails[i] = sblk->addr;
+  }
+  if (lvl > ld->tlvl) {
+    ld->tlvl = lvl;
+  }
+  if (lvl > lx->dblk.lvl) {
+    lx->dblk.lvl = lvl;
+  }
+  ++ld->bnum;
+  // Keep the last key to check records order
+  LOADREC *r = &ld->recs[ld->num - 1];
+  memmove(ld->buf, ld->buf + r->off, r->ksz);
+  ld->pksz = r->ksz;
+  ld->bufpos = r->ksz;
+  ld->num = 0;
+
+finish:
+  fsm->release_mmap(fsm);
+  _sblk_release(lx, &sblk);
+  return rc;
+}
+
+/**
+ * @brief Persist database block and database tail pointing
+ *        to the last loaded node and reset dbcache.
+ */
+static WUR iwrc _lx_load_sync_lw(IWLCTX *lx, LOADCTX *ld) {
+  uint8_t *mm;
+  SBLK *dbtail;
+  IWDB db = lx->db;
+  IWFS_FSM *fsm = &db->iwkv->fsm;
+  iwrc rc = _sblk_at(lx, 0, 0, &dbtail);
+  RCRET(rc);
+  dbtail->p0 = ADDR2BLK(ld->tails[0]);
+  dbtail->flags |= SBLK_DURTY;
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCRET(rc);
+  rc = _sblk_sync_mm(lx, &lx->dblk, mm);
+  IWRC(_sblk_sync_and_release_mm(lx, &dbtail, mm), rc);
+  fsm->release_mmap(fsm);
+  _dbcache_destroy_lw(db);
+  return rc;
+}
+
+/**
+ * @brief Check what loaded nodes chain was not changed
+ *        while database was unlocked.
+ */
+static WUR iwrc _lx_load_check_lw(IWLCTX *lx, LOADCTX *ld) {
+  SBLK *sblk;
+  IWDB db = lx->db;
+  iwrc rc = _sblk_at(lx, db->addr, 0, &sblk);
+  RCRET(rc);
+  memcpy(&lx->dblk, sblk, sizeof(lx->dblk));
+  if (db->rmcnt != ld->rmcnt) {
+    return IW_ERROR_INVALID_STATE;
+  }
+  for (int i = 0; i <= ld->tlvl; ++i) {
+    if (ld->tails[i] == db->addr) {
+      sblk = &lx->dblk;
+    } else {
+      rc = _sblk_at(lx, ld->tails[i], 0, &sblk);
+      RCRET(rc);
+    }
+    if (sblk->n[i] || (i == 0 && sblk->pnum != lx->db->idxnum)) {
+      return IW_ERROR_INVALID_STATE;
+    }
+  }
+  return 0;
+}
+
+iwrc iwkv_load(IWDB db, IWKV_LOAD_NEXT next, void *opaq, iwkv_opflags opflags) {
+  if (!db || !db->iwkv || !next) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  IWKV iwkv = db->iwkv;
+  if (iwkv->oflags & IWKV_RDONLY) {
+    return IW_ERROR_READONLY;
+  }
+  int rci;
+  iwrc rc = 0;
+  bool eof = false;
+  IWKV_val key, val;
+  LOADCTX ld = {0};
+  IWLCTX lx = {
+    .db = db,
+    .nlvl = -1,
+    .op = IWLCTX_PUT,
+    .opflags = opflags
+  };
+  iwp_current_time_ms(&lx.ts);
+  API_DB_WLOCK(db, rci);
+  SBLK *sblk;
+  rc = _sblk_at(&lx, db->addr, 0, &sblk);
+  RCGO(rc, finish);
+  memcpy(&lx.dblk, sblk, sizeof(lx.dblk));
+  if (lx.dblk.n[0]) {
+    rc = IW_ERROR_INVALID_STATE;
+    goto finish;
+  }
+  for (int i = 0; i < SLEVELS; ++i) {
+    ld.tails[i] = db->addr;
+  }
+  ld.rmcnt = db->rmcnt;
+  while (!eof) {
+    key.size = 0;
+    val.size = 0;
+    rc = next(&key, &val, opaq);
+    if (rc == IWKV_ERROR_NOTFOUND) {
+      rc = 0;
+      eof = true;
+    } else {
+      RCBREAK(rc);
+      rc = _lx_load_add(&lx, &ld, &key, &val);
+      RCBREAK(rc);
+    }
+    if (ld.num == db->idxnum || (eof && ld.num)) {
+      rc = _lx_load_flush(&lx, &ld);
+      RCBREAK(rc);
+      if (!eof && !(ld.bnum % IWKV_LOAD_CHUNK_NUM)) {
+        // Let WAL checkpoint run
+        rc = _lx_load_sync_lw(&lx, &ld);
+        API_DB_UNLOCK(db, rci, rc);
+        RCGO(rc, finish2);
+        rc = iwal_checkpoint(iwkv, false);
+        RCGO(rc, finish2);
+        rc = _api_db_wlock(db);
+        RCGO(rc, finish2);
+        rc = _lx_load_check_lw(&lx, &ld);
+        RCGO(rc, finish);
+      }
+    }
+  }
+  if (ld.bnum) {
+    IWRC(_lx_load_sync_lw(&lx, &ld), rc);
+    lx.dblk.addr = 0;
+    IWRC(_dbcache_fill_lw(&lx), rc);
+    if (!rc && db->bloomn && db->bloom_puts > 2 * _bloom_capacity(db)) {
+      rc = _bloom_rebuild_lw(db);
+    }
+  }
+
+finish:
+  API_DB_UNLOCK(db, rci, rc);
+finish2:
+  free(ld.buf);
+  if (!rc) {
+    if (opflags & IWKV_SYNC) {
+      rc = iwkv_sync(iwkv, 0);
+    } else {
+      rc = iwal_checkpoint(iwkv, false);
+    }
+  }
+  return rc;
+}
+
+iwrc iwkv_get(IWDB db, const IWKV_val *key, IWKV_val *oval) {
+  if (!db || !db->iwkv || !key || !oval) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  int rci;
+  iwrc rc = 0;
+  IWLCTX lx = {
+    .db = db,
+    .key = key,
+    .val = oval,
+    .nlvl = -1
+  };
+  iwp_current_time_ms(&lx.ts);
+  oval->size = 0;
+  if (IW_LIKELY(db->cache.open)) {
+    API_DB_RLOCK(db, rci);
+  } else {
+    API_DB_WLOCK(db, rci);
+    if (!db->cache.open) {
+      rc = _dbcache_fill_lw(&lx);
+      RCGO(rc, finish);
+    }
+  }
+  rc = _lx_get_lr(&lx);
+  
+finish:
+  API_DB_UNLOCK(db, rci, rc);
+  return rc;
+}
+
+iwrc iwkv_get_peek(IWDB db, const IWKV_val *key, IWKV_VISITOR visitor, void *opaq) {
+  if (!db || !db->iwkv || !key || !visitor) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  int rci;
+  iwrc rc = 0;
+  IWLCTX lx = {
+    .db = db,
+    .key = key,
+    .nlvl = -1
+  };
+  iwp_current_time_ms(&lx.ts);
+  if (IW_LIKELY(db->cache.open)) {
+    API_DB_RLOCK(db, rci);
+  } else {
+    API_DB_WLOCK(db, rci);
+    if (!db->cache.open) {
+      rc = _dbcache_fill_lw(&lx);
+      RCGO(rc, finish);
+    }
+  }
+  rc = _lx_peek_lr(&lx, visitor, opaq);
+
+finish:
+  API_DB_UNLOCK(db, rci, rc);
+  return rc;
+}
+
+iwrc iwkv_get_multi(IWDB db, const IWKV_val *keys, size_t num, IWKV_val *ovals, iwrc *orcs) {
+  if (!db || !db->iwkv || (num && (!keys || !ovals))) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  for (size_t i = 0; i < num; ++i) {
+    ovals[i].data = 0;
+    ovals[i].size = 0;
+    if (orcs) {
+      orcs[i] = IWKV_ERROR_NOTFOUND;
+    }
+  }
+  if (!num) {
+    return 0;
+  }
+  int rci;
+  bool found;
+  uint8_t *mm = 0, idx;
+  iwrc rc = 0;
+  IWFS_FSM *fsm = &db->iwkv->fsm;
+  KVREF *refs = malloc(2 * num * sizeof(*refs));
+  if (!refs) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  for (size_t i = 0; i < num; ++i) {
+    refs[i].key = &keys[i];
+    refs[i].val = &ovals[i];
+    refs[i].db = db;
+  }
+  ks_mergesort_kvref(num, refs, refs + num);
+
+  IWLCTX lx = {
+    .db = db,
+    .nlvl = -1
+  };
+  iwp_current_time_ms(&lx.ts);
+  if (IW_LIKELY(db->cache.open)) {
+    API_DB_RLOCK(db, rci);
+  } else {
+    API_DB_WLOCK(db, rci);
+    if (!db->cache.open) {
+      rc = _dbcache_fill_lw(&lx);
+      RCGO(rc, finish);
+    }
+  }
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCGO(rc, finish);
+  for (size_t i = 0; i < num; ++i) {
+    lx.key = refs[i].key;
+    lx.val = (IWKV_val *) refs[i].val;
+    if (!_bloom_check_mm(db, lx.key, mm)) {
+      continue;
+    }
+    if (lx.flower[0]) { // Start from bounds of previous lookup
+      rc = _lx_finger_lower(&lx);
+      RCBREAK(rc);
+    }
+    rc = _lx_find_bounds(&lx);
+    RCBREAK(rc);
+    rc = _sblk_loadkvblk_mm(&lx, lx.lower, mm);
+    RCBREAK(rc);
+    rc = _sblk_find_pi_mm(lx.lower, lx.key, mm, &found, &idx);
+    RCBREAK(rc);
+    if (found && !_kvblk_expired(lx.lower->kvblk, lx.lower->pi[idx], mm, lx.ts)) {
+      rc = _kvblk_getvalue(lx.lower->kvblk, mm, lx.lower->pi[idx], lx.val);
+      RCBREAK(rc);
+      if (orcs) {
+        orcs[lx.key - keys] = 0;
+      }
+    }
+    _lx_release_mm(&lx, 0);
+  }
+  _lx_release_mm(&lx, 0);
+  IWRC(fsm->release_mmap(fsm), rc);
+
+finish:
+  API_DB_UNLOCK(db, rci, rc);
+  free(refs);
+  if (rc) {
+    for (size_t i = 0; i < num; ++i) {
+      _kv_val_dispose(&ovals[i]);
+    }
+  }
+  return rc;
+}
+
+iwrc iwkv_del(IWDB db, const IWKV_val *key) {
+  if (!db || !db->iwkv || !key) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  int rci;
+  iwrc rc = 0;
+  IWKV iwkv = db->iwkv;
+  IWLCTX lx = {
+    .db = db,
+    .key = key,
+    .nlvl = -1,
+    .op = IWLCTX_DEL
+  };
+  iwp_current_time_ms(&lx.ts);
+  rc = _api_db_wlock_lx(&lx);
+  RCRET(rc);
+  if (!db->cache.open) {
+    rc = _dbcache_fill_lw(&lx);
+    RCGO(rc, finish);
+  }
+  rc = _lx_revalidate_lower_lw(&lx);
+  RCGO(rc, finish);
+  rc = _lx_del_lw(&lx);
+  
+finish:
+  API_DB_UNLOCK(db, rci, rc);
+  if (!rc) {
+    if (lx.opflags & IWKV_SYNC) {
+      rc = iwkv_sync(iwkv, 0);
+    } else {
+      rc = iwal_checkpoint(iwkv, false);
+    }
+  }
+  return rc;
+}
+
+//-------------------------- RANGE DELETE
+
+/** File extent released by `iwkv_del_range()` */
+typedef struct DELEXT {
+  off_t addr;
+  off_t len;
+} DELEXT;
+
+/** Range removal context */
+typedef struct DELCTX {
+  DELEXT *exts;                 /**< Extents of removed nodes and value blobs */
+  size_t extnum;                /**< Number of `exts` */
+  size_t extsz;                 /**< Allocated number of `exts` */
+  blkn_t *cblkns;               /**< Removed nodes of cached levels */
+  size_t cnum;                  /**< Number of `cblkns` */
+  size_t csz;                   /**< Allocated number of `cblkns` */
+  uint64_t knum;                /**< Number of removed records */
+  uint64_t bnum;                /**< Number of removed nodes */
+  off_t faddr;                  /**< Address of the first removed node */
+  IWKV_val fkey;                /**< Lowest key of the first removed node */
+  int8_t tlvl;                  /**< Top level of removed nodes, -1 if no nodes removed */
+  off_t paddr[2];               /**< Partially cleared nodes: the first and/or the last node of range */
+  uint8_t pidx[2][2];           /**< Ranges of records removed from `paddr` nodes */
+  blkn_t succ[SLEVELS];         /**< Next nodes of the last removed nodes per level */
+  uint32_t lcnt[SLEVELS];       /**< Number of removed nodes per level */
+} DELCTX;
+
+static WUR iwrc _delctx_add_ext(DELCTX *dc, off_t addr, off_t len) {
+  if (dc->extnum == dc->extsz) {
+    size_t nsz = MAX(64, 2 * dc->extsz);
+    DELEXT *exts = realloc(dc->exts, nsz * sizeof(*exts));
+    if (!exts) {
+      return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+    }
+    dc->exts = exts;
+    dc->extsz = nsz;
+  }
+  dc->exts[dc->extnum].addr = addr;
+  dc->exts[dc->extnum].len = len;
+  ++dc->extnum;
+  return 0;
+}
+
+static int _delext_cmp(const void *o1, const void *o2) {
+  const DELEXT *e1 = o1, *e2 = o2;
+  return e1->addr > e2->addr ? 1 : e1->addr < e2->addr ? -1 : 0;
+}
+
+/**
+ * @brief Register node removed as whole: its blocks, value blobs and links to the next nodes.
+ */
+static WUR iwrc _delctx_add_node(IWLCTX *lx, DELCTX *dc, SBLK *sblk) {
+  iwrc rc;
+  uint8_t *mm, kvbpow;
+  IWDB db = lx->db;
+  IWFS_FSM *fsm = &db->iwkv->fsm;
+  rc = _delctx_add_ext(dc, sblk->addr, SBLK_SZ);
+  RCRET(rc);
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCRET(rc);
+  if (!dc->bnum || (db->dbflg & IWDB_BLOB_VALS)) {
+    rc = _sblk_loadkvblk_mm(lx, sblk, mm);
+    RCGO(rc, finish);
+  }
+  if (!dc->bnum) {
+    rc = _kvblk_getkey(sblk->kvblk, mm, sblk->pi[0], &dc->fkey);
+    RCGO(rc, finish);
+    dc->faddr = sblk->addr;
+  }
+  if (db->dbflg & IWDB_BLOB_VALS) {
+    for (int i = 0; i < sblk->pnum; ++i) {
+      blkn_t bblkn;
+      uint32_t bblen;
+      uint8_t *vbuf;
+      uint32_t vlen;
+      _kvblk_peek_val(sblk->kvblk, sblk->pi[i], mm, &vbuf, &vlen);
+      if (_kv_val_blob(vbuf, vlen, &bblkn, &bblen)) {
+        rc = _delctx_add_ext(dc, BLK2ADDR(bblkn), IW_ROUNDUP(bblen, 1 << IWKV_FSM_BPOW));
+        RCGO(rc, finish);
+      }
+    }
+  }
+  memcpy(&kvbpow, mm + BLK2ADDR(sblk->kvblkn) + KBLK_SZPOW_OFF, 1);
+  rc = _delctx_add_ext(dc, BLK2ADDR(sblk->kvblkn), 1ULL << kvbpow);
+  RCGO(rc, finish);
+  if (db->cache.num && sblk->lvl >= db->cache.lvl) {
+    if (dc->cnum == dc->csz) {
+      size_t nsz = MAX(64, 2 * dc->csz);
+      blkn_t *cblkns = realloc(dc->cblkns, nsz * sizeof(*cblkns));
+      if (!cblkns) {
+        rc = iwrc_set_errno(IW_ERROR_ALLOC, errno);
+        goto finish;
+      }
+      dc->cblkns = cblkns;
+      dc->csz = nsz;
+    }
+    dc->cblkns[dc->cnum++] = ADDR2BLK(sblk->addr);
+  }
+  for (int i = 0; i <= sblk->lvl; ++i) {
+    dc->succ[i] = sblk->n[i];
+  }
+  if (sblk->lvl > dc->tlvl) {
+    dc->tlvl = sblk->lvl;
+  }
+  ++dc->lcnt[sblk->lvl];
+  ++dc->bnum;
+  dc->knum += sblk->pnum;
+
+finish:
+  fsm->release_mmap(fsm);
+  return rc;
+}
+
+/**
+ * @brief Walk nodes having records in range and register them in `dc`.
+ *
+ * Only the first and the last nodes of range may be cleared partially,
+ * all nodes in between are removed as whole.
+ */
+static WUR iwrc _lx_del_range_scan(IWLCTX *lx, const IWKV_val *from, const IWKV_val *to, DELCTX *dc) {
+  iwrc rc;
+  bool found, last = false;
+  uint8_t *mm, a = 0, b;
+  SBLK *sblk, *nsb = 0;
+  IWFS_FSM *fsm = &lx->db->iwkv->fsm;
+  if (from) {
+    lx->key = from;
+    rc = _lx_find_bounds(lx);
+    RCRET(rc);
+    sblk = lx->lower;
+    if (!(sblk->flags & SBLK_DB)) {
+      rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+      RCRET(rc);
+      rc = _sblk_loadkvblk_mm(lx, sblk, mm);
+      if (!rc) {
+        rc = _sblk_find_pi_mm(sblk, from, mm, &found, &a);
+      }
+      fsm->release_mmap(fsm);
+      RCRET(rc);
+    }
+  } else {
+    rc = _sblk_at(lx, lx->db->addr, 0, &sblk);
+    RCRET(rc);
+  }
+  lx->key = to;
+  while (!last) {
+    if ((sblk->flags & SBLK_DB) || a >= sblk->pnum) {
+      if (!sblk->n[0]) {
+        break;
+      }
+      if (nsb) {
+        sblk = nsb;
+      } else {
+        rc = _sblk_at(lx, BLK2ADDR(sblk->n[0]), 0, &sblk);
+        RCRET(rc);
+      }
+      nsb = 0;
+      a = 0;
+      continue;
+    }
+    b = sblk->pnum;
+    if (to) {
+      int cret = 1;
+      if (sblk->n[0]) {
+        rc = _sblk_at(lx, BLK2ADDR(sblk->n[0]), 0, &nsb);
+        RCRET(rc);
+        rc = _lx_sblk_cmp_key(lx, nsb, &cret);
+        RCRET(rc);
+      }
+      if (cret >= 0) { // Next node is not lower than `to`
+        last = true;
+      }
+      if (cret > 0) {
+        rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+        RCRET(rc);
+        rc = _sblk_loadkvblk_mm(lx, sblk, mm);
+        if (!rc) {
+          rc = _sblk_find_pi_mm(sblk, to, mm, &found, &b);
+        }
+        fsm->release_mmap(fsm);
+        RCRET(rc);
+      }
+    }
+    if (a == 0 && b == sblk->pnum) {
+      rc = _delctx_add_node(lx, dc, sblk);
+      RCRET(rc);
+    } else if (a < b) {
+      int i = dc->paddr[0] ? 1 : 0;
+      dc->paddr[i] = sblk->addr;
+      dc->pidx[i][0] = a;
+      dc->pidx[i][1] = b;
+      dc->knum += b - a;
+    }
+    a = sblk->pnum;
+  }
+  return 0;
+}
+
+/**
+ * @brief Remove records `[a, b)` of partially cleared node.
+ */
+static WUR iwrc _lx_del_range_trim(IWLCTX *lx, SBLK *sblk, uint8_t a, uint8_t b) {
+  iwrc rc = _sblk_loadkvblk(lx, sblk);
+  RCRET(rc);
+  if (b > sblk->pnum) {
+    rc = IWKV_ERROR_CORRUPTED;
+    iwlog_ecode_error3(rc);
+    return rc;
+  }
+  for (int i = b - 1; i >= a; --i) {
+    rc = _sblk_rmkv(sblk, i);
+    RCRET(rc);
+  }
+  return 0;
+}
+
+/**
+ * @brief Remove cached nodes of removed `SBLK` nodes.
+ */
+static void _dbcache_remove_nodes_lw(IWLCTX *lx, DELCTX *dc) {
+  IWDB db = lx->db;
+  DBCACHE *c = &db->cache;
+  size_t nsize = c->nsize;
+  size_t num = 0, fnum = 0;
+  uint8_t *rp = (uint8_t *) c->nodes;
+  c->atime = lx->ts;
+  qsort(dc->cblkns, dc->cnum, sizeof(*dc->cblkns), _u4cmp);
+  for (size_t i = 0; i < c->num; ++i) {
+    DBCNODE *n = (DBCNODE *)(rp + i * nsize);
+    if (bsearch(&n->sblkn, dc->cblkns, dc->cnum, sizeof(*dc->cblkns), _u4cmp)) {
+      continue;
+    }
+    if (i < c->fnum) {
+      ++fnum;
+    }
+    if (num != i) {
+      memcpy(rp + num * nsize, n, nsize);
+      if (c->pfx) {
+        c->pfx[num] = c->pfx[i];
+      }
+    }
+    ++num;
+  }
+  c->num = num;
+  c->fnum = fnum;
+}
+
+/**
+ * @brief Unlink removed nodes at all levels at once and clear partially removed nodes.
+ *
+ * Predecessors of the first removed node are pinned by lookup of its lowest key,
+ * each of them is linked to the node following the last removed node of its level.
+ */
+static WUR iwrc _lx_del_range_apply(IWLCTX *lx, DELCTX *dc) {
+  iwrc rc = 0;
+  IWDB db = lx->db;
+  lx->lower = 0;
+  lx->upper = 0;
+  lx->dblk.addr = 0;
+  if (dc->bnum) {
+    lx->key = &dc->fkey;
+    lx->nlvl = dc->tlvl;
+    lx->upper_addr = dc->faddr;
+    rc = _lx_find_bounds(lx);
+    RCGO(rc, finish);
+    if (!lx->pupper[0] || lx->pupper[0]->addr != dc->faddr) {
+      rc = IWKV_ERROR_CORRUPTED;
+      iwlog_ecode_error3(rc);
+      goto finish;
+    }
+    for (int i = 0; i <= lx->nlvl; ++i) {
+      lx->plower[i]->n[i] = dc->succ[i];
+      lx->plower[i]->flags |= SBLK_DURTY;
+      if ((lx->plower[i]->flags & SBLK_DB) && !lx->plower[i]->n[i] && lx->plower[i]->lvl) {
+        --lx->plower[i]->lvl;
+      }
+      if (db->lcnt[i] >= dc->lcnt[i]) {
+        db->lcnt[i] -= dc->lcnt[i];
+      } else {
+        db->lcnt[i] = 0;
+      }
+    }
+    rc = _sblk_at(lx, BLK2ADDR(dc->succ[0]), 0, &lx->nb);
+    RCGO(rc, finish);
+    lx->nb->p0 = ADDR2BLK(lx->plower[0]->addr);
+    lx->nb->flags |= SBLK_DURTY;
+    lx->dblk.flags |= SBLK_DURTY;
+    db->rmcnt += dc->bnum;
+    if (dc->cnum) {
+      _dbcache_remove_nodes_lw(lx, dc);
+    }
+    if (db->cache.nodes && _dbcache_lvl(db, lx->dblk.lvl, db->cache.nsize) != db->cache.lvl) {
+      lx->cache_reload = 1;
+    }
+    // Partially cleared nodes are neighbours of removed ones
+    for (int i = 0; i < 2 && dc->paddr[i]; ++i) {
+      SBLK *sblk = (dc->paddr[i] == lx->plower[0]->addr) ? lx->plower[0]
+                   : (dc->paddr[i] == lx->nb->addr) ? lx->nb : 0;
+      if (!sblk) {
+        rc = IWKV_ERROR_CORRUPTED;
+        iwlog_ecode_error3(rc);
+        goto finish;
+      }
+      rc = _lx_del_range_trim(lx, sblk, dc->pidx[i][0], dc->pidx[i][1]);
+      RCGO(rc, finish);
+    }
+  } else {
+    for (int i = 0; i < 2 && dc->paddr[i]; ++i) {
+      SBLK *sblk;
+      rc = _sblk_at(lx, dc->paddr[i], 0, &sblk);
+      RCGO(rc, finish);
+      rc = _lx_del_range_trim(lx, sblk, dc->pidx[i][0], dc->pidx[i][1]);
+      RCGO(rc, finish);
+      rc = _sblk_sync_and_release(lx, &sblk);
+      RCGO(rc, finish);
+    }
+  }
+
+finish:
+  if (rc) {
+    _lx_release_mm(lx, 0);
+    return rc;
+  }
+  return _lx_release(lx);
+}
+
+/**
+ * @brief Release blocks of removed nodes.
+ *
+ * Extents are sorted and adjacent ones are merged, so nodes allocated
+ * next to each other are returned to free space manager by single call.
+ */
+static iwrc _lx_del_range_free(IWDB db, DELCTX *dc) {
+  iwrc rc = 0;
+  IWFS_FSM *fsm = &db->iwkv->fsm;
+  if (!dc->extnum) {
     return 0;
   }
+  qsort(dc->exts, dc->extnum, sizeof(*dc->exts), _delext_cmp);
+  DELEXT e = dc->exts[0];
+  for (size_t i = 1; i <= dc->extnum; ++i) {
+    if (i < dc->extnum && dc->exts[i].addr == e.addr + e.len) {
+      e.len += dc->exts[i].len;
+      continue;
+    }
+    IWRC(fsm->deallocate(fsm, e.addr, e.len), rc);
+    if (i < dc->extnum) {
+      e = dc->exts[i];
+    }
+  }
+  if (rc) {
+    iwlog_ecode_error3(rc);
+  }
+  return rc;
+}
+
+/**
+ * @brief Remove records `from >= k > to` of database.
+ * @param [out] onum Number of removed records
+ */
+static WUR iwrc _db_del_range_lw(IWDB db, const IWKV_val *from, const IWKV_val *to, uint64_t *onum) {
+  iwrc rc = 0;
+  DELCTX dc = {
+    .tlvl = -1
+  };
+  IWLCTX lx = {
+    .db = db,
+    .nlvl = -1,
+    .op = IWLCTX_DEL
+  };
+  *onum = 0;
+  iwp_current_time_ms(&lx.ts);
+  if (!db->cache.open) {
+    rc = _dbcache_fill_lw(&lx);
+    RCGO(rc, finish);
+  }
+  rc = _lx_del_range_scan(&lx, from, to, &dc);
+  RCGO(rc, finish);
+  if (!dc.knum) {
+    goto finish;
+  }
+  rc = _lx_del_range_apply(&lx, &dc);
+  RCGO(rc, finish);
+  rc = _lx_del_range_free(db, &dc);
+  if (db->bloomn) {
+    IWRC(_bloom_del_lw(db, dc.knum), rc);
+  }
+  *onum = dc.knum;
+
+finish:
+  _kv_val_dispose(&dc.fkey);
+  free(dc.exts);
+  free(dc.cblkns);
+  return rc;
+}
+
+iwrc iwkv_del_range(IWDB db, const IWKV_val *from, const IWKV_val *to) {
+  if (!db || !db->iwkv || (from && !from->size) || (to && !to->size)) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  IWKV iwkv = db->iwkv;
+  if (iwkv->oflags & IWKV_RDONLY) {
+    return IW_ERROR_READONLY;
+  }
+  for (int i = 0; i < 2; ++i) {
+    const IWKV_val *key = i ? to : from;
+    if (key && (((db->dbflg & IWDB_UINT32_KEYS) && key->size != 4) ||
+                ((db->dbflg & IWDB_UINT64_KEYS) && key->size != 8))) {
+      return IWKV_ERROR_KEY_NUM_VALUE_SIZE;
+    }
+  }
+  int rci;
+  iwrc rc = 0;
+  uint64_t num = 0;
+  API_DB_WLOCK(db, rci);
+  rc = _db_del_range_lw(db, from, to, &num);
+  API_DB_UNLOCK(db, rci, rc);
+  if (!rc && num) {
+    rc = iwal_checkpoint(iwkv, false);
+  }
+  return rc;
+}
+
+//-------------------------- EXPIRED RECORDS REAPER
+
+/**
+ * @brief Check records of at most `TTL_REAP_STEP` nodes starting from `IWDB::reap_key`
+ *        and remove the first found run of expired records.
+ *
+ * @param [out] onum Number of removed records
+ */
+static WUR iwrc _db_reap_step_lw(IWDB db, uint64_t *onum) {
+  iwrc rc;
+  bool found, end = false;
+  uint8_t *mm, a = 0;
+  int steps = TTL_REAP_STEP;
+  SBLK *sblk;
+  IWKV_val from = { 0 }, to = { 0 };
+  IWFS_FSM *fsm = &db->iwkv->fsm;
+  IWLCTX lx = {
+    .db = db,
+    .nlvl = -1
+  };
+  *onum = 0;
+  iwp_current_time_ms(&lx.ts);
+  if (!db->cache.open) {
+    rc = _dbcache_fill_lw(&lx);
+    RCRET(rc);
+  }
+  if (db->reap_key.size) {
+    lx.key = &db->reap_key;
+    rc = _lx_find_bounds(&lx);
+    RCRET(rc);
+    sblk = lx.lower;
+  } else {
+    rc = _sblk_at(&lx, db->addr, 0, &sblk);
+    RCRET(rc);
+  }
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCGO(rc, finish);
+  if (db->reap_key.size && !(sblk->flags & SBLK_DB)) {
+    rc = _sblk_loadkvblk_mm(&lx, sblk, mm);
+    RCGO(rc, release);
+    rc = _sblk_find_pi_mm(sblk, &db->reap_key, mm, &found, &a);
+    RCGO(rc, release);
+  }
+  while (1) {
+    if ((sblk->flags & SBLK_DB) || a >= sblk->pnum) {
+      if (!sblk->n[0]) {
+        end = true;
+        break;
+      }
+      rc = _sblk_at(&lx, BLK2ADDR(sblk->n[0]), 0, &sblk);
+      RCGO(rc, release);
+      a = 0;
+      if (--steps < 0 && sblk->pnum) {
+        // Sweep is continued from the first record of this node by the next step
+        rc = _sblk_loadkvblk_mm(&lx, sblk, mm);
+        RCGO(rc, release);
+        rc = _kvblk_getkey(sblk->kvblk, mm, sblk->pi[0], &to);
+        break;
+      }
+      continue;
+    }
+    rc = _sblk_loadkvblk_mm(&lx, sblk, mm);
+    RCGO(rc, release);
+    bool expired = _kvblk_expired(sblk->kvblk, sblk->pi[a], mm, lx.ts);
+    if (expired && !from.size) {
+      rc = _kvblk_getkey(sblk->kvblk, mm, sblk->pi[a], &from);
+      RCGO(rc, release);
+    } else if (!expired && from.size) {
+      // Run of expired records is ended by this live record
+      rc = _kvblk_getkey(sblk->kvblk, mm, sblk->pi[a], &to);
+      break;
+    }
+    ++a;
+  }
+
+release:
+  fsm->release_mmap(fsm);
+
+finish:
+  _lx_release_mm(&lx, 0);
+  if (!rc && from.size) {
+    rc = _db_del_range_lw(db, &from, to.size ? &to : 0, onum);
+  }
+  _kv_val_dispose(&db->reap_key);
+  if (rc || end) {
+    db->reaping = false;
+    _kv_val_dispose(&to);
+  } else {
+    db->reap_key = to;
+  }
+  _kv_val_dispose(&from);
+  return rc;
+}
+
+/**
+ * @brief Start new sweep of expired records of all `IWDB_TTL` databases.
+ */
+static iwrc _ttl_sweep_start(IWKV iwkv) {
+  iwrc rc = _api_rlock(iwkv);
+  RCRET(rc);
+  for (IWDB db = iwkv->first_db; db; db = db->next) {
+    if (!(db->dbflg & IWDB_TTL) || _db_cmp_missing(db)) {
+      continue;
+    }
+    int rci = pthread_rwlock_wrlock(&db->rwl);
+    if (rci) {
+      rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+      break;
+    }
+    _kv_val_dispose(&db->reap_key);
+    db->reaping = true;
+    pthread_rwlock_unlock(&db->rwl);
+  }
+  iwdrwl_unlock(&iwkv->rwl);
+  return rc;
+}
+
+/**
+ * @brief Perform single reaper step for every database with sweep in progress.
+ *
+ * Locks are released after every round so reaper doesn't block readers,
+ * writers and WAL checkpoints for long.
+ *
+ * @param [out] omore True if some of sweeps are not completed
+ */
+static iwrc _ttl_reap_round(IWKV iwkv, bool *omore) {
+  uint64_t num = 0;
+  *omore = false;
+  iwrc rc = _api_rlock(iwkv);
+  RCRET(rc);
+  for (IWDB db = iwkv->first_db; db && !iwkv->ttl_shutdown; db = db->next) {
+    if (!(db->dbflg & IWDB_TTL)) {
+      continue;
+    }
+    int rci = pthread_rwlock_wrlock(&db->rwl);
+    if (rci) {
+      rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+      break;
+    }
+    if (db->reaping) {
+      uint64_t n;
+      rc = _db_reap_step_lw(db, &n);
+      num += n;
+      *omore |= db->reaping;
+    }
+    pthread_rwlock_unlock(&db->rwl);
+    RCBREAK(rc);
+  }
+  iwdrwl_unlock(&iwkv->rwl);
+  if (!rc && num) {
+    rc = iwal_checkpoint(iwkv, false);
+  }
+  return rc;
+}
+
+static void *_ttl_reaper_worker_fn(void *op) {
+  IWKV iwkv = op;
+  while (true) {
+    pthread_mutex_lock(&iwkv->ttl_mtx);
+    if (!iwkv->ttl_shutdown) {
+      uint64_t dl;
+      iwp_current_time_ms(&dl);
+      dl += iwkv->ttl_reap_interval_ms;
+      struct timespec tp = {
+        .tv_sec = dl / 1000,
+        .tv_nsec = (dl % 1000) * 1000000
+      };
+      pthread_cond_timedwait(&iwkv->ttl_cond, &iwkv->ttl_mtx, &tp);
+    }
+    pthread_mutex_unlock(&iwkv->ttl_mtx);
+    if (iwkv->ttl_shutdown) {
+      break;
+    }
+    bool more = true;
+    iwrc rc = _ttl_sweep_start(iwkv);
+    while (!rc && more && !iwkv->ttl_shutdown) {
+      rc = _ttl_reap_round(iwkv, &more);
+    }
+    if (rc && iwkv->open) {
+      iwlog_ecode_error2(rc, "Background reaper of expired records failed");
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Start background reaper of expired records if it is not started yet.
+ */
+static WUR iwrc _ttl_reaper_start(IWKV iwkv) {
+  iwrc rc = 0;
+  int rci = pthread_mutex_lock(&iwkv->ttl_mtx);
+  if (rci) {
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  if (!iwkv->ttl_started && !iwkv->ttl_shutdown) {
+    rci = pthread_create(&iwkv->ttl_thr, 0, _ttl_reaper_worker_fn, iwkv);
+    if (rci) {
+      rc = iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+    } else {
+      iwkv->ttl_started = true;
+    }
+  }
+  pthread_mutex_unlock(&iwkv->ttl_mtx);
+  return rc;
+}
+
+static iwrc _ttl_reaper_shutdown(IWKV iwkv) {
+  int rci = pthread_mutex_lock(&iwkv->ttl_mtx);
+  if (rci) {
+    return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+  }
+  bool started = iwkv->ttl_started;
+  iwkv->ttl_shutdown = true;
+  iwkv->ttl_started = false;
+  pthread_cond_broadcast(&iwkv->ttl_cond);
+  pthread_mutex_unlock(&iwkv->ttl_mtx);
+  if (started) {
+    rci = pthread_join(iwkv->ttl_thr, 0);
+    if (rci) {
+      return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci);
+    }
+  }
+  return 0;
+}
+
+iwrc iwkv_reap(IWKV iwkv) {
+  ENSURE_OPEN(iwkv);
   if (iwkv->oflags & IWKV_RDONLY) {
     return IW_ERROR_READONLY;
   }
-  rc = iwkv_exclusive_lock(iwkv);
-  ki = kh_get(DBS, iwkv->dbs, dbid);
-  if (ki != kh_end(iwkv->dbs)) {
-    db = kh_value(iwkv->dbs, ki);
-  }
-  if (db) {
-    if (db->dbflg != dbflg) {
-      return IWKV_ERROR_INCOMPATIBLE_DB_MODE;
-    }
-    *dbp = db;
-  } else {
-    rc = _db_create_lw(iwkv, dbid, dbflg, dbp);
-  }
-  iwkv_exclusive_unlock(iwkv);
-  if (!rc) {
-    rc = iwal_checkpoint(iwkv, true);
+  bool more = true;
+  iwrc rc = _ttl_sweep_start(iwkv);
+  while (!rc && more) {
+    rc = _ttl_reap_round(iwkv, &more);
   }
   return rc;
 }
 
-iwrc iwkv_db_cache_release(IWDB db) {
-  if (!db || !db->iwkv) {
-    return IW_ERROR_INVALID_ARGS;
+//-------------------------- TRANSACTIONS
+
+/** Operation recorded by `iwkv_txn_put()` or `iwkv_txn_del()` */
+typedef struct TXNOP {
+  IWDB db;
+  dbid_t dbid;                  /**< Database ID used to check `db` is not destroyed before commit */
+  IWKV_val key;
+  IWKV_val val;                 /**< Stored value, unused by removal */
+  iwkv_opflags opflags;
+  bool del;                     /**< Record removal */
+  struct TXNOP *next;
+} TXNOP;
+
+struct IWKV_txn {
+  IWKV iwkv;
+  TXNOP *first;                 /**< Recorded operations in order they will be applied */
+  TXNOP *last;
+};
+
+static void _txn_dispose(IWKV_txn *txnp) {
+  IWKV_txn txn = *txnp;
+  for (TXNOP *op = txn->first, *next; op; op = next) {
+    next = op->next;
+    free(op);
+  }
+  free(txn);
+  *txnp = 0;
+}
+
+static iwrc _txn_add(IWKV_txn txn, IWDB db, const IWKV_val *key, const IWKV_val *val, iwkv_opflags opflags) {
+  size_t vsz = val ? val->size : 0;
+  TXNOP *op = malloc(sizeof(*op) + key->size + vsz);
+  if (!op) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
   }
-  int rci;
-  iwrc rc = 0;
-  API_DB_WLOCK(db, rci);
-  _dbcache_destroy_lw(db);
-  API_DB_UNLOCK(db, rci, rc);
-  return rc;
+  op->db = db;
+  op->dbid = db->id;
+  op->opflags = opflags;
+  op->del = !val;
+  op->next = 0;
+  op->key.data = (uint8_t *) op + sizeof(*op);
+  op->key.size = key->size;
+  memcpy(op->key.data, key->data, key->size);
+  op->val.data = (uint8_t *) op->key.data + key->size;
+  op->val.size = vsz;
+  if (vsz) {
+    memcpy(op->val.data, val->data, vsz);
+  }
+  if (txn->last) {
+    txn->last->next = op;
+  } else {
+    txn->first = op;
+  }
+  txn->last = op;
+  return 0;
 }
 
-iwrc iwkv_db_last_access_time(const IWDB db, uint64_t *ts) {
-  if (!db || !db->iwkv || !ts) {
-    return IW_ERROR_INVALID_ARGS;
+/**
+ * @brief Checks databases of transaction operations are not destroyed.
+ */
+static iwrc _txn_check_dbs_lw(IWKV_txn txn) {
+  IWKV iwkv = txn->iwkv;
+  for (TXNOP *op = txn->first; op; op = op->next) {
+    khiter_t ki = kh_get(DBS, iwkv->dbs, op->dbid);
+    if (ki == kh_end(iwkv->dbs) || kh_value(iwkv->dbs, ki) != op->db) {
+      return IW_ERROR_INVALID_STATE;
+    }
   }
-  int rci;
+  return 0;
+}
+
+static iwrc _txn_apply_lw(TXNOP *op) {
   iwrc rc = 0;
-  API_DB_RLOCK(db, rci);
-  if (db->cache.open)   {
-    *ts = db->cache.atime;
-  } else {
-    *ts = 0;
+  IWDB db = op->db;
+  IWLCTX lx = {
+    .db = db,
+    .key = &op->key,
+    .val = &op->val,
+    .nlvl = -1,
+    .op = op->del ? IWLCTX_DEL : IWLCTX_PUT,
+    .opflags = op->opflags
+  };
+  iwp_current_time_ms(&lx.ts);
+  if (!db->cache.open) {
+    rc = _dbcache_fill_lw(&lx);
+    RCRET(rc);
+  }
+  rc = op->del ? _lx_del_lw(&lx) : _lx_put_lw(&lx);
+  if (rc == IWKV_ERROR_NOTFOUND) {
+    // Removal of missing record is noop
+    rc = 0;
   }
-  API_DB_UNLOCK(db, rci, rc);
   return rc;
 }
 
-iwrc iwkv_db_destroy(IWDB *dbp) {
-  if (!dbp || !*dbp) {
+iwrc iwkv_txn_begin(IWKV iwkv, IWKV_txn *txnp) {
+  if (!txnp) {
     return IW_ERROR_INVALID_ARGS;
   }
-  IWDB db = *dbp;
-  IWKV iwkv = db->iwkv;
+  *txnp = 0;
+  ENSURE_OPEN(iwkv);
   if (iwkv->oflags & IWKV_RDONLY) {
     return IW_ERROR_READONLY;
   }
-  iwrc rc = iwkv_exclusive_lock(iwkv);
-  RCGO(rc, finish);
-  rc = _iwkv_worker_inc_nolk(iwkv);
-  if (!rc) {
-    rc = _db_destroy_lw(dbp);
+  if (!iwkv->dlsnr) {
+    return IWKV_ERROR_INCOMPATIBLE_DB_MODE;
   }
-  iwkv_exclusive_unlock(iwkv);
-  
-finish:
-  return rc;
+  IWKV_txn txn = calloc(1, sizeof(*txn));
+  if (!txn) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  txn->iwkv = iwkv;
+  *txnp = txn;
+  return 0;
 }
 
-iwrc iwkv_put(IWDB db, const IWKV_val *key, const IWKV_val *val, iwkv_opflags opflags) {
-  if (!db || !db->iwkv || !key || !key->size || !val) {
+iwrc iwkv_txn_put(IWKV_txn txn, IWDB db, const IWKV_val *key, const IWKV_val *val, iwkv_opflags opflags) {
+  if (!txn || !db || db->iwkv != txn->iwkv || !key || !key->size || !val || (opflags & ~IWKV_DUP_REMOVE)) {
     return IW_ERROR_INVALID_ARGS;
   }
-  IWKV iwkv = db->iwkv;
-  if (iwkv->oflags & IWKV_RDONLY) {
-    return IW_ERROR_READONLY;
-  }
   if (((db->dbflg & IWDB_UINT32_KEYS) && key->size != 4) ||
       ((db->dbflg & IWDB_UINT64_KEYS) && key->size != 8)) {
     return IWKV_ERROR_KEY_NUM_VALUE_SIZE;
   }
-  int rci;
-  iwrc rc = 0;
-  IWLCTX lx = {
-    .db = db,
-    .key = key,
-    .val = (IWKV_val *) val,
-    .nlvl = -1,
-    .op = IWLCTX_PUT,
-    .opflags = opflags
-  };
-  iwp_current_time_ms(&lx.ts);
-  API_DB_WLOCK(db, rci);
-  if (!db->cache.open) {
-    rc = _dbcache_fill_lw(&lx);
-    RCGO(rc, finish);
+  if (((db->dbflg & IWDB_DUP_UINT32_VALS) && val->size != 4) ||
+      ((db->dbflg & IWDB_DUP_UINT64_VALS) && val->size != 8)) {
+    return IWKV_ERROR_DUP_VALUE_SIZE;
   }
-  rc = _lx_put_lw(&lx);
-  
-finish:
-  API_DB_UNLOCK(db, rci, rc);
-  if (!rc) {
-    if (lx.opflags & IWKV_SYNC) {
-      rc = iwkv_sync(iwkv, 0);
-    } else {
-      rc = iwal_checkpoint(iwkv, false);
-    }
+  if (key->size + val->size > IWKV_MAX_KVSZ) {
+    return IWKV_ERROR_MAXKVSZ;
   }
-  return rc;
+  return _txn_add(txn, db, key, val, opflags);
 }
 
-iwrc iwkv_get(IWDB db, const IWKV_val *key, IWKV_val *oval) {
-  if (!db || !db->iwkv || !key || !oval) {
+iwrc iwkv_txn_del(IWKV_txn txn, IWDB db, const IWKV_val *key) {
+  if (!txn || !db || db->iwkv != txn->iwkv || !key || !key->size) {
     return IW_ERROR_INVALID_ARGS;
   }
-  int rci;
-  iwrc rc = 0;
-  IWLCTX lx = {
-    .db = db,
-    .key = key,
-    .val = oval,
-    .nlvl = -1
-  };
-  iwp_current_time_ms(&lx.ts);
-  oval->size = 0;
-  if (IW_LIKELY(db->cache.open)) {
-    API_DB_RLOCK(db, rci);
-  } else {
-    API_DB_WLOCK(db, rci);
-    if (!db->cache.open) {
-      rc = _dbcache_fill_lw(&lx);
-      RCGO(rc, finish);
-    }
+  if (((db->dbflg & IWDB_UINT32_KEYS) && key->size != 4) ||
+      ((db->dbflg & IWDB_UINT64_KEYS) && key->size != 8)) {
+    return IWKV_ERROR_KEY_NUM_VALUE_SIZE;
   }
-  rc = _lx_get_lr(&lx);
-  
-finish:
-  API_DB_UNLOCK(db, rci, rc);
-  return rc;
+  return _txn_add(txn, db, key, 0, 0);
 }
 
-iwrc iwkv_del(IWDB db, const IWKV_val *key) {
-  if (!db || !db->iwkv || !key) {
+iwrc iwkv_txn_commit(IWKV_txn *txnp, iwkv_opflags opflags) {
+  if (!txnp || !*txnp) {
     return IW_ERROR_INVALID_ARGS;
   }
-  int rci;
   iwrc rc = 0;
-  IWKV iwkv = db->iwkv;
-  IWLCTX lx = {
-    .db = db,
-    .key = key,
-    .nlvl = -1,
-    .op = IWLCTX_DEL
-  };
-  iwp_current_time_ms(&lx.ts);
-  API_DB_WLOCK(db, rci);
-  if (!db->cache.open) {
-    rc = _dbcache_fill_lw(&lx);
-    RCGO(rc, finish);
+  uint64_t lsn = 0;
+  IWKV_txn txn = *txnp;
+  IWKV iwkv = txn->iwkv;
+  if (!iwkv->open) {
+    rc = IW_ERROR_INVALID_STATE;
+    goto finish;
   }
-  rc = _lx_del_lw(&lx);
-  
-finish:
-  API_DB_UNLOCK(db, rci, rc);
+  if (!txn->first) {
+    goto finish;
+  }
+  rc = iwkv_exclusive_lock(iwkv);
+  RCGO(rc, finish);
+  if (iwkv->fatalrc) {
+    rc = iwkv->fatalrc;
+    iwkv_exclusive_unlock(iwkv);
+    goto finish;
+  }
+  rc = _txn_check_dbs_lw(txn);
   if (!rc) {
-    if (lx.opflags & IWKV_SYNC) {
-      rc = iwkv_sync(iwkv, 0);
+    rc = iwal_txn_begin(iwkv);
+  }
+  if (rc) {
+    iwkv_exclusive_unlock(iwkv);
+    goto finish;
+  }
+  for (TXNOP *op = txn->first; op; op = op->next) {
+    rc = _txn_apply_lw(op);
+    RCBREAK(rc);
+  }
+#ifdef IW_TESTS
+  if (!rc && (g_trigger & IWKVD_TXN_FAIL_BEFORE_END)) {
+    rc = IW_ERROR_FAIL;
+  }
+#endif
+  IWRC(iwal_txn_end(iwkv, !rc, (opflags & IWKV_SYNC), &lsn), rc);
+  if (rc) {
+    // Partially applied transaction is not closed by WAL fixpoint.
+    // Storage is switched into fatal state: checkpoints are refused
+    // and it will be recovered to the fixpoint put by `iwal_txn_begin()` on next open.
+    iwlog_ecode_error2(rc, "Transaction commit failed");
+    iwkv->fatalrc = rc;
+  }
+  IWRC(iwkv_exclusive_unlock(iwkv), rc);
+  if (!rc) {
+    if (opflags & IWKV_SYNC) {
+      rc = iwal_txn_sync(iwkv, lsn);
     } else {
       rc = iwal_checkpoint(iwkv, false);
     }
   }
+
+finish:
+  _txn_dispose(txnp);
   return rc;
 }
 
+iwrc iwkv_txn_abort(IWKV_txn *txnp) {
+  if (!txnp || !*txnp) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  _txn_dispose(txnp);
+  return 0;
+}
+
 IW_INLINE iwrc _cursor_close_lw(IWKV_cursor cur) {
   iwrc rc = 0;
   cur->closed = true;
@@ -3285,6 +6683,7 @@ iwrc iwkv_cursor_to(IWKV_cursor cur, IWKV_cursor_op op) {
   }
   IWKV iwkv = cur->lx.db->iwkv;
   API_DB_RLOCK(cur->lx.db, rci);
+  iwp_current_time_ms(&cur->lx.ts);
   iwrc rc = _cursor_to_lr(cur, op);
   API_DB_UNLOCK(cur->lx.db, rci, rc);
   if (!rc) {
@@ -3304,6 +6703,7 @@ iwrc iwkv_cursor_to_key(IWKV_cursor cur, IWKV_cursor_op op, const IWKV_val *key)
   IWKV iwkv = cur->lx.db->iwkv;
   API_DB_RLOCK(cur->lx.db, rci);
   cur->lx.key = key;
+  iwp_current_time_ms(&cur->lx.ts);
   iwrc rc = _cursor_to_lr(cur, op);
   API_DB_UNLOCK(cur->lx.db, rci, rc);
   if (!rc) {
@@ -3333,8 +6733,15 @@ iwrc iwkv_cursor_get(IWKV_cursor cur,
     RCGO(rc, finish);
   }
   int8_t idx = cur->cn->pi[cur->cnpos];
-  if (okey && oval) {
+  if (okey && oval && !(cur->lx.db->dbflg & IWDB_VENC_FLAGS)) {
     rc = _kvblk_getkv(cur->cn->kvblk, mm, idx, okey, oval);
+  } else if (okey && oval) {
+    rc = _kvblk_getkey(cur->cn->kvblk, mm, idx, okey);
+    RCGO(rc, finish);
+    rc = _kvblk_getvalue(cur->cn->kvblk, mm, idx, oval);
+    if (rc) {
+      _kv_val_dispose(okey);
+    }
   } else if (oval) {
     rc = _kvblk_getvalue(cur->cn->kvblk, mm, idx, oval);
   } else if (okey) {
@@ -3351,6 +6758,73 @@ finish:
   return rc;
 }
 
+iwrc iwkv_cursor_peek(IWKV_cursor cur, IWKV_VISITOR visitor, void *opaq) {
+  int rci;
+  iwrc rc = 0;
+  if (!cur || !visitor) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  if (!cur->cn || !cur->lx.db || cur->cnpos >= cur->cn->pnum) {
+    return IW_ERROR_INVALID_STATE;
+  }
+  API_DB_RLOCK(cur->lx.db, rci);
+  uint8_t *mm = 0;
+  IWFS_FSM *fsm = &cur->lx.db->iwkv->fsm;
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCGO(rc, finish);
+  if (!cur->cn->kvblk) {
+    rc = _sblk_loadkvblk_mm(&cur->lx, cur->cn, mm);
+    RCGO(rc, finish);
+  }
+  rc = _kvblk_visit(cur->cn->kvblk, cur->cn->pi[cur->cnpos], mm, visitor, opaq);
+
+finish:
+  if (mm) {
+    fsm->release_mmap(fsm);
+  }
+  API_DB_UNLOCK(cur->lx.db, rci, rc);
+  return rc;
+}
+
+iwrc iwkv_cursor_scan(IWKV_cursor cur, IWKV_VISITOR visitor, void *opaq, size_t limit) {
+  int rci;
+  iwrc rc = 0;
+  if (!cur || !visitor) {
+    return IW_ERROR_INVALID_ARGS;
+  }
+  if (!cur->lx.db) {
+    return IW_ERROR_INVALID_STATE;
+  }
+  IWKV iwkv = cur->lx.db->iwkv;
+  API_DB_RLOCK(cur->lx.db, rci);
+  uint8_t *mm = 0;
+  IWFS_FSM *fsm = &iwkv->fsm;
+  iwp_current_time_ms(&cur->lx.ts);
+  rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
+  RCGO(rc, finish);
+  for (size_t i = 0; !limit || i < limit; ++i) {
+    rc = _cursor_to_lr(cur, IWKV_CURSOR_NEXT);
+    RCBREAK(rc);
+    if (!cur->cn->kvblk) {
+      rc = _sblk_loadkvblk_mm(&cur->lx, cur->cn, mm);
+      RCBREAK(rc);
+    }
+    _cursor_prefetch_mm(cur, mm);
+    rc = _kvblk_visit(cur->cn->kvblk, cur->cn->pi[cur->cnpos], mm, visitor, opaq);
+    RCBREAK(rc);
+  }
+
+finish:
+  if (mm) {
+    fsm->release_mmap(fsm);
+  }
+  API_DB_UNLOCK(cur->lx.db, rci, rc);
+  if (!rc) {
+    rc = iwal_checkpoint(iwkv, false);
+  }
+  return rc;
+}
+
 iwrc iwkv_cursor_copy_val(IWKV_cursor cur, uint8_t *vbuf, size_t vbufsz, size_t *vsz) {
   int rci;
   iwrc rc = 0;
@@ -3362,7 +6836,7 @@ iwrc iwkv_cursor_copy_val(IWKV_cursor cur, uint8_t *vbuf, size_t vbufsz, size_t
   }
   *vsz = 0;
   API_DB_RLOCK(cur->lx.db, rci);
-  uint8_t *mm = 0, *oval;
+  uint8_t *mm = 0, *oval, *dbuf = 0;
   uint32_t ovalsz;
   IWFS_FSM *fsm = &cur->lx.db->iwkv->fsm;
   rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
@@ -3373,10 +6847,15 @@ iwrc iwkv_cursor_copy_val(IWKV_cursor cur, uint8_t *vbuf, size_t vbufsz, size_t
   }
   int8_t idx = cur->cn->pi[cur->cnpos];
   _kvblk_peek_val(cur->cn->kvblk, idx, mm, &oval, &ovalsz);
+  if (cur->lx.db->dbflg & IWDB_VENC_FLAGS) {
+    rc = _kv_val_decode(mm, (const uint8_t **) &oval, &ovalsz, &dbuf);
+    RCGO(rc, finish);
+  }
   *vsz = ovalsz;
   memcpy(vbuf, oval, MIN(vbufsz, ovalsz));
   
 finish:
+  free(dbuf);
   if (mm) {
     fsm->release_mmap(fsm);
   }
@@ -3396,8 +6875,7 @@ iwrc iwkv_cursor_copy_key(IWKV_cursor cur, uint8_t *kbuf, size_t kbufsz, size_t
   *ksz = 0;
   API_DB_RLOCK(cur->lx.db, rci);
   uint8_t *mm = 0;
-  const uint8_t *okey;
-  uint32_t okeysz;
+  KVKEY okey;
   IWFS_FSM *fsm = &cur->lx.db->iwkv->fsm;
   rc = fsm->acquire_mmap(fsm, 0, &mm, 0);
   RCGO(rc, finish);
@@ -3406,10 +6884,10 @@ iwrc iwkv_cursor_copy_key(IWKV_cursor cur, uint8_t *kbuf, size_t kbufsz, size_t
     RCGO(rc, finish);
   }
   int8_t idx = cur->cn->pi[cur->cnpos];
-  rc = _kvblk_peek_key(cur->cn->kvblk, idx, mm, &okey, &okeysz);
+  rc = _kvblk_peek_key(cur->cn->kvblk, idx, mm, &okey);
   RCGO(rc, finish);
-  *ksz = okeysz;
-  memcpy(kbuf, okey, MIN(kbufsz, okeysz));
+  *ksz = _kvkey_len(&okey);
+  _kvkey_copy(&okey, kbuf, MIN(kbufsz, *ksz));
   
 finish:
   if (mm) {
@@ -3431,7 +6909,7 @@ iwrc iwkv_cursor_set(IWKV_cursor cur, IWKV_val *val, iwkv_opflags opflags) {
   IWDB db = cur->lx.db;
   IWKV iwkv = db->iwkv;
   API_DB_WLOCK(db, rci);
-  rc = _sblk_updatekv(cur->cn, cur->cnpos, 0, val, opflags);
+  rc = _sblk_updatekv(cur->cn, cur->cnpos, 0, val, opflags, 0);
   API_DB_UNLOCK(cur->lx.db, rci, rc);
   if (!rc) {
     rc = iwal_checkpoint(iwkv, false);
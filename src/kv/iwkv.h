@@ -68,6 +68,7 @@ typedef enum {
   IWKV_ERROR_INCOMPATIBLE_DB_MODE,    /**< Incorpatible database open mode (IWKV_ERROR_INCOMPATIBLE_DB_MODE) */
   IWKV_ERROR_INCOMPATIBLE_DB_FORMAT,  /**< Incompatible database format version, please migrate database data (IWKV_ERROR_INCOMPATIBLE_DB_FORMAT) */
   IWKV_ERROR_CORRUPTED_WAL_FILE,      /**< Corrupted WAL file (IWKV_ERROR_CORRUPTED_WAL_FILE) */
+  IWKV_ERROR_CAS_MISMATCH,            /**< Current value of record does not match expected one (IWKV_ERROR_CAS_MISMATCH) */
   _IWKV_ERROR_END,
   /* Internal error codes */
   _IWKV_ERROR_KVBLOCK_FULL,
@@ -90,7 +91,20 @@ typedef enum {
   IWDB_UINT32_KEYS = 0x1,     /**< Database keys are 32bit unsigned integers */
   IWDB_UINT64_KEYS = 0x2,     /**< Database keys are 64bit unsigned integers */
   IWDB_DUP_UINT32_VALS = 0x4, /**< Record key value is an array of sorted uint32 values */
-  IWDB_DUP_UINT64_VALS = 0x8  /**< Record key value is an array of sorted uint64 values */
+  IWDB_DUP_UINT64_VALS = 0x8, /**< Record key value is an array of sorted uint64 values */
+  IWDB_PREFIX_KEYS = 0x10,    /**< Keys are stored in KV blocks as suffixes of block-wide shared prefix.
+                                   Saves space for keys with long common prefixes (paths, URLs, composite keys).
+                                   Not compatible with `IWDB_UINT32_KEYS`|`IWDB_UINT64_KEYS` and custom comparators */
+  IWDB_COMPRESS_VALS = 0x20,  /**< Large values are compressed by fast LZ block compressor (`iwlz.h`).
+                                   Not compressible values are stored as is.
+                                   Not compatible with `IWDB_DUP_UINT32_VALS`|`IWDB_DUP_UINT64_VALS` */
+  IWDB_BLOB_VALS = 0x40,      /**< Values larger than `IWKV_OPTS::blob_threshold` are stored in separate
+                                   file blocks and referenced from KV blocks by address.
+                                   Not compatible with `IWDB_DUP_UINT32_VALS`|`IWDB_DUP_UINT64_VALS` */
+  IWDB_TTL = 0x80             /**< Records may have expiration time set by `iwkv_put_ttl()`.
+                                   Expired records are not visible to readers and cursors and
+                                   removed by background reaper, see `IWKV_OPTS::ttl_reap_interval_ms`.
+                                   Not compatible with `IWDB_DUP_UINT32_VALS`|`IWDB_DUP_UINT64_VALS` */
 } iwdb_flags_t;
 
 /**
@@ -117,8 +131,12 @@ typedef struct IWKV_WAL_OPTS {
   bool enabled;                     /**< WAL enabled */
   bool check_crc_on_checkpoint;     /**< Check CRC32 sum of data blocks during checkpoint. Default: false */
   size_t wal_buffer_sz;             /**< WAL file intermediate buffer size */
-  uint64_t checkpoint_buffer_sz;    /**< Checkpoint buffer size in bytes. */
-  uint64_t checkpoint_timeout_ms;   /**< Checkpoint timeout millesconds */
+  uint64_t checkpoint_buffer_sz;    /**< Checkpoint buffer size in bytes. Default: 1Gb */
+  uint64_t checkpoint_timeout_ms;   /**< Max time in milliseconds between checkpoints
+                                         performed by background checkpoint thread. Default: 1min */
+  size_t checkpoint_slice_sz;       /**< Max size of WAL data applied to database file at once
+                                         by background checkpoint thread without blocking readers
+                                         and writers. Default: 4Mb */
 } IWKV_WAL_OPTS;
 
 /**
@@ -132,6 +150,15 @@ typedef struct IWKV_OPTS {
   size_t wal_checkpoint_after_sz;   /**< Perform checkpoint after specified number of bytes changed */
   uint32_t wal_checkpoint_every_ms; /**< Perform checkpoint after period of time specified as milliseconds */
   IWKV_WAL_OPTS wal;                /**< WAL options */
+  uint32_t blob_threshold;          /**< Values of `IWDB_BLOB_VALS` databases larger than this number of bytes
+                                         are stored out of KV blocks. Default: 4096, min: 64 */
+  size_t dbcache_max_sz;            /**< Memory budget in bytes of in-memory index of skiplist nodes per database.
+                                         If set, nodes of as many lower skiplist levels as fit into budget
+                                         are indexed, down to all nodes of database, so most of lookups
+                                         jump directly to the target node.
+                                         Default: zero, top levels of about 1024 nodes are indexed */
+  uint32_t ttl_reap_interval_ms;    /**< Period of background removal of expired records
+                                         of `IWDB_TTL` databases. Default: 60000 (1min) */
 } IWKV_OPTS;
 
 /**
@@ -201,6 +228,89 @@ IW_EXPORT WUR iwrc iwkv_open(const IWKV_OPTS *opts, IWKV *iwkvp);
  */
 IW_EXPORT WUR iwrc iwkv_db(IWKV iwkv, uint32_t dbid, iwdb_flags_t flags, IWDB *dbp);
 
+/**
+ * @brief Custom keys comparator.
+ *
+ * @param v1 First key data
+ * @param v1len First key size
+ * @param v2 Second key data
+ * @param v2len Second key size
+ * @param op Opaque data given with comparator: `IWDB_OPTS::cmp_op`
+ * @return Negative, zero or positive value if `v1` is less than, equal to or greater than `v2`
+ */
+typedef int (*IWDB_CMP)(const void *v1, size_t v1len, const void *v2, size_t v2len, void *op);
+
+/**
+ * @brief Database creation options.
+ */
+typedef struct IWDB_OPTS {
+  uint8_t fanout;   /**< Max number of key/value pairs stored in single skiplist node: 32 or 64.
+                         Larger fanout reduces number of nodes and levels to traverse
+                         but shrinks lower key buffer of node from 116 to 84 bytes,
+                         suitable for databases with short (integer) keys.
+                         Zero means the default fanout: 32 */
+  uint32_t bloom_keys; /**< Expected number of keys in database. If not zero database keeps
+                            persisted Bloom filter (~10 bits per key) consulted by `iwkv_get()`,
+                            `iwkv_get_peek()` and `iwkv_get_multi()` before skiplist lookup,
+                            so most of lookups of missing keys don't touch database nodes.
+                            Filter is rebuilt and resized as keys are removed or added.
+                            Filter is not used if custom keys comparator is set */
+  IWDB_CMP cmp;        /**< Keys comparator, zero means lexicographic comparison of key bytes.
+                            Builtin comparators `iwkv_cmp_int64`, `iwkv_cmp_double`, `iwkv_cmp_vtuple`
+                            are stored in database file and used on every open.
+                            Other comparator must be given by every first `iwkv_db_ext()` call
+                            after storage is opened, `IWKV_ERROR_INCOMPATIBLE_DB_MODE` is returned otherwise.
+                            Not compatible with `IWDB_UINT32_KEYS`|`IWDB_UINT64_KEYS`|`IWDB_PREFIX_KEYS` */
+  void *cmp_op;        /**< Opaque data passed to `cmp` */
+} IWDB_OPTS;
+
+/**
+ * @brief Get iwkv database handler identified by `dbid` number,
+ *        new database is created with geometry specified by `opts`.
+ *
+ * @note Options are stored in database file. `IWKV_ERROR_INCOMPATIBLE_DB_MODE` is reported
+ *       if `opts` doesn't match options of existing database.
+ * @note `IWKV_ERROR_INCOMPATIBLE_DB_FORMAT` is reported if non default options
+ *       are requested for a new database in file of older format version.
+ *
+ * @param iwkv Pointer to @ref IWKV handler
+ * @param dbid Database identifier
+ * @param flags Database initialization flags
+ * @param opts Database creation options. Nullable.
+ * @param [out] dbp Pointer to database opaque structure.
+ * @see iwkv_db()
+ */
+IW_EXPORT WUR iwrc iwkv_db_ext(IWKV iwkv, uint32_t dbid, iwdb_flags_t flags, const IWDB_OPTS *opts, IWDB *dbp);
+
+/**
+ * @brief Set keys comparator of empty database.
+ *
+ * Comparator can be changed only while database has no records, `IW_ERROR_INVALID_STATE`
+ * is returned otherwise. The same comparator is used during database lifetime:
+ * builtin comparators are stored in database file, other comparator must be given
+ * by `IWDB_OPTS::cmp` on every database open. Prefer `IWDB_OPTS::cmp` of `iwkv_db_ext()`
+ * for new databases.
+ *
+ * Builtin comparators:
+ * - `iwkv_cmp_int64` Keys are signed 64bit integers in host byte order
+ * - `iwkv_cmp_double` Keys are `double` numbers in host byte order
+ * - `iwkv_cmp_vtuple` Keys are tuples of unsigned integers stored one by one
+ *                     as variable length numbers (`IW_SETVNUMBUF64`)
+ *
+ * @note Comparator is not compatible with `IWDB_UINT32_KEYS`|`IWDB_UINT64_KEYS`|`IWDB_PREFIX_KEYS` databases.
+ *
+ * @param db Database handler
+ * @param cmp Keys comparator or `NULL` to use default lexicographic comparison of key bytes
+ * @param op Opaque data passed to `cmp`
+ */
+IW_EXPORT iwrc iwkv_db_set_comparator(IWDB db, IWDB_CMP cmp, void *op);
+
+IW_EXPORT int iwkv_cmp_int64(const void *v1, size_t v1len, const void *v2, size_t v2len, void *op);
+
+IW_EXPORT int iwkv_cmp_double(const void *v1, size_t v1len, const void *v2, size_t v2len, void *op);
+
+IW_EXPORT int iwkv_cmp_vtuple(const void *v1, size_t v1len, const void *v2, size_t v2len, void *op);
+
 /**
  * @brief Frees memory resources used by database cache
  *        until to next database access operation (get/put/cursor).
@@ -249,6 +359,25 @@ IW_EXPORT iwrc iwkv_checkpoint(IWKV iwkv);
  */
 IW_EXPORT iwrc iwkv_close(IWKV *iwkvp);
 
+/**
+ * @brief Open read-only snapshot of iwkv storage.
+ *
+ * Snapshot is a separate @ref IWKV handler pinned to the consistent state of storage
+ * at the time of this call. Snapshot databases are accessed by regular API:
+ * `iwkv_db()`, `iwkv_get()`, cursors, while writers of `iwkv` keep working without
+ * being blocked by snapshot readers. Snapshot is a private copy-on-write mapping of database file,
+ * WAL checkpoints of `iwkv` copy pages they modify into snapshot memory.
+ *
+ * @note Available only in WAL enabled mode, otherwise `IWKV_ERROR_INCOMPATIBLE_DB_MODE` is returned.
+ * @note Snapshot must be closed by `iwkv_close()` before `iwkv`,
+ *       `iwkv_close()` of storage with open snapshots returns `IW_ERROR_INVALID_STATE`.
+ * @note Custom comparators (except builtin ones) must be given to `iwkv_db_ext()` for snapshot databases.
+ *
+ * @param iwkv IWKV handler
+ * @param [out] snapp Pointer to snapshot handler
+ */
+IW_EXPORT WUR iwrc iwkv_snapshot_open(IWKV iwkv, IWKV *snapp);
+
 /**
  * @brief Store record in database.
  *
@@ -267,6 +396,148 @@ IW_EXPORT iwrc iwkv_close(IWKV *iwkvp);
  */
 IW_EXPORT iwrc iwkv_put(IWDB db, const IWKV_val *key, const IWKV_val *val, iwkv_opflags opflags);
 
+/**
+ * @brief Store record expiring after `ttl_ms` milliseconds in `IWDB_TTL` database.
+ *
+ * Expired record is not visible to `iwkv_get()` and cursors, it is treated as absent
+ * by `IWKV_NO_OVERWRITE` put and removed by background reaper.
+ * Records stored by `iwkv_put()` never expire.
+ *
+ * @param db Database handler
+ * @param key Key data container
+ * @param val Value data container
+ * @param ttl_ms Record time to live in milliseconds, zero if record never expires
+ * @param opflags Put options used, see `iwkv_put()`
+ */
+IW_EXPORT iwrc iwkv_put_ttl(IWDB db, const IWKV_val *key, const IWKV_val *val, uint64_t ttl_ms,
+                            iwkv_opflags opflags);
+
+/**
+ * @brief Store record only if its current value is equal to `expected` (compare-and-set).
+ *
+ * Comparison and update are performed by single lookup under database write lock.
+ * Expired records are treated as absent.
+ *
+ * @note Not applicable to `IWDB_DUP_UINT32_VALS`|`IWDB_DUP_UINT64_VALS` databases.
+ *
+ * @param db Database handler
+ * @param key Key data container
+ * @param expected Expected current value, zero if record is expected to be absent
+ * @param val New value data container
+ * @param opflags Put options used, see `iwkv_put()`
+ * @return `IWKV_ERROR_CAS_MISMATCH` if current value of record does not match `expected`
+ */
+IW_EXPORT iwrc iwkv_put_cas(IWDB db, const IWKV_val *key, const IWKV_val *expected, const IWKV_val *val,
+                            iwkv_opflags opflags);
+
+/**
+ * @brief Merge callback used by `iwkv_merge()`.
+ *
+ * Callback computes a new value of record from its current value.
+ * Data of `newval` must be allocated by `malloc()`, it will be freed by `iwkv_merge()`.
+ * Database is write locked while callback is running so it must not call any `iwkv` API.
+ *
+ * @param key Record key
+ * @param oldval Current value of record, zero if record is absent
+ * @param [out] newval New value of record
+ * @param op Opaque data passed to `iwkv_merge()`
+ * @return Non zero error code aborts merge leaving record unchanged,
+ *         this error is returned by `iwkv_merge()`
+ */
+typedef iwrc(*IWKV_MERGE)(const IWKV_val *key, const IWKV_val *oldval, IWKV_val *newval, void *op);
+
+/**
+ * @brief Atomically replace value of record by result of `mfn` merge callback
+ *        called with the current value.
+ *
+ * Read-modify-write is performed by single lookup under database write lock,
+ * so concurrent merges of the same record are never lost.
+ * Useful for counters and appending to stored lists.
+ * Expired records are treated as absent.
+ *
+ * @note Not applicable to `IWDB_DUP_UINT32_VALS`|`IWDB_DUP_UINT64_VALS` databases.
+ *
+ * @param db Database handler
+ * @param key Key data container
+ * @param mfn Merge callback
+ * @param op Opaque data passed to `mfn`
+ * @param opflags Put options used, see `iwkv_put()`
+ */
+IW_EXPORT iwrc iwkv_merge(IWDB db, const IWKV_val *key, IWKV_MERGE mfn, void *op, iwkv_opflags opflags);
+
+/**
+ * @brief Store a batch of records in database.
+ *
+ * Records are sorted by key and stored under single database lock acquisition,
+ * skiplist lookup of every key starts from the nodes found for the previous one.
+ * Records with equal keys are applied in the order they are given in arrays.
+ * WAL checkpoint or `IWKV_SYNC` savepoint is performed once for the whole batch.
+ *
+ * @note Batch is not atomic: on error records applied before the failed one are kept.
+ *
+ * @param db Database handler
+ * @param keys Array of `num` keys
+ * @param vals Array of `num` values, `vals[i]` is stored with `keys[i]`
+ * @param num Number of records in batch
+ * @param opflags Put options applied to every record, see `iwkv_put()`
+ */
+IW_EXPORT iwrc iwkv_put_batch(IWDB db, const IWKV_val *keys, const IWKV_val *vals, size_t num,
+                              iwkv_opflags opflags);
+
+
+/**
+ * @brief Bulk load data source callback used by `iwkv_load()`.
+ *
+ * Callback fills `key` and `val` with the next record.
+ * Record data must stay valid until the next callback invocation.
+ * `IWKV_ERROR_NOTFOUND` should be returned when there are no more records.
+ *
+ * @param [out] key Next record key
+ * @param [out] val Next record value
+ * @param opaq Opaque data passed to `iwkv_load()`
+ */
+typedef iwrc(*IWKV_LOAD_NEXT)(IWKV_val *key, IWKV_val *val, void *opaq);
+
+/**
+ * @brief Bulk load sorted records into empty database.
+ *
+ * Records provided by `next` must be sorted in the order they are
+ * traversed by cursor moving with `IWKV_CURSOR_NEXT` (descending key order)
+ * and keys must be unique, otherwise `IW_ERROR_INVALID_ARGS` is returned.
+ * Skiplist nodes are filled completely and written sequentially,
+ * node levels are computed deterministically.
+ *
+ * Database is unlocked periodically to let WAL checkpoints run.
+ * It should not be updated concurrently during load: if chain of loaded nodes
+ * is changed in between `IW_ERROR_INVALID_STATE` is returned.
+ *
+ * @note Load is not atomic: on error (unsorted records included) nodes already
+ *       written stay in database, records buffered for the next node are dropped.
+ *       Database is not empty then, so load may be restarted only after it is
+ *       recreated by `iwkv_db_destroy()`.
+ *
+ * @param db Empty database, `IW_ERROR_INVALID_STATE` is returned if database has records
+ * @param next Data source callback
+ * @param opaq Opaque data passed to `next`
+ * @param opflags `IWKV_SYNC` Flush changes on disk after operation
+ */
+IW_EXPORT iwrc iwkv_load(IWDB db, IWKV_LOAD_NEXT next, void *opaq, iwkv_opflags opflags);
+
+/**
+ * @brief Visitor of a record data lent by `iwkv_get_peek()` and `iwkv_cursor_peek()`.
+ *
+ * `key` and `val` point directly into memory mapped database file
+ * and they are valid only until visitor returns. Keys of `IWDB_PREFIX_KEYS` databases
+ * and compressed values of `IWDB_COMPRESS_VALS` databases are passed in temporary buffers.
+ * Database and storage locks are held while visitor runs, so it must not call
+ * IWKV functions modifying the database.
+ *
+ * @param key Record key
+ * @param val Record value
+ * @param opaq User data passed to peek function
+ * @return Non zero error code is returned by peek function as is
+ */
+typedef iwrc(*IWKV_VISITOR)(const IWKV_val *key, const IWKV_val *val, void *opaq);
 
 /**
  * @brief Get value for given `key`.
@@ -280,6 +551,38 @@ IW_EXPORT iwrc iwkv_put(IWDB db, const IWKV_val *key, const IWKV_val *val, iwkv_
  */
 IW_EXPORT iwrc iwkv_get(IWDB db, const IWKV_val *key, IWKV_val *oval);
 
+/**
+ * @brief Get values for a set of keys.
+ *
+ * Keys are sorted internally and looked up in a single pass under one
+ * database read lock, skiplist lookup of every key starts from the nodes
+ * found for the previous one.
+ *
+ * @note Values of missing keys are returned as `NULL` data with zero size.
+ * @note On success every returned value must be freed with `iwkv_val_dispose()`,
+ *       on error no values are returned.
+ *
+ * @param db Database handler
+ * @param keys Array of `num` keys
+ * @param num Number of keys
+ * @param [out] ovals Array of `num` values, `ovals[i]` is associated with `keys[i]`
+ * @param [out] orcs Optional array of `num` per key results:
+ *                   zero or `IWKV_ERROR_NOTFOUND` if key is not found
+ */
+IW_EXPORT iwrc iwkv_get_multi(IWDB db, const IWKV_val *keys, size_t num, IWKV_val *ovals, iwrc *orcs);
+
+/**
+ * @brief Pass record identified by `key` to the `visitor` without copying its data.
+ *
+ * @note If not matching record found `IWKV_ERROR_NOTFOUND` will be returned.
+ *
+ * @param db Database handler
+ * @param key Key data
+ * @param visitor Record visitor, see `IWKV_VISITOR`
+ * @param opaq User data passed to `visitor`
+ */
+IW_EXPORT iwrc iwkv_get_peek(IWDB db, const IWKV_val *key, IWKV_VISITOR visitor, void *opaq);
+
 /**
  * @brief Remove record identified by `key`.
  *
@@ -289,6 +592,100 @@ IW_EXPORT iwrc iwkv_get(IWDB db, const IWKV_val *key, IWKV_val *oval);
  */
 IW_EXPORT iwrc iwkv_del(IWDB db, const IWKV_val *key);
 
+/**
+ * @brief Remove all records starting from `from` key (inclusive) up to `to` key (exclusive)
+ *        in order of records traversed by cursor moving with `IWKV_CURSOR_NEXT`
+ *        (descending key order): keys `k` where `from >= k > to`.
+ *
+ * Skiplist nodes having all their records in range are unlinked at once
+ * and their blocks are released without rewriting, so removal cost depends
+ * on the number of removed nodes rather than on the number of removed records.
+ *
+ * @param db Database handler
+ * @param from Key of the first removed record, if zero records are removed from the first one
+ * @param to Key range is ended before, if zero records are removed up to the last one
+ */
+IW_EXPORT iwrc iwkv_del_range(IWDB db, const IWKV_val *from, const IWKV_val *to);
+
+/**
+ * @brief Remove expired records of all `IWDB_TTL` databases of storage.
+ *
+ * Performs the same sweep as background reaper does every
+ * `IWKV_OPTS::ttl_reap_interval_ms` and returns when sweep is completed.
+ *
+ * @param iwkv Storage handler
+ */
+IW_EXPORT iwrc iwkv_reap(IWKV iwkv);
+
+/**
+ * @brief Transaction: put and remove operations over databases of one storage
+ *        applied atomically by `iwkv_txn_commit()`.
+ */
+typedef struct IWKV_txn *IWKV_txn;
+
+/**
+ * @brief Start a new transaction.
+ *
+ * Operations are recorded by `iwkv_txn_put()` and `iwkv_txn_del()`
+ * and are not visible until `iwkv_txn_commit()`.
+ * Transaction handler is disposed by `iwkv_txn_commit()` or `iwkv_txn_abort()`.
+ *
+ * @note Available only in WAL enabled mode, otherwise `IWKV_ERROR_INCOMPATIBLE_DB_MODE` is returned.
+ * @note Databases must not be destroyed while transaction is pending.
+ *
+ * @param iwkv Storage handler
+ * @param [out] txnp Pointer to transaction handler
+ */
+IW_EXPORT WUR iwrc iwkv_txn_begin(IWKV iwkv, IWKV_txn *txnp);
+
+/**
+ * @brief Record put of `key`/`val` into database `db` in transaction.
+ *
+ * Key and value data are copied. Sizes of keys and values are checked right here.
+ *
+ * @param txn Transaction handler
+ * @param db Database of transaction storage
+ * @param opflags Put options: only `IWKV_DUP_REMOVE` is allowed
+ */
+IW_EXPORT iwrc iwkv_txn_put(IWKV_txn txn, IWDB db, const IWKV_val *key, const IWKV_val *val,
+                            iwkv_opflags opflags);
+
+/**
+ * @brief Record removal of `key` from database `db` in transaction.
+ * @note Removal of missing key is not an error, it is skipped on commit.
+ *
+ * @param txn Transaction handler
+ * @param db Database of transaction storage
+ */
+IW_EXPORT iwrc iwkv_txn_del(IWKV_txn txn, IWDB db, const IWKV_val *key);
+
+/**
+ * @brief Apply all operations of transaction atomically and dispose transaction handler.
+ *
+ * Operations are applied in order they were recorded under storage exclusive lock
+ * so readers observe either none or all of transaction changes.
+ * Changes are written to WAL as one unit closed by a single fixpoint record:
+ * on crash storage is recovered either with all or with none of them.
+ * With `IWKV_SYNC` one WAL `fsync()` is performed for the whole transaction.
+ *
+ * If any database of transaction was destroyed after operation was recorded
+ * `IW_ERROR_INVALID_STATE` is returned and none of operations are applied.
+ *
+ * If commit fails while changes are being applied storage is switched
+ * to the failed state: all further operations except `iwkv_close()` return error
+ * and storage will be recovered to the state before transaction on next open.
+ *
+ * @param txnp Pointer to transaction handler
+ * @param opflags `IWKV_SYNC` to make transaction durable before return
+ */
+IW_EXPORT iwrc iwkv_txn_commit(IWKV_txn *txnp, iwkv_opflags opflags);
+
+/**
+ * @brief Discard all operations of transaction and dispose transaction handler.
+ * @param txnp Pointer to transaction handler
+ */
+IW_EXPORT iwrc iwkv_txn_abort(IWKV_txn *txnp);
+
 /**
  * @brief Destroy key/value data container.
  *
@@ -376,6 +773,34 @@ IW_EXPORT iwrc iwkv_cursor_copy_val(IWKV_cursor cur, uint8_t *vbuf, size_t vbufs
  */
 IW_EXPORT iwrc iwkv_cursor_key(IWKV_cursor cur, IWKV_val *okey);
 
+/**
+ * @brief Pass record at current cursor position to the `visitor` without copying its data.
+ *
+ * @param cur Opened cursor object
+ * @param visitor Record visitor, see `IWKV_VISITOR`
+ * @param opaq User data passed to `visitor`
+ */
+IW_EXPORT iwrc iwkv_cursor_peek(IWKV_cursor cur, IWKV_VISITOR visitor, void *opaq);
+
+/**
+ * @brief Move cursor forward record by record passing every record to the `visitor`.
+ *
+ * Equivalent of `iwkv_cursor_to(cur, IWKV_CURSOR_NEXT)` followed by `iwkv_cursor_peek()`
+ * in a loop, but database and storage locks are acquired only once for the whole scan.
+ * Cursor is left at the last visited record.
+ *
+ * @note Database writers are blocked until scan is finished, use `limit` to split long scans.
+ * @note Scan is stopped by the first non zero code returned by `visitor`.
+ *
+ * @param cur Opened cursor object
+ * @param visitor Record visitor, see `IWKV_VISITOR`
+ * @param opaq User data passed to `visitor`
+ * @param limit Maximum number of records to visit, zero means no limit
+ * @return `0` if `limit` records visited, `IWKV_ERROR_NOTFOUND` if there are no more records
+ *         or error code returned by `visitor`.
+ */
+IW_EXPORT iwrc iwkv_cursor_scan(IWKV_cursor cur, IWKV_VISITOR visitor, void *opaq, size_t limit);
+
 /**
  * @brief Copy key data to the specified buffer at the current cursor position.
  * @note At most of `bufsz` bytes will be copied into `kbuf`.
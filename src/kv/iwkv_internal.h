@@ -1,6 +1,7 @@
 #include "iwkv.h"
 #include "iwlog.h"
 #include "iwarr.h"
+#include "iwdrwl.h"
 #include "iwutils.h"
 #include "iwfsmfile.h"
 #include "iwdlsnr.h"
@@ -16,7 +17,10 @@
 #define IWKV_MAGIC 0x69776b76
 
 // IWKV file format version
-#define IWKV_FORMAT 0
+// 1: Number of KVBLK slots stored in database block
+// 2: Bloom filter of database keys
+// 3: Keys comparator ID and Bloom filter counters stored in database block
+#define IWKV_FORMAT 3
 
 // IWDB magic number
 #define IWDB_MAGIC 0x69776462
@@ -38,14 +42,14 @@
 // Length of KV fsm header in bytes
 #define KVHDRSZ 255
 
-// [u1:flags,lvl:u1,lkl:u1,pnum:u1,p0:u4,kblk:u4,[pi0:u1,... pi32],n0-n23:u4,lk:u116]:u256 // SBLK
+// [u1:flags,lvl:u1,lkl:u1,pnum:u1,p0:u4,kblk:u4,[pi0:u1,... pi32],n0-n23:u4,[pi32:u1,...],lk]:u256 // SBLK
 
 // Number of skip list levels
 #define SLEVELS 24
 
 #define AANUM (2 * SLEVELS + 2 /* levels + (new block created) + (db block may be updated) */)
 
-// Lower key length in SBLK
+// Max lower key length in SBLK, reduced by extra `pi` slots of databases with `IWDB::idxnum > KVBLK_IDXNUM`
 #define SBLK_LKLEN 116
 
 // Lower key padding
@@ -57,9 +61,12 @@
 // Size of `SBLK` in bytes
 #define SBLK_SZ (2 * (1 << IWKV_FSM_BPOW))
 
-// Number of `KV` blocks in KVBLK
+// Default number of `KV` blocks in KVBLK
 #define KVBLK_IDXNUM 32
 
+// Max number of `KV` blocks in KVBLK, must fit signed `SBLK::pnum`
+#define KVBLK_IDXNUM_MAX 64
+
 // Initial `KVBLK` size power of 2
 #define KVBLK_INISZPOW 9
 
@@ -72,10 +79,28 @@
 // Max kvp len 0xfffffffULL bytes
 #define KVP_MAX_LEN_VLEN 5
 
-#define KVBLK_MAX_IDX_SZ ((KVP_MAX_OFF_VLEN + KVP_MAX_LEN_VLEN) * KVBLK_IDXNUM)
+#define KVBLK_MAX_IDX_SZ(idxnum_) ((KVP_MAX_OFF_VLEN + KVP_MAX_LEN_VLEN) * (idxnum_))
 
 // Max non KV size [blen:u1,idxsz:u2,[ps1:vn,pl1:vn,...,ps63,pl63]
-#define KVBLK_MAX_NKV_SZ (KVBLK_HDRSZ + KVBLK_MAX_IDX_SZ)
+#define KVBLK_MAX_NKV_SZ(idxnum_) (KVBLK_HDRSZ + KVBLK_MAX_IDX_SZ(idxnum_))
+
+// Max size of block-wide key prefix for `IWDB_PREFIX_KEYS` databases
+#define KVBLK_MAX_PFX_SZ 64
+
+// Max size of prefix area stored after KV pairs index [pfxlen:vn,pfx]
+#define KVBLK_MAX_PFXA_SZ (1 + KVBLK_MAX_PFX_SZ)
+
+// Number of `SBLK` nodes written by `iwkv_load()` between database unlocks
+#define IWKV_LOAD_CHUNK_NUM 4096
+
+// Min size of value compressed in `IWDB_COMPRESS_VALS` databases
+#define IWKV_COMPRESS_MIN_VALSZ 128
+
+// Default `IWKV_OPTS::blob_threshold`
+#define IWKV_BLOB_THRESHOLD_DEFAULT 4096
+
+// Min `IWKV_OPTS::blob_threshold`
+#define IWKV_BLOB_THRESHOLD_MIN 64
 
 #define ADDR2BLK(addr_) ((addr_) >> IWKV_FSM_BPOW)
 
@@ -106,12 +131,23 @@ typedef enum {
   KVBLK_DURTY = 1 /**< KVBLK data is durty and should be flushed to mm */
 } kvblk_flags_t;
 
+/* Value encoding type of `IWDB_COMPRESS_VALS`|`IWDB_BLOB_VALS`|`IWDB_TTL` database: [vtype:u1,value] */
+typedef enum {
+  KVVAL_RAW = 0,    /**< Value stored as is */
+  KVVAL_LZ = 1,     /**< Value compressed by `iwlz_compress()`: [vtype:u1,vlen:vn,lz block] */
+  KVVAL_BLOB = 2,   /**< Value stored out of KVBLK: [vtype:u1,blen:vn,blkn:vn],
+                         blob of `blen` bytes keeps `KVVAL_RAW` or `KVVAL_LZ` encoded value */
+  KVVAL_TTL = 0x80  /**< Flag of value having expiration time: [vtype|KVVAL_TTL:u1,expire:u8,value],
+                         `expire` is a little endian number of milliseconds since epoch */
+} kvval_type_t;
+
 typedef enum {
   RMKV_SYNC = 1,
   RMKV_NO_RESIZE = 1 << 1
 } kvblk_rmkv_opts_t;
 
-/* KVBLK: [szpow:u1,idxsz:u2,[ps0:vn,pl0:vn,..., ps32,pl32]____[[KV],...]] */
+/* KVBLK: [szpow:u1,idxsz:u2,[ps0:vn,pl0:vn,..., ps32,pl32]____[[KV],...]]
+   `IWDB_PREFIX_KEYS` KVBLK: [szpow:u1,idxsz:u2,[ps0:vn,pl0:vn,..., ps32,pl32],pfxlen:vn,pfx____[[KV],...]] */
 typedef struct KVBLK {
   IWDB db;
   off_t addr;                 /**< Block address */
@@ -120,9 +156,20 @@ typedef struct KVBLK {
   int8_t zidx;                /**< Index of first empty pair slot (zero index), or -1 */
   uint8_t szpow;              /**< Block size as power of 2 */
   kvblk_flags_t flags;        /**< Flags */
-  KVP pidx[KVBLK_IDXNUM];     /**< KV pairs index */
+  KVP pidx[KVBLK_IDXNUM_MAX]; /**< KV pairs index, `IWDB::idxnum` slots used */
+  uint8_t pfxlen;             /**< Length of block-wide key prefix (`IWDB_PREFIX_KEYS` databases) */
+  uint8_t pfx[KVBLK_MAX_PFX_SZ]; /**< Block-wide key prefix */
 } KVBLK;
 
+/* Key of KV pair: concatenation of `pfx` and `sfx` parts.
+   `pfx` is empty unless database is created with `IWDB_PREFIX_KEYS` */
+typedef struct KVKEY {
+  const uint8_t *pfx;
+  const uint8_t *sfx;
+  uint32_t pfxlen;
+  uint32_t sfxlen;
+} KVKEY;
+
 typedef enum {
   SBLK_FULL_LKEY    = 1,       /**< The lowest `SBLK` key is fully contained in `SBLK`. Persistent flag. */
   SBLK_DB           = 1 << 3,  /**< This block is the start database block. */
@@ -137,6 +184,8 @@ typedef enum {
 
 #define IWDB_DUP_FLAGS (IWDB_DUP_UINT32_VALS | IWDB_DUP_UINT64_VALS)
 
+#define IWDB_VENC_FLAGS (IWDB_COMPRESS_VALS | IWDB_BLOB_VALS | IWDB_TTL)
+
 #define IWDB_UINT_KEYS_FLAGS (IWDB_UINT32_KEYS | IWDB_UINT64_KEYS)
 
 // Number of top levels to cache (~ (1<<DBCACHE_LEVELS) cached elements)
@@ -148,6 +197,28 @@ typedef enum {
 // Single allocation step - number of DBCNODEs
 #define DBCACHE_ALLOC_STEP 32
 
+// Number of SBLK nodes visited by background dbcache fill in single database lock acquisition
+#define DBCACHE_FILL_STEP 256
+
+// Number of SBLK nodes checked by reaper of expired records in single database lock acquisition
+#define TTL_REAP_STEP 64
+
+// Default period of background reaper of expired records
+#define TTL_REAP_INTERVAL_MS 60000
+
+// Bloom filter bits per key
+#define BLOOM_BITS_PER_KEY 10
+
+// Number of bits set in Bloom filter per key
+#define BLOOM_HASHES 7
+
+// Bloom filter is split into cache line sized blocks, all bits of a key are set in single block
+#define BLOOM_BLKSZ 64
+
+// Min and max size of Bloom filter as power of 2
+#define BLOOM_POW_MIN 12
+#define BLOOM_POW_MAX 31
+
 /** Cached SBLK node */
 typedef struct DBCNODE {
   blkn_t sblkn;               /**< SBLK block number */
@@ -155,7 +226,7 @@ typedef struct DBCNODE {
   uint8_t lkl;                /**< Lower key length */
   uint8_t fullkey;            /**< SBLK full key */
   uint8_t k0idx;              /**< KVBLK Zero KVP index */
-  uint8_t pad;                /**< 1 byte pad */
+  uint8_t lvl;                /**< SBLK level */
   uint8_t lk[1];              /**< Lower key buffer */
 } DBCNODE;
 
@@ -171,13 +242,19 @@ typedef struct DBCACHE {
   atomic_uint_least64_t atime;  /**< Cache access time */
   size_t asize;                 /**< Size of allocated cache buffer */
   size_t num;                   /**< Actual number of nodes */
+  size_t fnum;                  /**< Number of leading nodes filled by walking `lvl` level of database,
+                                     nodes after them are still checked by background fill */
   size_t nsize;                 /**< Cached node size */
   uint8_t lvl;                  /**< Lowes cached level */
   bool open;                    /**< Is cache open */
+  bool partial;                 /**< Background fill of cache is not completed */
   DBCNODE *nodes;               /**< Sorted nodes array */
+  uint64_t *pfx;                /**< Numeric lower key prefixes of `nodes` in the same order,
+                                     zero for databases with custom comparator */
 } DBCACHE;
 
-/* Database: [magic:u4,dbflg:u1,dbid:u4,next_db_blk:u4,p0:u4,n[24]:u4,c[24]:u4]:209 */
+/* Database: [magic:u4,dbflg:u1,dbid:u4,next_db_blk:u4,p0:u4,n[24]:u4,c[24]:u4,idxnum:u1,bloom_blk:u4,bloom_pow:u1,cmp:u1,
+              bloom_puts:u8,bloom_dels:u8]:232 */
 struct IWDB {
   // SBH
   IWDB db;                    /**< Database ref */
@@ -193,8 +270,21 @@ struct IWDB {
   dbid_t id;                  /**< Database ID */
   volatile int32_t wk_count;  /**< Number of active database workers */
   iwdb_flags_t dbflg;         /**< Database specific flags */
+  uint8_t idxnum;             /**< Number of KV slots in KVBLK (skiplist fanout) */
+  uint8_t lklen;              /**< Lower key buffer length of SBLK */
   atomic_bool open;           /**< True if DB is in OPEN state */
   uint32_t lcnt[SLEVELS];     /**< SBLK count per level */
+  uint64_t rmcnt;             /**< Number of removed SBLK nodes, used to validate optimistic lookups */
+  blkn_t bloomn;              /**< Bloom filter block number, zero if database has no filter */
+  uint8_t bloom_pow;          /**< Bloom filter size: `1 << bloom_pow` bytes */
+  uint64_t bloom_puts;        /**< Number of keys added to Bloom filter since it was built, stored on close */
+  uint64_t bloom_dels;        /**< Number of keys removed since Bloom filter was built, stored on close */
+  IWKV_val reap_key;          /**< Key of the next record checked by reaper of expired records,
+                                   empty if sweep starts from the first record */
+  bool reaping;               /**< Sweep of expired records is in progress */
+  IWDB_CMP cmp;               /**< Keys comparator, zero if keys bytes are compared lexicographically */
+  void *cmp_op;               /**< Opaque data passed to `cmp` */
+  uint8_t cmpid;              /**< Comparator ID stored in database block, see `DB_CMP_*` */
 };
 
 /* Skiplist block: [u1:flags,lvl:u1,lkl:u1,pnum:u1,p0:u4,kblk:u4,[pi0:u1,... pi32],n0-n23:u4,lk:u116]:u256 // SBLK */
@@ -211,7 +301,7 @@ typedef struct SBLK {
   blkn_t kvblkn;              /**< Associated KVBLK block number */
   int8_t lkl;                 /**< Lower key length within a buffer */
   int8_t pnum;                /**< Number of active kv indexes in `SBLK::pi` */
-  int8_t pi[KVBLK_IDXNUM];    /**< Sorted KV slots, value is an index of kv slot in `KVBLK` */
+  int8_t pi[KVBLK_IDXNUM_MAX]; /**< Sorted KV slots, value is an index of kv slot in `KVBLK` */
   uint8_t lk[SBLK_LKLEN];     /**< Lower key buffer */
 } SBLK;
 
@@ -220,7 +310,7 @@ KHASH_MAP_INIT_INT(DBS, IWDB)
 /** IWKV instance */
 struct IWKV {
   IWFS_FSM fsm;               /**< FSM pool */
-  pthread_rwlock_t rwl;       /**< API RW lock */
+  IWDRWL rwl;                 /**< API RW lock, read-mostly */
   iwrc fatalrc;               /**< Fatal error occuried, no farther operations can be performed */
   IWDB first_db;              /**< First database in chain */
   IWDB last_db;               /**< Last database in chain */
@@ -229,7 +319,23 @@ struct IWKV {
   iwkv_openflags oflags;      /**< Open flags */
   pthread_cond_t wk_cond;     /**< Workers cond variable */
   pthread_mutex_t wk_mtx;     /**< Workers cond mutext */
+  pthread_mutex_t dbc_mtx;    /**< Background dbcache fill mutex */
+  pthread_cond_t dbc_cond;    /**< Background dbcache fill wakeup condition */
+  pthread_t dbc_thr;          /**< Background dbcache fill thread */
+  bool dbc_started;           /**< Background dbcache fill thread is started */
+  bool dbc_pending;           /**< Some of database caches are partial */
+  atomic_bool dbc_shutdown;   /**< Background dbcache fill thread shutdown requested */
+  pthread_mutex_t ttl_mtx;    /**< Background reaper of expired records mutex */
+  pthread_cond_t ttl_cond;    /**< Background reaper wakeup condition */
+  pthread_t ttl_thr;          /**< Background reaper thread */
+  bool ttl_started;           /**< Background reaper thread is started */
+  atomic_bool ttl_shutdown;   /**< Background reaper thread shutdown requested */
+  uint32_t ttl_reap_interval_ms; /**< Period of background reaper sweeps */
+  IWKV snapof;                /**< IWKV this snapshot is opened of, zero if it is not a snapshot */
+  atomic_int snaps_num;       /**< Number of open snapshots of this IWKV */
   int32_t fmt_version;        /**< Database format version */
+  uint32_t blob_threshold;    /**< Values larger than it are stored out of KVBLK in `IWDB_BLOB_VALS` databases */
+  size_t dbcache_max_sz;      /**< Memory budget of dbcache per database, zero if only top levels are cached */
   volatile int32_t wk_count;  /**< Number of active workers */
   atomic_bool open;           /**< True if kvstore is in OPEN state */
 };
@@ -249,6 +355,13 @@ typedef struct IWLCTX {
   SBLK *upper;                /**< Upper bound block */
   SBLK *nb;                   /**< New block */
   off_t upper_addr;           /**< Upper block address used in `_lx_del_lr()` */
+  uint64_t rmcnt;             /**< `IWDB::rmcnt` snapshot taken by optimistic lookup */
+  uint64_t expire;            /**< Expiration time ms of stored record, zero if record never expires */
+  /** Put handler called once with the current value of record (zero if absent) before it is updated */
+  iwrc(*ph)(struct IWLCTX *lx, const IWKV_val *oval);
+  void *phop;                 /**< Opaque data of put handler */
+  IWKV_val phval;             /**< Value computed by put handler */
+  bool phdone;                /**< Put handler has been called */
 #ifndef NDEBUG
   uint32_t num_cmps;
 #endif
@@ -259,8 +372,11 @@ typedef struct IWLCTX {
   uint8_t kaan;               /**< Position of next free `KVBLK` element in the `kaa` area */
   int8_t nlvl;                /**< Level of new inserted/deleted `SBLK` node. -1 if no new node inserted/deleted */
   int8_t cache_reload;        /**< If true dbcache should be refreshed after operation */
+  int8_t flvl;                /**< Top level of finger recorded by `_lx_find_bounds()` */
   SBLK *plower[SLEVELS];      /**< Pinned lower nodes per level */
   SBLK *pupper[SLEVELS];      /**< Pinned upper nodes per level */
+  off_t flower[SLEVELS];      /**< Finger: lower node addresses per level found by last lookup */
+  off_t fupper[SLEVELS];      /**< Finger: upper node addresses per level found by last lookup, zero for tail */
   SBLK dblk;                  /**< First database block */
   SBLK saa[AANUM];            /**< `SBLK` allocation area */
   KVBLK kaa[AANUM];           /**< `KVBLK` allocation area */
@@ -284,7 +400,7 @@ struct IWKV_cursor {
 
 #define API_RLOCK(iwkv_, rci_) \
   ENSURE_OPEN(iwkv_);  \
-  rci_ = pthread_rwlock_rdlock(&(iwkv_)->rwl); \
+  rci_ = iwdrwl_rdlock(&(iwkv_)->rwl); \
   if (rci_) return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci_)
 
 IW_INLINE iwrc _api_rlock(IWKV iwkv)  {
@@ -295,7 +411,7 @@ IW_INLINE iwrc _api_rlock(IWKV iwkv)  {
 
 #define API_WLOCK(iwkv_, rci_) \
   ENSURE_OPEN(iwkv_);  \
-  rci_ = pthread_rwlock_wrlock(&(iwkv_)->rwl); \
+  rci_ = iwdrwl_wrlock(&(iwkv_)->rwl); \
   if (rci_) return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci_)
 
 IW_INLINE iwrc _api_wlock(IWKV iwkv)  {
@@ -305,7 +421,7 @@ IW_INLINE iwrc _api_wlock(IWKV iwkv)  {
 }
 
 #define API_UNLOCK(iwkv_, rci_, rc_)  \
-  rci_ = pthread_rwlock_unlock(&(iwkv_)->rwl); \
+  rci_ = iwdrwl_unlock(&(iwkv_)->rwl); \
   if (rci_) IWRC(iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci_), rc_)
 
 #define API_DB_RLOCK(db_, rci_)                               \
@@ -313,7 +429,7 @@ IW_INLINE iwrc _api_wlock(IWKV iwkv)  {
     API_RLOCK((db_)->iwkv, rci_);                             \
     rci_ = pthread_rwlock_rdlock(&(db_)->rwl);                \
     if (rci_) {                                               \
-      pthread_rwlock_unlock(&(db_)->iwkv->rwl);               \
+      iwdrwl_unlock(&(db_)->iwkv->rwl);                       \
       return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci_);  \
     }                                                         \
   } while(0)
@@ -329,7 +445,7 @@ IW_INLINE iwrc _api_db_rlock(IWDB db)  {
     API_RLOCK((db_)->iwkv, rci_);                             \
     rci_ = pthread_rwlock_wrlock(&(db_)->rwl);                \
     if (rci_) {                                               \
-      pthread_rwlock_unlock(&(db_)->iwkv->rwl);               \
+      iwdrwl_unlock(&(db_)->iwkv->rwl);                       \
       return iwrc_set_errno(IW_ERROR_THREADING_ERRNO, rci_);  \
     }                                                         \
   } while(0)
@@ -359,6 +475,7 @@ IW_INLINE iwrc _api_db_wlock(IWDB db)  {
 
 // SBLK
 // [u1:flags,lvl:u1,lkl:u1,pnum:u1,p0:u4,kblk:u4,[pi0:u1,... pi32],n0-n23:u4,lk:u116]:u256
+// Databases with `IWDB::idxnum > KVBLK_IDXNUM` store extra `pi` slots at `SOFF_LK` followed by lower key
 
 #define SOFF_FLAGS_U1     0
 #define SOFF_LVL_U1       (SOFF_FLAGS_U1 + 1)
@@ -372,9 +489,11 @@ IW_INLINE iwrc _api_db_wlock(IWDB db)  {
 #define SOFF_END          (SOFF_LK + SBLK_LKLEN)
 static_assert(SOFF_END == 256, "SOFF_END == 256");
 static_assert(SBLK_SZ >= SOFF_END, "SBLK_SZ >= SOFF_END");
+static_assert(KVBLK_IDXNUM_MAX - KVBLK_IDXNUM < SBLK_LKLEN, "KVBLK_IDXNUM_MAX - KVBLK_IDXNUM < SBLK_LKLEN");
 
 // DB
-// [magic:u4,dbflg:u1,dbid:u4,next_db_blk:u4,p0:u4,n[24]:u4,c[24]:u4]:209
+// [magic:u4,dbflg:u1,dbid:u4,next_db_blk:u4,p0:u4,n[24]:u4,c[24]:u4,idxnum:u1,bloom_blk:u4,bloom_pow:u1,cmp:u1,
+//  bloom_puts:u8,bloom_dels:u8]:232
 #define DOFF_MAGIC_U4     0
 #define DOFF_DBFLG_U1     (DOFF_MAGIC_U4 + 4)
 #define DOFF_DBID_U4      (DOFF_DBFLG_U1 + 1)
@@ -382,10 +501,23 @@ static_assert(SBLK_SZ >= SOFF_END, "SBLK_SZ >= SOFF_END");
 #define DOFF_P0_U4        (DOFF_NEXTDB_U4 + 4)
 #define DOFF_N0_U4        (DOFF_P0_U4 + 4)
 #define DOFF_C0_U4        (DOFF_N0_U4 + 4 * SLEVELS)
-#define DOFF_END          (DOFF_C0_U4 + 4 * SLEVELS)
-static_assert(DOFF_END == 209, "DOFF_END == 209");
+#define DOFF_IDXNUM_U1    (DOFF_C0_U4 + 4 * SLEVELS)
+#define DOFF_BLOOM_U4     (DOFF_IDXNUM_U1 + 1)
+#define DOFF_BLOOMPOW_U1  (DOFF_BLOOM_U4 + 4)
+#define DOFF_CMP_U1       (DOFF_BLOOMPOW_U1 + 1)
+#define DOFF_BLOOMPUTS_U8 (DOFF_CMP_U1 + 1)
+#define DOFF_BLOOMDELS_U8 (DOFF_BLOOMPUTS_U8 + 8)
+#define DOFF_END          (DOFF_BLOOMDELS_U8 + 8)
+static_assert(DOFF_END == 232, "DOFF_END == 232");
 static_assert(DB_SZ >= DOFF_END, "DB_SZ >= DOFF_END");
 
+// Keys comparator IDs stored at `DOFF_CMP_U1`
+#define DB_CMP_DEFAULT    0     /**< Lexicographic comparison of key bytes */
+#define DB_CMP_INT64      1     /**< `iwkv_cmp_int64()` */
+#define DB_CMP_DOUBLE     2     /**< `iwkv_cmp_double()` */
+#define DB_CMP_VTUPLE     3     /**< `iwkv_cmp_vtuple()` */
+#define DB_CMP_CUSTOM     0xff  /**< Application comparator given on every database open */
+
 // KVBLK
 // [szpow:u1,idxsz:u2,[ps1:vn,pl1:vn,...,ps32,pl32]____[[_KV],...]] // KVBLK
 #define KBLK_SZPOW_OFF   0
@@ -401,4 +533,5 @@ void iwkvd_db(FILE *f, IWDB db, int flags, int plvl);
 // IWKVD Trigger commands 
 #ifdef IW_TESTS
 #define IWKVD_WAL_NO_CHECKPOINT_ON_CLOSE 1UL
+#define IWKVD_TXN_FAIL_BEFORE_END 2UL
 #endif
\ No newline at end of file
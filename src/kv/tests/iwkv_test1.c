@@ -3,6 +3,8 @@
 #include "iwutils.h"
 #include "iwcfg.h"
 #include "iwkv_tests.h"
+#include <sys/stat.h>
+#include <pthread.h>
 
 #define KBUFSZ 128
 #define VBUFSZ 128
@@ -861,6 +863,2234 @@ static void iwkv_test6(void) {
   fclose(f);
 }
 
+static void iwkv_test7(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_7.db",
+    .oflags = IWKV_TRUNC
+  };
+  const int krange = 30000, bnum = 1000, nbatches = 40;
+  int *expected = malloc(krange * sizeof(int));
+  char *kbufs = malloc(bnum * 16);
+  int *vals = malloc(bnum * sizeof(int));
+  IWKV_val *keys = malloc(bnum * sizeof(*keys));
+  IWKV_val *vvals = malloc(bnum * sizeof(*vvals));
+  IWKV iwkv;
+  IWDB db1;
+  IWKV_val key, val;
+  char kb[16];
+
+  for (int i = 0; i < krange; ++i) {
+    expected[i] = -1;
+  }
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  for (int b = 0, v = 0; b < nbatches; ++b) {
+    for (int i = 0; i < bnum; ++i, ++v) {
+      // Duplicated keys within batch are expected
+      int k = iwu_rand_range(krange);
+      char *kp = kbufs + i * 16;
+      snprintf(kp, 16, "%08d", k);
+      vals[i] = v;
+      keys[i].data = kp;
+      keys[i].size = strlen(kp);
+      vvals[i].data = &vals[i];
+      vvals[i].size = sizeof(vals[i]);
+      expected[k] = v;
+    }
+    rc = iwkv_put_batch(db1, keys, vvals, bnum, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  for (int k = 0; k < krange; ++k) {
+    int v;
+    snprintf(kb, sizeof(kb), "%08d", k);
+    key.data = kb;
+    key.size = strlen(kb);
+    rc = iwkv_get(db1, &key, &val);
+    if (expected[k] < 0) {
+      CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_NOTFOUND);
+    } else {
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_EQUAL_FATAL(val.size, sizeof(v));
+      memcpy(&v, val.data, sizeof(v));
+      CU_ASSERT_EQUAL_FATAL(v, expected[k]);
+      iwkv_val_dispose(&val);
+    }
+  }
+  // Existing keys are rejected with `IWKV_NO_OVERWRITE`
+  for (int k = 0; k < krange; ++k) {
+    if (expected[k] >= 0) {
+      snprintf(kb, sizeof(kb), "%08d", k);
+      keys[0].data = kb;
+      keys[0].size = strlen(kb);
+      break;
+    }
+  }
+  rc = iwkv_put_batch(db1, keys, vvals, 1, IWKV_NO_OVERWRITE);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_KEY_EXISTS);
+
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  free(expected);
+  free(kbufs);
+  free(vals);
+  free(keys);
+  free(vvals);
+}
+
+typedef struct LOADSRC {
+  int k;
+  int end;
+  int step;
+  int v;
+  char kb[16];
+} LOADSRC;
+
+static iwrc _load_next(IWKV_val *key, IWKV_val *val, void *op) {
+  LOADSRC *src = op;
+  if (src->k == src->end) {
+    return IWKV_ERROR_NOTFOUND;
+  }
+  snprintf(src->kb, sizeof(src->kb), "%08d", src->k);
+  key->data = src->kb;
+  key->size = strlen(src->kb);
+  src->v = src->k;
+  val->data = &src->v;
+  val->size = sizeof(src->v);
+  src->k += src->step;
+  return 0;
+}
+
+// Source of `_load_next()` records followed by out of order key
+static iwrc _load_next_unsorted(IWKV_val *key, IWKV_val *val, void *op) {
+  LOADSRC *src = op;
+  if (src->k == src->end) {
+    src->k = 1000;
+    src->end = -1;
+  }
+  return _load_next(key, val, op);
+}
+
+static void iwkv_test8(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_8.db",
+    .oflags = IWKV_TRUNC,
+    .wal = {
+      .enabled = true
+    }
+  };
+  // Exceeds `IWKV_LOAD_CHUNK_NUM` nodes to cover intermediate checkpoints
+  const int num = 150000;
+  IWKV iwkv;
+  IWDB db1, db2;
+  IWKV_val key, val;
+  IWKV_cursor cur;
+  char kb[16];
+  int v;
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  LOADSRC src = {.k = num - 1, .end = -1, .step = -1};
+  rc = iwkv_load(db1, _load_next, &src, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Database is not empty
+  src.k = 10;
+  src.end = -1;
+  rc = iwkv_load(db1, _load_next, &src, 0);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_STATE);
+
+  // Records are not sorted
+  rc = iwkv_db(iwkv, 2, 0, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  src.k = 0;
+  src.end = 10;
+  src.step = 1;
+  rc = iwkv_load(db2, _load_next, &src, 0);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_ARGS);
+
+  // Nodes written before unsorted record are kept
+  rc = iwkv_db(iwkv, 3, 0, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  src.k = 100;
+  src.end = 0;
+  src.step = -1;
+  rc = iwkv_load(db2, _load_next_unsorted, &src, 0);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_ARGS);
+  int lcnt = 0;
+  rc = iwkv_cursor_open(db2, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+    ++lcnt;
+  }
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  CU_ASSERT_EQUAL(lcnt, 96); // Three filled nodes, the rest buffered records are dropped
+  rc = iwkv_cursor_close(&cur);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  src.k = 10;
+  src.end = -1;
+  rc = iwkv_load(db2, _load_next, &src, 0);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_STATE);
+
+  for (int i = 0; i < 2; ++i) {
+    for (int k = 0; k < num; k += 7) {
+      snprintf(kb, sizeof(kb), "%08d", k);
+      key.data = kb;
+      key.size = strlen(kb);
+      rc = iwkv_get(db1, &key, &val);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_EQUAL_FATAL(val.size, sizeof(v));
+      memcpy(&v, val.data, sizeof(v));
+      CU_ASSERT_EQUAL_FATAL(v, k);
+      iwkv_val_dispose(&val);
+    }
+    int cnt = 0;
+    rc = iwkv_cursor_open(db1, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+      rc = iwkv_cursor_get(cur, 0, &val);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      memcpy(&v, val.data, sizeof(v));
+      CU_ASSERT_EQUAL_FATAL(v, num - 1 - cnt);
+      iwkv_val_dispose(&val);
+      ++cnt;
+    }
+    CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+    CU_ASSERT_EQUAL(cnt, num);
+    rc = iwkv_cursor_close(&cur);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+    // Loaded database is writable as usual
+    if (i == 0) {
+      for (int k = 0; k < num; k += 2) {
+        snprintf(kb, sizeof(kb), "%08d", k);
+        key.data = kb;
+        key.size = strlen(kb);
+        rc = iwkv_del(db1, &key);
+        CU_ASSERT_EQUAL_FATAL(rc, 0);
+        val.data = &k;
+        val.size = sizeof(k);
+        rc = iwkv_put(db1, &key, &val, 0);
+        CU_ASSERT_EQUAL_FATAL(rc, 0);
+      }
+      rc = iwkv_close(&iwkv);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      opts.oflags = 0;
+      rc = iwkv_open(&opts, &iwkv);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      rc = iwkv_db(iwkv, 1, 0, &db1);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    }
+  }
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static void iwkv_test9(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_9.db",
+    .oflags = IWKV_TRUNC
+  };
+  const int krange = 20000, num = 500;
+  char *kbufs = malloc(num * 16);
+  IWKV_val *keys = malloc(num * sizeof(*keys));
+  IWKV_val *vals = malloc(num * sizeof(*vals));
+  iwrc *rcs = malloc(num * sizeof(*rcs));
+  IWKV iwkv;
+  IWDB db1;
+  IWKV_val key, val;
+  char kb[16];
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  // Even keys are stored
+  for (int k = 0; k < krange; k += 2) {
+    snprintf(kb, sizeof(kb), "%08d", k);
+    key.data = kb;
+    key.size = strlen(kb);
+    val.data = &k;
+    val.size = sizeof(k);
+    rc = iwkv_put(db1, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  for (int r = 0; r < 20; ++r) {
+    // Random keys including missing and duplicated ones
+    for (int i = 0; i < num; ++i) {
+      char *kp = kbufs + i * 16;
+      snprintf(kp, 16, "%08d", iwu_rand_range(krange));
+      keys[i].data = kp;
+      keys[i].size = strlen(kp);
+    }
+    rc = iwkv_get_multi(db1, keys, num, vals, rcs);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    for (int i = 0; i < num; ++i) {
+      int k = atoi(keys[i].data), v;
+      if (k % 2) {
+        CU_ASSERT_EQUAL_FATAL(rcs[i], IWKV_ERROR_NOTFOUND);
+        CU_ASSERT_FATAL(!vals[i].data);
+      } else {
+        CU_ASSERT_EQUAL_FATAL(rcs[i], 0);
+        CU_ASSERT_EQUAL_FATAL(vals[i].size, sizeof(v));
+        memcpy(&v, vals[i].data, sizeof(v));
+        CU_ASSERT_EQUAL_FATAL(v, k);
+        iwkv_val_dispose(&vals[i]);
+      }
+    }
+  }
+  rc = iwkv_get_multi(db1, keys, 0, vals, 0);
+  CU_ASSERT_EQUAL(rc, 0);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  free(kbufs);
+  free(keys);
+  free(vals);
+  free(rcs);
+}
+
+typedef struct PEEKCTX {
+  int cnt;
+  int k;
+  int v;
+} PEEKCTX;
+
+static iwrc _peek_visitor(const IWKV_val *key, const IWKV_val *val, void *op) {
+  PEEKCTX *ctx = op;
+  char kb[16];
+  if (key->size >= sizeof(kb) || val->size != sizeof(ctx->v)) {
+    return IW_ERROR_FAIL;
+  }
+  memcpy(kb, key->data, key->size);
+  kb[key->size] = '\0';
+  ctx->k = atoi(kb);
+  memcpy(&ctx->v, val->data, sizeof(ctx->v));
+  ++ctx->cnt;
+  return ctx->cnt > 1000 ? IW_ERROR_OVERFLOW : 0;
+}
+
+static void iwkv_test10(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_10.db",
+    .oflags = IWKV_TRUNC
+  };
+  const int num = 1000;
+  IWKV iwkv;
+  IWDB db1;
+  IWKV_val key, val;
+  IWKV_cursor cur;
+  PEEKCTX ctx = {0};
+  char kb[16];
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int k = 0; k < num; k += 2) {
+    snprintf(kb, sizeof(kb), "%08d", k);
+    key.data = kb;
+    key.size = strlen(kb);
+    int v = -k;
+    val.data = &v;
+    val.size = sizeof(v);
+    rc = iwkv_put(db1, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  for (int k = 0; k < num; ++k) {
+    snprintf(kb, sizeof(kb), "%08d", k);
+    key.data = kb;
+    key.size = strlen(kb);
+    rc = iwkv_get_peek(db1, &key, _peek_visitor, &ctx);
+    if (k % 2) {
+      CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_NOTFOUND);
+    } else {
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_EQUAL_FATAL(ctx.k, k);
+      CU_ASSERT_EQUAL_FATAL(ctx.v, -k);
+    }
+  }
+  CU_ASSERT_EQUAL(ctx.cnt, num / 2);
+
+  ctx.cnt = 0;
+  rc = iwkv_cursor_open(db1, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int k = num - 2; !(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT)); k -= 2) {
+    rc = iwkv_cursor_peek(cur, _peek_visitor, &ctx);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL_FATAL(ctx.k, k);
+    CU_ASSERT_EQUAL_FATAL(ctx.v, -k);
+  }
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  CU_ASSERT_EQUAL(ctx.cnt, num / 2);
+
+  // Visitor error is passed to caller
+  ctx.cnt = 1000;
+  rc = iwkv_cursor_to(cur, IWKV_CURSOR_PREV);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_cursor_peek(cur, _peek_visitor, &ctx);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_OVERFLOW);
+  rc = iwkv_cursor_close(&cur);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Scan records in chunks
+  ctx.cnt = 0;
+  rc = iwkv_cursor_open(db1, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_cursor_scan(cur, _peek_visitor, &ctx, 101);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(ctx.cnt, 101);
+  CU_ASSERT_EQUAL(ctx.k, num - 2 * 101);
+  CU_ASSERT_EQUAL(ctx.v, -(num - 2 * 101));
+  rc = iwkv_cursor_scan(cur, _peek_visitor, &ctx, 0);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  CU_ASSERT_EQUAL(ctx.cnt, num / 2);
+  CU_ASSERT_EQUAL(ctx.k, 0);
+  rc = iwkv_cursor_close(&cur);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static void iwkv_test11(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_11.db",
+    .oflags = IWKV_TRUNC
+  };
+  IWKV iwkv;
+  IWDB db1;
+  IWKV_val key, val;
+  // Binary keys with embedded zero bytes and common prefixes
+  char kb[64];
+  const int num = 2000;
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  memset(kb, 0, sizeof(kb));
+  for (int i = 0; i < num; ++i) {
+    kb[40] = i & 0xff;
+    kb[41] = i >> 8;
+    key.data = kb;
+    key.size = 40 + 2 + (i % 3);
+    val.data = &i;
+    val.size = sizeof(i);
+    rc = iwkv_put(db1, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  for (int i = 0; i < num; ++i) {
+    int v;
+    kb[40] = i & 0xff;
+    kb[41] = i >> 8;
+    key.data = kb;
+    key.size = 40 + 2 + (i % 3);
+    rc = iwkv_get(db1, &key, &val);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    memcpy(&v, val.data, sizeof(v));
+    CU_ASSERT_EQUAL_FATAL(v, i);
+    iwkv_val_dispose(&val);
+    key.size = 40 + 2 + ((i + 1) % 3);
+    rc = iwkv_get(db1, &key, &val);
+    CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_NOTFOUND);
+  }
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static int _test12_cmp_rev(const void *v1, size_t v1len, const void *v2, size_t v2len, void *op) {
+  int rv = memcmp(v2, v1, MIN(v1len, v2len));
+  return rv ? rv : (int) v2len - (int) v1len;
+}
+
+static void iwkv_test12(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_12.db",
+    .oflags = IWKV_TRUNC
+  };
+  IWDB_OPTS dbopts = {
+    .cmp = _test12_cmp_rev
+  };
+  IWKV iwkv;
+  IWDB db1, db2, db3;
+  IWKV_val key, val;
+  IWKV_cursor cur;
+  const int num = 5000;
+  uint8_t tb[2 * IW_VNUMBUFSZ];
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int r = 0; r < 2; ++r) {
+    rc = iwkv_db(iwkv, 1, 0, &db1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    if (r == 0) {
+      rc = iwkv_db_set_comparator(db1, iwkv_cmp_int64, 0);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    } // Builtin comparator is stored in database file
+    rc = iwkv_db(iwkv, 2, 0, &db2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_db_set_comparator(db2, iwkv_cmp_vtuple, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    if (r > 0) {
+      // Custom comparator must be given on every open
+      rc = iwkv_db(iwkv, 3, 0, &db3);
+      CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+    }
+    rc = iwkv_db_ext(iwkv, 3, 0, &dbopts, &db3);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    if (r == 0) {
+      for (int i = 0; i < num; ++i) {
+        // Signed keys: -2500 ... 2499 in shuffled order
+        int64_t k = (int64_t)((i * 7919) % num) - num / 2;
+        key.data = &k;
+        key.size = sizeof(k);
+        val.data = &k;
+        val.size = sizeof(k);
+        rc = iwkv_put(db1, &key, &val, 0);
+        CU_ASSERT_EQUAL_FATAL(rc, 0);
+        // Tuples (k / 100, k % 100) of non negative numbers
+        int len, len2;
+        uint64_t t = (i * 7919) % num;
+        IW_SETVNUMBUF64(len, tb, t / 100);
+        IW_SETVNUMBUF64(len2, tb + len, t % 100);
+        key.data = tb;
+        key.size = len + len2;
+        val.data = &t;
+        val.size = sizeof(t);
+        rc = iwkv_put(db2, &key, &val, 0);
+        CU_ASSERT_EQUAL_FATAL(rc, 0);
+        rc = iwkv_put(db3, &key, &val, 0);
+        CU_ASSERT_EQUAL_FATAL(rc, 0);
+      }
+      rc = iwkv_close(&iwkv);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      opts.oflags = 0;
+      rc = iwkv_open(&opts, &iwkv);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      continue;
+    }
+    // Cursor walks keys in descending order of comparator
+    int64_t ek = num / 2 - 1;
+    rc = iwkv_cursor_open(db1, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+      int64_t k;
+      rc = iwkv_cursor_get(cur, &key, 0);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_EQUAL_FATAL(key.size, sizeof(k));
+      memcpy(&k, key.data, sizeof(k));
+      CU_ASSERT_EQUAL_FATAL(k, ek);
+      iwkv_val_dispose(&key);
+      --ek;
+    }
+    CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+    CU_ASSERT_EQUAL(ek, -num / 2 - 1);
+    rc = iwkv_cursor_close(&cur);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+    uint64_t et = num - 1;
+    rc = iwkv_cursor_open(db2, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+      uint64_t t;
+      rc = iwkv_cursor_get(cur, 0, &val);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      memcpy(&t, val.data, sizeof(t));
+      CU_ASSERT_EQUAL_FATAL(t, et);
+      iwkv_val_dispose(&val);
+      --et;
+    }
+    CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+    CU_ASSERT_EQUAL(et, (uint64_t) -1);
+    rc = iwkv_cursor_close(&cur);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+    for (int64_t k = -num / 2; k < num / 2; ++k) {
+      int64_t v;
+      key.data = &k;
+      key.size = sizeof(k);
+      rc = iwkv_get(db1, &key, &val);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      memcpy(&v, val.data, sizeof(v));
+      CU_ASSERT_EQUAL_FATAL(v, k);
+      iwkv_val_dispose(&val);
+    }
+
+    // Cursor walks keys of custom comparator database in ascending order of key bytes
+    IWKV_val pkey = {0};
+    int cnt = 0;
+    rc = iwkv_cursor_open(db3, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+      rc = iwkv_cursor_get(cur, &key, 0);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      if (pkey.size) {
+        CU_ASSERT_TRUE_FATAL(_test12_cmp_rev(pkey.data, pkey.size, key.data, key.size, 0) > 0);
+        iwkv_val_dispose(&pkey);
+      }
+      pkey = key;
+      ++cnt;
+    }
+    iwkv_val_dispose(&pkey);
+    CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+    CU_ASSERT_EQUAL(cnt, num);
+    rc = iwkv_cursor_close(&cur);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+    // Comparator of database having records is not changed
+    rc = iwkv_db_set_comparator(db1, iwkv_cmp_double, 0);
+    CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_STATE);
+    rc = iwkv_db_set_comparator(db3, 0, 0);
+    CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_STATE);
+    IWDB_OPTS dopts = {
+      .cmp = iwkv_cmp_double
+    };
+    rc = iwkv_db_ext(iwkv, 1, 0, &dopts, &db1);
+    CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+    rc = iwkv_db(iwkv, 3, 0, &db3);
+    CU_ASSERT_EQUAL(rc, 0);
+  }
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  double d1 = -1.5, d2 = 2.0, d3 = NAN, d4 = INFINITY;
+  CU_ASSERT_TRUE(iwkv_cmp_double(&d1, sizeof(d1), &d2, sizeof(d2), 0) < 0);
+  CU_ASSERT_TRUE(iwkv_cmp_double(&d2, sizeof(d2), &d1, sizeof(d1), 0) > 0);
+  CU_ASSERT_TRUE(iwkv_cmp_double(&d3, sizeof(d3), &d4, sizeof(d4), 0) > 0);
+  CU_ASSERT_TRUE(iwkv_cmp_double(&d4, sizeof(d4), &d3, sizeof(d3), 0) < 0);
+  CU_ASSERT_EQUAL(iwkv_cmp_double(&d3, sizeof(d3), &d3, sizeof(d3), 0), 0);
+}
+
+static int _test13_key(char *buf, int i) {
+  if (i % 97 == 0) { // Short keys, shorter than KVBLK prefix
+    return sprintf(buf, "t%d", i);
+  }
+  return sprintf(buf, "tenant-%d/region/europe-west/service/storage/bucket/objects/%s/%06d",
+                 i % 3, (i % 5) ? "2026/10/15" : "x", i);
+}
+
+static void iwkv_test13(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_13.db",
+    .oflags = IWKV_TRUNC,
+    .wal = {
+      .enabled = true
+    }
+  };
+  IWKV iwkv;
+  IWDB db1, db2, db3;
+  IWKV_val key, val, key2, val2;
+  IWKV_cursor cur1, cur2;
+  char kb[128], vb[256];
+  size_t ksz;
+  const int num = 20000;
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, IWDB_PREFIX_KEYS, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, 0, &db2); // Reference database
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 3, IWDB_PREFIX_KEYS | IWDB_UINT32_KEYS, &db3);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+  rc = iwkv_db_set_comparator(db1, iwkv_cmp_int64, 0);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+
+  for (int i = 0; i < num; ++i) {
+    int k = (i * 7919) % num;
+    key.size = _test13_key(kb, k);
+    key.data = kb;
+    val.size = sprintf(vb, "%d", k);
+    val.data = vb;
+    rc = iwkv_put(db1, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_put(db2, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  // Grow values of some records and remove others
+  memset(vb, 'v', sizeof(vb));
+  for (int i = 0; i < num; ++i) {
+    key.size = _test13_key(kb, i);
+    key.data = kb;
+    if (i % 3 == 0) {
+      rc = iwkv_del(db1, &key);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      rc = iwkv_del(db2, &key);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    } else if (i % 7 == 0) {
+      val.size = 100 + i % 100;
+      val.data = vb;
+      rc = iwkv_put(db1, &key, &val, 0);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      rc = iwkv_put(db2, &key, &val, 0);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    }
+  }
+  for (int r = 0; r < 2; ++r) {
+    if (r) {
+      rc = iwkv_close(&iwkv);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      opts.oflags = 0;
+      rc = iwkv_open(&opts, &iwkv);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      rc = iwkv_db(iwkv, 1, IWDB_PREFIX_KEYS, &db1);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      rc = iwkv_db(iwkv, 2, 0, &db2);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    }
+    for (int i = 0; i < num; ++i) {
+      key.size = _test13_key(kb, i);
+      key.data = kb;
+      rc = iwkv_get(db1, &key, &val);
+      if (i % 3 == 0) {
+        CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_NOTFOUND);
+        continue;
+      }
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      rc = iwkv_get(db2, &key, &val2);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_EQUAL_FATAL(val.size, val2.size);
+      CU_ASSERT_FATAL(!memcmp(val.data, val2.data, val.size));
+      iwkv_val_dispose(&val);
+      iwkv_val_dispose(&val2);
+    }
+    // Records order must be the same as in reference database
+    int cnt = 0;
+    rc = iwkv_cursor_open(db1, &cur1, IWKV_CURSOR_BEFORE_FIRST, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_cursor_open(db2, &cur2, IWKV_CURSOR_BEFORE_FIRST, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    while (!(rc = iwkv_cursor_to(cur1, IWKV_CURSOR_NEXT))) {
+      rc = iwkv_cursor_to(cur2, IWKV_CURSOR_NEXT);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      rc = iwkv_cursor_get(cur1, &key, &val);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      rc = iwkv_cursor_get(cur2, &key2, &val2);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_EQUAL_FATAL(key.size, key2.size);
+      CU_ASSERT_FATAL(!memcmp(key.data, key2.data, key.size));
+      CU_ASSERT_EQUAL_FATAL(val.size, val2.size);
+      CU_ASSERT_FATAL(!memcmp(val.data, val2.data, val.size));
+      rc = iwkv_cursor_copy_key(cur1, (uint8_t *) kb, sizeof(kb), &ksz);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_EQUAL_FATAL(ksz, key.size);
+      CU_ASSERT_FATAL(!memcmp(kb, key.data, ksz));
+      iwkv_kv_dispose(&key, &val);
+      iwkv_kv_dispose(&key2, &val2);
+      ++cnt;
+    }
+    CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+    rc = iwkv_cursor_to(cur2, IWKV_CURSOR_NEXT);
+    CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+    CU_ASSERT_EQUAL(cnt, num - (num + 2) / 3);
+    rc = iwkv_cursor_close(&cur1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_cursor_close(&cur2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static size_t _test14_val(char *buf, int i) {
+  size_t len = 0, sz;
+  if (i % 10 == 0) { // Small value stored as is
+    return sprintf(buf, "{\"id\":%d}", i);
+  } else if (i % 10 == 1) { // Not compressible value
+    sz = 3000;
+    for (len = 0; len < sz; ++len) {
+      buf[len] = (i * 31 + len * 7919 + (len * len) % 251) % 256;
+    }
+    return sz;
+  }
+  sz = 2048 + (i % 7) * 1024;
+  for (int j = 0; len < sz - 128; ++j) {
+    len += sprintf(buf + len, "{\"id\":%d,\"seq\":%d,\"name\":\"user%d\",\"active\":%s},",
+                   i, j, j % 13, (j % 2) ? "true" : "false");
+  }
+  return len;
+}
+
+typedef struct PEEKCTX2 {
+  const char *data;
+  size_t size;
+  bool matched;
+} PEEKCTX2;
+
+static iwrc _peek_visitor2(const IWKV_val *key, const IWKV_val *val, void *op) {
+  PEEKCTX2 *ctx = op;
+  ctx->matched = (val->size == ctx->size && !memcmp(val->data, ctx->data, val->size));
+  return 0;
+}
+
+static void iwkv_test14(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_14.db",
+    .oflags = IWKV_TRUNC
+  };
+  IWKV_OPTS ropts = {
+    .path = "iwkv_test1_14r.db",
+    .oflags = IWKV_TRUNC
+  };
+  IWKV iwkv, riwkv;
+  IWDB db1, rdb;
+  IWKV_val key, val;
+  IWKV_cursor cur;
+  PEEKCTX2 ctx;
+  const int num = 2000;
+  char *vb = malloc(16 * 1024), *cb = malloc(16 * 1024);
+  size_t vsz;
+  struct stat st1, st2;
+  CU_ASSERT_PTR_NOT_NULL_FATAL(vb);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(cb);
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_open(&ropts, &riwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_COMPRESS_VALS | IWDB_DUP_UINT32_VALS, &db1);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+  rc = iwkv_db(iwkv, 1, IWDB_COMPRESS_VALS, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(riwkv, 1, 0, &rdb);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  for (int i = 0; i < num; ++i) {
+    key.data = &i;
+    key.size = sizeof(i);
+    val.data = vb;
+    val.size = _test14_val(vb, i);
+    rc = iwkv_put(db1, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_put(rdb, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  // Replace some values: compressed by raw and vice versa
+  for (int i = 0; i < num; i += 5) {
+    int k = i + 1;
+    key.data = &i;
+    key.size = sizeof(i);
+    val.data = vb;
+    val.size = _test14_val(vb, k);
+    rc = iwkv_put(db1, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = iwkv_close(&riwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  for (int r = 0; r < 2; ++r) {
+    if (r) {
+      rc = iwkv_close(&iwkv);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      opts.oflags = 0;
+      rc = iwkv_open(&opts, &iwkv);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      rc = iwkv_db(iwkv, 1, IWDB_COMPRESS_VALS, &db1);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    }
+    for (int i = 0; i < num; ++i) {
+      key.data = &i;
+      key.size = sizeof(i);
+      vsz = _test14_val(vb, (i % 5) ? i : i + 1);
+      rc = iwkv_get(db1, &key, &val);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_EQUAL_FATAL(val.size, vsz);
+      CU_ASSERT_FATAL(!memcmp(val.data, vb, vsz));
+      iwkv_val_dispose(&val);
+      ctx.data = vb;
+      ctx.size = vsz;
+      ctx.matched = false;
+      rc = iwkv_get_peek(db1, &key, _peek_visitor2, &ctx);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_TRUE_FATAL(ctx.matched);
+    }
+    int cnt = 0;
+    rc = iwkv_cursor_open(db1, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+      int k;
+      rc = iwkv_cursor_get(cur, &key, &val);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      memcpy(&k, key.data, sizeof(k));
+      vsz = _test14_val(vb, (k % 5) ? k : k + 1);
+      CU_ASSERT_EQUAL_FATAL(val.size, vsz);
+      CU_ASSERT_FATAL(!memcmp(val.data, vb, vsz));
+      iwkv_kv_dispose(&key, &val);
+      rc = iwkv_cursor_val(cur, &val);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_EQUAL_FATAL(val.size, vsz);
+      iwkv_val_dispose(&val);
+      size_t esz = vsz;
+      rc = iwkv_cursor_copy_val(cur, (uint8_t *) cb, 100, &vsz);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_EQUAL_FATAL(vsz, esz);
+      CU_ASSERT_FATAL(!memcmp(cb, vb, MIN(vsz, 100)));
+      ++cnt;
+    }
+    CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+    CU_ASSERT_EQUAL(cnt, num);
+    rc = iwkv_cursor_close(&cur);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  CU_ASSERT_EQUAL_FATAL(stat(opts.path, &st1), 0);
+  CU_ASSERT_EQUAL_FATAL(stat(ropts.path, &st2), 0);
+  CU_ASSERT_TRUE(st1.st_size * 2 < st2.st_size);
+  free(vb);
+  free(cb);
+}
+
+static void _test15_check(IWDB db, int num, char *vb, int mod) {
+  IWKV_val key, val;
+  IWKV_cursor cur;
+  PEEKCTX2 ctx;
+  size_t vsz;
+  int cnt = 0;
+  for (int i = 0; i < num; ++i) {
+    key.data = &i;
+    key.size = sizeof(i);
+    iwrc rc = iwkv_get(db, &key, &val);
+    if (i % 7 == 3) { // Removed
+      CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_NOTFOUND);
+      continue;
+    }
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    vsz = _test14_val(vb, i + mod);
+    CU_ASSERT_EQUAL_FATAL(val.size, vsz);
+    CU_ASSERT_FATAL(!memcmp(val.data, vb, vsz));
+    iwkv_val_dispose(&val);
+    ctx.data = vb;
+    ctx.size = vsz;
+    ctx.matched = false;
+    rc = iwkv_get_peek(db, &key, _peek_visitor2, &ctx);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_TRUE_FATAL(ctx.matched);
+  }
+  iwrc rc = iwkv_cursor_open(db, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+    int k;
+    rc = iwkv_cursor_get(cur, &key, &val);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    memcpy(&k, key.data, sizeof(k));
+    vsz = _test14_val(vb, k + mod);
+    CU_ASSERT_EQUAL_FATAL(val.size, vsz);
+    CU_ASSERT_FATAL(!memcmp(val.data, vb, vsz));
+    iwkv_kv_dispose(&key, &val);
+    ++cnt;
+  }
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  CU_ASSERT_EQUAL(cnt, num - (num + 3) / 7);
+  rc = iwkv_cursor_close(&cur);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static void iwkv_test15(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_15.db",
+    .oflags = IWKV_TRUNC,
+    .blob_threshold = 1024
+  };
+  IWKV iwkv;
+  IWDB db1, db2, db3;
+  IWKV_val key, val;
+  const int num = 700;
+  char *vb = malloc(16 * 1024);
+  struct stat st1, st2;
+  CU_ASSERT_PTR_NOT_NULL_FATAL(vb);
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 4, IWDB_BLOB_VALS | IWDB_DUP_UINT64_VALS, &db1);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+  rc = iwkv_db(iwkv, 1, IWDB_BLOB_VALS, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_BLOB_VALS | IWDB_COMPRESS_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 3, IWDB_BLOB_VALS, &db3);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  for (int i = 0; i < num; ++i) {
+    key.data = &i;
+    key.size = sizeof(i);
+    val.data = vb;
+    val.size = _test14_val(vb, i);
+    rc = iwkv_put(db1, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_put(db2, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_put(db3, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  for (int i = 3; i < num; i += 7) {
+    key.data = &i;
+    key.size = sizeof(i);
+    rc = iwkv_del(db1, &key);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_del(db2, &key);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  _test15_check(db1, num, vb, 0);
+  _test15_check(db2, num, vb, 0);
+  rc = iwkv_db_destroy(&db3);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_sync(iwkv, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL_FATAL(stat(opts.path, &st1), 0);
+
+  // Overwrite values: blob by inline and vice versa, blob by blob.
+  // Space of released blobs is reused so file must not grow much.
+  for (int r = 1; r <= 4; ++r) {
+    for (int i = 0; i < num; ++i) {
+      if (i % 7 == 3) {
+        continue;
+      }
+      key.data = &i;
+      key.size = sizeof(i);
+      val.data = vb;
+      val.size = _test14_val(vb, i + r);
+      rc = iwkv_put(db1, &key, &val, 0);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      rc = iwkv_put(db2, &key, &val, 0);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    }
+  }
+  rc = iwkv_sync(iwkv, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL_FATAL(stat(opts.path, &st2), 0);
+  CU_ASSERT_TRUE(st2.st_size < st1.st_size * 2);
+
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  opts.oflags = 0;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, IWDB_BLOB_VALS, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_BLOB_VALS | IWDB_COMPRESS_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test15_check(db1, num, vb, 4);
+  _test15_check(db2, num, vb, 4);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  free(vb);
+}
+
+static void _test16_check(IWDB db1, IWDB db2, int num) {
+  IWKV_val key, val;
+  IWKV_cursor cur;
+  char kb[128];
+  int cnt = 0;
+  uint64_t pk = UINT64_MAX;
+  for (int i = 0; i < num; ++i) {
+    uint64_t k = i * 7919ULL % num;
+    key.data = &k;
+    key.size = sizeof(k);
+    iwrc rc = iwkv_get(db1, &key, &val);
+    if (k % 3 == 0) { // Removed
+      CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_NOTFOUND);
+      continue;
+    }
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL_FATAL(val.size, sizeof(k));
+    CU_ASSERT_FATAL(!memcmp(val.data, &k, sizeof(k)));
+    iwkv_val_dispose(&val);
+    key.size = snprintf(kb, sizeof(kb), "%0100" PRIu64, k);
+    key.data = kb;
+    rc = iwkv_get(db2, &key, &val);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL_FATAL(val.size, sizeof(k));
+    iwkv_val_dispose(&val);
+  }
+  iwrc rc = iwkv_cursor_open(db1, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+    uint64_t k;
+    size_t ksz;
+    rc = iwkv_cursor_copy_key(cur, (uint8_t *) &k, sizeof(k), &ksz);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL_FATAL(ksz, sizeof(k));
+    CU_ASSERT_TRUE_FATAL(k < pk);
+    CU_ASSERT_TRUE_FATAL(k % 3);
+    pk = k;
+    ++cnt;
+  }
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  CU_ASSERT_EQUAL(cnt, num - (num + 2) / 3);
+  rc = iwkv_cursor_close(&cur);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static void iwkv_test16(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_16.db",
+    .oflags = IWKV_TRUNC
+  };
+  IWDB_OPTS dbopts = {
+    .fanout = 48
+  };
+  IWKV iwkv;
+  IWDB db1, db2;
+  IWKV_val key, val;
+  char kb[128];
+  const int num = 10000;
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db_ext(iwkv, 1, IWDB_UINT64_KEYS, &dbopts, &db1);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_ARGS);
+  dbopts.fanout = 128;
+  rc = iwkv_db_ext(iwkv, 1, IWDB_UINT64_KEYS, &dbopts, &db1);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_ARGS);
+  dbopts.fanout = 64;
+  rc = iwkv_db_ext(iwkv, 1, IWDB_UINT64_KEYS, &dbopts, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db_ext(iwkv, 2, 0, &dbopts, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  for (int i = 0; i < num; ++i) {
+    uint64_t k = i * 7919ULL % num;
+    val.data = &k;
+    val.size = sizeof(k);
+    key.data = &k;
+    key.size = sizeof(k);
+    rc = iwkv_put(db1, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    // Keys longer than lower key buffer of node
+    key.size = snprintf(kb, sizeof(kb), "%0100" PRIu64, k);
+    key.data = kb;
+    rc = iwkv_put(db2, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  for (uint64_t k = 0; k < num; k += 3) {
+    key.data = &k;
+    key.size = sizeof(k);
+    rc = iwkv_del(db1, &key);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  _test16_check(db1, db2, num);
+
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  opts.oflags = 0;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  dbopts.fanout = 32;
+  rc = iwkv_db_ext(iwkv, 1, IWDB_UINT64_KEYS, &dbopts, &db1);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+  rc = iwkv_db(iwkv, 1, IWDB_UINT64_KEYS, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, 0, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test16_check(db1, db2, num);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static void _test17_check(IWDB db, int num, int step) {
+  IWKV_val key, val;
+  IWKV_cursor cur;
+  char kb[64];
+  int cnt = 0;
+  for (int i = 0; i < num; ++i) {
+    int k = i * 7919 % num;
+    key.size = snprintf(kb, sizeof(kb), "key%07d", k);
+    key.data = kb;
+    iwrc rc = iwkv_get(db, &key, &val);
+    if (step && k % step == 0) { // Removed
+      CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_NOTFOUND);
+      continue;
+    }
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL_FATAL(val.size, sizeof(k));
+    CU_ASSERT_FATAL(!memcmp(val.data, &k, sizeof(k)));
+    iwkv_val_dispose(&val);
+  }
+  iwrc rc = iwkv_cursor_open(db, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+    ++cnt;
+  }
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  CU_ASSERT_EQUAL(cnt, step ? num - (num + step - 1) / step : num);
+  rc = iwkv_cursor_close(&cur);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static void _test17_run(size_t dbcache_max_sz) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_17.db",
+    .oflags = IWKV_TRUNC,
+    .dbcache_max_sz = dbcache_max_sz
+  };
+  IWKV iwkv;
+  IWDB db;
+  IWKV_val key, val;
+  char kb[64];
+  const int num = 50000;
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < num; ++i) {
+    int k = i * 7919 % num;
+    key.size = snprintf(kb, sizeof(kb), "key%07d", k);
+    key.data = kb;
+    val.data = &k;
+    val.size = sizeof(k);
+    rc = iwkv_put(db, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  _test17_check(db, num, 0);
+  // Remove most of records to shrink database
+  for (int k = 0; k < num; ++k) {
+    if (k % 5) {
+      continue;
+    }
+    key.size = snprintf(kb, sizeof(kb), "key%07d", k);
+    key.data = kb;
+    rc = iwkv_del(db, &key);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  _test17_check(db, num, 5);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  opts.oflags = 0;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test17_check(db, num, 5);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static void iwkv_test17(void) {
+  _test17_run(64 * 1024 * 1024); // All nodes are indexed
+  _test17_run(16 * 1024);        // Budget is exceeded as database grows
+}
+
+static int _test18_key(char *kb, int i) {
+  switch (i % 3) {
+    case 0:
+      return sprintf(kb, "%07d", i);
+    case 1: // Keys with common prefix longer than 8 bytes
+      return sprintf(kb, "long-common-prefix-%07d", i);
+    default:
+      kb[0] = (char) 0xff; // Check unsigned bytes order
+      return 1 + sprintf(kb + 1, "%d", i);
+  }
+}
+
+static void _test18_run(iwdb_flags_t dbflg) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_18.db",
+    .oflags = IWKV_TRUNC,
+    .dbcache_max_sz = 64 * 1024 * 1024
+  };
+  IWKV iwkv;
+  IWDB db;
+  IWKV_cursor cur;
+  IWKV_val key, val, pkey = {0};
+  char kb[64];
+  const int num = 30000;
+  int cnt = 0;
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, dbflg, &db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < num; ++i) {
+    int k = i * 7919 % num;
+    uint64_t llv = (uint64_t) k << 24;
+    uint32_t lv = (uint32_t) k << 8;
+    if (dbflg & IWDB_UINT64_KEYS) {
+      key.data = &llv;
+      key.size = sizeof(llv);
+    } else if (dbflg & IWDB_UINT32_KEYS) {
+      key.data = &lv;
+      key.size = sizeof(lv);
+    } else {
+      key.size = _test18_key(kb, k);
+      key.data = kb;
+    }
+    val.data = &k;
+    val.size = sizeof(k);
+    rc = iwkv_put(db, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  for (int k = 0; k < num; ++k) {
+    uint64_t llv = (uint64_t) k << 24;
+    uint32_t lv = (uint32_t) k << 8;
+    if (dbflg & IWDB_UINT64_KEYS) {
+      key.data = &llv;
+      key.size = sizeof(llv);
+    } else if (dbflg & IWDB_UINT32_KEYS) {
+      key.data = &lv;
+      key.size = sizeof(lv);
+    } else {
+      key.size = _test18_key(kb, k);
+      key.data = kb;
+    }
+    rc = iwkv_get(db, &key, &val);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_FATAL(val.size == sizeof(k) && !memcmp(val.data, &k, sizeof(k)));
+    iwkv_val_dispose(&val);
+  }
+  // Keys are traversed in descending order
+  rc = iwkv_cursor_open(db, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+    rc = iwkv_cursor_key(cur, &key);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    if (pkey.data) {
+      if (dbflg & IWDB_UINT64_KEYS) {
+        CU_ASSERT_FATAL(*(uint64_t *) pkey.data > *(uint64_t *) key.data);
+      } else if (dbflg & IWDB_UINT32_KEYS) {
+        CU_ASSERT_FATAL(*(uint32_t *) pkey.data > *(uint32_t *) key.data);
+      } else {
+        int cr = memcmp(pkey.data, key.data, MIN(pkey.size, key.size));
+        CU_ASSERT_FATAL(cr > 0 || (cr == 0 && pkey.size > key.size));
+      }
+      iwkv_val_dispose(&pkey);
+    }
+    pkey = key;
+    ++cnt;
+  }
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  CU_ASSERT_EQUAL(cnt, num);
+  iwkv_val_dispose(&pkey);
+  rc = iwkv_cursor_close(&cur);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static void iwkv_test18(void) {
+  _test18_run(0);
+  _test18_run(IWDB_UINT32_KEYS);
+  _test18_run(IWDB_UINT64_KEYS);
+}
+
+typedef struct TEST19CTX {
+  IWDB db;
+  int num;
+  volatile bool stop;
+  int failures;
+} TEST19CTX;
+
+static void *_test19_reader(void *op) {
+  TEST19CTX *ctx = op;
+  IWKV_val key, val;
+  char kb[64];
+  for (int i = 0; !ctx->stop; ++i) {
+    int k = i % ctx->num;
+    key.size = snprintf(kb, sizeof(kb), "key%07d", k);
+    key.data = kb;
+    iwrc rc = iwkv_get(ctx->db, &key, &val);
+    if (!rc) {
+      if (val.size != sizeof(k) || memcmp(val.data, &k, sizeof(k))) {
+        ++ctx->failures;
+      }
+      iwkv_val_dispose(&val);
+    } else if (rc != IWKV_ERROR_NOTFOUND) {
+      ++ctx->failures;
+    }
+  }
+  return 0;
+}
+
+// Only every 10th key is kept
+static void _test19_check(IWDB db, int num) {
+  IWKV_val key, val;
+  IWKV_cursor cur;
+  char kb[64];
+  int cnt = 0;
+  for (int k = 0; k < num; ++k) {
+    key.size = snprintf(kb, sizeof(kb), "key%07d", k);
+    key.data = kb;
+    iwrc rc = iwkv_get(db, &key, &val);
+    if (k % 10) {
+      CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_NOTFOUND);
+      continue;
+    }
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_FATAL(val.size == sizeof(k) && !memcmp(val.data, &k, sizeof(k)));
+    iwkv_val_dispose(&val);
+  }
+  iwrc rc = iwkv_cursor_open(db, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+    ++cnt;
+  }
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  CU_ASSERT_EQUAL(cnt, num / 10);
+  rc = iwkv_cursor_close(&cur);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static void _test19_run(size_t dbcache_max_sz) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_19.db",
+    .oflags = IWKV_TRUNC,
+    .dbcache_max_sz = dbcache_max_sz
+  };
+  IWKV iwkv;
+  IWKV_val key, val;
+  pthread_t th;
+  char kb[64];
+  TEST19CTX ctx = {
+    .num = 60000
+  };
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &ctx.db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  int rci = pthread_create(&th, 0, _test19_reader, &ctx);
+  CU_ASSERT_EQUAL_FATAL(rci, 0);
+  // Database grows and shrinks while cache is filled in background
+  for (int r = 0; r < 2; ++r) {
+    for (int i = 0; i < ctx.num; ++i) {
+      int k = i * 7919 % ctx.num;
+      key.size = snprintf(kb, sizeof(kb), "key%07d", k);
+      key.data = kb;
+      val.data = &k;
+      val.size = sizeof(k);
+      rc = iwkv_put(ctx.db, &key, &val, 0);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    }
+    for (int k = 0; k < ctx.num; ++k) {
+      if (!(k % 10)) {
+        continue;
+      }
+      key.size = snprintf(kb, sizeof(kb), "key%07d", k);
+      key.data = kb;
+      rc = iwkv_del(ctx.db, &key);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    }
+  }
+  ctx.stop = true;
+  pthread_join(th, 0);
+  CU_ASSERT_EQUAL(ctx.failures, 0);
+  _test19_check(ctx.db, ctx.num);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Lookups right after open, cache is not filled yet
+  opts.oflags = 0;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &ctx.db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test19_check(ctx.db, ctx.num);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static void iwkv_test19(void) {
+  _test19_run(0);
+  _test19_run(64 * 1024 * 1024);
+  _test19_run(16 * 1024);
+}
+
+// Keys `[0, num)` are stored if `k % mod == 0`, checks lookups of `[0, 2 * num)` keys
+static void _test20_check(IWDB db, int num, int mod) {
+  IWKV_val key, val, keys[64], vals[64];
+  iwrc rcs[64];
+  char kb[16], kbufs[64][16];
+  for (int k = 0; k < 2 * num; ++k) {
+    snprintf(kb, sizeof(kb), "%08d", k);
+    key.data = kb;
+    key.size = strlen(kb);
+    iwrc rc = iwkv_get(db, &key, &val);
+    if (k >= num || k % mod) {
+      CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_NOTFOUND);
+      continue;
+    }
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_FATAL(val.size == sizeof(k) && !memcmp(val.data, &k, sizeof(k)));
+    iwkv_val_dispose(&val);
+  }
+  for (int k = 0; k < 2 * num; k += 64) {
+    for (int i = 0; i < 64; ++i) {
+      snprintf(kbufs[i], sizeof(kbufs[i]), "%08d", k + i);
+      keys[i].data = kbufs[i];
+      keys[i].size = strlen(kbufs[i]);
+    }
+    iwrc rc = iwkv_get_multi(db, keys, 64, vals, rcs);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    for (int i = 0; i < 64; ++i) {
+      if (k + i >= num || (k + i) % mod) {
+        CU_ASSERT_EQUAL_FATAL(rcs[i], IWKV_ERROR_NOTFOUND);
+      } else {
+        CU_ASSERT_EQUAL_FATAL(rcs[i], 0);
+        iwkv_val_dispose(&vals[i]);
+      }
+    }
+  }
+}
+
+static void iwkv_test20(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_20.db",
+    .oflags = IWKV_TRUNC,
+    .wal = {
+      .enabled = true
+    }
+  };
+  IWDB_OPTS dbopts = {
+    .bloom_keys = 1000 // Filter grows as database grows
+  };
+  const int num = 50000;
+  IWKV iwkv;
+  IWDB db1, db2;
+  IWKV_val key, val;
+  char kb[16];
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db_ext(iwkv, 1, 0, &dbopts, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < num; ++i) {
+    int k = i * 7919 % num;
+    snprintf(kb, sizeof(kb), "%08d", k);
+    key.data = kb;
+    key.size = strlen(kb);
+    val.data = &k;
+    val.size = sizeof(k);
+    rc = iwkv_put(db1, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  _test20_check(db1, num, 1);
+  // Filter is rebuilt as keys are removed
+  for (int k = 0; k < num; ++k) {
+    if (k % 4) {
+      snprintf(kb, sizeof(kb), "%08d", k);
+      key.data = kb;
+      key.size = strlen(kb);
+      rc = iwkv_del(db1, &key);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    }
+  }
+  _test20_check(db1, num, 4);
+
+  // Bulk loaded database
+  rc = iwkv_db_ext(iwkv, 2, 0, &dbopts, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  LOADSRC src = {.k = num - 1, .end = -1, .step = -1};
+  rc = iwkv_load(db2, _load_next, &src, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test20_check(db2, num, 1);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Filters are persisted
+  opts.oflags = 0;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db_ext(iwkv, 1, 0, &dbopts, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test20_check(db1, num, 4);
+  rc = iwkv_db(iwkv, 2, 0, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test20_check(db2, num, 1);
+  // Filter is not created for existing database
+  rc = iwkv_db(iwkv, 3, 0, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db_ext(iwkv, 3, 0, &dbopts, &db2);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+  rc = iwkv_db_destroy(&db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Keys are added across reopens, filter counters are kept so filter still grows
+  for (int s = 0, k = 0; s < 5; ++s) {
+    rc = iwkv_open(&opts, &iwkv);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_db_ext(iwkv, 5, 0, &dbopts, &db1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    for (int e = k + 3000; k < e; ++k) {
+      snprintf(kb, sizeof(kb), "%08d", k);
+      key.data = kb;
+      key.size = strlen(kb);
+      val.data = &k;
+      val.size = sizeof(k);
+      rc = iwkv_put(db1, &key, &val, 0);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    }
+    _test20_check(db1, k, 1);
+    rc = iwkv_close(&iwkv);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+}
+
+static void _test21_check(IWDB db, const char *present, int num) {
+  IWKV_val key, val;
+  IWKV_cursor cur;
+  char kb[16], ckb[16];
+  size_t ksz;
+  int k, cnt = 0;
+  for (k = 0; k < num; ++k) {
+    key.size = snprintf(kb, sizeof(kb), "%08d", k);
+    key.data = kb;
+    iwrc rc = iwkv_get(db, &key, &val);
+    if (!present[k]) {
+      CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_NOTFOUND);
+      continue;
+    }
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_FATAL(val.size >= sizeof(k) && !memcmp(val.data, &k, sizeof(k)));
+    iwkv_val_dispose(&val);
+    ++cnt;
+  }
+  // Records are traversed in descending key order
+  iwrc rc = iwkv_cursor_open(db, &cur, IWKV_CURSOR_BEFORE_FIRST, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  k = num - 1;
+  while (!(rc = iwkv_cursor_to(cur, IWKV_CURSOR_NEXT))) {
+    while (k >= 0 && !present[k]) --k;
+    CU_ASSERT_FATAL(k >= 0);
+    rc = iwkv_cursor_copy_key(cur, (uint8_t *) ckb, sizeof(ckb), &ksz);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    snprintf(kb, sizeof(kb), "%08d", k);
+    CU_ASSERT_FATAL(ksz == strlen(kb) && !memcmp(ckb, kb, ksz));
+    --k;
+    --cnt;
+  }
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  CU_ASSERT_EQUAL(cnt, 0);
+  rc = iwkv_cursor_close(&cur);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static iwrc _test21_put(IWDB db, int k, char *present) {
+  char kb[16];
+  uint8_t vbuf[5000];
+  IWKV_val key, val;
+  key.size = snprintf(kb, sizeof(kb), "%08d", k);
+  key.data = kb;
+  memcpy(vbuf, &k, sizeof(k));
+  memset(vbuf + sizeof(k), k & 0xff, sizeof(vbuf) - sizeof(k));
+  val.data = vbuf;
+  val.size = (k % 50) ? sizeof(k) : sizeof(vbuf); // Large values are stored in blobs
+  present[k] = 1;
+  return iwkv_put(db, &key, &val, 0);
+}
+
+// Removes records `from >= k > to`, negative bound means no bound
+static iwrc _test21_del_range(IWDB db, int from, int to, char *present, int num) {
+  char kbf[16], kbt[16];
+  IWKV_val kfrom, kto;
+  kfrom.size = snprintf(kbf, sizeof(kbf), "%08d", from);
+  kfrom.data = kbf;
+  kto.size = snprintf(kbt, sizeof(kbt), "%08d", to);
+  kto.data = kbt;
+  for (int k = 0; k < num; ++k) {
+    if ((from < 0 || k <= from) && (to < 0 || k > to)) {
+      present[k] = 0;
+    }
+  }
+  return iwkv_del_range(db, from < 0 ? 0 : &kfrom, to < 0 ? 0 : &kto);
+}
+
+static void _test21_run(size_t dbcache_max_sz) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_21.db",
+    .oflags = IWKV_TRUNC,
+    .dbcache_max_sz = dbcache_max_sz,
+    .wal = {
+      .enabled = true
+    }
+  };
+  IWDB_OPTS dbopts = {
+    .bloom_keys = 1000
+  };
+  const int num = 20000;
+  const int ranges[][2] = {
+    {15000, 5000},  // Many nodes
+    {17003, 16990}, // Few records
+    {-1, 18000},    // Head of database
+    {2000, -1},     // Tail of database
+    {4000, 4500},   // Empty range
+    {14000, 6000},  // Range of removed records
+    {16000, 15500}
+  };
+  IWKV iwkv;
+  IWDB db1, db2;
+  char *present1 = calloc(num, 1), *present2 = calloc(num, 1);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(present1);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(present2);
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db_ext(iwkv, 1, 0, &dbopts, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_BLOB_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < num; ++i) {
+    int k = i * 7919 % num;
+    rc = _test21_put(db1, k, present1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = _test21_put(db2, k, present2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  for (int i = 0; i < sizeof(ranges) / sizeof(ranges[0]); ++i) {
+    rc = _test21_del_range(db1, ranges[i][0], ranges[i][1], present1, num);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    _test21_check(db1, present1, num);
+    rc = _test21_del_range(db2, ranges[i][0], ranges[i][1], present2, num);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    _test21_check(db2, present2, num);
+  }
+  // Removed range is filled again
+  for (int k = 5000; k < 15000; k += 3) {
+    rc = _test21_put(db1, k, present1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = _test21_put(db2, k, present2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  _test21_check(db1, present1, num);
+  _test21_check(db2, present2, num);
+  rc = _test21_del_range(db2, 12000, 7000, present2, num);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  opts.oflags = 0;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_BLOB_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test21_check(db1, present1, num);
+  _test21_check(db2, present2, num);
+  // Remove all records
+  rc = _test21_del_range(db1, -1, -1, present1, num);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test21_check(db1, present1, num);
+  for (int k = 0; k < num; k += 10) {
+    rc = _test21_put(db1, k, present1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  _test21_check(db1, present1, num);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  free(present1);
+  free(present2);
+}
+
+static void iwkv_test21(void) {
+  _test21_run(0);
+  _test21_run(64 * 1024 * 1024);
+}
+
+static iwrc _test22_put(IWDB db, int k, uint64_t ttl_ms, char *present) {
+  char kb[16];
+  uint8_t vbuf[5000];
+  IWKV_val key, val;
+  key.size = snprintf(kb, sizeof(kb), "%08d", k);
+  key.data = kb;
+  memcpy(vbuf, &k, sizeof(k));
+  memset(vbuf + sizeof(k), k & 0xff, sizeof(vbuf) - sizeof(k));
+  val.data = vbuf;
+  val.size = (k % 50) ? sizeof(k) : sizeof(vbuf);
+  present[k] = 1;
+  return iwkv_put_ttl(db, &key, &val, ttl_ms, 0);
+}
+
+static bool _test22_expiring(int k) {
+  return (k >= 5000 && k < 15000) || k % 3 == 0 || k >= 19990;
+}
+
+// Checks that expired records are physically removed
+static void _test22_check_reaped(IWDB db, const char *present, int num) {
+  char kb[16];
+  IWKV_val key;
+  for (int k = 0; k < num; k += 7) {
+    if (!present[k]) {
+      key.size = snprintf(kb, sizeof(kb), "%08d", k);
+      key.data = kb;
+      iwrc rc = iwkv_del(db, &key);
+      CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_NOTFOUND);
+    }
+  }
+}
+
+static void iwkv_test22(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_22.db",
+    .oflags = IWKV_TRUNC,
+    .ttl_reap_interval_ms = 3600 * 1000,
+    .wal = {
+      .enabled = true
+    }
+  };
+  IWDB_OPTS dbopts = {
+    .bloom_keys = 1000
+  };
+  const int num = 20000;
+  IWKV iwkv;
+  IWDB db1, db2, db3;
+  IWKV_val key, val;
+  IWKV_cursor cur;
+  char kb[16];
+  char *present1 = calloc(num, 1), *present2 = calloc(num, 1);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(present1);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(present2);
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 3, IWDB_TTL | IWDB_DUP_UINT32_VALS, &db3);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+  rc = iwkv_db(iwkv, 3, 0, &db3);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db_ext(iwkv, 1, IWDB_TTL | IWDB_BLOB_VALS, &dbopts, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_TTL | IWDB_COMPRESS_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  key.size = snprintf(kb, sizeof(kb), "%08d", 1);
+  key.data = kb;
+  val.size = key.size;
+  val.data = kb;
+  rc = iwkv_put_ttl(db3, &key, &val, 1000, 0);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+  rc = iwkv_put_ttl(db3, &key, &val, 0, 0);
+  CU_ASSERT_EQUAL(rc, 0);
+
+  for (int i = 0; i < num; ++i) {
+    int k = i * 7919 % num;
+    uint64_t ttl = _test22_expiring(k) ? 1 : (k % 2 ? 0 : 3600 * 1000);
+    rc = _test22_put(db1, k, ttl, present1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = _test22_put(db2, k, ttl, present2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  usleep(10000);
+  for (int k = 0; k < num; ++k) {
+    if (_test22_expiring(k)) {
+      present1[k] = 0;
+      present2[k] = 0;
+    }
+  }
+  _test21_check(db1, present1, num);
+  _test21_check(db2, present2, num);
+
+  // Cursor lookups and backward moves skip expired records
+  key.size = snprintf(kb, sizeof(kb), "%08d", 6000);
+  rc = iwkv_cursor_open(db1, &cur, IWKV_CURSOR_EQ, &key);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  rc = iwkv_cursor_close(&cur);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_cursor_open(db1, &cur, IWKV_CURSOR_GE, &key);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_cursor_get(cur, &key, &val);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(key.size, 8);
+  CU_ASSERT_NSTRING_EQUAL(key.data, "00004999", 8);
+  iwkv_kv_dispose(&key, &val);
+  rc = iwkv_cursor_to(cur, IWKV_CURSOR_PREV);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_cursor_get(cur, &key, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_NSTRING_EQUAL(key.data, "00015001", 8);
+  iwkv_val_dispose(&key);
+  rc = iwkv_cursor_close(&cur);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Expired record is treated as absent by IWKV_NO_OVERWRITE put
+  key.data = kb;
+  key.size = snprintf(kb, sizeof(kb), "%08d", 3);
+  val.data = kb;
+  val.size = key.size;
+  rc = iwkv_put(db2, &key, &val, IWKV_NO_OVERWRITE);
+  CU_ASSERT_EQUAL(rc, 0);
+  key.size = snprintf(kb, sizeof(kb), "%08d", 4);
+  rc = iwkv_put(db2, &key, &val, IWKV_NO_OVERWRITE);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_KEY_EXISTS);
+  rc = _test22_put(db2, 3, 0, present2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = iwkv_reap(iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test21_check(db1, present1, num);
+  _test21_check(db2, present2, num);
+  _test22_check_reaped(db1, present1, num);
+  _test22_check_reaped(db2, present2, num);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Background reaper
+  opts.oflags = 0;
+  opts.ttl_reap_interval_ms = 20;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db_ext(iwkv, 1, IWDB_TTL | IWDB_BLOB_VALS, &dbopts, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test21_check(db1, present1, num);
+  for (int k = 15000; k < 16000; ++k) {
+    rc = _test22_put(db1, k, 1, present1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    present1[k] = 0;
+  }
+  // Wait until expired records are removed: reaped key is not found by `iwkv_del()`
+  int i;
+  key.data = kb;
+  for (i = 0; i < 500; ++i) {
+    usleep(10000);
+    key.size = snprintf(kb, sizeof(kb), "%08d", 15000 + i);
+    rc = iwkv_del(db1, &key);
+    if (rc == IWKV_ERROR_NOTFOUND) {
+      break;
+    }
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  CU_ASSERT_TRUE(i < 500);
+  _test21_check(db1, present1, num);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  free(present1);
+  free(present2);
+}
+
+static void _test23_check_val(IWDB db, int k, const char *expected) {
+  char kb[16];
+  IWKV_val key, val;
+  key.size = snprintf(kb, sizeof(kb), "%08d", k);
+  key.data = kb;
+  iwrc rc = iwkv_get(db, &key, &val);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  if (expected) {
+    CU_ASSERT_EQUAL(val.size, strlen(expected));
+    CU_ASSERT_NSTRING_EQUAL(val.data, expected, strlen(expected));
+  } else {
+    CU_ASSERT_FATAL(val.size >= sizeof(k) && !memcmp(val.data, &k, sizeof(k)));
+  }
+  iwkv_val_dispose(&val);
+}
+
+static void iwkv_test23(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_23.db",
+    .oflags = IWKV_TRUNC,
+    .wal = {
+      .enabled = true,
+      .checkpoint_buffer_sz = 1024 * 1024,
+      .checkpoint_slice_sz = 64 * 1024
+    }
+  };
+  const int num = 20000;
+  IWKV iwkv, snap1, snap2;
+  IWDB db1, db2, sdb;
+  IWKV_val key, val;
+  char kb[16];
+  char *present1 = calloc(num, 1), *present2 = calloc(num, 1);
+  char *spresent1 = calloc(num, 1), *spresent2 = calloc(num, 1);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(present1);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(present2);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(spresent1);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(spresent2);
+
+  // Snapshots are not supported without WAL
+  opts.wal.enabled = false;
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_snapshot_open(iwkv, &snap1);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+  rc = iwkv_snapshot_open(iwkv, 0);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_ARGS);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  opts.wal.enabled = true;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_BLOB_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int k = 0; k < num; k += 2) {
+    rc = _test21_put(db1, k, present1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = _test21_put(db2, k, present2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = iwkv_snapshot_open(iwkv, &snap1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  memcpy(spresent1, present1, num);
+  memcpy(spresent2, present2, num);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_STATE);
+
+  // Database file is changed and grown by checkpoints, snapshot still sees original data
+  rc = _test21_del_range(db1, 15000, 5000, present1, num);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int k = 1; k < num; k += 2) {
+    rc = _test21_put(db1, k, present1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = _test21_put(db2, k, present2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  key.data = kb;
+  key.size = snprintf(kb, sizeof(kb), "%08d", 10);
+  val.data = "updated";
+  val.size = strlen(val.data);
+  rc = iwkv_put(db2, &key, &val, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_checkpoint(iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = iwkv_snapshot_open(iwkv, &snap2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test21_del_range(db2, -1, 10000, present2, num);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test21_put(db2, 10, present2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_checkpoint(iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  _test21_check(db1, present1, num);
+  _test21_check(db2, present2, num);
+
+  rc = iwkv_db(snap1, 1, 0, &sdb);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test21_check(sdb, spresent1, num);
+  rc = iwkv_put(sdb, &key, &val, 0);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_READONLY);
+  rc = iwkv_db(snap1, 2, IWDB_BLOB_VALS, &sdb);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test21_check(sdb, spresent2, num);
+  _test23_check_val(sdb, 10, 0);
+  rc = iwkv_close(&snap1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Second snapshot sees data written before it was opened
+  rc = iwkv_db(snap2, 2, IWDB_BLOB_VALS, &sdb);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test23_check_val(sdb, 10, "updated");
+  _test23_check_val(sdb, 10001, 0);
+  rc = iwkv_db(snap2, 1, 0, &sdb);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test21_check(sdb, present1, num);
+  rc = iwkv_close(&snap2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  opts.oflags = 0;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_BLOB_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test21_check(db1, present1, num);
+  _test21_check(db2, present2, num);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  free(present1);
+  free(present2);
+  free(spresent1);
+  free(spresent2);
+}
+
+static iwrc _test24_incr(const IWKV_val *key, const IWKV_val *oldval, IWKV_val *newval, void *op) {
+  uint64_t cnt = 0;
+  if (oldval) {
+    if (oldval->size != sizeof(cnt)) {
+      return IW_ERROR_INVALID_STATE;
+    }
+    memcpy(&cnt, oldval->data, sizeof(cnt));
+  }
+  cnt += (uint64_t)(intptr_t) op;
+  newval->data = malloc(sizeof(cnt));
+  if (!newval->data) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  memcpy(newval->data, &cnt, sizeof(cnt));
+  newval->size = sizeof(cnt);
+  return 0;
+}
+
+static iwrc _test24_append(const IWKV_val *key, const IWKV_val *oldval, IWKV_val *newval, void *op) {
+  const char *str = op;
+  size_t len = strlen(str), osz = oldval ? oldval->size : 0;
+  newval->data = malloc(osz + len);
+  if (!newval->data) {
+    return iwrc_set_errno(IW_ERROR_ALLOC, errno);
+  }
+  if (osz) {
+    memcpy(newval->data, oldval->data, osz);
+  }
+  memcpy((char *) newval->data + osz, str, len);
+  newval->size = osz + len;
+  return 0;
+}
+
+static uint64_t _test24_get_cnt(IWDB db, int k) {
+  char kb[16];
+  uint64_t cnt = 0;
+  IWKV_val key, val;
+  key.size = snprintf(kb, sizeof(kb), "%08d", k);
+  key.data = kb;
+  iwrc rc = iwkv_get(db, &key, &val);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL_FATAL(val.size, sizeof(cnt));
+  memcpy(&cnt, val.data, sizeof(cnt));
+  iwkv_val_dispose(&val);
+  return cnt;
+}
+
+#define TEST24_THREADS 4
+#define TEST24_KEYS    3000
+
+static void *_test24_worker(void *op) {
+  IWDB db = op;
+  char kb[16];
+  IWKV_val key = {.data = kb};
+  for (int i = 0; i < TEST24_KEYS; ++i) {
+    key.size = snprintf(kb, sizeof(kb), "%08d", i);
+    iwrc rc = iwkv_merge(db, &key, _test24_incr, (void *)(intptr_t) 1, 0);
+    if (rc) {
+      return (void *)(intptr_t) rc;
+    }
+  }
+  return 0;
+}
+
+static void iwkv_test24(void) {
+  IWKV_OPTS opts = {
+    .path = "iwkv_test1_24.db",
+    .oflags = IWKV_TRUNC,
+    .wal = {
+      .enabled = true
+    }
+  };
+  IWKV iwkv;
+  IWDB db1, db2, db3, db4;
+  IWKV_val key, val, expected;
+  pthread_t th[TEST24_THREADS];
+  char kb[16];
+
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_COMPRESS_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 3, IWDB_BLOB_VALS, &db3);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 4, IWDB_DUP_UINT32_VALS, &db4);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  key.size = snprintf(kb, sizeof(kb), "%08d", 1);
+  key.data = kb;
+  rc = iwkv_put_cas(db4, &key, 0, &key, 0);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+  rc = iwkv_merge(db4, &key, _test24_append, "a", 0);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+
+  // Compare-and-set
+  val.data = "one";
+  val.size = strlen(val.data);
+  expected.data = "two";
+  expected.size = strlen(expected.data);
+  rc = iwkv_put_cas(db1, &key, &expected, &val, 0);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_CAS_MISMATCH);
+  rc = iwkv_put_cas(db1, &key, 0, &val, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test23_check_val(db1, 1, "one");
+  rc = iwkv_put_cas(db1, &key, 0, &val, 0);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_CAS_MISMATCH);
+  val.data = "three";
+  val.size = strlen(val.data);
+  rc = iwkv_put_cas(db1, &key, &expected, &val, 0);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_CAS_MISMATCH);
+  expected.size = 2; // Prefix of current value must not match
+  expected.data = "on";
+  rc = iwkv_put_cas(db1, &key, &expected, &val, 0);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_CAS_MISMATCH);
+  _test23_check_val(db1, 1, "one");
+  expected.data = "one";
+  expected.size = strlen(expected.data);
+  rc = iwkv_put_cas(db1, &key, &expected, &val, IWKV_SYNC);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test23_check_val(db1, 1, "three");
+
+  // Failed merge leaves record unchanged
+  rc = iwkv_merge(db1, &key, _test24_incr, (void *) 1, 0);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_STATE);
+  _test23_check_val(db1, 1, "three");
+  rc = iwkv_merge(db1, &key, 0, 0, 0);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_ARGS);
+
+  // Concurrent counters, new keys are inserted by merge
+  for (int i = 0; i < TEST24_THREADS; ++i) {
+    int rci = pthread_create(&th[i], 0, _test24_worker, db2);
+    CU_ASSERT_EQUAL_FATAL(rci, 0);
+  }
+  for (int i = 0; i < TEST24_THREADS; ++i) {
+    void *ret;
+    pthread_join(th[i], &ret);
+    CU_ASSERT_PTR_NULL(ret);
+  }
+  for (int i = 0; i < TEST24_KEYS; ++i) {
+    CU_ASSERT_EQUAL_FATAL(_test24_get_cnt(db2, i), TEST24_THREADS);
+  }
+
+  // Appending to list stored in blobs
+  const int anum = 3000;
+  const char *chunk = "0123456789";
+  for (int i = 0; i < anum; ++i) {
+    rc = iwkv_merge(db3, &key, _test24_append, (void *) chunk, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = iwkv_get(db3, &key, &val);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL_FATAL(val.size, anum * strlen(chunk));
+  for (int i = 0; i < anum; ++i) {
+    CU_ASSERT_NSTRING_EQUAL_FATAL((char *) val.data + i * strlen(chunk), chunk, strlen(chunk));
+  }
+  expected = val;
+  val.data = "short";
+  val.size = strlen(val.data);
+  rc = iwkv_put_cas(db3, &key, &expected, &val, 0);
+  CU_ASSERT_EQUAL(rc, 0);
+  iwkv_val_dispose(&expected);
+  _test23_check_val(db3, 1, "short");
+
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  opts.oflags &= ~IWKV_TRUNC;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_COMPRESS_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 3, IWDB_BLOB_VALS, &db3);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  _test23_check_val(db1, 1, "three");
+  _test23_check_val(db3, 1, "short");
+  rc = iwkv_merge(db2, &key, _test24_incr, (void *) 10, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(_test24_get_cnt(db2, 1), TEST24_THREADS + 10);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
 int main() {
   CU_pSuite pSuite = NULL;
 
@@ -882,7 +3112,25 @@ int main() {
     (NULL == CU_add_test(pSuite, "iwkv_test3", iwkv_test3)) ||
     (NULL == CU_add_test(pSuite, "iwkv_test4", iwkv_test4)) ||
     (NULL == CU_add_test(pSuite, "iwkv_test5", iwkv_test5)) ||
-    (NULL == CU_add_test(pSuite, "iwkv_test6", iwkv_test6)))  {
+    (NULL == CU_add_test(pSuite, "iwkv_test6", iwkv_test6)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test7", iwkv_test7)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test8", iwkv_test8)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test9", iwkv_test9)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test10", iwkv_test10)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test11", iwkv_test11)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test12", iwkv_test12)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test13", iwkv_test13)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test14", iwkv_test14)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test15", iwkv_test15)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test16", iwkv_test16)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test17", iwkv_test17)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test18", iwkv_test18)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test19", iwkv_test19)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test20", iwkv_test20)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test21", iwkv_test21)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test22", iwkv_test22)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test23", iwkv_test23)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test24", iwkv_test24)))  {
     CU_cleanup_registry();
     return CU_get_error();
   }
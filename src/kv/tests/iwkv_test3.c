@@ -162,6 +162,87 @@ static void iwkv_test1(void) {
   iwkv_test1_impl(4, 30000);
 }
 
+static void *iwkv_test2_worker(void *op) {
+  TASK *t = op;
+  CTX *ctx = t->ctx;
+  char kbuf[64];
+  IWKV_val key, val;
+  // Keys of all workers are interleaved and share the same skiplist nodes
+  for (int i = 0; i < t->cnt; ++i) {
+    int k = i * ctx->thrnum + t->start;
+    snprintf(kbuf, sizeof(kbuf), "%08d", k);
+    key.data = kbuf;
+    key.size = strlen(kbuf);
+    val.data = &k;
+    val.size = sizeof(k);
+    iwrc rc = iwkv_put(ctx->db, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    if (i > 0 && !(i % 3)) {
+      k = (i - 1) * ctx->thrnum + t->start;
+      snprintf(kbuf, sizeof(kbuf), "%08d", k);
+      key.size = strlen(kbuf);
+      rc = iwkv_del(ctx->db, &key);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+    }
+  }
+  return 0;
+}
+
+static void iwkv_test2_impl(int thrnum, int recth) {
+  char kbuf[64];
+  IWKV iwkv;
+  IWKV_val key, val;
+  TASK *tasks = calloc(thrnum, sizeof(*tasks));
+  CTX ctx = {
+    .thrnum = thrnum
+  };
+  IWKV_OPTS opts = {
+    .path = "iwkv_test3_2.db",
+    .oflags = IWKV_TRUNC
+  };
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &ctx.db);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < thrnum; ++i) {
+    tasks[i].ctx = &ctx;
+    tasks[i].start = i;
+    tasks[i].cnt = recth;
+    int rci = pthread_create(&tasks[i].thr, 0, iwkv_test2_worker, &tasks[i]);
+    CU_ASSERT_EQUAL_FATAL(rci, 0);
+  }
+  for (int i = 0; i < thrnum; ++i) {
+    int rci = pthread_join(tasks[i].thr, 0);
+    CU_ASSERT_EQUAL_FATAL(rci, 0);
+  }
+  for (int i = 0; i < recth; ++i) {
+    for (int t = 0; t < thrnum; ++t) {
+      int v, k = i * thrnum + t;
+      bool deleted = (i < recth - 1) && !((i + 1) % 3);
+      snprintf(kbuf, sizeof(kbuf), "%08d", k);
+      key.data = kbuf;
+      key.size = strlen(kbuf);
+      rc = iwkv_get(ctx.db, &key, &val);
+      if (deleted) {
+        CU_ASSERT_EQUAL_FATAL(rc, IWKV_ERROR_NOTFOUND);
+      } else {
+        CU_ASSERT_EQUAL_FATAL(rc, 0);
+        CU_ASSERT_EQUAL_FATAL(val.size, sizeof(v));
+        memcpy(&v, val.data, sizeof(v));
+        CU_ASSERT_EQUAL_FATAL(v, k);
+        iwkv_val_dispose(&val);
+      }
+    }
+  }
+  free(tasks);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static void iwkv_test2(void) {
+  iwkv_test2_impl(8, 20000);
+}
+
 int main() {
   CU_pSuite pSuite = NULL;
 
@@ -177,7 +258,8 @@ int main() {
   }
 
   /* Add the tests to the suite */
-  if ((NULL == CU_add_test(pSuite, "iwkv_test1", iwkv_test1))
+  if ((NULL == CU_add_test(pSuite, "iwkv_test1", iwkv_test1)) ||
+      (NULL == CU_add_test(pSuite, "iwkv_test2", iwkv_test2))
      )  {
     CU_cleanup_registry();
     return CU_get_error();
@@ -4,6 +4,7 @@
 #include "iwcfg.h"
 #include "iwkv_tests.h"
 #include "iwkv_internal.h"
+#include <sys/stat.h>
 
 uint32_t g_seed;
 uint32_t g_rnd_data_pos;
@@ -132,7 +133,8 @@ static void iwkv_test3(void) {
   CU_ASSERT_EQUAL_FATAL(rc, 0);
 }
 
-static void iwkv_test2_impl(char *path, const char *walpath, uint32_t num, uint32_t vrange) {
+static void iwkv_test2_impl2(char *path, const char *walpath, uint32_t num, uint32_t vrange,
+                             const IWKV_WAL_OPTS *wopts) {
   g_rnd_data_pos = 0;
   char kbuf[100];
   iwrc rc;
@@ -155,6 +157,9 @@ static void iwkv_test2_impl(char *path, const char *walpath, uint32_t num, uint3
       .checkpoint_buffer_sz = 32 * 1024 * 1024
     }
   };
+  if (walpath && wopts) {
+    opts.wal = *wopts;
+  }
   rc = iwkv_open(&opts, &iwkv);
   CU_ASSERT_EQUAL_FATAL(rc, 0);
   
@@ -180,6 +185,10 @@ static void iwkv_test2_impl(char *path, const char *walpath, uint32_t num, uint3
   CU_ASSERT_EQUAL_FATAL(rc, 0);
 }
 
+static void iwkv_test2_impl(char *path, const char *walpath, uint32_t num, uint32_t vrange) {
+  iwkv_test2_impl2(path, walpath, num, vrange, 0);
+}
+
 static void iwkv_test2(void) {
   uint32_t num = 1000;
   uint32_t vrange = 100000;
@@ -268,6 +277,558 @@ static void iwkv_test1(void) {
   fclose(iw2);
 }
 
+static void iwkv_test6(void) {
+  uint32_t num = 2000;
+  uint32_t vrange = 10000;
+  // Frequent incremental checkpoints in small slices
+  IWKV_WAL_OPTS wopts = {
+    .enabled = true,
+    .check_crc_on_checkpoint = true,
+    .wal_buffer_sz = 16 * 1024,
+    .checkpoint_buffer_sz = 512 * 1024,
+    .checkpoint_slice_sz = 32 * 1024,
+    .checkpoint_timeout_ms = 20
+  };
+  iwkv_test2_impl("iwkv_test4_6.db", NULL, num, vrange);
+  iwkv_test2_impl2("iwkv_test4_6wal.db", "iwkv_test4_6wal.db-wal", num, vrange, &wopts);
+  FILE *iw1 = fopen("iwkv_test4_6.db", "rb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(iw1);
+  FILE *iw2 = fopen("iwkv_test4_6wal.db", "rb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(iw2);
+  int ret = cmp_files(iw1, iw2);
+  CU_ASSERT_FALSE(ret);
+  fclose(iw1);
+  fclose(iw2);
+}
+
+static bool file_contains(const char *path, const char *data) {
+  bool ret = false;
+  FILE *f = fopen(path, "rb");
+  CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+  fseek(f, 0, SEEK_END);
+  long fsz = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *buf = malloc(fsz);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(buf);
+  if (fread(buf, 1, fsz, f) == fsz) {
+    ret = memmem(buf, fsz, data, strlen(data)) != 0;
+  }
+  free(buf);
+  fclose(f);
+  return ret;
+}
+
+static void iwkv_test4(void) {
+  char *path = "iwkv_test4_4.db";
+  IWKV iwkv;
+  IWDB db1;
+  IWKV_val key = {0};
+  IWKV_val val = {0};
+  IWKV_OPTS opts = {
+    .path = path,
+    .oflags = IWKV_TRUNC,
+    .random_seed = g_seed,
+    .wal = {
+      .enabled = true,
+      .checkpoint_timeout_ms = 300
+    }
+  };
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  key.data = "key00001";
+  key.size = strlen(key.data);
+  val.data = "tvalue00001";
+  val.size = strlen(val.data);
+  rc = iwkv_put(db1, &key, &val, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_FALSE(file_contains(path, "tvalue00001"));
+
+  // Wait for background checkpoint
+  for (int i = 0; i < 50 && !file_contains(path, "tvalue00001"); ++i) {
+    iwp_sleep(100);
+  }
+  CU_ASSERT_TRUE(file_contains(path, "tvalue00001"));
+
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+typedef struct SYNCTASK {
+  IWDB db;
+  int id;
+  int num;
+  pthread_t thr;
+} SYNCTASK;
+
+static void *iwkv_test5_worker(void *op) {
+  SYNCTASK *t = op;
+  char kbuf[64];
+  IWKV_val key, val;
+  for (int i = 0; i < t->num; ++i) {
+    snprintf(kbuf, sizeof(kbuf), "%02d_%06d", t->id, i);
+    key.data = kbuf;
+    key.size = strlen(kbuf);
+    val.data = kbuf;
+    val.size = key.size;
+    iwrc rc = iwkv_put(t->db, &key, &val, IWKV_SYNC);
+    CU_ASSERT_EQUAL(rc, 0);
+    if (rc) {
+      break;
+    }
+  }
+  return 0;
+}
+
+static void iwkv_test5(void) {
+  char *path = "iwkv_test4_5.db";
+  const int nthreads = 8;
+  const int num = 200;
+  char kbuf[64];
+  SYNCTASK tasks[nthreads];
+  IWKV iwkv;
+  IWDB db1;
+  IWKV_val key = {0};
+  IWKV_val val = {0};
+  IWKV_OPTS opts = {
+    .path = path,
+    .oflags = IWKV_TRUNC,
+    .random_seed = g_seed,
+    .wal = {
+      .enabled = true
+    }
+  };
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < nthreads; ++i) {
+    tasks[i].db = db1;
+    tasks[i].id = i;
+    tasks[i].num = num;
+    CU_ASSERT_EQUAL_FATAL(pthread_create(&tasks[i].thr, 0, iwkv_test5_worker, &tasks[i]), 0);
+  }
+  for (int i = 0; i < nthreads; ++i) {
+    pthread_join(tasks[i].thr, 0);
+  }
+  // Simulate crash: all synced records must survive
+  iwkvd_trigger_xor(IWKVD_WAL_NO_CHECKPOINT_ON_CLOSE);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwkvd_trigger_xor(IWKVD_WAL_NO_CHECKPOINT_ON_CLOSE);
+
+  opts.oflags &= ~IWKV_TRUNC;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < nthreads; ++i) {
+    for (int j = 0; j < num; ++j) {
+      snprintf(kbuf, sizeof(kbuf), "%02d_%06d", i, j);
+      key.data = kbuf;
+      key.size = strlen(kbuf);
+      rc = iwkv_get(db1, &key, &val);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_NSTRING_EQUAL(val.data, kbuf, val.size);
+      iwkv_val_dispose(&val);
+    }
+  }
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
+static int _test7_get(IWDB db, const char *k) {
+  int v = -1;
+  IWKV_val key, val;
+  key.data = (void *) k;
+  key.size = strlen(k);
+  iwrc rc = iwkv_get(db, &key, &val);
+  if (!rc) {
+    CU_ASSERT_EQUAL(val.size, sizeof(v));
+    memcpy(&v, val.data, sizeof(v));
+    iwkv_val_dispose(&val);
+  } else {
+    CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  }
+  return v;
+}
+
+static iwrc _test7_put(IWKV_txn txn, IWDB db, const char *k, int v) {
+  IWKV_val key, val;
+  key.data = (void *) k;
+  key.size = strlen(k);
+  val.data = &v;
+  val.size = sizeof(v);
+  return iwkv_txn_put(txn, db, &key, &val, 0);
+}
+
+typedef struct TXNTASK {
+  IWKV iwkv;
+  IWDB db1;
+  IWDB db2;
+  int num;
+  pthread_t thr;
+} TXNTASK;
+
+// Moves units from `db1` to `db2` in transactions: sum of "a" and "b" is constant
+static void *iwkv_test7_worker(void *op) {
+  TXNTASK *t = op;
+  IWKV_txn txn;
+  IWKV_val key = {
+    .data = "m",
+    .size = 1
+  };
+  for (int i = 0; i < t->num; ++i) {
+    int a = _test7_get(t->db1, "a");
+    int b = _test7_get(t->db2, "b");
+    iwrc rc = iwkv_txn_begin(t->iwkv, &txn);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = _test7_put(txn, t->db1, "a", a - 1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = _test7_put(txn, t->db2, "b", b + 1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    // Marker record is moved between databases
+    rc = iwkv_txn_del(txn, (i % 2) ? t->db2 : t->db1, &key);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = _test7_put(txn, (i % 2) ? t->db1 : t->db2, "m", i);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_txn_commit(&txn, (i % 10) ? 0 : IWKV_SYNC);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  return 0;
+}
+
+static void iwkv_test7(void) {
+  char *path = "iwkv_test4_7.db";
+  const int total = 1000;
+  IWKV iwkv, snap;
+  IWDB db1, db2, db3, sdb1, sdb2;
+  IWKV_txn txn;
+  IWKV_val key, val;
+  IWKV_OPTS opts = {
+    .path = path,
+    .oflags = IWKV_TRUNC,
+    .random_seed = g_seed
+  };
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_txn_begin(iwkv, &txn);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_INCOMPATIBLE_DB_MODE);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  opts.wal.enabled = true;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_BLOB_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 3, IWDB_DUP_UINT32_VALS, &db3);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  // Invalid operations are rejected before commit
+  rc = iwkv_txn_begin(iwkv, &txn);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  key.data = "a";
+  key.size = 1;
+  val.data = "ab";
+  val.size = 2;
+  rc = iwkv_txn_put(txn, db1, &key, &val, IWKV_NO_OVERWRITE);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_ARGS);
+  rc = iwkv_txn_put(txn, db3, &key, &val, 0);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_DUP_VALUE_SIZE);
+  rc = _test7_put(txn, db1, "a", total);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_txn_abort(&txn);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_PTR_NULL(txn);
+  CU_ASSERT_EQUAL(_test7_get(db1, "a"), -1);
+
+  // Changes are not visible before commit
+  rc = iwkv_txn_begin(iwkv, &txn);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test7_put(txn, db1, "a", total);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test7_put(txn, db2, "b", 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test7_put(txn, db3, "c", 7);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_txn_del(txn, db1, &key); // Put and remove in the same transaction
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test7_put(txn, db1, "a", total);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  key.data = "missing";
+  key.size = strlen(key.data);
+  rc = iwkv_txn_del(txn, db2, &key);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(_test7_get(db1, "a"), -1);
+  rc = iwkv_txn_commit(&txn, IWKV_SYNC);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_PTR_NULL(txn);
+  CU_ASSERT_EQUAL(_test7_get(db1, "a"), total);
+  CU_ASSERT_EQUAL(_test7_get(db2, "b"), 0);
+  key.data = "c";
+  key.size = 1;
+  rc = iwkv_get(db3, &key, &val);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwkv_val_dispose(&val);
+
+  // Snapshots never observe partially applied transactions
+  TXNTASK task = {
+    .iwkv = iwkv,
+    .db1 = db1,
+    .db2 = db2,
+    .num = 300
+  };
+  CU_ASSERT_EQUAL_FATAL(pthread_create(&task.thr, 0, iwkv_test7_worker, &task), 0);
+  for (int i = 0; i < 20; ++i) {
+    rc = iwkv_snapshot_open(iwkv, &snap);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_db(snap, 1, 0, &sdb1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_db(snap, 2, IWDB_BLOB_VALS, &sdb2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    CU_ASSERT_EQUAL(_test7_get(sdb1, "a") + _test7_get(sdb2, "b"), total);
+    int m1 = _test7_get(sdb1, "m"), m2 = _test7_get(sdb2, "m");
+    CU_ASSERT_TRUE((m1 < 0) != (m2 < 0) || (m1 < 0 && _test7_get(sdb2, "b") == 0));
+    rc = iwkv_close(&snap);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    iwp_sleep(5);
+  }
+  pthread_join(task.thr, 0);
+  CU_ASSERT_EQUAL(_test7_get(db1, "a"), total - task.num);
+  CU_ASSERT_EQUAL(_test7_get(db2, "b"), task.num);
+
+  // Simulate crash: committed transaction survives
+  rc = iwkv_txn_begin(iwkv, &txn);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test7_put(txn, db1, "a", 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test7_put(txn, db2, "b", total);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_txn_commit(&txn, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwkvd_trigger_xor(IWKVD_WAL_NO_CHECKPOINT_ON_CLOSE);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwkvd_trigger_xor(IWKVD_WAL_NO_CHECKPOINT_ON_CLOSE);
+
+  opts.oflags &= ~IWKV_TRUNC;
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_BLOB_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(_test7_get(db1, "a"), 0);
+  CU_ASSERT_EQUAL(_test7_get(db2, "b"), total);
+
+  // Failed commit: none of transaction changes survive close and reopen,
+  // changes made before transaction are kept
+  key.data = "p";
+  key.size = 1;
+  val.data = "p";
+  val.size = 1;
+  rc = iwkv_put(db1, &key, &val, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_txn_begin(iwkv, &txn);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test7_put(txn, db1, "a", total);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test7_put(txn, db2, "b", 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwkvd_trigger_xor(IWKVD_TXN_FAIL_BEFORE_END);
+  rc = iwkv_txn_commit(&txn, 0);
+  iwkvd_trigger_xor(IWKVD_TXN_FAIL_BEFORE_END);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_FAIL);
+  rc = iwkv_put(db1, &key, &val, 0);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_FAIL);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_BLOB_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(_test7_get(db1, "a"), 0);
+  CU_ASSERT_EQUAL(_test7_get(db2, "b"), total);
+  rc = iwkv_get(db1, &key, &val);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_NSTRING_EQUAL(val.data, "p", val.size);
+  iwkv_val_dispose(&val);
+
+  // Failed transaction which extends database file is not visible after reopen
+  const size_t gsz = 1024 * 1024;
+  char *gbuf = malloc(4 * gsz);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(gbuf);
+  char gkey[16];
+  rc = iwkv_txn_begin(iwkv, &txn);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test7_put(txn, db1, "a", total);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  memset(gbuf, 'z', 4 * gsz);
+  key.data = "big";
+  key.size = 3;
+  val.data = gbuf;
+  val.size = 4 * gsz;
+  rc = iwkv_txn_put(txn, db1, &key, &val, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  iwkvd_trigger_xor(IWKVD_TXN_FAIL_BEFORE_END);
+  rc = iwkv_txn_commit(&txn, 0);
+  iwkvd_trigger_xor(IWKVD_TXN_FAIL_BEFORE_END);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_FAIL);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_BLOB_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_get(db1, &key, &val);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  CU_ASSERT_EQUAL(_test7_get(db1, "a"), 0);
+  CU_ASSERT_EQUAL(_test7_get(db2, "b"), total);
+
+  // Committed transaction which extends database file
+  rc = iwkv_txn_begin(iwkv, &txn);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < 8; ++i) {
+    snprintf(gkey, sizeof(gkey), "g%d", i);
+    memset(gbuf, 'a' + i, gsz);
+    key.data = gkey;
+    key.size = strlen(gkey);
+    val.data = gbuf;
+    val.size = gsz;
+    rc = iwkv_txn_put(txn, db1, &key, &val, 0);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = _test7_put(txn, db1, "a", total);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test7_put(txn, db2, "b", 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_txn_commit(&txn, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  free(gbuf);
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int i = 0; i < 8; ++i) {
+      snprintf(gkey, sizeof(gkey), "g%d", i);
+      key.data = gkey;
+      key.size = strlen(gkey);
+      rc = iwkv_get(db1, &key, &val);
+      CU_ASSERT_EQUAL_FATAL(rc, 0);
+      CU_ASSERT_EQUAL(val.size, gsz);
+      CU_ASSERT_TRUE(((char *) val.data)[0] == 'a' + i && ((char *) val.data)[gsz - 1] == 'a' + i);
+      iwkv_val_dispose(&val);
+    }
+    CU_ASSERT_EQUAL(_test7_get(db1, "a"), total);
+    CU_ASSERT_EQUAL(_test7_get(db2, "b"), 0);
+    if (pass) {
+      break;
+    }
+    // Simulate crash
+    iwkvd_trigger_xor(IWKVD_WAL_NO_CHECKPOINT_ON_CLOSE);
+    rc = iwkv_close(&iwkv);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    iwkvd_trigger_xor(IWKVD_WAL_NO_CHECKPOINT_ON_CLOSE);
+    rc = iwkv_open(&opts, &iwkv);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_db(iwkv, 1, 0, &db1);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+    rc = iwkv_db(iwkv, 2, IWDB_BLOB_VALS, &db2);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+
+  // Transaction frees file tail taken by values above, it is trimmed on close
+  struct stat st;
+  CU_ASSERT_EQUAL_FATAL(stat(path, &st), 0);
+  off_t fsz = st.st_size;
+  rc = iwkv_txn_begin(iwkv, &txn);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  for (int i = 0; i < 8; ++i) {
+    snprintf(gkey, sizeof(gkey), "g%d", i);
+    key.data = gkey;
+    key.size = strlen(gkey);
+    rc = iwkv_txn_del(txn, db1, &key);
+    CU_ASSERT_EQUAL_FATAL(rc, 0);
+  }
+  rc = iwkv_txn_commit(&txn, 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL_FATAL(stat(path, &st), 0);
+  CU_ASSERT_TRUE(st.st_size <= fsz);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL_FATAL(stat(path, &st), 0);
+  CU_ASSERT_TRUE(st.st_size < fsz - 4 * (off_t) gsz);
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 2, IWDB_BLOB_VALS, &db2);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  key.data = "g0";
+  key.size = 2;
+  rc = iwkv_get(db1, &key, &val);
+  CU_ASSERT_EQUAL(rc, IWKV_ERROR_NOTFOUND);
+  CU_ASSERT_EQUAL(_test7_get(db1, "a"), total);
+
+  // File shrink in the middle of transaction is applied on commit
+  uint64_t lsn;
+  IWFS_EXT *extf;
+  const off_t gsize = gsz;
+  CU_ASSERT_EQUAL_FATAL(stat(path, &st), 0);
+  fsz = st.st_size;
+  rc = iwkv->fsm.extfile(&iwkv->fsm, &extf);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_exclusive_lock(iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwal_txn_begin(iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = extf->truncate(extf, fsz + 4 * gsize);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = extf->truncate(extf, fsz + gsize);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL_FATAL(stat(path, &st), 0);
+  CU_ASSERT_EQUAL(st.st_size, fsz + 4 * gsize);
+  rc = iwal_txn_end(iwkv, true, false, &lsn);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_exclusive_unlock(iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL_FATAL(stat(path, &st), 0);
+  CU_ASSERT_EQUAL(st.st_size, fsz + gsize);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_open(&opts, &iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db(iwkv, 1, 0, &db1);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  CU_ASSERT_EQUAL(_test7_get(db1, "a"), total);
+
+  // Database destroyed before commit: nothing is applied
+  rc = iwkv_db(iwkv, 4, 0, &db3);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_txn_begin(iwkv, &txn);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test7_put(txn, db1, "a", 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = _test7_put(txn, db3, "c", 0);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_db_destroy(&db3);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+  rc = iwkv_txn_commit(&txn, 0);
+  CU_ASSERT_EQUAL(rc, IW_ERROR_INVALID_STATE);
+  CU_ASSERT_PTR_NULL(txn);
+  CU_ASSERT_EQUAL(_test7_get(db1, "a"), total);
+  rc = iwkv_close(&iwkv);
+  CU_ASSERT_EQUAL_FATAL(rc, 0);
+}
+
 int main() {
   CU_pSuite pSuite = NULL;
   
@@ -286,7 +847,11 @@ int main() {
   if (
     //(NULL == CU_add_test(pSuite, "iwkv_test1", iwkv_test1)) ||
     //(NULL == CU_add_test(pSuite, "iwkv_test2", iwkv_test2)) ||
-    (NULL == CU_add_test(pSuite, "iwkv_test3", iwkv_test3))
+    (NULL == CU_add_test(pSuite, "iwkv_test3", iwkv_test3)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test4", iwkv_test4)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test5", iwkv_test5)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test6", iwkv_test6)) ||
+    (NULL == CU_add_test(pSuite, "iwkv_test7", iwkv_test7))
     
   )  {
     CU_cleanup_registry();
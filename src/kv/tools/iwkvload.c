@@ -0,0 +1,130 @@
+//
+// Bulk load of sorted `key<TAB>value` lines into iwkv database.
+//
+// Input lines must be sorted in reverse lexicographic order of keys
+// without duplicates, eg: `LC_ALL=C sort -r -u -t$'\t' -k1,1 data.tsv`.
+//
+
+#include "iwkv.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct LOADSRC {
+  FILE *in;
+  char *line;
+  size_t linesz;
+  uint64_t lnum;
+} LOADSRC;
+
+static iwrc _next(IWKV_val *key, IWKV_val *val, void *op) {
+  LOADSRC *src = op;
+  ssize_t len;
+  while ((len = getline(&src->line, &src->linesz, src->in)) != -1) {
+    ++src->lnum;
+    while (len > 0 && (src->line[len - 1] == '\n' || src->line[len - 1] == '\r')) {
+      src->line[--len] = '\0';
+    }
+    if (!len) {
+      continue;
+    }
+    char *sep = memchr(src->line, '\t', len);
+    key->data = src->line;
+    if (sep) {
+      key->size = sep - src->line;
+      val->data = sep + 1;
+      val->size = len - key->size - 1;
+    } else {
+      key->size = len;
+      val->data = 0;
+      val->size = 0;
+    }
+    return 0;
+  }
+  if (ferror(src->in)) {
+    return iwrc_set_errno(IW_ERROR_IO_ERRNO, errno);
+  }
+  return IWKV_ERROR_NOTFOUND;
+}
+
+static void _usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [-d dbid] [-w] [-s] [-t] <database file> [input file]\n"
+          "  Loads tab separated `key<TAB>value` lines into empty database.\n"
+          "  Input must be sorted by keys in reverse order without duplicates.\n"
+          "  -d dbid  Database identifier, default: 1\n"
+          "  -w       Enable WAL\n"
+          "  -s       Fsync database file after loading\n"
+          "  -t       Truncate database file before loading\n",
+          prog);
+}
+
+int main(int argc, char *argv[]) {
+  int opt;
+  uint32_t dbid = 1;
+  iwkv_opflags opflags = 0;
+  IWKV_OPTS opts = {0};
+  LOADSRC src = {.in = stdin};
+  IWKV iwkv;
+  IWDB db;
+
+  while ((opt = getopt(argc, argv, "d:wsth")) != -1) {
+    switch (opt) {
+      case 'd':
+        dbid = strtoul(optarg, 0, 10);
+        break;
+      case 'w':
+        opts.wal.enabled = true;
+        break;
+      case 's':
+        opflags |= IWKV_SYNC;
+        break;
+      case 't':
+        opts.oflags |= IWKV_TRUNC;
+        break;
+      default:
+        _usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (optind >= argc || !dbid) {
+    _usage(argv[0]);
+    return 1;
+  }
+  opts.path = argv[optind++];
+  if (optind < argc) {
+    src.in = fopen(argv[optind], "r");
+    if (!src.in) {
+      fprintf(stderr, "Failed to open input file: %s\n", argv[optind]);
+      return 1;
+    }
+  }
+  iwrc rc = iwkv_open(&opts, &iwkv);
+  if (rc) {
+    iwlog_ecode_error2(rc, "Failed to open database");
+    goto finish;
+  }
+  rc = iwkv_db(iwkv, dbid, 0, &db);
+  if (!rc) {
+    rc = iwkv_load(db, _next, &src, opflags);
+    if (rc) {
+      iwlog_ecode_error(rc, "Failed to load data at line: %" PRIu64, src.lnum);
+    }
+  } else {
+    iwlog_ecode_error2(rc, "Failed to open database");
+  }
+  IWRC(iwkv_close(&iwkv), rc);
+  if (!rc) {
+    fprintf(stdout, "Loaded %" PRIu64 " lines\n", src.lnum);
+  }
+
+finish:
+  if (src.in != stdin) {
+    fclose(src.in);
+  }
+  free(src.line);
+  return rc ? 1 : 0;
+}
@@ -0,0 +1,224 @@
+#include "iwdrwl.h"
+#include "iwutils.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define IWDRWL_CACHE_LINE 64
+
+typedef struct _IWDRWL_SLOT {
+  atomic_long cnt;
+  char pad[IWDRWL_CACHE_LINE - sizeof(atomic_long)];
+} IWDRWL_SLOT;
+
+static atomic_uint _iwdrwl_tseq;
+
+static _Thread_local int _iwdrwl_tslot = -1;
+
+// Max number of distinct locks tracked as read locked by a thread
+#define IWDRWL_THELD 8
+
+/** Read lock held by the current thread */
+typedef struct IWDRWL_HELD {
+  IWDRWL *l;
+  int depth;   /**< Recursion depth */
+} IWDRWL_HELD;
+
+static _Thread_local IWDRWL_HELD _iwdrwl_held[IWDRWL_THELD];
+
+// Number of read locks not fit into `_iwdrwl_held`, such thread is assumed to hold any lock
+static _Thread_local int _iwdrwl_held_ovf;
+
+static bool _iwdrwl_holds(IWDRWL *l) {
+  if (_iwdrwl_held_ovf) {
+    return true;
+  }
+  for (int i = 0; i < IWDRWL_THELD; ++i) {
+    if (_iwdrwl_held[i].l == l) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void _iwdrwl_held_inc(IWDRWL *l) {
+  IWDRWL_HELD *e = 0;
+  for (int i = 0; i < IWDRWL_THELD; ++i) {
+    if (_iwdrwl_held[i].l == l) {
+      ++_iwdrwl_held[i].depth;
+      return;
+    }
+    if (!e && !_iwdrwl_held[i].l) {
+      e = &_iwdrwl_held[i];
+    }
+  }
+  if (e) {
+    e->l = l;
+    e->depth = 1;
+  } else {
+    ++_iwdrwl_held_ovf;
+  }
+}
+
+static void _iwdrwl_held_dec(IWDRWL *l) {
+  for (int i = 0; i < IWDRWL_THELD; ++i) {
+    if (_iwdrwl_held[i].l == l) {
+      if (!--_iwdrwl_held[i].depth) {
+        _iwdrwl_held[i].l = 0;
+      }
+      return;
+    }
+  }
+  if (_iwdrwl_held_ovf) {
+    --_iwdrwl_held_ovf;
+  }
+}
+
+// Reader may pass if there is no writer or if it already holds lock while writer waits for readers
+IW_INLINE bool _iwdrwl_rdpass(IWDRWL *l) {
+  int wstate = atomic_load(&l->wstate);
+  return !wstate || (wstate == 1 && _iwdrwl_holds(l));
+}
+
+IW_INLINE IWDRWL_SLOT *_iwdrwl_slot(IWDRWL *l) {
+  if (IW_UNLIKELY(_iwdrwl_tslot < 0)) {
+    _iwdrwl_tslot = atomic_fetch_add(&_iwdrwl_tseq, 1) % IWDRWL_SLOTS;
+  }
+  return &l->slots[_iwdrwl_tslot];
+}
+
+IW_INLINE bool _iwdrwl_drained(IWDRWL *l) {
+  for (int i = 0; i < IWDRWL_SLOTS; ++i) {
+    if (atomic_load(&l->slots[i].cnt)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void _iwdrwl_backoff(int *spins) {
+  if (*spins < 64) {
+    ++*spins;
+  } else if (*spins < 128) {
+    ++*spins;
+    sched_yield();
+  } else {
+    struct timespec ts = {0, 50000};
+    nanosleep(&ts, 0);
+  }
+}
+
+static int _iwdrwl_wstate_set_wl(IWDRWL *l, int wstate) {
+  int rci = pthread_mutex_lock(&l->mtx);
+  if (rci) return rci;
+  atomic_store(&l->wstate, wstate);
+  pthread_cond_broadcast(&l->cond);
+  return pthread_mutex_unlock(&l->mtx);
+}
+
+int iwdrwl_init(IWDRWL *l) {
+  memset(l, 0, sizeof(*l));
+  int rci = posix_memalign((void **) &l->slots, IWDRWL_CACHE_LINE, IWDRWL_SLOTS * sizeof(*l->slots));
+  if (rci) {
+    l->slots = 0;
+    return rci;
+  }
+  for (int i = 0; i < IWDRWL_SLOTS; ++i) {
+    atomic_init(&l->slots[i].cnt, 0);
+  }
+  atomic_init(&l->wstate, 0);
+  atomic_init(&l->wheld, false);
+  rci = pthread_mutex_init(&l->wmtx, 0);
+  if (rci) goto finish;
+  rci = pthread_mutex_init(&l->mtx, 0);
+  if (rci) {
+    pthread_mutex_destroy(&l->wmtx);
+    goto finish;
+  }
+  rci = pthread_cond_init(&l->cond, 0);
+  if (rci) {
+    pthread_mutex_destroy(&l->mtx);
+    pthread_mutex_destroy(&l->wmtx);
+  }
+finish:
+  if (rci) {
+    free(l->slots);
+    l->slots = 0;
+  }
+  return rci;
+}
+
+int iwdrwl_destroy(IWDRWL *l) {
+  if (!l->slots) {
+    return EINVAL;
+  }
+  int rci = pthread_cond_destroy(&l->cond);
+  int rci2 = pthread_mutex_destroy(&l->mtx);
+  if (!rci) rci = rci2;
+  rci2 = pthread_mutex_destroy(&l->wmtx);
+  if (!rci) rci = rci2;
+  free(l->slots);
+  l->slots = 0;
+  return rci;
+}
+
+int iwdrwl_rdlock(IWDRWL *l) {
+  IWDRWL_SLOT *s = _iwdrwl_slot(l);
+  while (1) {
+    atomic_fetch_add(&s->cnt, 1);
+    if (IW_LIKELY(_iwdrwl_rdpass(l))) {
+      _iwdrwl_held_inc(l);
+      return 0;
+    }
+    // Writer is pending or holds the lock, step back
+    atomic_fetch_sub(&s->cnt, 1);
+    int rci = pthread_mutex_lock(&l->mtx);
+    if (rci) return rci;
+    while (!_iwdrwl_rdpass(l)) {
+      pthread_cond_wait(&l->cond, &l->mtx);
+    }
+    pthread_mutex_unlock(&l->mtx);
+  }
+}
+
+int iwdrwl_wrlock(IWDRWL *l) {
+  int spins = 0;
+  int rci = pthread_mutex_lock(&l->wmtx);
+  if (rci) return rci;
+  while (1) {
+    atomic_store(&l->wstate, 1);
+    while (!_iwdrwl_drained(l)) {
+      _iwdrwl_backoff(&spins);
+    }
+    atomic_store(&l->wstate, 2);
+    // Recheck: reader may have entered before it could observe `wstate == 2`
+    if (_iwdrwl_drained(l)) {
+      break;
+    }
+    // Let recursive readers proceed
+    rci = _iwdrwl_wstate_set_wl(l, 1);
+    if (rci) {
+      atomic_store(&l->wstate, 0);
+      pthread_mutex_unlock(&l->wmtx);
+      return rci;
+    }
+  }
+  l->wowner = pthread_self();
+  atomic_store(&l->wheld, true);
+  return 0;
+}
+
+int iwdrwl_unlock(IWDRWL *l) {
+  if (atomic_load(&l->wheld) && pthread_equal(l->wowner, pthread_self())) {
+    atomic_store(&l->wheld, false);
+    int rci = _iwdrwl_wstate_set_wl(l, 0);
+    int rci2 = pthread_mutex_unlock(&l->wmtx);
+    return rci ? rci : rci2;
+  }
+  _iwdrwl_held_dec(l);
+  atomic_fetch_sub(&_iwdrwl_slot(l)->cnt, 1);
+  return 0;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#ifndef IWDRWL_H
+#define IWDRWL_H
+
+/**************************************************************************************************
+ * IOWOW library
+ *
+ * MIT License
+ *
+ * Copyright (c) 2012-2018 Softmotions Ltd <info@softmotions.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *************************************************************************************************/
+
+/** @file
+ *  @brief Distributed read-mostly RW lock.
+ *
+ *  Readers increment a counter in one of `IWDRWL_SLOTS` cache line sized slots
+ *  selected per thread, so concurrent readers running on different cores
+ *  do not contend on a single cache line. Writers are expensive:
+ *  they have to wait until all reader slots are drained.
+ *
+ *  Lock is writer-preferring: new readers wait while writer is pending,
+ *  so writer is not starved by continuous stream of readers.
+ *  Recursive read locking is allowed: threads already holding read lock
+ *  pass pending writer. API mimics `pthread_rwlock_*` functions:
+ *  zero or `errno` code is returned.
+ */
+
+#include "basedefs.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+IW_EXTERN_C_START
+
+#ifndef IWDRWL_SLOTS
+#define IWDRWL_SLOTS 32
+#endif
+
+struct _IWDRWL_SLOT;
+
+typedef struct IWDRWL {
+  struct _IWDRWL_SLOT *slots; /**< Cache line aligned reader slots */
+  atomic_int wstate;          /**< Writer state: 0 - none, 1 - pending, 2 - checking/holding */
+  atomic_bool wheld;          /**< Write lock is held */
+  pthread_t wowner;           /**< Write lock owner thread */
+  pthread_mutex_t wmtx;       /**< Writers mutex */
+  pthread_mutex_t mtx;        /**< Readers wait mutex */
+  pthread_cond_t cond;        /**< Readers wait condition */
+} IWDRWL;
+
+/**
+ * @brief Initialize lock instance.
+ * @return `0` on success or `errno` code.
+ */
+IW_EXPORT int iwdrwl_init(IWDRWL *l);
+
+/**
+ * @brief Destroy lock instance and release its resources.
+ */
+IW_EXPORT int iwdrwl_destroy(IWDRWL *l);
+
+/**
+ * @brief Acquire lock for reading.
+ */
+IW_EXPORT int iwdrwl_rdlock(IWDRWL *l);
+
+/**
+ * @brief Acquire lock for writing.
+ */
+IW_EXPORT int iwdrwl_wrlock(IWDRWL *l);
+
+/**
+ * @brief Release read or write lock held by the current thread.
+ */
+IW_EXPORT int iwdrwl_unlock(IWDRWL *l);
+
+IW_EXTERN_C_END
+
+#endif
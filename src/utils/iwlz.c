@@ -0,0 +1,157 @@
+#include "iwlz.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define IWLZ_HASH_LOG     12
+#define IWLZ_MINMATCH     4
+#define IWLZ_LASTLITERALS 5    /**< Last bytes of input are always literals */
+#define IWLZ_MFLIMIT      12   /**< Last match must start before this number of bytes till the end */
+#define IWLZ_MAX_OFFSET   65535
+
+IW_INLINE uint32_t _iwlz_read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+IW_INLINE uint32_t _iwlz_hash(uint32_t v) {
+  return (v * 2654435761U) >> (32 - IWLZ_HASH_LOG);
+}
+
+IW_INLINE uint8_t *_iwlz_put_len(uint8_t *op, size_t len) {
+  for (; len >= 255; len -= 255) {
+    *op++ = 255;
+  }
+  *op++ = (uint8_t) len;
+  return op;
+}
+
+size_t iwlz_compress(const void *src, size_t slen, void *dst, size_t dcap) {
+  uint32_t htab[1 << IWLZ_HASH_LOG];
+  const uint8_t *base = src, *ip = base, *anchor = base, *iend = base + slen;
+  uint8_t *op = dst, *oend = op + dcap;
+  size_t llen;
+
+  if (slen > IWLZ_MFLIMIT) {
+    const uint8_t *mflimit = iend - IWLZ_MFLIMIT;
+    const uint8_t *matchlimit = iend - IWLZ_LASTLITERALS;
+    memset(htab, 0, sizeof(htab));
+    ++ip;
+    while (ip < mflimit) {
+      uint32_t seq = _iwlz_read32(ip);
+      uint32_t h = _iwlz_hash(seq);
+      const uint8_t *ref = base + htab[h];
+      htab[h] = ip - base;
+      if (ref >= ip || ip - ref > IWLZ_MAX_OFFSET || _iwlz_read32(ref) != seq) {
+        ip += 1 + ((ip - anchor) >> 6); // skip faster over incompressible data
+        continue;
+      }
+      while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+        --ip;
+        --ref;
+      }
+      size_t mlen = IWLZ_MINMATCH;
+      while (ip + mlen < matchlimit && ip[mlen] == ref[mlen]) {
+        ++mlen;
+      }
+      llen = ip - anchor;
+      // token + literals + offset + lengths
+      if (1 + llen + llen / 255 + 1 + 2 + (mlen - IWLZ_MINMATCH) / 255 + 1 > (size_t)(oend - op)) {
+        return 0;
+      }
+      uint8_t *token = op++;
+      *token = (llen < 15 ? llen : 15) << 4;
+      if (llen >= 15) {
+        op = _iwlz_put_len(op, llen - 15);
+      }
+      memcpy(op, anchor, llen);
+      op += llen;
+      uint16_t off = ip - ref;
+      *op++ = off & 0xff;
+      *op++ = off >> 8;
+      size_t ml = mlen - IWLZ_MINMATCH;
+      *token |= (ml < 15 ? ml : 15);
+      if (ml >= 15) {
+        op = _iwlz_put_len(op, ml - 15);
+      }
+      ip += mlen;
+      anchor = ip;
+      if (ip < mflimit) {
+        htab[_iwlz_hash(_iwlz_read32(ip - 2))] = ip - 2 - base;
+      }
+    }
+  }
+  llen = iend - anchor;
+  if (1 + llen + llen / 255 + 1 > (size_t)(oend - op)) {
+    return 0;
+  }
+  *op = (llen < 15 ? llen : 15) << 4;
+  ++op;
+  if (llen >= 15) {
+    op = _iwlz_put_len(op, llen - 15);
+  }
+  memcpy(op, anchor, llen);
+  op += llen;
+  return op - (uint8_t *) dst;
+}
+
+size_t iwlz_decompress(const void *src, size_t slen, void *dst, size_t dcap) {
+  const uint8_t *ip = src, *iend = ip + slen;
+  uint8_t *op = dst, *oend = op + dcap;
+  uint8_t b;
+  while (ip < iend) {
+    unsigned token = *ip++;
+    size_t llen = token >> 4;
+    if (llen == 15) {
+      do {
+        if (ip >= iend) {
+          return 0;
+        }
+        b = *ip++;
+        llen += b;
+      } while (b == 255);
+    }
+    if (llen > (size_t)(iend - ip) || llen > (size_t)(oend - op)) {
+      return 0;
+    }
+    memcpy(op, ip, llen);
+    op += llen;
+    ip += llen;
+    if (ip == iend) { // last sequence
+      break;
+    }
+    if (iend - ip < 2) {
+      return 0;
+    }
+    size_t off = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (!off || off > (size_t)(op - (uint8_t *) dst)) {
+      return 0;
+    }
+    size_t mlen = token & 15;
+    if (mlen == 15) {
+      do {
+        if (ip >= iend) {
+          return 0;
+        }
+        b = *ip++;
+        mlen += b;
+      } while (b == 255);
+    }
+    mlen += IWLZ_MINMATCH;
+    if (mlen > (size_t)(oend - op)) {
+      return 0;
+    }
+    const uint8_t *ref = op - off;
+    if (off >= mlen) {
+      memcpy(op, ref, mlen);
+      op += mlen;
+    } else { // overlapped match
+      while (mlen--) {
+        *op++ = *ref++;
+      }
+    }
+  }
+  return op - (uint8_t *) dst;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef IWLZ_H
+#define IWLZ_H
+
+/**************************************************************************************************
+ * IOWOW library
+ *
+ * MIT License
+ *
+ * Copyright (c) 2012-2018 Softmotions Ltd <info@softmotions.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *************************************************************************************************/
+
+/** @file
+ *  @brief Fast LZ77 block compressor.
+ *
+ *  Compressed block is a sequence of `[token:u1,literals length:vn255,literals,
+ *  match offset:u2le,match length:vn255]` items in the LZ4 block format:
+ *  high four bits of token keep literals length, low four bits keep
+ *  match length minus `4`, value `15` is continued by bytes summed until byte less than `255`.
+ *  The last sequence contains literals only. Matches are searched
+ *  in the 64K window using single probe hash table, no additional memory is allocated.
+ */
+
+#include "basedefs.h"
+#include <stddef.h>
+
+IW_EXTERN_C_START
+
+/**
+ * @brief Max size of compressed data of `len` bytes.
+ */
+#define IWLZ_COMPRESS_BOUND(len_) ((len_) + (len_) / 255 + 16)
+
+/**
+ * @brief Compress `slen` bytes of `src` into `dst` buffer of `dcap` bytes.
+ * @return Size of compressed data or zero if it does not fit into `dst`.
+ */
+IW_EXPORT size_t iwlz_compress(const void *src, size_t slen, void *dst, size_t dcap);
+
+/**
+ * @brief Decompress block of `slen` bytes into `dst` buffer of `dcap` bytes.
+ * @return Size of decompressed data or zero if block is malformed or does not fit into `dst`.
+ */
+IW_EXPORT size_t iwlz_decompress(const void *src, size_t slen, void *dst, size_t dcap);
+
+IW_EXTERN_C_END
+
+#endif
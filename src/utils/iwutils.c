@@ -31,6 +31,14 @@
 #include <limits.h>
 #include <stdint.h>
 #include "mt19937ar.h"
+#include "iwp.h"
+#include <string.h>
+#include <stdatomic.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IWU_X86_SIMD
+#include <immintrin.h>
+#endif
 
 #define IWU_RAND_MAX 0xffffffff
 
@@ -164,3 +172,98 @@ uint32_t iwu_crc32(const uint8_t *buf, int len, uint32_t init) {
   }
   return crc;
 }
+
+IW_INLINE int _iwu_memcmp_tail(const uint8_t *p1, const uint8_t *p2, size_t i, size_t len) {
+  for (; i < len; ++i) {
+    if (p1[i] != p2[i]) {
+      return (int) p1[i] - (int) p2[i];
+    }
+  }
+  return 0;
+}
+
+static int _iwu_memcmp_std(const void *v1, const void *v2, size_t len) {
+  return memcmp(v1, v2, len);
+}
+
+#ifdef IWU_X86_SIMD
+
+__attribute__((target("sse4.2")))
+static int _iwu_memcmp_sse42(const void *v1, const void *v2, size_t len) {
+  size_t i = 0;
+  const uint8_t *p1 = v1, *p2 = v2;
+  for (; i + 16 <= len; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(p1 + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(p2 + i));
+    // Index of the first differing byte or 16
+    int j = _mm_cmpestri(a, 16, b, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH | _SIDD_NEGATIVE_POLARITY);
+    if (j < 16) {
+      return (int) p1[i + j] - (int) p2[i + j];
+    }
+  }
+  return _iwu_memcmp_tail(p1, p2, i, len);
+}
+
+__attribute__((target("avx2")))
+static int _iwu_memcmp_avx2(const void *v1, const void *v2, size_t len) {
+  size_t i = 0;
+  const uint8_t *p1 = v1, *p2 = v2;
+  for (; i + 32 <= len; i += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(p1 + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(p2 + i));
+    uint32_t m = ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+    if (m) {
+      int j = __builtin_ctz(m);
+      return (int) p1[i + j] - (int) p2[i + j];
+    }
+  }
+  if (i + 16 <= len) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(p1 + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(p2 + i));
+    uint32_t m = ~(uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) & 0xffff;
+    if (m) {
+      int j = __builtin_ctz(m);
+      return (int) p1[i + j] - (int) p2[i + j];
+    }
+    i += 16;
+  }
+  return _iwu_memcmp_tail(p1, p2, i, len);
+}
+
+#endif
+
+typedef int (*IWU_MEMCMP_FN)(const void *, const void *, size_t);
+
+// Plain `memcmp()` is used until `iwu_init()` selects implementation for detected CPU
+static _Atomic IWU_MEMCMP_FN _iwu_memcmp_impl = _iwu_memcmp_std;
+
+static IWU_MEMCMP_FN _iwu_memcmp_pick(unsigned int cpuflags) {
+#ifdef IWU_X86_SIMD
+  if (cpuflags & IWCPU_AVX2) {
+    return _iwu_memcmp_avx2;
+  } else if (cpuflags & IWCPU_SSE4_2) {
+    return _iwu_memcmp_sse42;
+  }
+#endif
+  return _iwu_memcmp_std;
+}
+
+int iwu_memcmp(const void *v1, const void *v2, size_t len) {
+  if (len < 16) {
+    // Short keys: SIMD setup does not pay off
+    return _iwu_memcmp_tail(v1, v2, 0, len);
+  }
+  return atomic_load_explicit(&_iwu_memcmp_impl, memory_order_relaxed)(v1, v2, len);
+}
+
+iwrc iwu_init(void) {
+  atomic_store(&_iwu_memcmp_impl, _iwu_memcmp_pick(iwcpuflags));
+  return 0;
+}
+
+#ifdef IW_TESTS
+// Switches `iwu_memcmp()` to implementation selected by `cpuflags` supported by CPU
+void iwu_memcmp_select(unsigned int cpuflags) {
+  atomic_store(&_iwu_memcmp_impl, _iwu_memcmp_pick(cpuflags & iwcpuflags));
+}
+#endif
@@ -335,6 +335,19 @@ IW_EXPORT int iwlog2_64(uint64_t val);
 
 IW_EXPORT uint32_t iwu_crc32(const uint8_t *buf, int len, uint32_t init);
 
+/**
+ * @brief Compare `len` bytes of `v1` and `v2` buffers like `memcmp()`.
+ *
+ * Buffers shorter than 16 bytes are compared by a scalar loop. Longer ones are
+ * compared by SSE4.2 or AVX2 implementation selected by `iw_init()` according to
+ * `iwcpuflags` detected by `iwp_init()`, plain `memcmp()` is used before that.
+ * Embedded zero bytes are compared as any others.
+ *
+ * @return Negative, zero or positive value if `v1` is less than,
+ *         equal to or greater than `v2`.
+ */
+IW_EXPORT int iwu_memcmp(const void *v1, const void *v2, size_t len);
+
 IW_EXTERN_C_END
 
 #endif
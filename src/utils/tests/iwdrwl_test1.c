@@ -0,0 +1,177 @@
+#include "iowow.h"
+#include "iwcfg.h"
+#include <CUnit/Basic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "iwdrwl.h"
+#include "iwp.h"
+
+#define NTHREADS 8
+#define NITER    20000
+
+static IWDRWL lk;
+static volatile int64_t va, vb;
+static atomic_int failures;
+
+int init_suite(void) {
+  return iw_init();
+}
+
+int clean_suite(void) {
+  return 0;
+}
+
+static void *_rw_fn(void *op) {
+  int64_t n = (int64_t) op;
+  for (int i = 0; i < NITER; ++i) {
+    if (i % 100 == (int) n) {
+      iwdrwl_wrlock(&lk);
+      ++va;
+      ++vb;
+      iwdrwl_unlock(&lk);
+    } else {
+      iwdrwl_rdlock(&lk);
+      if (va != vb) {
+        ++failures;
+      }
+      if (i % 2) {
+        // Recursive read lock
+        iwdrwl_rdlock(&lk);
+        if (va != vb) {
+          ++failures;
+        }
+        iwdrwl_unlock(&lk);
+      }
+      iwdrwl_unlock(&lk);
+    }
+  }
+  return 0;
+}
+
+void test_iwdrwl1(void) {
+  pthread_t th[NTHREADS];
+  int rci = iwdrwl_init(&lk);
+  CU_ASSERT_EQUAL_FATAL(rci, 0);
+  for (int64_t i = 0; i < NTHREADS; ++i) {
+    rci = pthread_create(&th[i], 0, _rw_fn, (void *) i);
+    CU_ASSERT_EQUAL_FATAL(rci, 0);
+  }
+  for (int i = 0; i < NTHREADS; ++i) {
+    pthread_join(th[i], 0);
+  }
+  CU_ASSERT_EQUAL(atomic_load(&failures), 0);
+  CU_ASSERT_EQUAL(va, NTHREADS * (NITER / 100));
+  CU_ASSERT_EQUAL(va, vb);
+  rci = iwdrwl_destroy(&lk);
+  CU_ASSERT_EQUAL(rci, 0);
+}
+
+static void *_writer_fn(void *op) {
+  iwdrwl_wrlock(&lk);
+  ++va;
+  iwdrwl_unlock(&lk);
+  return 0;
+}
+
+// Recursive read lock must not deadlock with pending writer
+void test_iwdrwl2(void) {
+  pthread_t th;
+  int rci = iwdrwl_init(&lk);
+  CU_ASSERT_EQUAL_FATAL(rci, 0);
+  va = 0;
+  rci = iwdrwl_rdlock(&lk);
+  CU_ASSERT_EQUAL_FATAL(rci, 0);
+  rci = pthread_create(&th, 0, _writer_fn, 0);
+  CU_ASSERT_EQUAL_FATAL(rci, 0);
+  usleep(10000);
+  CU_ASSERT_EQUAL(va, 0);
+  rci = iwdrwl_rdlock(&lk);
+  CU_ASSERT_EQUAL_FATAL(rci, 0);
+  CU_ASSERT_EQUAL(va, 0);
+  iwdrwl_unlock(&lk);
+  iwdrwl_unlock(&lk);
+  pthread_join(th, 0);
+  CU_ASSERT_EQUAL(va, 1);
+  rci = iwdrwl_destroy(&lk);
+  CU_ASSERT_EQUAL(rci, 0);
+}
+
+static atomic_bool rstop;
+
+static void *_reader_fn(void *op) {
+  while (!atomic_load(&rstop)) {
+    iwdrwl_rdlock(&lk);
+    if (va != vb) {
+      ++failures;
+    }
+    iwdrwl_unlock(&lk);
+  }
+  return 0;
+}
+
+// Writer is not starved by continuous stream of readers
+void test_iwdrwl3(void) {
+  pthread_t th[NTHREADS];
+  uint64_t ts, ts2, maxt = 0;
+  int rci = iwdrwl_init(&lk);
+  CU_ASSERT_EQUAL_FATAL(rci, 0);
+  va = vb = 0;
+  atomic_store(&failures, 0);
+  atomic_store(&rstop, false);
+  for (int i = 0; i < NTHREADS; ++i) {
+    rci = pthread_create(&th[i], 0, _reader_fn, 0);
+    CU_ASSERT_EQUAL_FATAL(rci, 0);
+  }
+  for (int i = 0; i < 100; ++i) {
+    usleep(1000);
+    iwp_current_time_ms(&ts);
+    iwdrwl_wrlock(&lk);
+    ++va;
+    ++vb;
+    iwdrwl_unlock(&lk);
+    iwp_current_time_ms(&ts2);
+    if (ts2 - ts > maxt) {
+      maxt = ts2 - ts;
+    }
+  }
+  atomic_store(&rstop, true);
+  for (int i = 0; i < NTHREADS; ++i) {
+    pthread_join(th[i], 0);
+  }
+  CU_ASSERT_EQUAL(atomic_load(&failures), 0);
+  CU_ASSERT_EQUAL(va, 100);
+  CU_ASSERT_TRUE(maxt < 1000);
+  rci = iwdrwl_destroy(&lk);
+  CU_ASSERT_EQUAL(rci, 0);
+}
+
+int main() {
+  CU_pSuite pSuite = NULL;
+
+  /* Initialize the CUnit test registry */
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  /* Add a suite to the registry */
+  pSuite = CU_add_suite("iwdrwl_test1", init_suite, clean_suite);
+
+  if (NULL == pSuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  /* Add the tests to the suite */
+  if ((NULL == CU_add_test(pSuite, "test_iwdrwl1", test_iwdrwl1)) ||
+      (NULL == CU_add_test(pSuite, "test_iwdrwl2", test_iwdrwl2)) ||
+      (NULL == CU_add_test(pSuite, "test_iwdrwl3", test_iwdrwl3))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  /* Run all tests using the CUnit Basic interface */
+  CU_basic_set_mode(CU_BRM_VERBOSE);
+  CU_basic_run_tests();
+  int ret = CU_get_error() || CU_get_number_of_failures();
+  CU_cleanup_registry();
+  return ret;
+}
@@ -0,0 +1,119 @@
+#include "iowow.h"
+#include "iwcfg.h"
+#include "iwlz.h"
+#include "iwutils.h"
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <string.h>
+
+int init_suite(void) {
+  return iw_init();
+}
+
+int clean_suite(void) {
+  return 0;
+}
+
+static void _roundtrip(const uint8_t *src, size_t len, size_t *ocsz) {
+  uint8_t *cbuf = malloc(IWLZ_COMPRESS_BOUND(len));
+  uint8_t *dbuf = malloc(len + 1);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(cbuf);
+  CU_ASSERT_PTR_NOT_NULL_FATAL(dbuf);
+  size_t csz = iwlz_compress(src, len, cbuf, IWLZ_COMPRESS_BOUND(len));
+  CU_ASSERT_TRUE_FATAL(csz > 0);
+  size_t dsz = iwlz_decompress(cbuf, csz, dbuf, len);
+  CU_ASSERT_EQUAL_FATAL(dsz, len);
+  CU_ASSERT_FATAL(!memcmp(src, dbuf, len));
+  if (len) {
+    // Output buffer too small
+    CU_ASSERT_EQUAL(iwlz_decompress(cbuf, csz, dbuf, len - 1), 0);
+    // Truncated block
+    CU_ASSERT_TRUE(iwlz_decompress(cbuf, csz - 1, dbuf, len) != len);
+  }
+  *ocsz = csz;
+  free(cbuf);
+  free(dbuf);
+}
+
+void test_iwlz1(void) {
+  size_t csz;
+  uint8_t buf[8192];
+  // Small and incompressible inputs
+  for (size_t len = 0; len < 64; ++len) {
+    for (size_t i = 0; i < len; ++i) {
+      buf[i] = iwu_rand_range(256);
+    }
+    _roundtrip(buf, len, &csz);
+  }
+  for (size_t i = 0; i < sizeof(buf); ++i) {
+    buf[i] = iwu_rand_range(256);
+  }
+  _roundtrip(buf, sizeof(buf), &csz);
+  CU_ASSERT_TRUE(csz <= IWLZ_COMPRESS_BOUND(sizeof(buf)));
+  // Compressed data does not fit
+  CU_ASSERT_EQUAL(iwlz_compress(buf, sizeof(buf), buf + 1, 100), 0);
+
+  // Runs of the same byte: overlapped matches
+  memset(buf, 'a', sizeof(buf));
+  _roundtrip(buf, sizeof(buf), &csz);
+  CU_ASSERT_TRUE(csz < 64);
+
+  // JSON-like records
+  size_t len = 0;
+  for (int i = 0; len < sizeof(buf) - 128; ++i) {
+    len += snprintf((char *) buf + len, sizeof(buf) - len,
+                    "{\"id\":%d,\"name\":\"user%d\",\"active\":%s,\"tags\":[\"a\",\"b\"]},",
+                    i, i % 17, (i % 2) ? "true" : "false");
+  }
+  _roundtrip(buf, len, &csz);
+  CU_ASSERT_TRUE(csz < len / 3);
+}
+
+void test_iwlz2(void) {
+  uint8_t src[1024], cbuf[IWLZ_COMPRESS_BOUND(1024)], dbuf[1024];
+  for (size_t i = 0; i < sizeof(src); ++i) {
+    src[i] = "abcd"[i % 4] + (i / 256);
+  }
+  size_t csz = iwlz_compress(src, sizeof(src), cbuf, sizeof(cbuf));
+  CU_ASSERT_TRUE_FATAL(csz > 0);
+  // Corrupted blocks must not be decoded out of buffer bounds
+  for (size_t i = 0; i < csz; ++i) {
+    uint8_t sv = cbuf[i];
+    cbuf[i] ^= 0xff;
+    size_t dsz = iwlz_decompress(cbuf, csz, dbuf, sizeof(dbuf));
+    CU_ASSERT_TRUE(dsz <= sizeof(dbuf));
+    cbuf[i] = sv;
+  }
+  CU_ASSERT_EQUAL(iwlz_decompress(cbuf, csz, dbuf, sizeof(dbuf)), sizeof(src));
+  CU_ASSERT_FATAL(!memcmp(src, dbuf, sizeof(src)));
+}
+
+int main() {
+  CU_pSuite pSuite = NULL;
+
+  /* Initialize the CUnit test registry */
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  /* Add a suite to the registry */
+  pSuite = CU_add_suite("iwlz_test1", init_suite, clean_suite);
+
+  if (NULL == pSuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  /* Add the tests to the suite */
+  if ((NULL == CU_add_test(pSuite, "test_iwlz1", test_iwlz1)) ||
+      (NULL == CU_add_test(pSuite, "test_iwlz2", test_iwlz2))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  /* Run all tests using the CUnit Basic interface */
+  CU_basic_set_mode(CU_BRM_VERBOSE);
+  CU_basic_run_tests();
+  int ret = CU_get_error() || CU_get_number_of_failures();
+  CU_cleanup_registry();
+  return ret;
+}
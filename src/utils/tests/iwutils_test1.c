@@ -0,0 +1,84 @@
+#include "iowow.h"
+#include "iwcfg.h"
+#include "iwutils.h"
+#include "iwp.h"
+#include <CUnit/Basic.h>
+#include <string.h>
+
+int init_suite(void) {
+  return iw_init();
+}
+
+int clean_suite(void) {
+  return 0;
+}
+
+#define SIGN(v_) ((v_) > 0 ? 1 : (v_) < 0 ? -1 : 0)
+
+void iwu_memcmp_select(unsigned int cpuflags);
+
+static void _test_iwu_memcmp_impl(void) {
+  uint8_t b1[300], b2[300];
+  for (int i = 0; i < sizeof(b1); ++i) {
+    b1[i] = iwu_rand_range(256);
+  }
+  for (size_t len = 0; len < sizeof(b1); ++len) {
+    memcpy(b2, b1, sizeof(b1));
+    CU_ASSERT_EQUAL_FATAL(iwu_memcmp(b1, b2, len), 0);
+    // Difference at every position including zero bytes and bytes above 0x7f
+    for (size_t pos = 0; pos < len; ++pos) {
+      memcpy(b2, b1, sizeof(b1));
+      b2[pos] = (pos % 3) ? b1[pos] + 1 + iwu_rand_range(255) : 0;
+      if (b2[pos] == b1[pos]) {
+        b2[pos] ^= 0x80;
+      }
+      CU_ASSERT_EQUAL_FATAL(SIGN(iwu_memcmp(b1, b2, len)), SIGN(memcmp(b1, b2, len)));
+      CU_ASSERT_EQUAL_FATAL(SIGN(iwu_memcmp(b2, b1, len)), SIGN(memcmp(b2, b1, len)));
+    }
+  }
+  // Bytes after zero byte are compared
+  CU_ASSERT_TRUE(iwu_memcmp("a\0b", "a\0c", 3) < 0);
+  CU_ASSERT_TRUE(iwu_memcmp("0123456789abcdef\0b", "0123456789abcdef\0c", 18) < 0);
+}
+
+void test_iwu_memcmp(void) {
+  // Every implementation supported by CPU: AVX2, SSE4.2 and plain `memcmp()`
+  unsigned int cpuflags[] = {IWCPU_AVX2, IWCPU_SSE4_2, 0};
+  for (int i = 0; i < sizeof(cpuflags) / sizeof(cpuflags[0]); ++i) {
+    if (cpuflags[i] && !(iwcpuflags & cpuflags[i])) {
+      continue;
+    }
+    iwu_memcmp_select(cpuflags[i]);
+    _test_iwu_memcmp_impl();
+  }
+  iwu_memcmp_select(iwcpuflags);
+}
+
+int main() {
+  CU_pSuite pSuite = NULL;
+
+  /* Initialize the CUnit test registry */
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  /* Add a suite to the registry */
+  pSuite = CU_add_suite("iwutils_test1", init_suite, clean_suite);
+
+  if (NULL == pSuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  /* Add the tests to the suite */
+  if (NULL == CU_add_test(pSuite, "test_iwu_memcmp", test_iwu_memcmp)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  /* Run all tests using the CUnit Basic interface */
+  CU_basic_set_mode(CU_BRM_VERBOSE);
+  CU_basic_run_tests();
+  int ret = CU_get_error() || CU_get_number_of_failures();
+  CU_cleanup_registry();
+  return ret;
+}